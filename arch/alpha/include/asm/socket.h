@@ -69,6 +69,12 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_MAX_PACING_RATE      41
+
+#define SO_BUSY_POLL            42
+
+#define SO_ZEROCOPY             43
+
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
  */
@@ -64,6 +64,12 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_MAX_PACING_RATE      41
+
+#define SO_BUSY_POLL            42
+
+#define SO_ZEROCOPY             43
+
 #endif /* _ASM_SOCKET_H */
 
 
@@ -61,6 +61,12 @@
 
 #define SO_RXQ_OVFL             0x4021
 
+#define SO_MAX_PACING_RATE      0x4022
+
+#define SO_BUSY_POLL            0x4023
+
+#define SO_ZEROCOPY             0x4024
+
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
  */
@@ -58,6 +58,12 @@
 
 #define SO_RXQ_OVFL             0x0024
 
+#define SO_MAX_PACING_RATE      0x0025
+
+#define SO_BUSY_POLL            0x0026
+
+#define SO_ZEROCOPY             0x0027
+
 /* Security levels - as per NRL IPv6 - don't actually do anything */
 #define SO_SECURITY_AUTHENTICATION		0x5001
 #define SO_SECURITY_ENCRYPTION_TRANSPORT	0x5002
@@ -310,6 +310,29 @@ do {									\
 #define irqsafe_cpu_or_8(pcp, val)	percpu_to_op("or", (pcp), val)
 #define irqsafe_cpu_xor_8(pcp, val)	percpu_to_op("xor", (pcp), val)
 
+/*
+ * cmpxchg16b on a per cpu double word.  The instruction is missing on
+ * the earliest AMD64 processors; those take the generic interrupt
+ * disabling variant instead.
+ */
+#define percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2)		\
+({									\
+	char __ret;							\
+	typeof(o1) __o1 = (o1);						\
+	typeof(o1) __n1 = (n1);						\
+	typeof(o2) __o2 = (o2);						\
+	typeof(o2) __n2 = (n2);						\
+	asm volatile("cmpxchg16b "__percpu_arg(1)"\n\tsetz %0"		\
+		     : "=a" (__ret), "+m" (pcp1), "+m" (pcp2), "+d" (__o2) \
+		     : "b" (__n1), "c" (__n2), "a" (__o1));		\
+	__ret;								\
+})
+
+#define irqsafe_cpu_cmpxchg_double_8(pcp1, pcp2, o1, o2, n1, n2)	\
+	(static_cpu_has(X86_FEATURE_CX16) ?				\
+	 percpu_cmpxchg16b_double(pcp1, pcp2, o1, o2, n1, n2) :		\
+	 _irqsafe_cpu_generic_cmpxchg_double(pcp1, pcp2, o1, o2, n1, n2))
+
 #endif
 
 /* This is not atomic against other CPUs -- CPU preemption needs to be off */
@@ -1049,6 +1049,18 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	write = error_code & PF_WRITE;
+
+	/*
+	 * Most faults just need a new pte: try that without the mmap_sem
+	 * first, so that threads don't all wait for one doing mmap() or
+	 * mprotect().  Anything else is retried below.
+	 */
+	fault = handle_speculative_fault(mm, address,
+					 write ? FAULT_FLAG_WRITE : 0);
+	if (!(fault & VM_FAULT_RETRY))
+		goto done;
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1114,8 +1126,6 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 	 * we can handle it..
 	 */
 good_area:
-	write = error_code & PF_WRITE;
-
 	if (unlikely(access_error(error_code, write, vma))) {
 		bad_area_access_error(regs, error_code, address);
 		return;
@@ -1133,6 +1143,9 @@ good_area:
 		return;
 	}
 
+	up_read(&mm->mmap_sem);
+
+done:
 	if (fault & VM_FAULT_MAJOR) {
 		tsk->maj_flt++;
 		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1, 0,
@@ -1144,6 +1157,4 @@ good_area:
 	}
 
 	check_v8086_mode(regs, address, tsk);
-
-	up_read(&mm->mmap_sem);
 }
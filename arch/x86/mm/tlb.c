@@ -276,6 +276,30 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+/*
+ * The batch may hold translations of several mms, which the mm-keyed
+ * invalidate vector cannot express; reloading cr3 drops all of them.
+ */
+static void do_flush_tlb_batched(void *info)
+{
+	local_flush_tlb();
+}
+
+/*
+ * Flush the user translations on all cpus in @cpumask with a single
+ * IPI round, for the ptes reclaim cleared without flushing.
+ */
+void arch_tlbbatch_flush(const struct cpumask *cpumask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, cpumask))
+		local_flush_tlb();
+	if (cpumask_any_but(cpumask, cpu) < nr_cpu_ids)
+		smp_call_function_many(cpumask, do_flush_tlb_batched, NULL, 1);
+	put_cpu();
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	unsigned long cpu = smp_processor_id();
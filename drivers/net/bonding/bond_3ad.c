@@ -2378,34 +2378,43 @@ int bond_3ad_get_active_agg_info(struct bonding *bond, struct ad_info *ad_info)
 	return -1;
 }
 
+/*
+ * Runs under rcu_read_lock_bh() from dev_queue_xmit(); the slaves and their
+ * aggregators are reached through bond->tx_slaves without taking bond->lock.
+ */
 int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 {
-	struct slave *slave, *start_at;
 	struct bonding *bond = netdev_priv(dev);
+	struct bond_tx_slaves *tx_slaves;
+	struct aggregator *agg, *active_agg = NULL;
+	struct slave *slave;
+	unsigned int i, count;
 	int slave_agg_no;
 	int slaves_in_agg;
 	int agg_id;
-	int i;
-	struct ad_info ad_info;
 	int res = 1;
 
-	/* make sure that the slaves list will
-	 * not change during tx
-	 */
-	read_lock(&bond->lock);
-
-	if (!BOND_IS_OK(bond)) {
+	tx_slaves = rcu_dereference_bh(bond->tx_slaves);
+	if (!BOND_IS_OK(bond) || !tx_slaves) {
 		goto out;
 	}
+	count = tx_slaves->count;
 
-	if (bond_3ad_get_active_agg_info(bond, &ad_info)) {
-		pr_debug("%s: Error: bond_3ad_get_active_agg_info failed\n",
-			 dev->name);
+	for (i = 0; i < count; i++) {
+		agg = SLAVE_AD_INFO(tx_slaves->arr[i]).port.aggregator;
+		if (agg && agg->is_active) {
+			active_agg = agg;
+			break;
+		}
+	}
+
+	if (!active_agg) {
+		pr_debug("%s: Error: no active aggregator\n", dev->name);
 		goto out;
 	}
 
-	slaves_in_agg = ad_info.ports;
-	agg_id = ad_info.aggregator_id;
+	slaves_in_agg = active_agg->num_of_ports;
+	agg_id = active_agg->aggregator_identifier;
 
 	if (slaves_in_agg == 0) {
 		/*the aggregator is empty*/
@@ -2415,8 +2424,8 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 
 	slave_agg_no = bond->xmit_hash_policy(skb, slaves_in_agg);
 
-	bond_for_each_slave(bond, slave, i) {
-		struct aggregator *agg = SLAVE_AD_INFO(slave).port.aggregator;
+	for (i = 0; i < count; i++) {
+		agg = SLAVE_AD_INFO(tx_slaves->arr[i]).port.aggregator;
 
 		if (agg && (agg->aggregator_identifier == agg_id)) {
 			slave_agg_no--;
@@ -2432,20 +2441,17 @@ int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 		goto out;
 	}
 
-	start_at = slave;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		int slave_agg_id = 0;
-		struct aggregator *agg = SLAVE_AD_INFO(slave).port.aggregator;
+	for (count = tx_slaves->count; count; count--) {
+		slave = tx_slaves->arr[i];
+		agg = SLAVE_AD_INFO(slave).port.aggregator;
 
-		if (agg) {
-			slave_agg_id = agg->aggregator_identifier;
-		}
-
-		if (SLAVE_IS_OK(slave) && agg && (slave_agg_id == agg_id)) {
+		if (SLAVE_IS_OK(slave) && agg &&
+		    (agg->aggregator_identifier == agg_id)) {
 			res = bond_dev_queue_xmit(bond, skb, slave->dev);
 			break;
 		}
+		if (++i == tx_slaves->count)
+			i = 0;
 	}
 
 out:
@@ -2453,7 +2459,6 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
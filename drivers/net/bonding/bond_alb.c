@@ -233,45 +233,38 @@ static void tlb_deinitialize(struct bonding *bond)
 	_unlock_tx_hashtbl(bond);
 }
 
-/* Caller must hold bond lock for read */
+/* Caller must hold tx_hashtbl lock and rcu_read_lock_bh() */
 static struct slave *tlb_get_least_loaded_slave(struct bonding *bond)
 {
-	struct slave *slave, *least_loaded;
-	s64 max_gap;
-	int i, found = 0;
-
-	/* Find the first enabled slave */
-	bond_for_each_slave(bond, slave, i) {
-		if (SLAVE_IS_OK(slave)) {
-			found = 1;
-			break;
-		}
-	}
+	struct bond_tx_slaves *tx_slaves = rcu_dereference_bh(bond->tx_slaves);
+	struct slave *slave, *least_loaded = NULL;
+	s64 max_gap = 0;
+	unsigned int i;
 
-	if (!found) {
+	if (!tx_slaves) {
 		return NULL;
 	}
 
-	least_loaded = slave;
-	max_gap = (s64)(slave->speed << 20) - /* Convert to Megabit per sec */
-			(s64)(SLAVE_TLB_INFO(slave).load << 3); /* Bytes to bits */
+	/* Find the enabled slave with the largest gap */
+	for (i = 0; i < tx_slaves->count; i++) {
+		s64 gap;
 
-	/* Find the slave with the largest gap */
-	bond_for_each_slave_from(bond, slave, i, least_loaded) {
-		if (SLAVE_IS_OK(slave)) {
-			s64 gap = (s64)(slave->speed << 20) -
-					(s64)(SLAVE_TLB_INFO(slave).load << 3);
-			if (max_gap < gap) {
-				least_loaded = slave;
-				max_gap = gap;
-			}
+		slave = tx_slaves->arr[i];
+		if (!SLAVE_IS_OK(slave)) {
+			continue;
+		}
+
+		gap = (s64)(slave->speed << 20) - /* Convert to Megabit per sec */
+		      (s64)(SLAVE_TLB_INFO(slave).load << 3); /* Bytes to bits */
+		if (!least_loaded || max_gap < gap) {
+			least_loaded = slave;
+			max_gap = gap;
 		}
 	}
 
 	return least_loaded;
 }
 
-/* Caller must hold bond lock for read */
 static struct slave *tlb_choose_channel(struct bonding *bond, u32 hash_index, u32 skb_len)
 {
 	struct alb_bond_info *bond_info = &(BOND_ALB_INFO(bond));
@@ -1280,7 +1273,7 @@ int bond_alb_xmit(struct sk_buff *skb, struct net_device *bond_dev)
 	struct bonding *bond = netdev_priv(bond_dev);
 	struct ethhdr *eth_data;
 	struct alb_bond_info *bond_info = &(BOND_ALB_INFO(bond));
-	struct slave *tx_slave = NULL;
+	struct slave *tx_slave = NULL, *curr_active;
 	static const __be32 ip_bcast = htonl(0xffffffff);
 	int hash_size = 0;
 	int do_tx_balance = 1;
@@ -1292,12 +1285,9 @@ int bond_alb_xmit(struct sk_buff *skb, struct net_device *bond_dev)
 	skb_reset_mac_header(skb);
 	eth_data = eth_hdr(skb);
 
-	/* make sure that the curr_active_slave and the slaves list do
-	 * not change during tx
+	/* we run under rcu_read_lock_bh(); only the rlb ARP path below
+	 * still walks the slave list and needs bond->lock
 	 */
-	read_lock(&bond->lock);
-	read_lock(&bond->curr_slave_lock);
-
 	if (!BOND_IS_OK(bond)) {
 		goto out;
 	}
@@ -1368,7 +1358,9 @@ int bond_alb_xmit(struct sk_buff *skb, struct net_device *bond_dev)
 	case ETH_P_ARP:
 		do_tx_balance = 0;
 		if (bond_info->rlb_enabled) {
+			read_lock(&bond->lock);
 			tx_slave = rlb_arp_xmit(skb, bond);
+			read_unlock(&bond->lock);
 		}
 		break;
 	default:
@@ -1381,14 +1373,15 @@ int bond_alb_xmit(struct sk_buff *skb, struct net_device *bond_dev)
 		tx_slave = tlb_choose_channel(bond, hash_index, skb->len);
 	}
 
+	curr_active = rcu_dereference_bh(bond->curr_active_slave);
 	if (!tx_slave) {
 		/* unbalanced or unassigned, send through primary */
-		tx_slave = bond->curr_active_slave;
+		tx_slave = curr_active;
 		bond_info->unbalanced_load += skb->len;
 	}
 
 	if (tx_slave && SLAVE_IS_OK(tx_slave)) {
-		if (tx_slave != bond->curr_active_slave) {
+		if (tx_slave != curr_active) {
 			memcpy(eth_data->h_source,
 			       tx_slave->dev->dev_addr,
 			       ETH_ALEN);
@@ -1406,8 +1399,6 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->curr_slave_lock);
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
@@ -1640,7 +1631,7 @@ void bond_alb_handle_active_change(struct bonding *bond, struct slave *new_slave
 	}
 
 	swap_slave = bond->curr_active_slave;
-	bond->curr_active_slave = new_slave;
+	rcu_assign_pointer(bond->curr_active_slave, new_slave);
 
 	if (!new_slave || (bond->slave_cnt == 0)) {
 		return;
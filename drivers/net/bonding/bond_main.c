@@ -106,6 +106,7 @@ static int arp_interval = BOND_LINK_ARP_INTERV;
 static char *arp_ip_target[BOND_MAX_ARP_TARGETS];
 static char *arp_validate;
 static char *fail_over_mac;
+static int tx_queues;
 static struct bond_params bonding_defaults;
 
 module_param(max_bonds, int, 0);
@@ -155,6 +156,8 @@ module_param(arp_validate, charp, 0);
 MODULE_PARM_DESC(arp_validate, "validate src/dst of ARP probes: none (default), active, backup or all");
 module_param(fail_over_mac, charp, 0);
 MODULE_PARM_DESC(fail_over_mac, "For active-backup, do not set all slaves to the same MAC.  none (default), active or follow");
+module_param(tx_queues, int, 0);
+MODULE_PARM_DESC(tx_queues, "Number of transmit queues (default: one per possible CPU)");
 
 /*----------------------------- Global variables ----------------------------*/
 
@@ -431,6 +434,11 @@ int bond_dev_queue_xmit(struct bonding *bond, struct sk_buff *skb,
 	}
 
 	skb->priority = 1;
+	/* the bond's queue index means nothing to the slave, and a non-zero
+	 * queue_mapping would be taken for a recorded rx queue by
+	 * skb_tx_hash()
+	 */
+	skb->queue_mapping = 0;
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	if (unlikely(bond->dev->priv_flags & IFF_IN_NETPOLL)) {
 		struct netpoll *np = bond->dev->npinfo->netpoll;
@@ -1145,7 +1153,7 @@ void bond_change_active_slave(struct bonding *bond, struct slave *new_active)
 		if (new_active)
 			bond_set_slave_active_flags(new_active);
 	} else {
-		bond->curr_active_slave = new_active;
+		rcu_assign_pointer(bond->curr_active_slave, new_active);
 	}
 
 	if (bond->params.mode == BOND_MODE_ACTIVEBACKUP) {
@@ -1216,12 +1224,49 @@ void bond_select_active_slave(struct bonding *bond)
 
 /*--------------------------- slave list handling ---------------------------*/
 
+static struct bond_tx_slaves *bond_alloc_tx_slaves(int count)
+{
+	return kmalloc(sizeof(struct bond_tx_slaves) +
+		       count * sizeof(struct slave *), GFP_KERNEL);
+}
+
+static void bond_free_tx_slaves_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct bond_tx_slaves, rcu));
+}
+
+/*
+ * Fill @tx_slaves from the slave list and publish it for the transmit
+ * path.  @tx_slaves must have room for bond->slave_cnt entries; NULL
+ * leaves the bond without transmit slaves.
+ *
+ * bond->lock held for writing by caller.
+ */
+static void bond_install_tx_slaves(struct bonding *bond,
+				   struct bond_tx_slaves *tx_slaves)
+{
+	struct bond_tx_slaves *old = bond->tx_slaves;
+	struct slave *slave;
+	int i;
+
+	if (tx_slaves) {
+		tx_slaves->count = bond->slave_cnt;
+		bond_for_each_slave(bond, slave, i)
+			tx_slaves->arr[i] = slave;
+	}
+
+	rcu_assign_pointer(bond->tx_slaves, tx_slaves);
+	if (old)
+		call_rcu_bh(&old->rcu, bond_free_tx_slaves_rcu);
+}
+
 /*
  * This function attaches the slave to the end of list.
  *
  * bond->lock held for writing by caller.
  */
-static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
+static void bond_attach_slave(struct bonding *bond, struct slave *new_slave,
+			      struct bond_tx_slaves *tx_slaves)
 {
 	if (bond->first_slave == NULL) { /* attaching the first slave */
 		new_slave->next = new_slave;
@@ -1235,6 +1280,7 @@ static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
 	}
 
 	bond->slave_cnt++;
+	bond_install_tx_slaves(bond, tx_slaves);
 }
 
 /*
@@ -1244,10 +1290,13 @@ static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
  * Nothing is freed on return, structures are just unchained.
  * If any slave pointer in bond was pointing to <slave>,
  * it should be changed by the calling function.
+ * The transmit path may still be using <slave> until synchronize_rcu_bh()
+ * returns.
  *
  * bond->lock held for writing by caller.
  */
-static void bond_detach_slave(struct bonding *bond, struct slave *slave)
+static void bond_detach_slave(struct bonding *bond, struct slave *slave,
+			      struct bond_tx_slaves *tx_slaves)
 {
 	if (slave->next)
 		slave->next->prev = slave->prev;
@@ -1266,6 +1315,7 @@ static void bond_detach_slave(struct bonding *bond, struct slave *slave)
 	slave->next = NULL;
 	slave->prev = NULL;
 	bond->slave_cnt--;
+	bond_install_tx_slaves(bond, tx_slaves);
 }
 
 #ifdef CONFIG_NET_POLL_CONTROLLER
@@ -1405,6 +1455,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 	struct bonding *bond = netdev_priv(bond_dev);
 	const struct net_device_ops *slave_ops = slave_dev->netdev_ops;
 	struct slave *new_slave = NULL;
+	struct bond_tx_slaves *new_tx_slaves = NULL;
 	struct netdev_hw_addr *ha;
 	struct sockaddr addr;
 	int link_reporting;
@@ -1528,6 +1579,12 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 		goto err_undo_flags;
 	}
 
+	new_tx_slaves = bond_alloc_tx_slaves(bond->slave_cnt + 1);
+	if (!new_tx_slaves) {
+		res = -ENOMEM;
+		goto err_free;
+	}
+
 	/* save slave's original flags before calling
 	 * netdev_set_master and dev_open
 	 */
@@ -1616,7 +1673,8 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 
 	write_lock_bh(&bond->lock);
 
-	bond_attach_slave(bond, new_slave);
+	bond_attach_slave(bond, new_slave, new_tx_slaves);
+	new_tx_slaves = NULL;
 
 	new_slave->delay = 0;
 	new_slave->link_failure_count = 0;
@@ -1732,7 +1790,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 		 * so we can change it without calling change_active_interface()
 		 */
 		if (!bond->curr_active_slave)
-			bond->curr_active_slave = new_slave;
+			rcu_assign_pointer(bond->curr_active_slave, new_slave);
 
 		break;
 	} /* switch(bond_mode) */
@@ -1794,6 +1852,7 @@ err_restore_mac:
 	}
 
 err_free:
+	kfree(new_tx_slaves);
 	kfree(new_slave);
 
 err_undo_flags:
@@ -1817,6 +1876,7 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
 	struct slave *slave, *oldcurrent;
+	struct bond_tx_slaves *new_tx_slaves;
 	struct sockaddr addr;
 
 	/* slave is not a slave or master is not master of this slave */
@@ -1827,6 +1887,11 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 		return -EINVAL;
 	}
 
+	/* RTNL keeps slave_cnt stable until the detach below */
+	new_tx_slaves = bond_alloc_tx_slaves(bond->slave_cnt - 1);
+	if (!new_tx_slaves)
+		return -ENOMEM;
+
 	netdev_bonding_change(bond_dev, NETDEV_BONDING_DESLAVE);
 	write_lock_bh(&bond->lock);
 
@@ -1836,6 +1901,7 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 		pr_info("%s: %s not enslaved\n",
 			bond_dev->name, slave_dev->name);
 		write_unlock_bh(&bond->lock);
+		kfree(new_tx_slaves);
 		return -EINVAL;
 	}
 
@@ -1866,7 +1932,7 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 	bond->current_arp_slave = NULL;
 
 	/* release the slave from its bond */
-	bond_detach_slave(bond, slave);
+	bond_detach_slave(bond, slave, new_tx_slaves);
 
 	bond_compute_features(bond);
 
@@ -1881,8 +1947,11 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 		 * detached from the list and the curr_active_slave
 		 * has been cleared (if our_slave == old_current),
 		 * but before a new active slave is selected.
+		 * Wait for transmitters first, so that none of them
+		 * hashes a flow back onto the slave after it is cleared.
 		 */
 		write_unlock_bh(&bond->lock);
+		synchronize_rcu_bh();
 		bond_alb_deinit_slave(bond, slave);
 		write_lock_bh(&bond->lock);
 	}
@@ -1984,6 +2053,8 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 				   IFF_SLAVE_INACTIVE | IFF_BONDING |
 				   IFF_SLAVE_NEEDARP);
 
+	/* the transmit path may still hold the slave */
+	synchronize_rcu_bh();
 	kfree(slave);
 
 	return 0;  /* deletion OK */
@@ -2037,7 +2108,7 @@ static int bond_release_all(struct net_device *bond_dev)
 			bond_3ad_unbind_slave(slave);
 
 		slave_dev = slave->dev;
-		bond_detach_slave(bond, slave);
+		bond_detach_slave(bond, slave, NULL);
 
 		/* now that the slave is detached, unlock and perform
 		 * all the undo steps that should not be called from
@@ -2045,6 +2116,9 @@ static int bond_release_all(struct net_device *bond_dev)
 		 */
 		write_unlock_bh(&bond->lock);
 
+		/* and wait until the transmit path is done with it */
+		synchronize_rcu_bh();
+
 		if (bond_is_lb(bond)) {
 			/* must be called only after the slave
 			 * has been detached from the list
@@ -4202,16 +4276,43 @@ unwind:
 	return res;
 }
 
+/*
+ * Transmit on the first usable slave found scanning @tx_slaves from
+ * position @start.  Returns non-zero if the frame was not sent.
+ */
+static int bond_xmit_slave_from(struct bonding *bond, struct sk_buff *skb,
+				struct bond_tx_slaves *tx_slaves,
+				unsigned int start)
+{
+	unsigned int i, idx = start;
+	struct slave *slave;
+
+	for (i = 0; i < tx_slaves->count; i++) {
+		slave = tx_slaves->arr[idx];
+		if (IS_UP(slave->dev) &&
+		    (slave->link == BOND_LINK_UP) &&
+		    (slave->state == BOND_STATE_ACTIVE))
+			return bond_dev_queue_xmit(bond, skb, slave->dev);
+		if (++idx == tx_slaves->count)
+			idx = 0;
+	}
+	return 1;
+}
+
+/*
+ * The xmit routines below run under rcu_read_lock_bh(), taken by
+ * dev_queue_xmit(), and never touch bond->lock or curr_slave_lock.
+ */
 static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
-	int i, slave_no, res = 1;
+	struct bond_tx_slaves *tx_slaves;
+	struct slave *slave;
+	int res = 1;
 	struct iphdr *iph = ip_hdr(skb);
 
-	read_lock(&bond->lock);
-
-	if (!BOND_IS_OK(bond))
+	tx_slaves = rcu_dereference_bh(bond->tx_slaves);
+	if (!BOND_IS_OK(bond) || !tx_slaves || !tx_slaves->count)
 		goto out;
 	/*
 	 * Start with the curr_active_slave that joined the bond as the
@@ -4222,44 +4323,26 @@ static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev
 	 */
 	if ((iph->protocol == IPPROTO_IGMP) &&
 	    (skb->protocol == htons(ETH_P_IP))) {
-
-		read_lock(&bond->curr_slave_lock);
-		slave = bond->curr_active_slave;
-		read_unlock(&bond->curr_slave_lock);
-
-		if (!slave)
+		slave = rcu_dereference_bh(bond->curr_active_slave);
+		if (slave && SLAVE_IS_OK(slave)) {
+			res = bond_dev_queue_xmit(bond, skb, slave->dev);
 			goto out;
-	} else {
-		/*
-		 * Concurrent TX may collide on rr_tx_counter; we accept
-		 * that as being rare enough not to justify using an
-		 * atomic op here.
-		 */
-		slave_no = bond->rr_tx_counter++ % bond->slave_cnt;
-
-		bond_for_each_slave(bond, slave, i) {
-			slave_no--;
-			if (slave_no < 0)
-				break;
 		}
 	}
 
-	start_at = slave;
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		if (IS_UP(slave->dev) &&
-		    (slave->link == BOND_LINK_UP) &&
-		    (slave->state == BOND_STATE_ACTIVE)) {
-			res = bond_dev_queue_xmit(bond, skb, slave->dev);
-			break;
-		}
-	}
+	/*
+	 * Concurrent TX may collide on rr_tx_counter; we accept
+	 * that as being rare enough not to justify using an
+	 * atomic op here.
+	 */
+	res = bond_xmit_slave_from(bond, skb, tx_slaves,
+				   bond->rr_tx_counter++ % tx_slaves->count);
 
 out:
 	if (res) {
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
@@ -4271,26 +4354,23 @@ out:
 static int bond_xmit_activebackup(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
+	struct slave *slave;
 	int res = 1;
 
-	read_lock(&bond->lock);
-	read_lock(&bond->curr_slave_lock);
-
 	if (!BOND_IS_OK(bond))
 		goto out;
 
-	if (!bond->curr_active_slave)
+	slave = rcu_dereference_bh(bond->curr_active_slave);
+	if (!slave)
 		goto out;
 
-	res = bond_dev_queue_xmit(bond, skb, bond->curr_active_slave->dev);
+	res = bond_dev_queue_xmit(bond, skb, slave->dev);
 
 out:
 	if (res)
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 
-	read_unlock(&bond->curr_slave_lock);
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
@@ -4302,41 +4382,21 @@ out:
 static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
-	int slave_no;
-	int i;
+	struct bond_tx_slaves *tx_slaves;
 	int res = 1;
 
-	read_lock(&bond->lock);
-
-	if (!BOND_IS_OK(bond))
+	tx_slaves = rcu_dereference_bh(bond->tx_slaves);
+	if (!BOND_IS_OK(bond) || !tx_slaves || !tx_slaves->count)
 		goto out;
 
-	slave_no = bond->xmit_hash_policy(skb, bond->slave_cnt);
-
-	bond_for_each_slave(bond, slave, i) {
-		slave_no--;
-		if (slave_no < 0)
-			break;
-	}
-
-	start_at = slave;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		if (IS_UP(slave->dev) &&
-		    (slave->link == BOND_LINK_UP) &&
-		    (slave->state == BOND_STATE_ACTIVE)) {
-			res = bond_dev_queue_xmit(bond, skb, slave->dev);
-			break;
-		}
-	}
+	res = bond_xmit_slave_from(bond, skb, tx_slaves,
+				   bond->xmit_hash_policy(skb, tx_slaves->count));
 
 out:
 	if (res) {
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
@@ -4346,24 +4406,18 @@ out:
 static int bond_xmit_broadcast(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
+	struct bond_tx_slaves *tx_slaves;
+	struct slave *slave;
 	struct net_device *tx_dev = NULL;
-	int i;
+	unsigned int i;
 	int res = 1;
 
-	read_lock(&bond->lock);
-
-	if (!BOND_IS_OK(bond))
+	tx_slaves = rcu_dereference_bh(bond->tx_slaves);
+	if (!BOND_IS_OK(bond) || !tx_slaves)
 		goto out;
 
-	read_lock(&bond->curr_slave_lock);
-	start_at = bond->curr_active_slave;
-	read_unlock(&bond->curr_slave_lock);
-
-	if (!start_at)
-		goto out;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
+	for (i = 0; i < tx_slaves->count; i++) {
+		slave = tx_slaves->arr[i];
 		if (IS_UP(slave->dev) &&
 		    (slave->link == BOND_LINK_UP) &&
 		    (slave->state == BOND_STATE_ACTIVE)) {
@@ -4394,7 +4448,6 @@ out:
 		dev_kfree_skb(skb);
 
 	/* frame sent to all suitable interfaces */
-	read_unlock(&bond->lock);
 	return NETDEV_TX_OK;
 }
 
@@ -4416,6 +4469,20 @@ static void bond_set_xmit_hash_policy(struct bonding *bond)
 	}
 }
 
+/*
+ * Give every CPU its own transmit queue, and so its own qdisc lock, so
+ * that CPUs transmitting through the bond do not contend with each other.
+ */
+static u16 bond_select_queue(struct net_device *dev, struct sk_buff *skb)
+{
+	u16 txq = smp_processor_id();
+
+	while (unlikely(txq >= dev->real_num_tx_queues))
+		txq -= dev->real_num_tx_queues;
+
+	return txq;
+}
+
 static netdev_tx_t bond_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	const struct bonding *bond = netdev_priv(dev);
@@ -4503,6 +4570,7 @@ static const struct net_device_ops bond_netdev_ops = {
 	.ndo_open		= bond_open,
 	.ndo_stop		= bond_close,
 	.ndo_start_xmit		= bond_start_xmit,
+	.ndo_select_queue	= bond_select_queue,
 	.ndo_get_stats		= bond_get_stats,
 	.ndo_do_ioctl		= bond_do_ioctl,
 	.ndo_set_multicast_list	= bond_set_multicast_list,
@@ -4762,6 +4830,12 @@ static int bond_check_params(struct bond_params *params)
 		num_unsol_na = 1;
 	}
 
+	if (tx_queues < 0 || tx_queues > BOND_MAX_TX_QUEUES) {
+		pr_warning("Warning: tx_queues (%d) not in range 0-%d so it was reset to 0\n",
+			   tx_queues, BOND_MAX_TX_QUEUES);
+		tx_queues = 0;
+	}
+
 	/* reset values for 802.3ad */
 	if (bond_mode == BOND_MODE_8023AD) {
 		if (!miimon) {
@@ -4932,6 +5006,8 @@ static int bond_check_params(struct bond_params *params)
 	params->miimon = miimon;
 	params->num_grat_arp = num_grat_arp;
 	params->num_unsol_na = num_unsol_na;
+	params->tx_queues = tx_queues ? tx_queues :
+			    min_t(int, num_possible_cpus(), BOND_MAX_TX_QUEUES);
 	params->arp_interval = arp_interval;
 	params->arp_validate = arp_validate_value;
 	params->updelay = updelay;
@@ -5008,11 +5084,21 @@ static int bond_validate(struct nlattr *tb[], struct nlattr *data[])
 	return 0;
 }
 
+static int bond_get_tx_queues(struct net *net, struct nlattr *tb[],
+			      unsigned int *num_queues,
+			      unsigned int *real_num_queues)
+{
+	*num_queues = bonding_defaults.tx_queues;
+	*real_num_queues = *num_queues;
+	return 0;
+}
+
 static struct rtnl_link_ops bond_link_ops __read_mostly = {
 	.kind		= "bond",
 	.priv_size	= sizeof(struct bonding),
 	.setup		= bond_setup,
 	.validate	= bond_validate,
+	.get_tx_queues	= bond_get_tx_queues,
 };
 
 /* Create a new bond based on the specified name and bonding parameters.
@@ -5027,8 +5113,8 @@ int bond_create(struct net *net, const char *name)
 
 	rtnl_lock();
 
-	bond_dev = alloc_netdev(sizeof(struct bonding), name ? name : "",
-				bond_setup);
+	bond_dev = alloc_netdev_mq(sizeof(struct bonding), name ? name : "",
+				   bond_setup, bonding_defaults.tx_queues);
 	if (!bond_dev) {
 		pr_err("%s: eek! can't alloc netdev!\n", name);
 		rtnl_unlock();
@@ -5131,6 +5217,9 @@ static void __exit bonding_exit(void)
 
 	rtnl_link_unregister(&bond_link_ops);
 	unregister_pernet_subsys(&bond_net_ops);
+
+	/* wait for pending bond_free_tx_slaves_rcu() callbacks */
+	rcu_barrier_bh();
 }
 
 module_init(bonding_init);
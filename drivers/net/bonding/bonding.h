@@ -20,6 +20,7 @@
 #include <linux/if_bonding.h>
 #include <linux/kobject.h>
 #include <linux/in6.h>
+#include <linux/rcupdate.h>
 #include "bond_3ad.h"
 #include "bond_alb.h"
 
@@ -30,6 +31,8 @@
 
 #define BOND_MAX_ARP_TARGETS	16
 
+#define BOND_MAX_TX_QUEUES	255
+
 #define IS_UP(dev)					   \
 	      ((((dev)->flags & IFF_UP) == IFF_UP)	&& \
 	       netif_running(dev)			&& \
@@ -130,6 +133,7 @@ struct bond_params {
 	int ad_select;
 	char primary[IFNAMSIZ];
 	int primary_reselect;
+	int tx_queues;
 	__be32 arp_targets[BOND_MAX_ARP_TARGETS];
 };
 
@@ -174,6 +178,16 @@ struct slave {
  */
 #define BOND_LINK_NOCHANGE -1
 
+/*
+ * RCU-protected copy of the slave list, in list order, for the transmit
+ * path.  Replaced by bond_attach_slave() and bond_detach_slave().
+ */
+struct bond_tx_slaves {
+	struct rcu_head	rcu;
+	unsigned int	count;
+	struct slave	*arr[0];
+};
+
 /*
  * Here are the locking policies for the two bonding locks:
  *
@@ -182,6 +196,11 @@ struct slave {
  *    (It is unnecessary when the write-lock is put with bond->lock.)
  * 3) When we lock with bond->curr_slave_lock, we must lock with bond->lock
  *    beforehand.
+ * 4) The transmit path takes neither lock.  It runs under
+ *    rcu_read_lock_bh() and only looks at bond->tx_slaves and
+ *    bond->curr_active_slave, which are updated with rcu_assign_pointer().
+ *    A released slave is freed only after synchronize_rcu_bh(): a plain
+ *    RCU grace period does not wait for bh readers under preemptible RCU.
  */
 struct bonding {
 	struct   net_device *dev; /* first - useful for panic debug */
@@ -191,6 +210,7 @@ struct bonding {
 	struct   slave *primary_slave;
 	bool     force_primary;
 	s32      slave_cnt; /* never change this value outside the attach/detach wrappers */
+	struct   bond_tx_slaves *tx_slaves;
 	rwlock_t lock;
 	rwlock_t curr_slave_lock;
 	s8       kill_timers;
@@ -26,6 +26,7 @@
 #include <linux/scatterlist.h>
 #include <linux/if_vlan.h>
 #include <linux/slab.h>
+#include <net/busy_poll.h>
 
 static int napi_weight = 128;
 module_param(napi_weight, int, 0444);
@@ -315,6 +316,7 @@ static void receive_buf(struct net_device *dev, void *buf, unsigned int len)
 		skb_shinfo(skb)->gso_segs = 0;
 	}
 
+	skb_mark_napi_id(skb, &vi->napi);
 	netif_receive_skb(skb);
 	return;
 
@@ -482,7 +484,6 @@ static int virtnet_poll(struct napi_struct *napi, int budget)
 	void *buf;
 	unsigned int len, received = 0;
 
-again:
 	while (received < budget &&
 	       (buf = virtqueue_get_buf(vi->rvq, &len)) != NULL) {
 		receive_buf(vi->dev, buf, len);
@@ -498,11 +499,15 @@ again:
 	/* Out of packets? */
 	if (received < budget) {
 		napi_complete(napi);
+		/*
+		 * More buffers raced in: requeue ourselves rather than loop,
+		 * so that a busy poller never sees the full budget returned
+		 * by a NAPI that is already back on a poll list.
+		 */
 		if (unlikely(!virtqueue_enable_cb(vi->rvq)) &&
 		    napi_schedule_prep(napi)) {
 			virtqueue_disable_cb(vi->rvq);
 			__napi_schedule(napi);
-			goto again;
 		}
 	}
 
@@ -941,6 +946,7 @@ static int virtnet_probe(struct virtio_device *vdev)
 	/* Set up our device-specific information */
 	vi = netdev_priv(dev);
 	netif_napi_add(dev, &vi->napi, virtnet_poll, napi_weight);
+	napi_hash_add(&vi->napi);
 	vi->dev = dev;
 	vi->vdev = vdev;
 	vdev->priv = vi;
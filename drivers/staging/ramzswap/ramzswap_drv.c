@@ -126,7 +126,7 @@ static void ramzswap_ioctl_get_stats(struct ramzswap *rzs,
 	size_t succ_writes, mem_used;
 	unsigned int good_compress_perc = 0, no_compress_perc = 0;
 
-	mem_used = xv_get_total_size_bytes(rzs->mem_pool)
+	mem_used = (zs_get_total_pages(rzs->mem_pool) << PAGE_SHIFT)
 			+ (rs->pages_expand << PAGE_SHIFT);
 	succ_writes = rzs_stat64_read(rzs, &rs->num_writes) -
 			rzs_stat64_read(rzs, &rs->failed_writes);
@@ -161,12 +161,10 @@ static void ramzswap_ioctl_get_stats(struct ramzswap *rzs,
 static void ramzswap_free_page(struct ramzswap *rzs, size_t index)
 {
 	u32 clen;
-	void *obj;
 
-	struct page *page = rzs->table[index].page;
-	u32 offset = rzs->table[index].offset;
+	unsigned long handle = rzs->table[index].handle;
 
-	if (unlikely(!page)) {
+	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -180,17 +178,14 @@ static void ramzswap_free_page(struct ramzswap *rzs, size_t index)
 
 	if (unlikely(rzs_test_flag(rzs, index, RZS_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		rzs_clear_flag(rzs, index, RZS_UNCOMPRESSED);
 		rzs_stat_dec(&rzs->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(rzs->mem_pool, page, offset);
+	clen = rzs->table[index].size;
+	zs_free(rzs->mem_pool, handle);
 	if (clen <= PAGE_SIZE / 2)
 		rzs_stat_dec(&rzs->stats.good_compress);
 
@@ -198,8 +193,8 @@ out:
 	rzs->stats.compr_size -= clen;
 	rzs_stat_dec(&rzs->stats.pages_stored);
 
-	rzs->table[index].page = NULL;
-	rzs->table[index].offset = 0;
+	rzs->table[index].handle = 0;
+	rzs->table[index].size = 0;
 }
 
 static int handle_zero_page(struct bio *bio)
@@ -228,8 +223,7 @@ static int handle_uncompressed_page(struct ramzswap *rzs, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
-			rzs->table[index].offset;
+	cmem = kmap_atomic((struct page *)rzs->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
 	kunmap_atomic(user_mem, KM_USER0);
@@ -267,7 +261,6 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 	u32 index;
 	size_t clen;
 	struct page *page;
-	struct zobj_header *zheader;
 	unsigned char *user_mem, *cmem;
 
 	rzs_stat64_inc(rzs, &rzs->stats.num_reads);
@@ -279,7 +272,7 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 		return handle_zero_page(bio);
 
 	/* Requested page is not present in compressed area */
-	if (!rzs->table[index].page)
+	if (!rzs->table[index].handle)
 		return handle_ramzswap_fault(rzs, bio);
 
 	/* Page is stored uncompressed since it's incompressible */
@@ -289,16 +282,14 @@ static int ramzswap_read(struct ramzswap *rzs, struct bio *bio)
 	user_mem = kmap_atomic(page, KM_USER0);
 	clen = PAGE_SIZE;
 
-	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
-			rzs->table[index].offset;
+	cmem = zs_map_object(rzs->mem_pool, rzs->table[index].handle,
+				ZS_MM_RO);
 
-	ret = lzo1x_decompress_safe(
-		cmem + sizeof(*zheader),
-		xv_get_object_size(cmem) - sizeof(*zheader),
-		user_mem, &clen);
+	ret = lzo1x_decompress_safe(cmem, rzs->table[index].size,
+				    user_mem, &clen);
 
 	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
+	zs_unmap_object(rzs->mem_pool, rzs->table[index].handle);
 
 	/* should NEVER happen */
 	if (unlikely(ret != LZO_E_OK)) {
@@ -322,10 +313,10 @@ out:
 static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 {
 	int ret;
-	u32 offset, index;
+	u32 index;
 	size_t clen;
-	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	unsigned long handle = 0;
+	struct page *page, *page_store = NULL;
 	unsigned char *user_mem, *cmem, *src;
 
 	rzs_stat64_inc(rzs, &rzs->stats.num_writes);
@@ -337,6 +328,13 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 
 	mutex_lock(&rzs->lock);
 
+	/*
+	 * A slot can be written again without a free notification in
+	 * between, when a page is redirtied while still in swap cache.
+	 */
+	if (rzs->table[index].handle || rzs_test_flag(rzs, index, RZS_ZERO))
+		ramzswap_free_page(rzs, index);
+
 	user_mem = kmap_atomic(page, KM_USER0);
 	if (page_zero_filled(user_mem)) {
 		kunmap_atomic(user_mem, KM_USER0);
@@ -377,17 +375,15 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 			goto out;
 		}
 
-		offset = 0;
 		rzs_set_flag(rzs, index, RZS_UNCOMPRESSED);
 		rzs_stat_inc(&rzs->stats.pages_expand);
-		rzs->table[index].page = page_store;
+		handle = (unsigned long)page_store;
 		src = kmap_atomic(page, KM_USER0);
 		goto memstore;
 	}
 
-	if (xv_malloc(rzs->mem_pool, clen + sizeof(*zheader),
-			&rzs->table[index].page, &offset,
-			GFP_NOIO | __GFP_HIGHMEM)) {
+	handle = zs_malloc(rzs->mem_pool, clen, GFP_NOIO | __GFP_HIGHMEM);
+	if (!handle) {
 		mutex_unlock(&rzs->lock);
 		pr_info("Error allocating memory for compressed "
 			"page: %u, size=%zu\n", index, clen);
@@ -396,25 +392,19 @@ static int ramzswap_write(struct ramzswap *rzs, struct bio *bio)
 	}
 
 memstore:
-	rzs->table[index].offset = offset;
-
-	cmem = kmap_atomic(rzs->table[index].page, KM_USER1) +
-			rzs->table[index].offset;
+	rzs->table[index].handle = handle;
+	rzs->table[index].size = clen;
 
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!rzs_test_flag(rzs, index, RZS_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
-	}
-#endif
-
-	memcpy(cmem, src, clen);
-
-	kunmap_atomic(cmem, KM_USER1);
-	if (unlikely(rzs_test_flag(rzs, index, RZS_UNCOMPRESSED)))
+	if (unlikely(page_store)) {
+		cmem = kmap_atomic(page_store, KM_USER1);
+		memcpy(cmem, src, clen);
+		kunmap_atomic(cmem, KM_USER1);
 		kunmap_atomic(src, KM_USER0);
+	} else {
+		cmem = zs_map_object(rzs->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, src, clen);
+		zs_unmap_object(rzs->mem_pool, handle);
+	}
 
 	/* Update stats */
 	rzs->stats.compr_size += clen;
@@ -500,25 +490,22 @@ static void reset_device(struct ramzswap *rzs)
 
 	/* Free all pages that are still in this ramzswap device */
 	for (index = 0; index < rzs->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = rzs->table[index].page;
-		offset = rzs->table[index].offset;
+		unsigned long handle = rzs->table[index].handle;
 
-		if (!page)
+		if (!handle)
 			continue;
 
 		if (unlikely(rzs_test_flag(rzs, index, RZS_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page((struct page *)handle);
 		else
-			xv_free(rzs->mem_pool, page, offset);
+			zs_free(rzs->mem_pool, handle);
 	}
 
 	vfree(rzs->table);
 	rzs->table = NULL;
 
-	xv_destroy_pool(rzs->mem_pool);
+	if (rzs->mem_pool)
+		zs_destroy_pool(rzs->mem_pool);
 	rzs->mem_pool = NULL;
 
 	/* Reset stats */
@@ -572,7 +559,7 @@ static int ramzswap_ioctl_init_device(struct ramzswap *rzs)
 		ret = -ENOMEM;
 		goto fail;
 	}
-	rzs->table[0].page = page;
+	rzs->table[0].handle = (unsigned long)page;
 	rzs_set_flag(rzs, 0, RZS_UNCOMPRESSED);
 
 	swap_header = kmap(page);
@@ -584,7 +571,7 @@ static int ramzswap_ioctl_init_device(struct ramzswap *rzs)
 	/* ramzswap devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, rzs->disk->queue);
 
-	rzs->mem_pool = xv_create_pool();
+	rzs->mem_pool = zs_create_pool(rzs->disk->disk_name);
 	if (!rzs->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
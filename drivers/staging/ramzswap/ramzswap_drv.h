@@ -17,9 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/zsmalloc.h>
 
 #include "ramzswap_ioctl.h"
-#include "xvmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -27,18 +27,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default ramzswap disk size: 25% of total RAM */
@@ -51,9 +39,9 @@ static const unsigned default_disksize_perc_ram = 25;
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * NOTE: max_zpage_size must be smaller than the largest zsmalloc
+ * object (PAGE_SIZE minus the handle zsmalloc keeps in each object),
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -81,8 +69,12 @@ enum rzs_pageflags {
  * These table entries must fit exactly in a page.
  */
 struct table {
-	struct page *page;
-	u16 offset;
+	/*
+	 * zsmalloc handle of the compressed object, or the struct page
+	 * holding the data if the RZS_UNCOMPRESSED flag is set.
+	 */
+	unsigned long handle;
+	u16 size;	/* object size, needed for decompression */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -107,7 +99,7 @@ struct ramzswap_stats {
 };
 
 struct ramzswap {
-	struct xv_pool *mem_pool;
+	struct zs_pool *mem_pool;
 	void *compress_workmem;
 	void *compress_buffer;
 	struct table *table;
@@ -374,6 +374,7 @@ int bprm_mm_init(struct linux_binprm *bprm)
 	if (err)
 		goto err;
 
+	lru_gen_add_mm(mm);
 	return 0;
 
 err:
@@ -316,6 +316,7 @@ void clear_inode(struct inode *inode)
 	invalidate_inode_buffers(inode);
 
 	BUG_ON(inode->i_data.nrpages);
+	truncate_inode_shadows(&inode->i_data);
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
 	inode_sync_wait(inode);
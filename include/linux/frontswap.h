@@ -0,0 +1,131 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+/*
+ * frontswap: a synchronous, page-granular cache that sits in front of the
+ * swap devices.  swap_writepage() offers every page to the registered
+ * backend before building a bio; if the backend accepts it, the page
+ * never reaches the device.  swap_readpage() asks the backend first, and
+ * freeing a swap slot or swapoff tells the backend to drop its copies.
+ *
+ * A backend may later write a page it holds to the real swap slot (see
+ * __swap_writepage()) and drop its own copy; a failed load then simply
+ * falls back to reading the device.
+ */
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+struct frontswap_ops {
+	void (*init)(unsigned type);
+	int (*store)(unsigned type, pgoff_t offset, struct page *page);
+	int (*load)(unsigned type, pgoff_t offset, struct page *page);
+	void (*invalidate_page)(unsigned type, pgoff_t offset);
+	void (*invalidate_area)(unsigned type);
+};
+
+#ifdef CONFIG_FRONTSWAP
+extern bool frontswap_enabled;
+extern struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops);
+
+extern void __frontswap_init(struct swap_info_struct *sis);
+extern int __frontswap_store(struct page *page);
+extern int __frontswap_load(struct page *page);
+extern void __frontswap_invalidate_page(struct swap_info_struct *sis,
+					pgoff_t offset);
+extern void __frontswap_invalidate_area(struct swap_info_struct *sis);
+
+static inline bool frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (frontswap_enabled && sis->frontswap_map)
+		return test_bit(offset, sis->frontswap_map);
+	return false;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return sis->frontswap_map;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+	sis->frontswap_map = map;
+}
+#else
+#define frontswap_enabled (false)
+
+static inline void __frontswap_init(struct swap_info_struct *sis)
+{
+}
+
+static inline int __frontswap_store(struct page *page)
+{
+	return -1;
+}
+
+static inline int __frontswap_load(struct page *page)
+{
+	return -1;
+}
+
+static inline void __frontswap_invalidate_page(struct swap_info_struct *sis,
+					       pgoff_t offset)
+{
+}
+
+static inline void __frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+}
+
+static inline bool frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	return false;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return NULL;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+}
+#endif
+
+static inline void frontswap_init(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_init(sis);
+}
+
+static inline int frontswap_store(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_store(page);
+	return -1;
+}
+
+static inline int frontswap_load(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_load(page);
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(struct swap_info_struct *sis,
+					     pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_page(sis, offset);
+}
+
+static inline void frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_area(sis);
+}
+
+#endif /* _LINUX_FRONTSWAP_H */
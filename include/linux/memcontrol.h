@@ -24,13 +24,14 @@ struct mem_cgroup;
 struct page_cgroup;
 struct page;
 struct mm_struct;
+struct zone;
 
-extern unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
-					struct list_head *dst,
-					unsigned long *scanned, int order,
-					int mode, struct zone *z,
-					struct mem_cgroup *mem_cont,
-					int active, int file);
+/* State of a walk over all cgroups, see mem_cgroup_reclaim_iter() */
+struct mem_cgroup_reclaim_walk {
+	struct zone *zone;	/* zone being reclaimed */
+	int start;		/* css id the walk started at */
+	bool wrapped;		/* went past the highest id */
+};
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 /*
@@ -55,12 +56,31 @@ extern void mem_cgroup_cancel_charge_swapin(struct mem_cgroup *ptr);
 
 extern int mem_cgroup_cache_charge(struct page *page, struct mm_struct *mm,
 					gfp_t gfp_mask);
-extern void mem_cgroup_add_lru_list(struct page *page, enum lru_list lru);
-extern void mem_cgroup_del_lru_list(struct page *page, enum lru_list lru);
-extern void mem_cgroup_rotate_lru_list(struct page *page, enum lru_list lru);
-extern void mem_cgroup_del_lru(struct page *page);
-extern void mem_cgroup_move_lists(struct page *page,
-				  enum lru_list from, enum lru_list to);
+extern struct list_head *mem_cgroup_zone_lru_list(struct mem_cgroup *mem,
+						  struct zone *zone,
+						  enum lru_list lru);
+extern struct list_head *mem_cgroup_lru_add_list(struct zone *zone,
+						 struct page *page,
+						 enum lru_list lru);
+extern void mem_cgroup_lru_del_list(struct page *page, enum lru_list lru);
+extern void mem_cgroup_lru_del(struct page *page);
+extern struct list_head *mem_cgroup_lru_move_lists(struct zone *zone,
+						   struct page *page,
+						   enum lru_list from,
+						   enum lru_list to);
+#ifdef CONFIG_LRU_GEN
+extern struct lru_gen_struct *mem_cgroup_zone_lru_gen(struct mem_cgroup *mem,
+						      struct zone *zone);
+extern struct lru_gen_struct *mem_cgroup_page_lru_gen(struct zone *zone,
+						      struct page *page);
+extern struct lru_gen_struct *mem_cgroup_lru_gen_add(struct zone *zone,
+						     struct page *page);
+extern struct lru_gen_struct *mem_cgroup_lru_gen_del(struct zone *zone,
+						     struct page *page);
+extern void mem_cgroup_lru_gen_update_size(struct zone *zone,
+					   struct lru_gen_struct *lrugen,
+					   enum lru_list lru, int nr);
+#endif
 
 /* For coalescing uncharge for reducing memcg' overhead*/
 extern void mem_cgroup_uncharge_start(void);
@@ -103,6 +123,9 @@ extern void mem_cgroup_note_reclaim_priority(struct mem_cgroup *mem,
 							int priority);
 extern void mem_cgroup_record_reclaim_priority(struct mem_cgroup *mem,
 							int priority);
+struct mem_cgroup *mem_cgroup_reclaim_iter(struct mem_cgroup *prev,
+					   struct mem_cgroup_reclaim_walk *walk);
+void mem_cgroup_reclaim_iter_break(struct mem_cgroup *mem);
 int mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg);
 int mem_cgroup_inactive_file_is_low(struct mem_cgroup *memcg);
 unsigned long mem_cgroup_zone_nr_pages(struct mem_cgroup *memcg,
@@ -129,7 +152,8 @@ static inline bool mem_cgroup_disabled(void)
 void mem_cgroup_update_file_mapped(struct page *page, int val);
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask, int nid,
-						int zid);
+						int zid,
+						unsigned long *total_scanned);
 #else /* CONFIG_CGROUP_MEM_RES_CTLR */
 struct mem_cgroup;
 
@@ -182,29 +206,65 @@ static inline int mem_cgroup_shmem_charge_fallback(struct page *page,
 	return 0;
 }
 
-static inline void mem_cgroup_add_lru_list(struct page *page, int lru)
+static inline struct list_head *
+mem_cgroup_zone_lru_list(struct mem_cgroup *mem, struct zone *zone,
+			 enum lru_list lru)
+{
+	return &zone->lru[lru].list;
+}
+
+static inline struct list_head *
+mem_cgroup_lru_add_list(struct zone *zone, struct page *page, enum lru_list lru)
+{
+	return &zone->lru[lru].list;
+}
+
+static inline void mem_cgroup_lru_del_list(struct page *page, enum lru_list lru)
+{
+}
+
+static inline void mem_cgroup_lru_del(struct page *page)
+{
+}
+
+static inline struct list_head *
+mem_cgroup_lru_move_lists(struct zone *zone, struct page *page,
+			  enum lru_list from, enum lru_list to)
 {
+	return &zone->lru[to].list;
 }
 
-static inline void mem_cgroup_del_lru_list(struct page *page, int lru)
+#ifdef CONFIG_LRU_GEN
+static inline struct lru_gen_struct *
+mem_cgroup_zone_lru_gen(struct mem_cgroup *mem, struct zone *zone)
 {
-	return ;
+	return &zone->lrugen;
 }
 
-static inline void mem_cgroup_rotate_lru_list(struct page *page, int lru)
+static inline struct lru_gen_struct *
+mem_cgroup_page_lru_gen(struct zone *zone, struct page *page)
 {
-	return ;
+	return &zone->lrugen;
 }
 
-static inline void mem_cgroup_del_lru(struct page *page)
+static inline struct lru_gen_struct *
+mem_cgroup_lru_gen_add(struct zone *zone, struct page *page)
 {
-	return ;
+	return &zone->lrugen;
+}
+
+static inline struct lru_gen_struct *
+mem_cgroup_lru_gen_del(struct zone *zone, struct page *page)
+{
+	return &zone->lrugen;
 }
 
 static inline void
-mem_cgroup_move_lists(struct page *page, enum lru_list from, enum lru_list to)
+mem_cgroup_lru_gen_update_size(struct zone *zone, struct lru_gen_struct *lrugen,
+			       enum lru_list lru, int nr)
 {
 }
+#endif
 
 static inline struct mem_cgroup *try_get_mem_cgroup_from_page(struct page *page)
 {
@@ -255,6 +315,17 @@ static inline void mem_cgroup_record_reclaim_priority(struct mem_cgroup *mem,
 {
 }
 
+static inline struct mem_cgroup *
+mem_cgroup_reclaim_iter(struct mem_cgroup *prev,
+			struct mem_cgroup_reclaim_walk *walk)
+{
+	return NULL;
+}
+
+static inline void mem_cgroup_reclaim_iter_break(struct mem_cgroup *mem)
+{
+}
+
 static inline bool mem_cgroup_disabled(void)
 {
 	return true;
@@ -304,7 +375,8 @@ static inline void mem_cgroup_update_file_mapped(struct page *page,
 
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
-					    gfp_t gfp_mask, int nid, int zid)
+					    gfp_t gfp_mask, int nid, int zid,
+					    unsigned long *total_scanned)
 {
 	return 0;
 }
@@ -45,4 +45,9 @@ static inline int migrate_vmas(struct mm_struct *mm,
 #define fail_migrate_page NULL
 
 #endif /* CONFIG_MIGRATION */
+
+#ifdef CONFIG_NUMA_BALANCING
+extern int migrate_misplaced_page(struct page *page, int node);
+#endif
+
 #endif /* _LINUX_MIGRATE_H */
@@ -19,20 +19,203 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+
+static inline bool lru_gen_enabled(void)
+{
+	return true;
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/*
+ * Returns the generation @page is on, or -1 if it is not on one.
+ */
+static inline int page_lru_gen(struct page *page)
+{
+	return (int)((page->flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * Set the generation of @page, -1 for none, and change the flags in
+ * @clear and @set along with it.  The other flags are updated with
+ * atomic bitops without zone->lru_lock, so this needs a cmpxchg loop.
+ */
+static inline void set_page_lru_gen(struct page *page, int gen,
+				    unsigned long clear, unsigned long set)
+{
+	unsigned long old_flags, new_flags;
+
+	do {
+		old_flags = ACCESS_ONCE(page->flags);
+		new_flags = (old_flags & ~(LRU_GEN_MASK | clear)) | set |
+			    ((gen + 1UL) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+}
+
+/*
+ * The two youngest generations are what the active lists used to be.
+ */
+static inline bool lru_gen_is_active(struct lru_gen_struct *lrugen, int gen)
+{
+	unsigned long max_seq = lrugen->max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/*
+ * Account for @page moving from generation @old_gen to @new_gen, either
+ * of which can be -1 for none.
+ */
+static inline void lru_gen_update_size(struct zone *zone,
+				       struct lru_gen_struct *lrugen,
+				       struct page *page,
+				       int old_gen, int new_gen)
+{
+	int type = page_is_file_cache(page);
+	enum lru_list l = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+
+	if (old_gen >= 0) {
+		enum lru_list old = l;
+
+		if (lru_gen_is_active(lrugen, old_gen))
+			old += LRU_ACTIVE;
+		lrugen->nr_pages[old_gen][type]--;
+		__dec_zone_state(zone, NR_LRU_BASE + old);
+		mem_cgroup_lru_gen_update_size(zone, lrugen, old, -1);
+	}
+	if (new_gen >= 0) {
+		enum lru_list new = l;
+
+		if (lru_gen_is_active(lrugen, new_gen))
+			new += LRU_ACTIVE;
+		lrugen->nr_pages[new_gen][type]++;
+		__inc_zone_state(zone, NR_LRU_BASE + new);
+		mem_cgroup_lru_gen_update_size(zone, lrugen, new, 1);
+	}
+}
+
+/**
+ * lru_gen_add_page - put an evictable page on a generation
+ * @zone: zone of the page
+ * @page: the page
+ * @reclaiming: @page is to be reclaimed next, put it at the tail
+ *
+ * Active pages go into the youngest generation, all others into the
+ * oldest; except anon pages not yet in the swap cache and pages under
+ * writeback for reclaim, which get one more generation to go.
+ *
+ * Returns false if @page is unevictable and goes on the regular list.
+ */
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	struct lru_gen_struct *lrugen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	VM_BUG_ON(page_lru_gen(page) >= 0);
+
+	if (PageUnevictable(page))
+		return false;
+
+	lrugen = mem_cgroup_lru_gen_add(zone, page);
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if ((!type && !PageSwapCache(page)) ||
+		 (PageReclaim(page) &&
+		  (PageDirty(page) || PageWriteback(page))))
+		seq = lrugen->min_seq[type] + 1;
+	else
+		seq = lrugen->min_seq[type];
+
+	gen = lru_gen_from_seq(seq);
+	set_page_lru_gen(page, gen, 1UL << PG_active, 0);
+	lru_gen_update_size(zone, lrugen, page, -1, gen);
+	if (reclaiming)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type]);
+
+	return true;
+}
+
+/**
+ * lru_gen_del_page - take a page off its generation
+ * @zone: zone of the page
+ * @page: the page
+ * @reclaiming: @page is isolated for reclaim or being freed
+ *
+ * Unless @reclaiming, a page from one of the two youngest generations
+ * is marked active, to be put back into the youngest later on.
+ *
+ * Returns false if @page is not on a generation.
+ */
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	struct lru_gen_struct *lrugen;
+	unsigned long set = 0;
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	lrugen = mem_cgroup_lru_gen_del(zone, page);
+	if (!reclaiming && lru_gen_is_active(lrugen, gen))
+		set = 1UL << PG_active;
+	lru_gen_update_size(zone, lrugen, page, gen, -1);
+	set_page_lru_gen(page, -1, 0, set);
+	list_del(&page->lru);
+
+	return true;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	list_add(&page->lru, &zone->lru[l].list);
+	if (lru_gen_add_page(zone, page, false))
+		return;
+
+	list_add(&page->lru, mem_cgroup_lru_add_list(zone, page, l));
 	__inc_zone_state(zone, NR_LRU_BASE + l);
-	mem_cgroup_add_lru_list(page, l);
 }
 
 static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	if (lru_gen_del_page(zone, page, false))
+		return;
+
+	mem_cgroup_lru_del_list(page, l);
 	list_del(&page->lru);
 	__dec_zone_state(zone, NR_LRU_BASE + l);
-	mem_cgroup_del_lru_list(page, l);
 }
 
 /**
@@ -55,6 +238,9 @@ del_page_from_lru(struct zone *zone, struct page *page)
 {
 	enum lru_list l;
 
+	if (lru_gen_del_page(zone, page, true))
+		return;
+
 	list_del(&page->lru);
 	if (PageUnevictable(page)) {
 		__ClearPageUnevictable(page);
@@ -67,7 +253,7 @@ del_page_from_lru(struct zone *zone, struct page *page)
 		}
 	}
 	__dec_zone_state(zone, NR_LRU_BASE + l);
-	mem_cgroup_del_lru_list(page, l);
+	mem_cgroup_lru_del_list(page, l);
 }
 
 /**
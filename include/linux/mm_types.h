@@ -9,6 +9,8 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -72,9 +74,21 @@ struct page {
 		pgoff_t index;		/* Our offset within mapping. */
 		void *freelist;		/* SLUB: freelist req. slab lock */
 	};
-	struct list_head lru;		/* Pageout list, eg. active_list
+	union {
+		struct list_head lru;	/* Pageout list, eg. active_list
 					 * protected by zone->lru_lock !
 					 */
+		struct {		/* SLUB per cpu partial slabs */
+			struct page *next;	/* Next partial slab */
+#ifdef CONFIG_64BIT
+			int pages;	/* Nr of partial slabs left */
+			int pobjects;	/* Approximate # of objects */
+#else
+			short int pages;
+			short int pobjects;
+#endif
+		};
+	};
 	/*
 	 * On machines where all RAM is mapped into kernel address space,
 	 * we can simply calculate the virtual address. On machines with
@@ -183,6 +197,14 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Bumped around changes to the fields above, and to the page
+	 * tables, by holders of mmap_sem for write; see vm_write_begin().
+	 */
+	seqcount_t vm_sequence;
+	struct rcu_head vm_rcu_head;	/* freed after a grace period */
+#endif
 };
 
 struct core_thread {
@@ -219,6 +241,19 @@ struct mm_rss_stat {
 };
 #endif /* !USE_SPLIT_PTLOCKS */
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * Reclaim unmaps pages without flushing the TLB of each one; it
+ * gathers here the cpus that may still cache the old translations
+ * and flushes them all at once, see try_to_unmap_flush().
+ */
+struct tlbflush_unmap_batch {
+	struct cpumask cpumask;	/* cpus to flush */
+	bool flush_required;	/* a pte was cleared without a flush */
+	bool writable;		/* ... and it was dirty */
+};
+#endif
+
 struct mm_struct {
 	struct vm_area_struct * mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -310,6 +345,28 @@ struct mm_struct {
 #ifdef CONFIG_MMU_NOTIFIER
 	struct mmu_notifier_mm *mmu_notifier_mm;
 #endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* page tables deposited for splitting huge pmds, page_table_lock */
+	pgtable_t pmd_huge_pte;
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Set when reclaim cleared a pte of this mm and has not yet
+	 * flushed the TLB for it.  Anyone who finds a pte_none under the
+	 * page table lock and relies on no translation being cached for
+	 * it must call flush_tlb_batched_pending() first.
+	 */
+	bool tlb_flush_batched;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	unsigned long numa_next_scan;	/* jiffies when the next scan is due */
+	unsigned long numa_scan_offset;	/* where the next scan starts */
+	int numa_scan_seq;		/* completed passes over the mm */
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* On the list of mm's whose page tables are walked to age pages */
+	struct list_head lru_gen_list;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -104,6 +104,9 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	WORKINGSET_REFAULT,	/* evicted file pages read back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated straight away */
+	WORKINGSET_NODERECLAIM,	/* shadow nodes reclaimed */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -155,6 +158,37 @@ static inline int is_unevictable_lru(enum lru_list l)
 	return (l == LRU_UNEVICTABLE);
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * With the multi-generational LRU, evictable pages are not kept on the
+ * active and inactive lists but sorted into generations, by how long ago
+ * they were last found referenced.  Generations are numbered by sequence
+ * numbers: max_seq is the youngest generation, and aging creates a new
+ * one after walking the page tables and moving every page whose accessed
+ * bit was set into the current youngest.  Eviction takes pages from the
+ * oldest generation of a type, min_seq[type], and retires it once empty.
+ *
+ * There are always at least MIN_NR_GENS generations of each type, and
+ * the two youngest ones are accounted as active in the LRU statistics.
+ * A page's generation is stored in page->flags, see LRU_GEN_PGOFF.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+struct lru_gen_struct {
+	unsigned long		max_seq;
+	/* the oldest generation of anon [0] and file [1] pages */
+	unsigned long		min_seq[2];
+	/* when each generation was created, in jiffies */
+	unsigned long		timestamps[MAX_NR_GENS];
+	/* indexed by seq % MAX_NR_GENS and page_is_file_cache() */
+	struct list_head	lists[MAX_NR_GENS][2];
+	long			nr_pages[MAX_NR_GENS][2];
+};
+
+extern void lru_gen_init(struct lru_gen_struct *lrugen);
+#endif
+
 enum zone_watermarks {
 	WMARK_MIN,
 	WMARK_LOW,
@@ -345,9 +379,15 @@ struct zone {
 	struct zone_lru {
 		struct list_head list;
 	} lru[NR_LRU_LISTS];
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct	lrugen;
+#endif
 
 	struct zone_reclaim_stat reclaim_stat;
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
@@ -170,6 +170,7 @@ struct skb_shared_hwtstamps {
  * @in_progress:	device driver is going to provide
  *			hardware time stamp
  * @prevent_sk_orphan:	make sk reference available on driver level
+ * @zerocopy_frag:	frags point to pinned user pages, see &ubuf_info
  * @flags:		all shared_tx flags
  *
  * These flags are attached to packets as part of the
@@ -180,11 +181,33 @@ union skb_shared_tx {
 		__u8	hardware:1,
 			software:1,
 			in_progress:1,
-			prevent_sk_orphan:1;
+			prevent_sk_orphan:1,
+			zerocopy_frag:1;
 	};
 	__u8 flags;
 };
 
+/**
+ * struct ubuf_info - MSG_ZEROCOPY completion tracking
+ * @id: first notification id covered by this buffer
+ * @len: number of consecutive ids covered (sendmsg calls)
+ * @zerocopy: cleared when any of the data had to be copied
+ * @bytelen: number of bytes covered
+ * @refcnt: one reference per skb pointing at it, plus the sender's
+ *
+ * Lives in the cb[] of the skb that is queued on the socket error
+ * queue when the last reference drops, see sock_zerocopy_alloc().
+ * Frags of skbs with @zerocopy_frag set point to user pages; the
+ * user may reuse those only once the notification is received.
+ */
+struct ubuf_info {
+	u32		id;
+	u16		len;
+	u16		zerocopy:1;
+	u32		bytelen;
+	atomic_t	refcnt;
+};
+
 /* This data is invariant across clones and lives at
  * the end of the header data, ie. at skb->end.
  */
@@ -244,6 +267,19 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* The payload is encapsulated behind an outer IPv4 + GRE header. */
+	SKB_GSO_GRE = 1 << 6,
+
+	/* The payload is encapsulated behind an outer IPv4 header. */
+	SKB_GSO_IPIP = 1 << 7,
+
+	/* Types below have no NETIF_F_ bit and are always segmented in
+	 * software.
+	 */
+
+	/* UDP payload split into datagrams of gso_size bytes each. */
+	SKB_GSO_UDP_L4 = 1 << 8,
 };
 
 #if BITS_PER_LONG > 32
@@ -309,6 +345,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
  *	@secmark: security marking
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@vlan_tci: vlan tag control information
  */
 
@@ -396,6 +433,9 @@ struct sk_buff {
 #endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
+#endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;
 #endif
 	union {
 		__u32		mark;
@@ -582,6 +622,78 @@ static inline union skb_shared_tx *skb_tx(struct sk_buff *skb)
 	return &skb_shinfo(skb)->tx_flags;
 }
 
+extern struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size);
+extern struct ubuf_info *sock_zerocopy_realloc(struct sock *sk, size_t size,
+					       struct ubuf_info *uarg);
+extern void sock_zerocopy_put(struct ubuf_info *uarg);
+extern void sock_zerocopy_put_abort(struct ubuf_info *uarg);
+extern int skb_zerocopy_from_user(struct sock *sk, struct sk_buff *skb,
+				  const void __user *from, int len);
+extern int skb_zerocopy_from_iovec(struct sock *sk, struct sk_buff *skb,
+				   struct iovec *iov, int offset, int len);
+extern int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
+
+static inline struct ubuf_info *skb_zcopy(struct sk_buff *skb)
+{
+	if (skb && skb_shinfo(skb)->tx_flags.zerocopy_frag)
+		return skb_shinfo(skb)->destructor_arg;
+	return NULL;
+}
+
+static inline void sock_zerocopy_get(struct ubuf_info *uarg)
+{
+	atomic_inc(&uarg->refcnt);
+}
+
+/* Attach @uarg to @skb, whose frags are (about to be) user pages */
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	if (skb && uarg && !skb_zcopy(skb)) {
+		sock_zerocopy_get(uarg);
+		skb_shinfo(skb)->destructor_arg = uarg;
+		skb_shinfo(skb)->tx_flags.zerocopy_frag = 1;
+	}
+}
+
+/* Release the reference of @skb's shared info on its ubuf_info */
+static inline void skb_zcopy_clear(struct sk_buff *skb, bool zerocopy)
+{
+	struct ubuf_info *uarg = skb_zcopy(skb);
+
+	if (uarg) {
+		uarg->zerocopy = uarg->zerocopy && zerocopy;
+		sock_zerocopy_put(uarg);
+		skb_shinfo(skb)->tx_flags.zerocopy_frag = 0;
+	}
+}
+
+/* Make @nskb, which shares frags with @orig, share its ubuf_info too */
+static inline int skb_zerocopy_clone(struct sk_buff *nskb,
+				     struct sk_buff *orig)
+{
+	if (skb_zcopy(orig)) {
+		if (skb_zcopy(nskb)) {
+			/* !gfp_mask callers are verified to !skb_zcopy(nskb) */
+			if (skb_zcopy(nskb) == skb_zcopy(orig))
+				return 0;
+			return -EIO;
+		}
+		skb_zcopy_set(nskb, skb_zcopy(orig));
+	}
+	return 0;
+}
+
+/* Frags of a zerocopy skb must not reach a receiving socket or tap:
+ * the sender may reuse its buffer as soon as it is notified. Replace
+ * them by private copies before the skb is handed to an rx handler.
+ */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
@@ -378,6 +378,13 @@ struct tcp_sock {
 	u32	snd_cwnd_used;
 	u32	snd_cwnd_stamp;
 
+	u32	delivered;	/* Total data packets delivered incl. rexmits */
+	u32	lost;		/* Total data packets lost incl. rexmits */
+	u32	app_limited;	/* limited until "delivered" reaches this val */
+	u32	first_tx_mstamp;  /* start of window send phase (usec) */
+	u32	delivered_mstamp; /* time we reached "delivered" (usec) */
+	u32	rate_min_rtt_us;  /* lowest RTT seen by the rate sampler */
+
  	u32	rcv_wnd;	/* Current receiver window		*/
 	u32	write_seq;	/* Tail(+1) of data held in tcp send buffer */
 	u32	pushed_seq;	/* Last pushed seq, required to talk to windows */
@@ -58,6 +58,23 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
 		UNEVICTABLE_MLOCKFREED,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		THP_FAULT_ALLOC,
+		THP_FAULT_FALLBACK,
+		THP_COLLAPSE_ALLOC,
+		THP_COLLAPSE_ALLOC_FAILED,
+		THP_SPLIT,
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_FAULT,		/* handled without mmap_sem */
+		SPF_ABORT,		/* retried under mmap_sem */
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+		NUMA_PTE_UPDATES,	/* ptes made hinting ptes */
+		NUMA_HINT_FAULTS,
+		NUMA_HINT_FAULTS_LOCAL,	/* page already on the faulting node */
+		NUMA_PAGE_MIGRATE,	/* pages moved by hinting faults */
+#endif
 		NR_VM_EVENT_ITEMS
 };
 
@@ -6,13 +6,17 @@
 #include <linux/mutex.h>
 #include <net/sock.h>
 
+struct scm_fp_list;
+
 extern void unix_inflight(struct file *fp);
 extern void unix_notinflight(struct file *fp);
 extern void unix_gc(void);
-extern void wait_for_unix_gc(void);
+extern void wait_for_unix_gc(struct scm_fp_list *fpl);
 extern struct sock *unix_get_socket(struct file *filp);
+extern struct work_struct unix_gc_work;
 
-#define UNIX_HASH_SIZE	256
+#define UNIX_HASH_BITS	8
+#define UNIX_HASH_SIZE	(1 << UNIX_HASH_BITS)
 
 extern unsigned int unix_tot_inflight;
 
@@ -124,8 +124,8 @@ struct inet_connection_sock {
 		/* Information on the current probe. */
 		int		  probe_size;
 	} icsk_mtup;
-	u32			  icsk_ca_priv[16];
-#define ICSK_CA_PRIV_SIZE	(16 * sizeof(u32))
+	u64			  icsk_ca_priv[13];
+#define ICSK_CA_PRIV_SIZE	(13 * sizeof(u64))
 };
 
 #define ICSK_TIME_RETRANS	1	/* Retransmit timer */
@@ -265,10 +265,15 @@ extern void inet_csk_reqsk_queue_hash_add(struct sock *sk,
 static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
 						struct request_sock *req)
 {
-	if (reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req) == 0)
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+
+	write_lock(&queue->syn_wait_lock);
+	if (reqsk_queue_removed(queue, req) == 0)
 		inet_csk_delete_keepalive_timer(sk);
+	write_unlock(&queue->syn_wait_lock);
 }
 
+/* Called with syn_wait_lock held for writing */
 static inline void inet_csk_reqsk_queue_added(struct sock *sk,
 					      const unsigned long timeout)
 {
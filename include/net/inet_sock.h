@@ -106,6 +106,7 @@ struct rtable;
  * @mc_ttl - Multicasting TTL
  * @is_icsk - is this an inet_connection_sock?
  * @mc_index - Multicast device index
+ * @rx_dst_ifindex - ifindex the cached input route (sk_rx_dst) is for
  * @mc_list - Group array
  * @cork - info to build ip hdr on each ip frag while socket is corked
  */
@@ -139,6 +140,7 @@ struct inet_sock {
 				transparent:1,
 				mc_all:1;
 	int			mc_index;
+	int			rx_dst_ifindex;
 	__be32			mc_addr;
 	struct ip_mc_socklist	*mc_list;
 	struct {
@@ -149,6 +151,7 @@ struct inet_sock {
 		int			length; /* Total length of all frames */
 		__be32			addr;
 		struct flowi		fl;
+		__u16			gso_size;
 	} cork;
 };
 
@@ -160,6 +163,22 @@ static inline struct inet_sock *inet_sk(const struct sock *sk)
 	return (struct inet_sock *)sk;
 }
 
+/* Cache the input route of @skb for early demux, replacing any old one. */
+static inline void inet_sk_rx_dst_set(struct sock *sk, const struct sk_buff *skb)
+{
+	struct dst_entry *dst = skb_dst(skb);
+
+	dst_hold(dst);
+	inet_sk(sk)->rx_dst_ifindex = skb->skb_iif;
+	dst_release(xchg(&sk->sk_rx_dst, dst));
+}
+
+/* Forget the cached input route, e.g. when the socket changes peer. */
+static inline void inet_sk_rx_dst_reset(struct sock *sk)
+{
+	dst_release(xchg(&sk->sk_rx_dst, NULL));
+}
+
 static inline void __inet_sk_copy_descendant(struct sock *sk_to,
 					     const struct sock *sk_from,
 					     const int ancestor_size)
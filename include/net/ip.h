@@ -54,6 +54,7 @@ struct ipcm_cookie {
 	int			oif;
 	struct ip_options	*opt;
 	union skb_shared_tx	shtx;
+	__u16			gso_size;
 };
 
 #define IPCB(skb) ((struct inet_skb_parm*)((skb)->cb))
@@ -93,6 +94,8 @@ extern int		ip_build_and_send_pkt(struct sk_buff *skb, struct sock *sk,
 extern int		ip_rcv(struct sk_buff *skb, struct net_device *dev,
 			       struct packet_type *pt, struct net_device *orig_dev);
 extern int		ip_local_deliver(struct sk_buff *skb);
+extern void		ip_protocol_deliver_rcu(struct net *net, struct sk_buff *skb,
+						int protocol);
 extern int		ip_mr_input(struct sk_buff *skb);
 extern int		ip_output(struct sk_buff *skb);
 extern int		ip_mc_output(struct sk_buff *skb);
@@ -206,6 +209,9 @@ extern int inet_peer_gc_maxtime;
 /* From ip_output.c */
 extern int sysctl_ip_dynaddr;
 
+/* From ip_input.c */
+extern int sysctl_ip_early_demux;
+
 extern void ipfrag_init(void);
 
 extern void ip_static_sysctl_init(void);
@@ -19,6 +19,8 @@
 #include <asm/atomic.h>                 /* for struct atomic_t */
 #include <linux/compiler.h>
 #include <linux/timer.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 
 #include <net/checksum.h>
 #include <linux/netfilter.h>		/* for union nf_inet_addr */
@@ -276,10 +278,27 @@ struct ip_vs_estimator {
 	u32			outbps;
 };
 
+/*
+ *	Packet path counters, kept per CPU and only written with BH
+ *	disabled on their own CPU.  They are summed into ustats by
+ *	ip_vs_read_stats(); syncp keeps the 64-bit byte counters
+ *	consistent for readers on 32-bit machines.
+ */
+struct ip_vs_cpu_stats {
+	u64			inbytes;
+	u64			outbytes;
+	u32			conns;
+	u32			inpkts;
+	u32			outpkts;
+	seqcount_t		syncp;
+};
+
 struct ip_vs_stats {
 	struct ip_vs_stats_user	ustats;         /* statistics */
 	struct ip_vs_estimator	est;		/* estimator */
 
+	struct ip_vs_cpu_stats	*cpustats;	/* per CPU counters */
+	struct ip_vs_stats_user	zbase;		/* counters at last zeroing */
 	spinlock_t              lock;           /* spin lock */
 };
 
@@ -359,7 +378,7 @@ extern struct ip_vs_protocol * ip_vs_proto_get(unsigned short proto);
  *	IP_VS structure allocated for each dynamically scheduled connection
  */
 struct ip_vs_conn {
-	struct list_head        c_list;         /* hashed list heads */
+	struct hlist_node       c_list;         /* hashed list heads */
 
 	/* Protocol, addresses and port numbers */
 	u16                      af;		/* address family */
@@ -405,6 +424,8 @@ struct ip_vs_conn {
 	void                    *app_data;      /* Application private data */
 	struct ip_vs_seq        in_seq;         /* incoming seq. struct */
 	struct ip_vs_seq        out_seq;        /* outgoing seq. struct */
+
+	struct rcu_head		rcu_head;	/* deferred free after unlink */
 };
 
 
@@ -475,6 +496,8 @@ struct ip_vs_service {
 	struct ip_vs_scheduler	*scheduler;    /* bound scheduler object */
 	rwlock_t		sched_lock;    /* lock sched_data */
 	void			*sched_data;   /* scheduler application data */
+
+	struct rcu_head		rcu_head;      /* deferred free after unhash */
 };
 
 
@@ -836,6 +859,7 @@ extern void ip_vs_estimator_cleanup(void);
 extern void ip_vs_new_estimator(struct ip_vs_stats *stats);
 extern void ip_vs_kill_estimator(struct ip_vs_stats *stats);
 extern void ip_vs_zero_estimator(struct ip_vs_stats *stats);
+extern void ip_vs_read_stats(struct ip_vs_stats *stats);
 
 /*
  *	Various IPVS packet transmitters (from ip_vs_xmit.c)
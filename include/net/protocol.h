@@ -42,6 +42,7 @@ struct net_protocol {
 	struct sk_buff	      **(*gro_receive)(struct sk_buff **head,
 					       struct sk_buff *skb);
 	int			(*gro_complete)(struct sk_buff *skb);
+	void			(*early_demux)(struct sk_buff *skb);
 	unsigned int		no_policy:1,
 				netns_ok:1;
 };
@@ -121,6 +121,13 @@ struct listen_sock {
  * don't need to grab this lock in read mode too as rskq_accept_head. writes
  * are always protected from the main sock lock.
  */
+/*
+ * SYNs may be hashed into syn_table without the listener lock held (see
+ * tcp_v4_syn_rcv()), so syn_wait_lock serializes all changes of syn_table,
+ * qlen and qlen_young. Removal of requests still also requires the
+ * listener lock, which lets it walk the chains unlocked. listen_opt is
+ * freed only after an RCU grace period once it was yanked.
+ */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
 	struct request_sock	*rskq_accept_tail;
@@ -155,6 +162,11 @@ static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
 				      struct request_sock **prev_req)
 {
 	write_lock(&queue->syn_wait_lock);
+	/* requests hashed since @prev_req was looked up sit in front of
+	 * @req, when @prev_req is the head of its chain
+	 */
+	while (*prev_req != req)
+		prev_req = &(*prev_req)->dl_next;
 	*prev_req = req->dl_next;
 	write_unlock(&queue->syn_wait_lock);
 }
@@ -202,6 +214,7 @@ static inline struct sock *reqsk_queue_get_child(struct request_sock_queue *queu
 	return child;
 }
 
+/* Called with syn_wait_lock held for writing */
 static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 				      struct request_sock *req)
 {
@@ -213,6 +226,7 @@ static inline int reqsk_queue_removed(struct request_sock_queue *queue,
 	return --lopt->qlen;
 }
 
+/* Called with syn_wait_lock held for writing */
 static inline int reqsk_queue_added(struct request_sock_queue *queue)
 {
 	struct listen_sock *lopt = queue->listen_opt;
@@ -228,16 +242,22 @@ static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
 }
 
+/* The listener may be closed under a SYN handled without its lock */
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	const struct listen_sock *lopt = ACCESS_ONCE(queue->listen_opt);
+
+	return lopt != NULL ? lopt->qlen_young : 0;
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
+	const struct listen_sock *lopt = ACCESS_ONCE(queue->listen_opt);
+
+	return lopt == NULL || lopt->qlen >> lopt->max_qlen_log;
 }
 
+/* Called with syn_wait_lock held for writing */
 static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 					u32 hash, struct request_sock *req,
 					unsigned long timeout)
@@ -248,10 +268,9 @@ static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
 	req->retrans = 0;
 	req->sk = NULL;
 	req->dl_next = lopt->syn_table[hash];
-
-	write_lock(&queue->syn_wait_lock);
+	/* chains are walked without syn_wait_lock under the listener lock */
+	smp_wmb();
 	lopt->syn_table[hash] = req;
-	write_unlock(&queue->syn_wait_lock);
 }
 
 #endif /* _REQUEST_SOCK_H */
@@ -452,6 +452,8 @@ extern struct sock *		tcp_v4_syn_recv_sock(struct sock *sk,
 extern int			tcp_v4_do_rcv(struct sock *sk,
 					      struct sk_buff *skb);
 
+extern void			tcp_v4_early_demux(struct sk_buff *skb);
+
 extern int			tcp_v4_connect(struct sock *sk,
 					       struct sockaddr *uaddr,
 					       int addr_len);
@@ -635,11 +637,22 @@ extern u32	__tcp_select_window(struct sock *sk);
  */
 struct tcp_skb_cb {
 	union {
-		struct inet_skb_parm	h4;
+		struct {
+			/* There is space for up to 20 bytes */
+			__u32 is_app_limited:1, /* cwnd not fully used? */
+			      unused:31;
+			__u32 delivered;	/* tp->delivered at last (re)xmit */
+			__u32 sent_mstamp;	/* time of last (re)xmit (usec) */
+			__u32 first_tx_mstamp;	/* tp->first_tx_mstamp at xmit */
+			__u32 delivered_mstamp;	/* tp->delivered_mstamp at xmit */
+		} tx;		/* For outgoing frames		*/
+		union {
+			struct inet_skb_parm	h4;
 #if defined(CONFIG_IPV6) || defined (CONFIG_IPV6_MODULE)
-		struct inet6_skb_parm	h6;
+			struct inet6_skb_parm	h6;
 #endif
-	} header;	/* For incoming frames		*/
+		} header;	/* For incoming frames		*/
+	};
 	__u32		seq;		/* Starting sequence number	*/
 	__u32		end_seq;	/* SEQ + FIN + SYN + datalen	*/
 	__u32		when;		/* used to compute rtt's	*/
@@ -706,6 +719,34 @@ enum tcp_ca_event {
 #define TCP_CONG_NON_RESTRICTED 0x1
 #define TCP_CONG_RTT_STAMP	0x2
 
+/* A rate sample measures the number of (original/retransmitted) data
+ * packets delivered "delivered" over an interval of time "interval_us".
+ * The tcp_rate code in tcp_input.c fills in the rate sample, and
+ * congestion control modules that define a cong_control function
+ * run at the end of ACK processing can optionally choose to consult
+ * this sample when setting cwnd and pacing rate.
+ * A sample is invalid if "delivered" or "interval_us" is negative.
+ */
+struct rate_sample {
+	u32  prior_mstamp;	/* starting timestamp for interval (usec) */
+	u32  prior_delivered;	/* tp->delivered at "prior_mstamp" */
+	s32  delivered;		/* number of packets delivered over interval */
+	long interval_us;	/* time for tp->delivered to incr "delivered" */
+	long rtt_us;		/* RTT of last (S)ACKed packet (or -1) */
+	int  losses;		/* number of packets marked lost upon ACK */
+	u32  acked_sacked;	/* number of packets newly (S)ACKed upon ACK */
+	u32  prior_in_flight;	/* in flight before this ACK */
+	bool is_app_limited;	/* is sample from packet with bubble in pipe? */
+	bool is_retrans;	/* is sample from retransmission? */
+};
+
+static inline u32 tcp_clock_us(void)
+{
+	u32 now = (u32)ktime_to_us(ktime_get());
+
+	return now ? : 1;	/* zero means "no timestamp" */
+}
+
 struct tcp_congestion_ops {
 	struct list_head	list;
 	unsigned long flags;
@@ -719,7 +760,7 @@ struct tcp_congestion_ops {
 	u32 (*ssthresh)(struct sock *sk);
 	/* lower bound for congestion window (optional) */
 	u32 (*min_cwnd)(const struct sock *sk);
-	/* do new cwnd calculation (required) */
+	/* do new cwnd calculation (required unless cong_control is set) */
 	void (*cong_avoid)(struct sock *sk, u32 ack, u32 in_flight);
 	/* call before changing ca_state (optional) */
 	void (*set_state)(struct sock *sk, u8 new_state);
@@ -731,6 +772,10 @@ struct tcp_congestion_ops {
 	void (*pkts_acked)(struct sock *sk, u32 num_acked, s32 rtt_us);
 	/* get info for inet_diag (optional) */
 	void (*get_info)(struct sock *sk, u32 ext, struct sk_buff *skb);
+	/* call when packets are delivered to update cwnd and pacing rate,
+	 * after all the ca_state processing. (optional)
+	 */
+	void (*cong_control)(struct sock *sk, const struct rate_sample *rs);
 
 	char 		name[TCP_CA_NAME_MAX];
 	struct module 	*owner;
@@ -949,6 +994,8 @@ static inline int tcp_prequeue(struct sock *sk, struct sk_buff *skb)
 	if (sysctl_tcp_low_latency || !tp->ucopy.task)
 		return 0;
 
+	/* Processed outside the RCU section the dst was looked up in. */
+	skb_dst_force(skb);
 	__skb_queue_tail(&tp->ucopy.prequeue, skb);
 	tp->ucopy.memory += skb->truesize;
 	if (tp->ucopy.memory > sk->sk_rcvbuf) {
@@ -1040,6 +1087,36 @@ static inline void tcp_openreq_init(struct request_sock *req,
 	ireq->loc_port = tcp_hdr(skb)->dest;
 }
 
+/* A SYN to a listener can be answered without the listener lock, unless
+ * the listener has state that setsockopt() may free under us: MD5 keys
+ * or TCP cookie transaction values.  setsockopt() may install them right
+ * after this check; see tcp_syn_lockless_sync() for why that is safe.
+ */
+static inline bool tcp_syn_lockless(const struct sock *sk,
+				    const struct tcphdr *th)
+{
+	if ((tcp_flag_word(th) & (TCP_FLAG_ACK | TCP_FLAG_RST | TCP_FLAG_SYN)) !=
+	    TCP_FLAG_SYN)
+		return false;
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_sk(sk)->md5sig_info)
+		return false;
+#endif
+	return tcp_sk(sk)->cookie_values == NULL;
+}
+
+/* Called by setsockopt() after giving a listener its first MD5 key info,
+ * cookie values or IPv6 tx options.  A lockless SYN handler that found
+ * none of them may still be running and could look at what was just
+ * installed, so wait for it before anything can be freed again.  The
+ * handlers run under rcu_read_lock() from the protocol receive path.
+ */
+static inline void tcp_syn_lockless_sync(const struct sock *sk)
+{
+	if (sk->sk_state == TCP_LISTEN)
+		synchronize_rcu();
+}
+
 extern void tcp_enter_memory_pressure(struct sock *sk);
 
 static inline int keepalive_intvl_when(const struct tcp_sock *tp)
@@ -22,6 +22,8 @@
 
 #include <linux/latencytop.h>
 #include <linux/sched.h>
+#include <linux/mempolicy.h>
+#include <linux/tracehook.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -605,6 +607,270 @@ update_stats_curr_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	se->exec_start = rq_of(cfs_rq)->clock_task;
 }
 
+/**************************************************
+ * NUMA balancing:
+ */
+
+#ifdef CONFIG_NUMA_BALANCING
+/* Sample memory and move tasks and pages at all */
+int sysctl_numa_balancing = 1;
+
+/* Cpu time a new task runs before its first scan, in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* Bounds of the per-task scan period, in ms of cpu time */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* Address space made into hinting ptes per scan, in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+static void migrate_task_to(struct task_struct *p, int dest_cpu);
+
+/*
+ * Move current to the least loaded cpu of its preferred node, unless
+ * that cpu would end up busier than the one it leaves.
+ */
+static void task_numa_migrate(struct task_struct *p)
+{
+	unsigned long src_load, load, best_load = ULONG_MAX;
+	int cpu, best_cpu = -1;
+
+	src_load = weighted_cpuload(task_cpu(p));
+	for_each_cpu_and(cpu, cpumask_of_node(p->numa_preferred_nid),
+			 &p->cpus_allowed) {
+		load = weighted_cpuload(cpu);
+		if (load < best_load) {
+			best_load = load;
+			best_cpu = cpu;
+		}
+	}
+
+	if (best_cpu == -1 || best_load + p->se.load.weight > src_load)
+		return;
+
+	migrate_task_to(p, best_cpu);
+}
+
+/*
+ * Once per pass of the scanner over the mm, fold the faults of the
+ * pass into the decaying per-node statistics, adapt the scan period,
+ * and follow the memory to the node with most of the faults.
+ */
+static void task_numa_placement(struct task_struct *p)
+{
+	int seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	unsigned long faults, max_faults = 0;
+	int nid, max_nid = -1;
+
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	for_each_online_node(nid) {
+		faults = p->numa_faults[nid] / 2 + p->numa_faults_buffer[nid];
+		p->numa_faults[nid] = faults;
+		p->numa_faults_buffer[nid] = 0;
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+	}
+
+	/* Scan faster while pages move, back off once they settled */
+	if (p->numa_migrated)
+		p->numa_scan_period = max(p->numa_scan_period / 2,
+				sysctl_numa_balancing_scan_period_min);
+	else
+		p->numa_scan_period = min(p->numa_scan_period * 2,
+				sysctl_numa_balancing_scan_period_max);
+	p->numa_migrated = 0;
+
+	p->numa_preferred_nid = max_nid;
+	if (max_nid != -1 && max_nid != cpu_to_node(task_cpu(p)))
+		task_numa_migrate(p);
+}
+
+/*
+ * Called from the NUMA hinting fault: current touched @pages that are
+ * on @node, and that were just migrated there if @migrated.
+ */
+void task_numa_fault(int node, int pages, int migrated)
+{
+	struct task_struct *p = current;
+
+	if (!sysctl_numa_balancing || !p->mm)
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		int size = sizeof(*p->numa_faults) * 2 * nr_node_ids;
+
+		p->numa_faults = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+		p->numa_faults_buffer = p->numa_faults + nr_node_ids;
+	}
+
+	task_numa_placement(p);
+
+	if (migrated)
+		p->numa_migrated += pages;
+	p->numa_faults_buffer[node] += pages;
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+static void reset_ptenuma_scan(struct mm_struct *mm)
+{
+	ACCESS_ONCE(mm->numa_scan_seq)++;
+	mm->numa_scan_offset = 0;
+}
+
+/*
+ * Run on the way back to user space once task_tick_numa() found a scan
+ * due: make the next sysctl_numa_balancing_scan_size of the address
+ * space into hinting ptes, carrying on where the last scan of the mm
+ * stopped.  Only one thread of an mm scans per scan period.
+ */
+void task_numa_work(void)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages;
+
+	if (likely(!p->numa_work_pending))
+		return;
+	p->numa_work_pending = 0;
+
+	if (!mm || (p->flags & PF_EXITING))
+		return;
+
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT;	/* MB in pages */
+	if (!pages)
+		return;
+
+	down_read(&mm->mmap_sem);
+	start = mm->numa_scan_offset;
+	vma = find_vma(mm, start);
+	if (!vma) {
+		reset_ptenuma_scan(mm);
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		/* PROT_NONE vmas take their faults the usual way */
+		if (!vma_migratable(vma) ||
+		    !(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = ALIGN(start + (pages << PAGE_SHIFT), PMD_SIZE);
+			end = min(end, vma->vm_end);
+			change_prot_numa(vma, start, end);
+			pages -= (end - start) >> PAGE_SHIFT;
+			start = end;
+			if (pages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+
+out:
+	/*
+	 * Reaching the end of the vma list, even past vmas that were
+	 * skipped, completes a pass.
+	 */
+	if (vma)
+		mm->numa_scan_offset = start;
+	else
+		reset_ptenuma_scan(mm);
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Each numa_scan_period of cpu time, have the task scan part of its
+ * address space, from task_numa_work() on its way back to user space.
+ */
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	u64 period, now;
+
+	if (!sysctl_numa_balancing || nr_online_nodes < 2)
+		return;
+
+	if (!curr->mm || (curr->flags & (PF_EXITING | PF_KTHREAD)) ||
+	    curr->numa_work_pending)
+		return;
+
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		curr->node_stamp = now;
+
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			curr->numa_work_pending = 1;
+			set_notify_resume(curr);
+		}
+	}
+}
+
+/* Whether moving @p between the two cpus brings it to its memory */
+static bool migrate_improves_locality(struct task_struct *p,
+				      int src_cpu, int dst_cpu)
+{
+	int src_nid = cpu_to_node(src_cpu), dst_nid = cpu_to_node(dst_cpu);
+
+	if (!sysctl_numa_balancing || p->numa_preferred_nid == -1)
+		return false;
+
+	return src_nid != dst_nid && dst_nid == p->numa_preferred_nid;
+}
+
+/* Whether moving @p between the two cpus takes it away from its memory */
+static bool migrate_degrades_locality(struct task_struct *p,
+				      int src_cpu, int dst_cpu)
+{
+	int src_nid = cpu_to_node(src_cpu), dst_nid = cpu_to_node(dst_cpu);
+
+	if (!sysctl_numa_balancing || p->numa_preferred_nid == -1)
+		return false;
+
+	return src_nid != dst_nid && src_nid == p->numa_preferred_nid;
+}
+#else
+static inline void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+
+static inline bool migrate_improves_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+
+static inline bool migrate_degrades_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**************************************************
  * Scheduling class queueing methods:
  */
@@ -1804,6 +2070,16 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 	 */
 
 	tsk_cache_hot = task_hot(p, rq->clock_task, sd);
+
+	/*
+	 * A task is as good as cache cold for a move onto the node its
+	 * memory is on, and hot for a move away from it.
+	 */
+	if (migrate_improves_locality(p, cpu_of(rq), this_cpu))
+		tsk_cache_hot = 0;
+	else if (migrate_degrades_locality(p, cpu_of(rq), this_cpu))
+		tsk_cache_hot = 1;
+
 	if (!tsk_cache_hot ||
 		sd->nr_balance_failed > sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -3592,6 +3868,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
@@ -0,0 +1,210 @@
+/*
+ * Frontswap frontend
+ *
+ * This code provides the generic "frontend" layer to call a matching
+ * "backend" driver implementation of frontswap.  See include/linux/frontswap.h
+ * for the interface.  The backend keeps compressed or otherwise transformed
+ * copies of swap pages, indexed by swap type and offset; this layer keeps
+ * track of which offsets of each swap device the backend holds.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/pagemap.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/frontswap.h>
+
+/*
+ * frontswap_ops is set by frontswap_register_ops to contain the pointers
+ * to the frontswap "backend" implementation functions.
+ */
+static struct frontswap_ops frontswap_ops __read_mostly;
+
+/*
+ * This global enablement flag reduces overhead on systems where frontswap_ops
+ * has not been registered, so is preferred to the slower alternative: a
+ * function call that checks a non-global.
+ */
+bool frontswap_enabled __read_mostly;
+EXPORT_SYMBOL(frontswap_enabled);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Counters available via /sys/kernel/debug/frontswap (if debugfs is
+ * properly configured).  These are for information only so are not
+ * protected against increment races.
+ */
+static u64 frontswap_loads;
+static u64 frontswap_succ_stores;
+static u64 frontswap_failed_stores;
+static u64 frontswap_invalidates;
+
+static inline void inc_frontswap_loads(void)
+{
+	frontswap_loads++;
+}
+static inline void inc_frontswap_succ_stores(void)
+{
+	frontswap_succ_stores++;
+}
+static inline void inc_frontswap_failed_stores(void)
+{
+	frontswap_failed_stores++;
+}
+static inline void inc_frontswap_invalidates(void)
+{
+	frontswap_invalidates++;
+}
+#else
+static inline void inc_frontswap_loads(void) { }
+static inline void inc_frontswap_succ_stores(void) { }
+static inline void inc_frontswap_failed_stores(void) { }
+static inline void inc_frontswap_invalidates(void) { }
+#endif
+
+/*
+ * Register operations for frontswap, returning previous thus allowing
+ * detection of multiple backends and possible nesting.
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+
+	frontswap_ops = *ops;
+	frontswap_enabled = true;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/*
+ * Called when a swap device is swapon'd.  Devices that were enabled
+ * before a backend registered have no frontswap_map and are skipped.
+ */
+void __frontswap_init(struct swap_info_struct *sis)
+{
+	if (sis->frontswap_map == NULL)
+		return;
+	atomic_set(&sis->frontswap_pages, 0);
+	frontswap_ops.init(sis->type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * "Store" data from a page to frontswap and associate it with the page's
+ * swaptype and offset.  Page must be locked and in the swap cache.
+ * If frontswap already contains a page with matching swaptype and
+ * offset, the frontswap implementation may either overwrite the data and
+ * return success or invalidate the page from frontswap and return failure.
+ */
+int __frontswap_store(struct page *page)
+{
+	int ret = -1, dup = 0;
+	swp_entry_t entry = { .val = page_private(page), };
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	if (!sis->frontswap_map)
+		return ret;
+	if (frontswap_test(sis, offset))
+		dup = 1;
+	ret = frontswap_ops.store(sis->type, offset, page);
+	if (ret == 0) {
+		set_bit(offset, sis->frontswap_map);
+		inc_frontswap_succ_stores();
+		if (!dup)
+			atomic_inc(&sis->frontswap_pages);
+	} else {
+		/*
+		 * A failed dup always results in automatic invalidate of
+		 * the (older) page from frontswap: the device copy written
+		 * instead is the only valid one now.
+		 */
+		inc_frontswap_failed_stores();
+		if (dup) {
+			frontswap_ops.invalidate_page(sis->type, offset);
+			clear_bit(offset, sis->frontswap_map);
+			atomic_dec(&sis->frontswap_pages);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_store);
+
+/*
+ * "Get" data from frontswap associated with swaptype and offset that were
+ * specified when the data was put to frontswap and use it to fill the
+ * specified page with data. Page must be locked and in the swap cache.
+ */
+int __frontswap_load(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	if (frontswap_test(sis, offset))
+		ret = frontswap_ops.load(sis->type, offset, page);
+	if (ret == 0)
+		inc_frontswap_loads();
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_load);
+
+/*
+ * Invalidate any data from frontswap associated with the specified swaptype
+ * and offset so that a subsequent "get" will fail.  Called under swap_lock
+ * when the swap slot is freed.
+ */
+void __frontswap_invalidate_page(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (frontswap_test(sis, offset)) {
+		frontswap_ops.invalidate_page(sis->type, offset);
+		clear_bit(offset, sis->frontswap_map);
+		atomic_dec(&sis->frontswap_pages);
+		inc_frontswap_invalidates();
+	}
+}
+EXPORT_SYMBOL(__frontswap_invalidate_page);
+
+/*
+ * Invalidate all data from frontswap associated with all offsets for the
+ * specified swaptype.  Called at swapoff once try_to_unuse() succeeded.
+ */
+void __frontswap_invalidate_area(struct swap_info_struct *sis)
+{
+	if (sis->frontswap_map == NULL)
+		return;
+	frontswap_ops.invalidate_area(sis->type);
+	atomic_set(&sis->frontswap_pages, 0);
+	memset(sis->frontswap_map, 0,
+	       BITS_TO_LONGS(sis->max) * sizeof(long));
+}
+EXPORT_SYMBOL(__frontswap_invalidate_area);
+
+static int __init init_frontswap(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *root = debugfs_create_dir("frontswap", NULL);
+
+	if (root == NULL)
+		return -ENXIO;
+	debugfs_create_u64("loads", S_IRUGO, root, &frontswap_loads);
+	debugfs_create_u64("succ_stores", S_IRUGO, root,
+			   &frontswap_succ_stores);
+	debugfs_create_u64("failed_stores", S_IRUGO, root,
+			   &frontswap_failed_stores);
+	debugfs_create_u64("invalidates", S_IRUGO, root,
+			   &frontswap_invalidates);
+#endif
+	return 0;
+}
+module_init(init_frontswap);
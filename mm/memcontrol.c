@@ -100,10 +100,15 @@ struct mem_cgroup_stat_cpu {
  */
 struct mem_cgroup_per_zone {
 	/*
-	 * spin_lock to protect the per cgroup LRU
+	 * zone->lru_lock protects the per cgroup LRU
 	 */
 	struct list_head	lists[NR_LRU_LISTS];
 	unsigned long		count[NR_LRU_LISTS];
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct	lrugen;
+#endif
+	int			last_scanned_id;/* Where global reclaim */
+						/* resumes (root only)  */
 
 	struct zone_reclaim_stat reclaim_stat;
 	struct rb_node		tree_node;	/* RB tree node */
@@ -706,92 +711,268 @@ static inline bool mem_cgroup_is_root(struct mem_cgroup *mem)
  * 2. moving account
  * In typical case, "charge" is done before add-to-lru. Exception is SwapCache.
  * It is added to LRU before charge.
- * If PCG_USED bit is not set, page_cgroup is not added to this private LRU.
  * When moving account, the page is not on LRU. It's isolated.
+ *
+ * A page on the LRU is linked on exactly one list.  Pages charged to a
+ * cgroup other than the root live on that cgroup's per-zone lists.  Pages
+ * of the root cgroup live on the zone's own lists, and so do pages that
+ * are not charged at all: the root cgroup accounts for them until they
+ * get charged.  PCG_ACCT_LRU is set when the page is accounted to
+ * pc->mem_cgroup, clear when it is accounted to the root cgroup.
  */
 
-void mem_cgroup_del_lru_list(struct page *page, enum lru_list lru)
+static struct mem_cgroup_per_zone *
+page_lru_zoneinfo(struct mem_cgroup *mem, struct page *page)
+{
+	return mem_cgroup_zoneinfo(mem, page_to_nid(page), page_zonenum(page));
+}
+
+/**
+ * mem_cgroup_zone_lru_list - LRU list of a cgroup in a zone
+ * @mem: the cgroup
+ * @zone: the zone
+ * @lru: which list
+ */
+struct list_head *mem_cgroup_zone_lru_list(struct mem_cgroup *mem,
+					   struct zone *zone,
+					   enum lru_list lru)
 {
-	struct page_cgroup *pc;
 	struct mem_cgroup_per_zone *mz;
 
-	if (mem_cgroup_disabled())
-		return;
-	pc = lookup_page_cgroup(page);
-	/* can happen while we handle swapcache. */
-	if (!TestClearPageCgroupAcctLRU(pc))
-		return;
-	VM_BUG_ON(!pc->mem_cgroup);
+	if (mem_cgroup_is_root(mem))
+		return &zone->lru[lru].list;
+
+	mz = mem_cgroup_zoneinfo(mem, zone_to_nid(zone), zone_idx(zone));
+	return &mz->lists[lru];
+}
+
+/*
+ * An LRU page is linked up with the cgroup it is charged to, or with the
+ * root cgroup while uncharged.  PCG_ACCT_LRU records which one it was, as
+ * pc->mem_cgroup is left behind when the page gets uncharged.
+ */
+static struct mem_cgroup *mem_cgroup_lru_link(struct page *page)
+{
+	struct page_cgroup *pc = lookup_page_cgroup(page);
+
+	VM_BUG_ON(PageCgroupAcctLRU(pc));
+	/*
+	 * Used bit is set without atomic ops but after smp_wmb().
+	 * For making pc->mem_cgroup visible, insert smp_rmb() here.
+	 */
+	smp_rmb();
+	if (PageCgroupUsed(pc)) {
+		SetPageCgroupAcctLRU(pc);
+		return pc->mem_cgroup;
+	}
+	return root_mem_cgroup;
+}
+
+static struct mem_cgroup *mem_cgroup_lru_unlink(struct page *page)
+{
+	struct page_cgroup *pc = lookup_page_cgroup(page);
+
 	/*
 	 * We don't check PCG_USED bit. It's cleared when the "page" is finally
 	 * removed from global LRU.
 	 */
-	mz = page_cgroup_zoneinfo(pc);
-	MEM_CGROUP_ZSTAT(mz, lru) -= 1;
-	if (mem_cgroup_is_root(pc->mem_cgroup))
+	if (TestClearPageCgroupAcctLRU(pc)) {
+		VM_BUG_ON(!pc->mem_cgroup);
+		return pc->mem_cgroup;
+	}
+	return root_mem_cgroup;
+}
+
+/**
+ * mem_cgroup_lru_add_list - account for adding an LRU page
+ * @zone: zone of the page
+ * @page: the page
+ * @lru: the list the page goes on
+ *
+ * Returns the list the caller has to link @page on.
+ */
+struct list_head *mem_cgroup_lru_add_list(struct zone *zone, struct page *page,
+					  enum lru_list lru)
+{
+	struct mem_cgroup_per_zone *mz;
+	struct mem_cgroup *mem;
+
+	if (mem_cgroup_disabled())
+		return &zone->lru[lru].list;
+
+	mem = mem_cgroup_lru_link(page);
+	mz = page_lru_zoneinfo(mem, page);
+	MEM_CGROUP_ZSTAT(mz, lru) += 1;
+	if (mem_cgroup_is_root(mem))
+		return &zone->lru[lru].list;
+	return &mz->lists[lru];
+}
+
+/**
+ * mem_cgroup_lru_del_list - account for removing an LRU page
+ * @page: the page
+ * @lru: the list the page is on
+ *
+ * The caller unlinks @page from its list.
+ */
+void mem_cgroup_lru_del_list(struct page *page, enum lru_list lru)
+{
+	struct mem_cgroup_per_zone *mz;
+
+	if (mem_cgroup_disabled())
 		return;
-	VM_BUG_ON(list_empty(&pc->lru));
-	list_del_init(&pc->lru);
-	return;
+
+	mz = page_lru_zoneinfo(mem_cgroup_lru_unlink(page), page);
+	MEM_CGROUP_ZSTAT(mz, lru) -= 1;
 }
 
-void mem_cgroup_del_lru(struct page *page)
+void mem_cgroup_lru_del(struct page *page)
 {
-	mem_cgroup_del_lru_list(page, page_lru(page));
+	mem_cgroup_lru_del_list(page, page_lru(page));
 }
 
-void mem_cgroup_rotate_lru_list(struct page *page, enum lru_list lru)
+/**
+ * mem_cgroup_lru_move_lists - account for moving a page between LRU lists
+ * @zone: zone of the page
+ * @page: the page
+ * @from: the list the page is on
+ * @to: the list the page goes on
+ *
+ * Returns the list the caller has to move @page to.  This is used for
+ * rotation too (@from == @to): an uncharged page may still sit on the
+ * lists of the cgroup it was charged to, and moves to the zone's then.
+ */
+struct list_head *mem_cgroup_lru_move_lists(struct zone *zone,
+					    struct page *page,
+					    enum lru_list from,
+					    enum lru_list to)
+{
+	mem_cgroup_lru_del_list(page, from);
+	return mem_cgroup_lru_add_list(zone, page, to);
+}
+
+#ifdef CONFIG_LRU_GEN
+/**
+ * mem_cgroup_zone_lru_gen - generations of a cgroup in a zone
+ * @mem: the cgroup, NULL without the memory controller
+ * @zone: the zone
+ *
+ * Like the LRU lists, the root cgroup's generations are the zone's.
+ */
+struct lru_gen_struct *mem_cgroup_zone_lru_gen(struct mem_cgroup *mem,
+					       struct zone *zone)
 {
 	struct mem_cgroup_per_zone *mz;
+
+	if (!mem || mem_cgroup_is_root(mem))
+		return &zone->lrugen;
+
+	mz = mem_cgroup_zoneinfo(mem, zone_to_nid(zone), zone_idx(zone));
+	return &mz->lrugen;
+}
+
+/**
+ * mem_cgroup_page_lru_gen - generations a page is on
+ * @zone: zone of the page
+ * @page: the page, on a generation list
+ *
+ * Must be called with zone->lru_lock held.
+ */
+struct lru_gen_struct *mem_cgroup_page_lru_gen(struct zone *zone,
+					       struct page *page)
+{
 	struct page_cgroup *pc;
 
 	if (mem_cgroup_disabled())
-		return;
+		return &zone->lrugen;
 
 	pc = lookup_page_cgroup(page);
-	/*
-	 * Used bit is set without atomic ops but after smp_wmb().
-	 * For making pc->mem_cgroup visible, insert smp_rmb() here.
-	 */
-	smp_rmb();
-	/* unused or root page is not rotated. */
-	if (!PageCgroupUsed(pc) || mem_cgroup_is_root(pc->mem_cgroup))
-		return;
-	mz = page_cgroup_zoneinfo(pc);
-	list_move(&pc->lru, &mz->lists[lru]);
+	if (!PageCgroupAcctLRU(pc))
+		return &zone->lrugen;
+	return mem_cgroup_zone_lru_gen(pc->mem_cgroup, zone);
 }
 
-void mem_cgroup_add_lru_list(struct page *page, enum lru_list lru)
+/**
+ * mem_cgroup_lru_gen_add - link a page up with a cgroup's generations
+ * @zone: zone of the page
+ * @page: the page
+ *
+ * Returns the generations the caller has to put @page on.  The page is
+ * accounted by mem_cgroup_lru_gen_update_size() once its generation is
+ * known.
+ */
+struct lru_gen_struct *mem_cgroup_lru_gen_add(struct zone *zone,
+					      struct page *page)
+{
+	if (mem_cgroup_disabled())
+		return &zone->lrugen;
+
+	return mem_cgroup_zone_lru_gen(mem_cgroup_lru_link(page), zone);
+}
+
+/**
+ * mem_cgroup_lru_gen_del - unlink a page from a cgroup's generations
+ * @zone: zone of the page
+ * @page: the page
+ *
+ * Returns the generations @page is on.
+ */
+struct lru_gen_struct *mem_cgroup_lru_gen_del(struct zone *zone,
+					      struct page *page)
+{
+	if (mem_cgroup_disabled())
+		return &zone->lrugen;
+
+	return mem_cgroup_zone_lru_gen(mem_cgroup_lru_unlink(page), zone);
+}
+
+/**
+ * mem_cgroup_lru_gen_update_size - account for pages of a generation
+ * @zone: the zone
+ * @lrugen: generations of a cgroup in @zone
+ * @lru: the list the pages are accounted to
+ * @nr: number of pages added, negative when removed
+ */
+void mem_cgroup_lru_gen_update_size(struct zone *zone,
+				    struct lru_gen_struct *lrugen,
+				    enum lru_list lru, int nr)
 {
-	struct page_cgroup *pc;
 	struct mem_cgroup_per_zone *mz;
 
 	if (mem_cgroup_disabled())
 		return;
-	pc = lookup_page_cgroup(page);
-	VM_BUG_ON(PageCgroupAcctLRU(pc));
-	/*
-	 * Used bit is set without atomic ops but after smp_wmb().
-	 * For making pc->mem_cgroup visible, insert smp_rmb() here.
-	 */
-	smp_rmb();
-	if (!PageCgroupUsed(pc))
-		return;
 
-	mz = page_cgroup_zoneinfo(pc);
-	MEM_CGROUP_ZSTAT(mz, lru) += 1;
-	SetPageCgroupAcctLRU(pc);
-	if (mem_cgroup_is_root(pc->mem_cgroup))
+	if (lrugen == &zone->lrugen)
+		mz = mem_cgroup_zoneinfo(root_mem_cgroup, zone_to_nid(zone),
+					 zone_idx(zone));
+	else
+		mz = container_of(lrugen, struct mem_cgroup_per_zone, lrugen);
+	MEM_CGROUP_ZSTAT(mz, lru) += nr;
+}
+#endif
+
+/*
+ * Move an LRU page over to the lists of the cgroup it is charged to now,
+ * or to the root cgroup's.  Must be called with zone->lru_lock held.
+ */
+static void mem_cgroup_lru_relink(struct zone *zone, struct page *page)
+{
+	enum lru_list lru = page_lru(page);
+
+	if (lru_gen_del_page(zone, page, false)) {
+		lru_gen_add_page(zone, page, false);
 		return;
-	list_add(&pc->lru, &mz->lists[lru]);
+	}
+	list_move(&page->lru, mem_cgroup_lru_move_lists(zone, page, lru, lru));
 }
 
 /*
  * At handling SwapCache, pc->mem_cgroup may be changed while it's linked to
  * lru because the page may.be reused after it's fully uncharged (because of
- * SwapCache behavior).To handle that, unlink page_cgroup from LRU when charge
- * it again. This function is only used to charge SwapCache. It's done under
- * lock_page and expected that zone->lru_lock is never held.
+ * SwapCache behavior).To handle that, hand the page to the root cgroup's
+ * lists before charging it again, and move it to the new cgroup's lists
+ * afterwards. These functions are only used to charge SwapCache. It's done
+ * under lock_page and expected that zone->lru_lock is never held.
  */
 static void mem_cgroup_lru_del_before_commit_swapcache(struct page *page)
 {
@@ -804,8 +985,8 @@ static void mem_cgroup_lru_del_before_commit_swapcache(struct page *page)
 	 * Forget old LRU when this page_cgroup is *not* used. This Used bit
 	 * is guarded by lock_page() because the page is SwapCache.
 	 */
-	if (!PageCgroupUsed(pc))
-		mem_cgroup_del_lru_list(page, page_lru(page));
+	if (PageLRU(page) && PageCgroupAcctLRU(pc) && !PageCgroupUsed(pc))
+		mem_cgroup_lru_relink(zone, page);
 	spin_unlock_irqrestore(&zone->lru_lock, flags);
 }
 
@@ -818,18 +999,82 @@ static void mem_cgroup_lru_add_after_commit_swapcache(struct page *page)
 	spin_lock_irqsave(&zone->lru_lock, flags);
 	/* link when the page is linked to LRU but page_cgroup isn't */
 	if (PageLRU(page) && !PageCgroupAcctLRU(pc))
-		mem_cgroup_add_lru_list(page, page_lru(page));
+		mem_cgroup_lru_relink(zone, page);
 	spin_unlock_irqrestore(&zone->lru_lock, flags);
 }
 
+/*
+ * Global reclaim walks all cgroups in each zone.  A walk starts where the
+ * previous one in the same zone stopped, so reclaimers that bail out
+ * early don't keep picking on the cgroups with the lowest ids.
+ */
 
-void mem_cgroup_move_lists(struct page *page,
-			   enum lru_list from, enum lru_list to)
+/**
+ * mem_cgroup_reclaim_iter - walk all cgroups for global reclaim
+ * @prev: cgroup returned by the previous call, NULL to start a walk
+ * @walk: walk state, with ->zone set by the caller
+ *
+ * Returns the next cgroup with a reference held, or NULL after the last
+ * one.  The reference on @prev is dropped.  Returns NULL right away when
+ * the memory controller is disabled.
+ */
+struct mem_cgroup *mem_cgroup_reclaim_iter(struct mem_cgroup *prev,
+					   struct mem_cgroup_reclaim_walk *walk)
 {
+	struct mem_cgroup_per_zone *root_mz;
+	struct cgroup_subsys_state *css;
+	struct mem_cgroup *mem = NULL;
+	int id, found;
+
 	if (mem_cgroup_disabled())
-		return;
-	mem_cgroup_del_lru_list(page, from);
-	mem_cgroup_add_lru_list(page, to);
+		return NULL;
+
+	root_mz = mem_cgroup_zoneinfo(root_mem_cgroup,
+				      zone_to_nid(walk->zone),
+				      zone_idx(walk->zone));
+	if (!prev) {
+		id = walk->start = root_mz->last_scanned_id;
+		walk->wrapped = false;
+	} else {
+		id = css_id(&prev->css) + 1;
+		css_put(&prev->css);
+	}
+
+	while (!mem) {
+		rcu_read_lock();
+		css = css_get_next(&mem_cgroup_subsys, id,
+				   &root_mem_cgroup->css, &found);
+		if (!css) {
+			rcu_read_unlock();
+			if (walk->wrapped)
+				break;
+			walk->wrapped = true;
+			id = 1;
+			continue;
+		}
+		if (walk->wrapped && found >= walk->start) {
+			rcu_read_unlock();
+			break;
+		}
+		if (css_tryget(css))
+			mem = container_of(css, struct mem_cgroup, css);
+		rcu_read_unlock();
+		id = found + 1;
+	}
+
+	if (mem)
+		root_mz->last_scanned_id = id;
+	return mem;
+}
+
+/**
+ * mem_cgroup_reclaim_iter_break - abort a walk
+ * @mem: the last cgroup returned by mem_cgroup_reclaim_iter()
+ */
+void mem_cgroup_reclaim_iter_break(struct mem_cgroup *mem)
+{
+	if (mem)
+		css_put(&mem->css);
 }
 
 int task_in_mem_cgroup(struct task_struct *task, const struct mem_cgroup *mem)
@@ -986,61 +1231,6 @@ mem_cgroup_get_reclaim_stat_from_page(struct page *page)
 	return &mz->reclaim_stat;
 }
 
-unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
-					struct list_head *dst,
-					unsigned long *scanned, int order,
-					int mode, struct zone *z,
-					struct mem_cgroup *mem_cont,
-					int active, int file)
-{
-	unsigned long nr_taken = 0;
-	struct page *page;
-	unsigned long scan;
-	LIST_HEAD(pc_list);
-	struct list_head *src;
-	struct page_cgroup *pc, *tmp;
-	int nid = z->zone_pgdat->node_id;
-	int zid = zone_idx(z);
-	struct mem_cgroup_per_zone *mz;
-	int lru = LRU_FILE * file + active;
-	int ret;
-
-	BUG_ON(!mem_cont);
-	mz = mem_cgroup_zoneinfo(mem_cont, nid, zid);
-	src = &mz->lists[lru];
-
-	scan = 0;
-	list_for_each_entry_safe_reverse(pc, tmp, src, lru) {
-		if (scan >= nr_to_scan)
-			break;
-
-		page = pc->page;
-		if (unlikely(!PageCgroupUsed(pc)))
-			continue;
-		if (unlikely(!PageLRU(page)))
-			continue;
-
-		scan++;
-		ret = __isolate_lru_page(page, mode, file);
-		switch (ret) {
-		case 0:
-			list_move(&page->lru, dst);
-			mem_cgroup_del_lru(page);
-			nr_taken++;
-			break;
-		case -EBUSY:
-			/* we don't affect global LRU but rotate in our LRU */
-			mem_cgroup_rotate_lru_list(page, page_lru(page));
-			break;
-		default:
-			break;
-		}
-	}
-
-	*scanned = scan;
-	return nr_taken;
-}
-
 #define mem_cgroup_from_res_counter(counter, member)	\
 	container_of(counter, struct mem_cgroup, member)
 
@@ -1207,15 +1397,19 @@ mem_cgroup_select_victim(struct mem_cgroup *root_mem)
  * (other groups can be removed while we're walking....)
  *
  * If shrink==true, for avoiding to free too much, this returns immedieately.
+ *
+ * Soft limit reclaim adds the number of pages it scanned to *total_scanned.
  */
 static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 						struct zone *zone,
 						gfp_t gfp_mask,
-						unsigned long reclaim_options)
+						unsigned long reclaim_options,
+						unsigned long *total_scanned)
 {
 	struct mem_cgroup *victim;
 	int ret, total = 0;
 	int loop = 0;
+	unsigned long nr_scanned;
 	bool noswap = reclaim_options & MEM_CGROUP_RECLAIM_NOSWAP;
 	bool shrink = reclaim_options & MEM_CGROUP_RECLAIM_SHRINK;
 	bool check_soft = reclaim_options & MEM_CGROUP_RECLAIM_SOFT;
@@ -1260,11 +1454,12 @@ static int mem_cgroup_hierarchical_reclaim(struct mem_cgroup *root_mem,
 			continue;
 		}
 		/* we use swappiness of local cgroup */
-		if (check_soft)
+		if (check_soft) {
 			ret = mem_cgroup_shrink_node_zone(victim, gfp_mask,
 				noswap, get_swappiness(victim), zone,
-				zone->zone_pgdat->node_id);
-		else
+				zone->zone_pgdat->node_id, &nr_scanned);
+			*total_scanned += nr_scanned;
+		} else
 			ret = try_to_free_mem_cgroup_pages(victim, gfp_mask,
 						noswap, get_swappiness(victim));
 		css_put(&victim->css);
@@ -1656,7 +1851,7 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 			goto nomem;
 
 		ret = mem_cgroup_hierarchical_reclaim(mem_over_limit, NULL,
-						gfp_mask, flags);
+						gfp_mask, flags, NULL);
 		if (ret)
 			continue;
 
@@ -1832,7 +2027,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
 	 * Especially when a page_cgroup is taken from a page, pc->mem_cgroup
 	 * is accessed after testing USED bit. To make pc->mem_cgroup visible
 	 * before USED bit, we need memory barrier here.
-	 * See mem_cgroup_add_lru_list(), etc.
+	 * See mem_cgroup_lru_add_list(), etc.
  	 */
 	smp_wmb();
 	switch (ctype) {
@@ -2717,7 +2912,8 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 			break;
 
 		mem_cgroup_hierarchical_reclaim(memcg, NULL, GFP_KERNEL,
-						MEM_CGROUP_RECLAIM_SHRINK);
+						MEM_CGROUP_RECLAIM_SHRINK,
+						NULL);
 		curusage = res_counter_read_u64(&memcg->res, RES_USAGE);
 		/* Usage is reduced ? */
   		if (curusage >= oldusage)
@@ -2777,7 +2973,8 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 
 		mem_cgroup_hierarchical_reclaim(memcg, NULL, GFP_KERNEL,
 						MEM_CGROUP_RECLAIM_NOSWAP |
-						MEM_CGROUP_RECLAIM_SHRINK);
+						MEM_CGROUP_RECLAIM_SHRINK,
+						NULL);
 		curusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
 		/* Usage is reduced ? */
 		if (curusage >= oldusage)
@@ -2790,9 +2987,15 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 	return ret;
 }
 
+/*
+ * Reclaim from the cgroups that exceed their soft limit the most, on
+ * behalf of kswapd balancing @zone.  Returns the number of pages
+ * reclaimed and adds the number scanned to *total_scanned.
+ */
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask, int nid,
-						int zid)
+						int zid,
+						unsigned long *total_scanned)
 {
 	unsigned long nr_reclaimed = 0;
 	struct mem_cgroup_per_zone *mz, *next_mz = NULL;
@@ -2820,7 +3023,8 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 
 		reclaimed = mem_cgroup_hierarchical_reclaim(mz->mem, zone,
 						gfp_mask,
-						MEM_CGROUP_RECLAIM_SOFT);
+						MEM_CGROUP_RECLAIM_SOFT,
+						total_scanned);
 		nr_reclaimed += reclaimed;
 		spin_lock(&mctz->lock);
 
@@ -2886,20 +3090,16 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
  * *And* this routine doesn't reclaim page itself, just removes page_cgroup.
  */
 static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
-				int node, int zid, enum lru_list lru)
+				int node, int zid, struct list_head *list,
+				unsigned long loop)
 {
 	struct zone *zone;
-	struct mem_cgroup_per_zone *mz;
-	struct page_cgroup *pc, *busy;
-	unsigned long flags, loop;
-	struct list_head *list;
+	struct page_cgroup *pc;
+	struct page *page, *busy;
+	unsigned long flags;
 	int ret = 0;
 
 	zone = &NODE_DATA(node)->node_zones[zid];
-	mz = mem_cgroup_zoneinfo(mem, node, zid);
-	list = &mz->lists[lru];
-
-	loop = MEM_CGROUP_ZSTAT(mz, lru);
 	/* give some margin against EBUSY etc...*/
 	loop += 256;
 	busy = NULL;
@@ -2910,13 +3110,23 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 			spin_unlock_irqrestore(&zone->lru_lock, flags);
 			break;
 		}
-		pc = list_entry(list->prev, struct page_cgroup, lru);
-		if (busy == pc) {
-			list_move(&pc->lru, list);
+		page = list_entry(list->prev, struct page, lru);
+		pc = lookup_page_cgroup(page);
+		if (busy == page) {
+			list_move(&page->lru, list);
 			busy = NULL;
 			spin_unlock_irqrestore(&zone->lru_lock, flags);
 			continue;
 		}
+		/*
+		 * Uncharged pages linger on our lists until they are freed,
+		 * hand them over to the root cgroup.
+		 */
+		if (!PageCgroupUsed(pc)) {
+			mem_cgroup_lru_relink(zone, page);
+			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			continue;
+		}
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
 
 		ret = mem_cgroup_move_parent(pc, mem, GFP_KERNEL);
@@ -2925,7 +3135,7 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 
 		if (ret == -EBUSY || ret == -EINVAL) {
 			/* found lock contention or "pc" is obsolete. */
-			busy = pc;
+			busy = page;
 			cond_resched();
 		} else
 			busy = NULL;
@@ -2936,6 +3146,40 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 	return ret;
 }
 
+/*
+ * Empty all lists of a cgroup in a zone.  They are always empty for the
+ * root cgroup, its pages are on the zone lists.
+ */
+static int mem_cgroup_force_empty_zone(struct mem_cgroup *mem,
+				       int node, int zid)
+{
+	struct mem_cgroup_per_zone *mz = mem_cgroup_zoneinfo(mem, node, zid);
+	enum lru_list l;
+	int ret;
+#ifdef CONFIG_LRU_GEN
+	int gen, type;
+#endif
+
+	for_each_lru(l) {
+		ret = mem_cgroup_force_empty_list(mem, node, zid,
+				&mz->lists[l], MEM_CGROUP_ZSTAT(mz, l));
+		if (ret)
+			return ret;
+	}
+#ifdef CONFIG_LRU_GEN
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < 2; type++) {
+			ret = mem_cgroup_force_empty_list(mem, node, zid,
+					&mz->lrugen.lists[gen][type],
+					mz->lrugen.nr_pages[gen][type]);
+			if (ret)
+				return ret;
+		}
+	}
+#endif
+	return 0;
+}
+
 /*
  * make mem_cgroup's charge to be 0 if there is no task.
  * This enables deleting this mem_cgroup.
@@ -2966,15 +3210,9 @@ move_account:
 		drain_all_stock_sync();
 		ret = 0;
 		for_each_node_state(node, N_HIGH_MEMORY) {
-			for (zid = 0; !ret && zid < MAX_NR_ZONES; zid++) {
-				enum lru_list l;
-				for_each_lru(l) {
-					ret = mem_cgroup_force_empty_list(mem,
-							node, zid, l);
-					if (ret)
-						break;
-				}
-			}
+			for (zid = 0; !ret && zid < MAX_NR_ZONES; zid++)
+				ret = mem_cgroup_force_empty_zone(mem, node,
+								  zid);
 			if (ret)
 				break;
 		}
@@ -3922,6 +4160,9 @@ static int alloc_mem_cgroup_per_zone_info(struct mem_cgroup *mem, int node)
 		mz = &pn->zoneinfo[zone];
 		for_each_lru(l)
 			INIT_LIST_HEAD(&mz->lists[l]);
+#ifdef CONFIG_LRU_GEN
+		lru_gen_init(&mz->lrugen);
+#endif
 		mz->usage_in_excess = 0;
 		mz->on_tree = false;
 		mz->mem = mem;
@@ -4358,6 +4599,8 @@ static int mem_cgroup_count_precharge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, addr, pmd);
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE)
 		if (is_target_pte_for_mc(vma, addr, *pte, NULL))
@@ -4502,6 +4745,7 @@ static int mem_cgroup_move_charge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
+	split_huge_page_pmd(walk->mm, addr, pmd);
 retry:
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; addr += PAGE_SIZE) {
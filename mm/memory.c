@@ -57,6 +57,9 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/file.h>
+#include <linux/mempolicy.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -797,6 +800,17 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 	src_pmd = pmd_offset(src_pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		if (pmd_trans_huge(*src_pmd)) {
+			int err;
+			VM_BUG_ON(next-addr != HPAGE_PMD_SIZE);
+			err = copy_huge_pmd(dst_mm, src_mm,
+					    dst_pmd, src_pmd, addr, vma);
+			if (err == -ENOMEM)
+				return -ENOMEM;
+			if (!err)
+				continue;
+			/* fall through */
+		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
@@ -903,6 +917,7 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	init_rss_vec(rss);
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -999,7 +1014,20 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		if (pmd_trans_huge(*pmd)) {
+			if (next-addr != HPAGE_PMD_SIZE)
+				split_huge_page_pmd(vma->vm_mm, addr, pmd);
+			else if (zap_huge_pmd(tlb, vma, pmd, addr)) {
+				(*zap_work) -= HPAGE_PMD_SIZE;
+				continue;
+			}
+			/* fall through */
+		}
+		/*
+		 * MADV_DONTNEED only holds mmap_sem for reading: a huge pmd
+		 * faulted in meanwhile must be skipped, not cleared as bad.
+		 */
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd)) {
 			(*zap_work)--;
 			continue;
 		}
@@ -1083,7 +1111,8 @@ static unsigned long unmap_page_range(struct mmu_gather *tlb,
  * Unmap all pages in the vma list.
  *
  * We aim to not hold locks for too long (for scheduling latency reasons).
- * So zap pages in ZAP_BLOCK_SIZE bytecounts.  This means we need to
+ * So zap pages in ZAP_BLOCK_SIZE bytecounts, and give up the mmu_gather
+ * between blocks when we need to reschedule.  This means we need to
  * return the ending mmu_gather to the caller.
  *
  * Only addresses between `start' and `end' will be unmapped.
@@ -1159,20 +1188,25 @@ unsigned long unmap_vmas(struct mmu_gather **tlbp,
 				break;
 			}
 
-			tlb_finish_mmu(*tlbp, tlb_start, start);
-
+			/*
+			 * Only finish the gather, which flushes the TLB on
+			 * every cpu of the mm, when we must let go of the
+			 * cpu or the lock: tlb_remove_page() flushes by
+			 * itself once the gather fills, and flushing every
+			 * block would just multiply the shootdown IPIs.
+			 */
+			zap_work = ZAP_BLOCK_SIZE;
 			if (need_resched() ||
 				(i_mmap_lock && spin_needbreak(i_mmap_lock))) {
+				tlb_finish_mmu(*tlbp, tlb_start, start);
 				if (i_mmap_lock) {
 					*tlbp = NULL;
 					goto out;
 				}
 				cond_resched();
+				*tlbp = tlb_gather_mmu(vma->vm_mm, fullmm);
+				tlb_start_valid = 0;
 			}
-
-			*tlbp = tlb_gather_mmu(vma->vm_mm, fullmm);
-			tlb_start_valid = 0;
-			zap_work = ZAP_BLOCK_SIZE;
 		}
 	}
 out:
@@ -1275,11 +1309,26 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	pmd = pmd_offset(pud, address);
 	if (pmd_none(*pmd))
 		goto no_page_table;
-	if (pmd_huge(*pmd)) {
+	if (pmd_huge(*pmd) && vma->vm_flags & VM_HUGETLB) {
 		BUG_ON(flags & FOLL_GET);
 		page = follow_huge_pmd(mm, address, pmd, flags & FOLL_WRITE);
 		goto out;
 	}
+	if (pmd_trans_huge(*pmd)) {
+		if (flags & FOLL_SPLIT) {
+			split_huge_page_pmd(mm, address, pmd);
+			goto split_fallthrough;
+		}
+		spin_lock(&mm->page_table_lock);
+		if (likely(pmd_trans_huge(*pmd))) {
+			page = follow_trans_huge_pmd(vma, address, pmd, flags);
+			spin_unlock(&mm->page_table_lock);
+			goto out;
+		}
+		spin_unlock(&mm->page_table_lock);
+		/* fall through */
+	}
+split_fallthrough:
 	if (unlikely(pmd_bad(*pmd)))
 		goto no_page_table;
 
@@ -3184,6 +3233,68 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting fault on a pte that change_prot_numa() made PROT_NONE.
+ * Make the pte accessible again, migrate the page to this node if it
+ * belongs here, and account the fault to the node the page is on.
+ *
+ * We enter with non-exclusive mmap_sem (to exclude vma changes,
+ * but allow concurrent faults), and pte mapped but not yet locked.
+ * We return with mmap_sem still held, but pte unmapped and unlocked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *page_table, pmd_t *pmd,
+		pte_t orig_pte)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t pte;
+	int page_nid, target_nid;
+	int migrated = 0;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*page_table, orig_pte))) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	count_vm_event(NUMA_HINT_FAULTS);
+
+	/* change_prot_numa() kept the write bit in the PROT_NONE pte */
+	pte = pte_modify(orig_pte, vma->vm_page_prot);
+	if (pte_write(orig_pte))
+		pte = pte_mkwrite(pte);
+	pte = pte_mkyoung(pte);
+	set_pte_at(mm, address, page_table, pte);
+	update_mmu_cache(vma, address, page_table);
+
+	page = vm_normal_page(vma, address, pte);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(page_table, ptl);
+
+	page_nid = page_to_nid(page);
+	if (page_nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	target_nid = mpol_misplaced(page, vma, address);
+	if (target_nid != -1) {
+		migrated = migrate_misplaced_page(page, target_nid);
+		if (migrated)
+			page_nid = target_nid;
+	} else
+		put_page(page);
+
+	task_numa_fault(page_nid, 1, migrated);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3222,6 +3333,12 @@ static inline int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+#ifdef CONFIG_NUMA_BALANCING
+	if (pte_protnone(entry) &&
+	    (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+#endif
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3278,13 +3395,399 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	pte = pte_alloc_map(mm, pmd, address);
-	if (!pte)
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma) &&
+	    !vma->vm_ops) {
+		int ret = do_huge_pmd_anonymous_page(mm, vma, address,
+						     pmd, flags);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	} else {
+		pmd_t orig_pmd = *pmd;
+		barrier();
+		if (pmd_trans_huge(orig_pmd)) {
+			if (flags & FAULT_FLAG_WRITE &&
+			    !pmd_write(orig_pmd) &&
+			    pmd_present(orig_pmd)) {
+				int ret = do_huge_pmd_wp_page(mm, vma, address,
+							      pmd, orig_pmd);
+				if (!(ret & VM_FAULT_FALLBACK))
+					return ret;
+			} else
+				return 0;
+		}
+	}
+
+	/*
+	 * Use __pte_alloc instead of pte_alloc_map, because we can't
+	 * run pte_offset_map on the pmd, if an huge pmd could
+	 * materialize from under us from a different thread.
+	 */
+	if (unlikely(pmd_none(*pmd)) && __pte_alloc(mm, pmd, address))
 		return VM_FAULT_OOM;
+	/* if an huge pmd materialized from under us just retry later */
+	if (unlikely(pmd_trans_huge(*pmd)))
+		return 0;
+	/*
+	 * A regular pmd is established and it can't morph into a huge pmd
+	 * from under us anymore at this point because we hold the mmap_sem
+	 * read mode and khugepaged takes it in write mode. So now it's
+	 * safe to run pte_offset_map().
+	 */
+	pte = pte_offset_map(pmd, address);
 
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * handle_speculative_fault() handles the faults that only need a new pte,
+ * of anonymous memory or of page cache, without the mmap_sem.  The vma is
+ * looked up in the rbtree locklessly and copied while its sequence count
+ * says nobody is changing it: vmas are freed after an RCU grace period, so
+ * neither the lookup nor the copy can touch freed memory.  The page tables
+ * are walked with interrupts disabled, which holds off the TLB flush that
+ * precedes freeing them, as get_user_pages_fast() does.
+ *
+ * Right before installing the pte, the vma is checked again under the pte
+ * lock.  Whoever changes a vma bumps its sequence count before going for
+ * the page tables under the pte lock, and munmap unlinks the vma from the
+ * rbtree before zapping its range; either way, the check catches it.
+ *
+ * Everything else, and any change to the vma in the meantime, returns
+ * VM_FAULT_RETRY so that the caller takes the mmap_sem and faults the
+ * usual way.
+ */
+
+/* An rbtree of vmas is never this deep: give up on a lookup that is */
+#define SPF_MAX_DEPTH	(2 * BITS_PER_LONG)
+
+static struct vm_area_struct *spf_find_vma(struct mm_struct *mm,
+					   unsigned long address)
+{
+	struct rb_node *rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	int depth = 0;
+
+	while (rb_node && depth++ < SPF_MAX_DEPTH) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (ACCESS_ONCE(vma->vm_end) <= address)
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+		else if (ACCESS_ONCE(vma->vm_start) > address)
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/* Has @vma changed, or been unmapped, since @seq was read? */
+static inline bool spf_vma_changed(struct vm_area_struct *vma,
+				   unsigned int seq)
+{
+	return read_seqcount_retry(&vma->vm_sequence, seq) ||
+		RB_EMPTY_NODE(&vma->vm_rb);
+}
+
+/*
+ * Find the vma covering @address and copy it to @copy.  Returns the vma
+ * itself, to check against later, with a reference held on the file it
+ * maps, if any.
+ */
+static struct vm_area_struct *spf_get_vma(struct mm_struct *mm,
+					  unsigned long address,
+					  struct vm_area_struct *copy,
+					  unsigned int *seq)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	vma = spf_find_vma(mm, address);
+	if (!vma)
+		goto fail;
+
+	*seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (*seq & 1)
+		goto fail;
+	*copy = *vma;
+	if (spf_vma_changed(vma, *seq))
+		goto fail;
+
+	/* files are freed by RCU too */
+	if (copy->vm_file &&
+	    !atomic_long_inc_not_zero(&copy->vm_file->f_count))
+		goto fail;
+	rcu_read_unlock();
+	return vma;
+
+fail:
+	rcu_read_unlock();
+	return NULL;
+}
+
+/* Is this a fault we know how to handle speculatively? */
+static bool spf_vma_ok(struct vm_area_struct *vma, unsigned long address,
+		       unsigned int flags)
+{
+	if (address < vma->vm_start || address >= vma->vm_end)
+		return false;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			return false;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		return false;
+
+	/* stack guard pages and nonlinear ptes need the mmap_sem */
+	if (vma->vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_NONLINEAR))
+		return false;
+	if (is_vm_hugetlb_page(vma))
+		return false;
+#ifdef CONFIG_NUMA
+	/* the vma's own policy is not pinned without the mmap_sem */
+	if (vma->vm_policy)
+		return false;
+#endif
+	if (!vma->vm_ops)
+		return true;
+
+	/* Page cache: read faults only, no ->page_mkwrite or COW */
+	return vma->vm_ops->fault == filemap_fault &&
+		!(flags & FAULT_FLAG_WRITE);
+}
+
+/*
+ * Map and lock the pte for @address, if the page table is there and the
+ * vma has not changed.  Returns NULL otherwise.
+ */
+static pte_t *spf_pte_map_lock(struct mm_struct *mm,
+			       struct vm_area_struct *vma, unsigned int seq,
+			       unsigned long address, spinlock_t **ptlp)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte;
+	spinlock_t *ptl;
+
+	/*
+	 * With interrupts disabled, the page tables can't be freed under
+	 * us.  Only trylock the pte lock: its holder may be waiting for us
+	 * to answer a TLB flush IPI.
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	/* huge pmds, and missing page tables, are for handle_mm_fault() */
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out;
+
+	ptl = pte_lockptr(mm, &pmdval);
+	pte = pte_offset_map(&pmdval, address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out;
+	}
+	if (pmd_val(*pmd) != pmd_val(pmdval) || spf_vma_changed(vma, seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+	local_irq_enable();
+	*ptlp = ptl;
+	return pte;
+
+out:
+	local_irq_enable();
+	return NULL;
+}
+
+/* do_anonymous_page() on a copy of the vma */
+static int spf_anonymous_page(struct mm_struct *mm,
+			      struct vm_area_struct *vma,
+			      struct vm_area_struct *orig, unsigned int seq,
+			      unsigned long address, unsigned int flags)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	pte_t entry;
+
+	/* Use the zero-page for reads */
+	if (!(flags & FAULT_FLAG_WRITE)) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						vma->vm_page_prot));
+		page_table = spf_pte_map_lock(mm, orig, seq, address, &ptl);
+		if (!page_table)
+			return VM_FAULT_RETRY;
+		if (!pte_none(*page_table))
+			goto unlock;
+		goto setpte;
+	}
+
+	/* anon_vma_prepare() needs the mmap_sem */
+	if (!vma->anon_vma)
+		return VM_FAULT_RETRY;
+	page = alloc_zeroed_user_highpage_movable(vma, address);
+	if (!page)
+		return VM_FAULT_RETRY;
+	__SetPageUptodate(page);
+
+	if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
+
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (vma->vm_flags & VM_WRITE)
+		entry = pte_mkwrite(pte_mkdirty(entry));
+
+	page_table = spf_pte_map_lock(mm, orig, seq, address, &ptl);
+	if (!page_table) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
+	if (!pte_none(*page_table))
+		goto release;
+
+	inc_mm_counter_fast(mm, MM_ANONPAGES);
+	page_add_new_anon_rmap(page, vma, address);
+setpte:
+	set_pte_at(mm, address, page_table, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, page_table);
+unlock:
+	pte_unmap_unlock(page_table, ptl);
+	return 0;
+release:
+	pte_unmap_unlock(page_table, ptl);
+	mem_cgroup_uncharge_page(page);
+	page_cache_release(page);
+	return 0;
+}
+
+/* The read fault side of __do_fault() on a copy of the vma */
+static int spf_read_fault(struct mm_struct *mm, struct vm_area_struct *vma,
+			  struct vm_area_struct *orig, unsigned int seq,
+			  unsigned long address, unsigned int flags)
+{
+	struct vm_fault vmf;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	int ret;
+
+	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
+	vmf.pgoff = (((address & PAGE_MASK) - vma->vm_start) >> PAGE_SHIFT) +
+		vma->vm_pgoff;
+	vmf.flags = flags;
+	vmf.page = NULL;
+
+	ret = vma->vm_ops->fault(vma, &vmf);
+	/* Let the regular path sort out errors, with an up to date vma */
+	if (unlikely(ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE)))
+		return VM_FAULT_RETRY;
+
+	page = vmf.page;
+	if (unlikely(!(ret & VM_FAULT_LOCKED)))
+		lock_page(page);
+	if (unlikely(PageHWPoison(page))) {
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
+
+	page_table = spf_pte_map_lock(mm, orig, seq, address, &ptl);
+	if (!page_table) {
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
+	if (likely(pte_none(*page_table))) {
+		flush_icache_page(vma, page);
+		inc_mm_counter_fast(mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+		set_pte_at(mm, address, page_table,
+			   mk_pte(page, vma->vm_page_prot));
+
+		/* no need to invalidate: a not-present page won't be cached */
+		update_mmu_cache(vma, address, page_table);
+		pte_unmap_unlock(page_table, ptl);
+		unlock_page(page);
+		return ret;
+	}
+	pte_unmap_unlock(page_table, ptl);
+out:
+	unlock_page(page);
+	page_cache_release(page);
+	return ret;
+}
+
+/**
+ * handle_speculative_fault - handle a page fault without the mmap_sem
+ * @mm: the faulting mm, current's
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx flags
+ *
+ * Returns VM_FAULT_RETRY if the fault has to be handled by
+ * handle_mm_fault() under the mmap_sem, and never an error.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct vma, *orig;
+	unsigned int seq;
+	spinlock_t *ptl;
+	pte_t *pte;
+	pte_t entry;
+	int ret = VM_FAULT_RETRY;
+
+	orig = spf_get_vma(mm, address, &vma, &seq);
+	if (!orig)
+		goto out;
+	if (!spf_vma_ok(&vma, address, flags))
+		goto out_put;
+
+	/* Only faults on an empty pte are handled here */
+	pte = spf_pte_map_lock(mm, orig, seq, address, &ptl);
+	if (!pte)
+		goto out_put;
+	entry = *pte;
+	pte_unmap_unlock(pte, ptl);
+	if (!pte_none(entry))
+		goto out_put;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	if (vma.vm_ops)
+		ret = spf_read_fault(mm, &vma, orig, seq, address, flags);
+	else
+		ret = spf_anonymous_page(mm, &vma, orig, seq, address, flags);
+
+out_put:
+	if (vma.vm_file)
+		fput(vma.vm_file);
+out:
+	if (ret & VM_FAULT_RETRY)
+		count_vm_event(SPF_ABORT);
+	else {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPF_FAULT);
+	}
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -514,7 +514,8 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		split_huge_page_pmd(vma->vm_mm, addr, pmd);
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
 				    flags, private))
@@ -2213,6 +2214,56 @@ void numa_default_policy(void)
 	do_set_mempolicy(MPOL_DEFAULT, 0, NULL);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Turn the ptes of [addr, end) into NUMA hinting ptes: PROT_NONE ptes
+ * in a vma that allows access.  The next touch of each page takes a
+ * fault into do_numa_page(), which restores the pte and tells us which
+ * node the page is used from.  Returns the number of ptes changed.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end)
+{
+	unsigned long nr_updated;
+
+	nr_updated = change_protection(vma, addr, end, PAGE_NONE, 0, 1);
+	if (nr_updated)
+		count_vm_events(NUMA_PTE_UPDATES, nr_updated);
+
+	return nr_updated;
+}
+
+/**
+ * mpol_misplaced - check whether a page should move to the faulting node
+ * @page: page taking a NUMA hinting fault
+ * @vma: vm area where the page is mapped
+ * @addr: virtual address where the page is mapped
+ *
+ * Only memory under the default, local allocation policy is moved: a
+ * page placed by an explicit policy stays where the policy put it.
+ *
+ * Returns the node the page should be migrated to, or -1 to leave it.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int thisnid = numa_node_id();
+	int ret = -1;
+
+	if (page_to_nid(page) == thisnid)
+		return -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol->mode == MPOL_PREFERRED && (pol->flags & MPOL_F_LOCAL) &&
+	    node_isset(thisnid, cpuset_current_mems_allowed))
+		ret = thisnid;
+	mpol_cond_put(pol);
+
+	return ret;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Parse and format mempolicy from/to strings
  */
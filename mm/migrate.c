@@ -1155,4 +1155,81 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	}
  	return err;
 }
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Only migrate misplaced pages to a node that has them to spare: taking
+ * it below its high watermark would just have kswapd push pages back.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   int nr_migrate_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone->all_unreclaimable)
+			continue;
+		if (!zone_watermark_ok(zone, 0,
+				       high_wmark_pages(zone) + nr_migrate_pages,
+				       0, 0))
+			continue;
+		return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data, int **result)
+{
+	int nid = (int)data;
+
+	return alloc_pages_exact_node(nid,
+				(GFP_HIGHUSER_MOVABLE | GFP_THISNODE |
+				 __GFP_NOMEMALLOC) & ~GFP_IOFS, 0);
+}
+
+/*
+ * Move a page that took a NUMA hinting fault to @node.  This runs from
+ * the fault, so a single attempt is made, without waiting for the page
+ * lock or writeback: if the page stays behind it faults again on the
+ * next scan.  The caller's reference on the page is dropped.
+ *
+ * Returns 1 if the page was migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int migrated = 0;
+
+	/*
+	 * A page mapped by more than one process may well be used from
+	 * more than one node: don't bounce it between them.
+	 */
+	if (page_mapcount(page) != 1)
+		goto out;
+	if (!migrate_balanced_pgdat(NODE_DATA(node), 1))
+		goto out;
+	if (isolate_lru_page(page))
+		goto out;
+
+	list_add(&page->lru, &migratepages);
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	put_page(page);
+
+	if (!unmap_and_move(alloc_misplaced_dst_page, node, page, 0, 0)) {
+		count_vm_event(NUMA_PAGE_MIGRATE);
+		migrated = 1;
+	}
+	putback_lru_pages(&migratepages);
+	return migrated;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
 #endif
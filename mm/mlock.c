@@ -325,7 +325,9 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
 	unsigned long addr;
 
 	lru_add_drain();
+	vm_write_begin(vma);
 	vma->vm_flags &= ~VM_LOCKED;
+	vm_write_end(vma);
 
 	for (addr = start; addr < end; addr += PAGE_SIZE) {
 		struct page *page;
@@ -420,7 +422,9 @@ success:
 	 */
 
 	if (lock) {
+		vm_write_begin(vma);
 		vma->vm_flags = newflags;
+		vm_write_end(vma);
 		ret = __mlock_vma_pages_range(vma, start, end);
 		if (ret < 0)
 			ret = __mlock_posix_error_return(ret);
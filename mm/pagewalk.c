@@ -34,17 +34,27 @@ static int walk_pmd_range(pud_t *pud, unsigned long addr, unsigned long end,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		if (pmd_none(*pmd) ||
+		    (!pmd_trans_huge(*pmd) && pmd_none_or_clear_bad(pmd))) {
 			if (walk->pte_hole)
 				err = walk->pte_hole(addr, next, walk);
 			if (err)
 				break;
 			continue;
 		}
+		/*
+		 * ->pmd_entry() handlers see transparent huge pmds as they
+		 * are and must cope with them; only split when we have to
+		 * walk the ptes ourselves.
+		 */
 		if (walk->pmd_entry)
 			err = walk->pmd_entry(pmd, addr, next, walk);
-		if (!err && walk->pte_entry)
+		if (!err && walk->pte_entry) {
+			split_huge_page_pmd(walk->mm, addr, pmd);
+			if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+				continue;
 			err = walk_pte_range(pmd, addr, next, walk);
+		}
 		if (err)
 			break;
 	} while (pmd++, addr = next, addr != end);
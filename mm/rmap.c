@@ -378,6 +378,8 @@ pte_t *page_check_address(struct page *page, struct mm_struct *mm,
 		return NULL;
 
 	pmd = pmd_offset(pud, address);
+	/* A transparent huge pmd has to be split to be looked into */
+	split_huge_page_pmd(mm, address, pmd);
 	if (!pmd_present(*pmd))
 		return NULL;
 
@@ -437,6 +439,47 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int referenced = 0;
 
+	/*
+	 * Look at the young bit of a transparent huge pmd directly rather
+	 * than splitting it through page_check_address().
+	 */
+	if (PageAnon(page)) {
+		pmd_t *pmd = page_check_address_pmd(page, mm, address);
+		int young;
+
+		if (pmd) {
+			if (vma->vm_flags & VM_LOCKED) {
+				spin_unlock(&mm->page_table_lock);
+				*mapcount = 1;	/* break early from loop */
+				*vm_flags |= VM_LOCKED;
+				goto out;
+			}
+			/*
+			 * All subpages share the pmd's young bit but sit
+			 * on the LRU one by one.  Credit the reference to
+			 * each of them when the bit is cleared, so the
+			 * others don't look cold on their own scans.
+			 */
+			young = pmdp_clear_flush_young_notify(vma,
+					address & HPAGE_PMD_MASK, pmd);
+			if (likely(!VM_SequentialReadHint(vma))) {
+				if (young) {
+					struct page *subpage = pmd_page(*pmd);
+					int i;
+
+					for (i = 0; i < HPAGE_PMD_NR;
+					     i++, subpage++)
+						if (subpage != page)
+							SetPageReferenced(subpage);
+					referenced++;
+				} else if (TestClearPageReferenced(page))
+					referenced++;
+			}
+			spin_unlock(&mm->page_table_lock);
+			goto out_swap_token;
+		}
+	}
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
@@ -463,21 +506,26 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		if (likely(!VM_SequentialReadHint(vma)))
 			referenced++;
 	}
+	pte_unmap_unlock(pte, ptl);
 
+out_swap_token:
 	/* Pretend the page is referenced if the task has the
 	   swap token and is in the middle of a page fault. */
 	if (mm != current->mm && has_swap_token(mm) &&
 			rwsem_is_locked(&mm->mmap_sem))
 		referenced++;
 
-out_unmap:
 	(*mapcount)--;
-	pte_unmap_unlock(pte, ptl);
 
 	if (referenced)
 		*vm_flags |= vma->vm_flags;
 out:
 	return referenced;
+
+out_unmap:
+	(*mapcount)--;
+	pte_unmap_unlock(pte, ptl);
+	return referenced;
 }
 
 static int page_referenced_anon(struct page *page,
@@ -891,6 +939,102 @@ void page_remove_rmap(struct page *page)
 	 */
 }
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * Flush the TLBs of the cpus that may still cache translations for the
+ * ptes cleared under TTU_BATCH_FLUSH.  This must happen before those
+ * pages are freed, or a stale translation would let a task reach a
+ * page that has been reused.
+ */
+void try_to_unmap_flush(void)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+
+	if (!tlb_ubc->flush_required)
+		return;
+
+	arch_tlbbatch_flush(&tlb_ubc->cpumask);
+	cpumask_clear(&tlb_ubc->cpumask);
+	tlb_ubc->flush_required = false;
+	tlb_ubc->writable = false;
+}
+
+/*
+ * A dirty pte may still be cached writable: flush it before IO is
+ * started on the page, or writes through it would be lost.
+ */
+void try_to_unmap_flush_dirty(void)
+{
+	if (current->tlb_ubc.writable)
+		try_to_unmap_flush();
+}
+
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+
+	cpumask_or(&tlb_ubc->cpumask, &tlb_ubc->cpumask, mm_cpumask(mm));
+	tlb_ubc->flush_required = true;
+
+	/*
+	 * The pte was cleared before this store, and both happen under
+	 * the page table lock, which flush_tlb_batched_pending() holds.
+	 */
+	mm->tlb_flush_batched = true;
+
+	if (writable)
+		tlb_ubc->writable = true;
+}
+
+/*
+ * Batching only pays when other cpus have to be interrupted; a flush
+ * of the local TLB alone is cheaper done right away.
+ */
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	bool should_defer = false;
+
+	if (!(flags & TTU_BATCH_FLUSH))
+		return false;
+
+	if (cpumask_any_but(mm_cpumask(mm), get_cpu()) < nr_cpu_ids)
+		should_defer = true;
+	put_cpu();
+
+	return should_defer;
+}
+
+/*
+ * Reclaim may have cleared ptes of this mm and not flushed them yet.
+ * Called under the page table lock by those who would otherwise find
+ * such a pte_none and carry on as if no cpu could still use it: munmap
+ * would let the address be reused, mprotect and mremap would return
+ * while a stale translation still gives the old access.
+ */
+void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+	if (ACCESS_ONCE(mm->tlb_flush_batched)) {
+		/*
+		 * Clear before flushing: a batch that sets it again after
+		 * this point is for ptes our flush may have missed and must
+		 * stay visible to the next caller.
+		 */
+		mm->tlb_flush_batched = false;
+		smp_mb();
+		flush_tlb_mm(mm);
+	}
+}
+#else
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+}
+
+static bool should_defer_flush(struct mm_struct *mm, enum ttu_flags flags)
+{
+	return false;
+}
+#endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
+
 /*
  * Subfunctions of try_to_unmap: try_to_unmap_one called
  * repeatedly from either try_to_unmap_anon or try_to_unmap_file.
@@ -929,7 +1073,16 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
-	pteval = ptep_clear_flush_notify(vma, address, pte);
+	if (should_defer_flush(mm, flags)) {
+		/*
+		 * Clear the pte and leave the TLB flush to the caller,
+		 * who flushes all the cpus of the batch at once.
+		 */
+		pteval = ptep_get_and_clear(mm, address, pte);
+		set_tlb_ubc_flush_pending(mm, pte_dirty(pteval));
+		mmu_notifier_invalidate_page(mm, address);
+	} else
+		pteval = ptep_clear_flush_notify(vma, address, pte);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
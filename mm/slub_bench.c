@@ -0,0 +1,223 @@
+/*
+ * mm/slub_bench.c
+ *
+ * Microbenchmark for the slab allocator fast and slow paths.
+ *
+ * Loading the module runs three tests for kmalloc sizes from 8 bytes
+ * to 8k and reports the average number of cycles per operation:
+ *
+ *  1. a series of kmallocs followed by a series of kfrees of the same
+ *     objects on one processor (allocation and free slowpaths, slab
+ *     refill from the partial lists),
+ *  2. kmalloc immediately followed by kfree (the lockless fastpath),
+ *  3. every online processor allocates a batch of objects and then
+ *     frees the batch that was allocated by its neighbour (remote frees
+ *     into slabs owned by another processor, per cpu partial lists).
+ *
+ * The module refuses to stay loaded once the tests are done.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/cpu.h>
+#include <linux/math64.h>
+#include <asm/timex.h>
+
+static unsigned int iterations = 10000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Objects allocated per size and test");
+
+#define BENCH_MIN_SIZE	8
+#define BENCH_MAX_SIZE	8192
+
+static void **bench_objs;
+
+static void bench_single(size_t size)
+{
+	cycles_t t0, t1, t2;
+	unsigned int i;
+
+	t0 = get_cycles();
+	for (i = 0; i < iterations; i++)
+		bench_objs[i] = kmalloc(size, GFP_KERNEL);
+	t1 = get_cycles();
+	for (i = 0; i < iterations; i++)
+		kfree(bench_objs[i]);
+	t2 = get_cycles();
+
+	printk(KERN_INFO "slub_bench: %u times kmalloc(%zu) -> %llu cycles"
+	       " kfree -> %llu cycles\n", iterations, size,
+	       div_u64(t1 - t0, iterations), div_u64(t2 - t1, iterations));
+}
+
+static void bench_pairs(size_t size)
+{
+	cycles_t t0, t1;
+	unsigned int i;
+
+	t0 = get_cycles();
+	for (i = 0; i < iterations; i++)
+		kfree(kmalloc(size, GFP_KERNEL));
+	t1 = get_cycles();
+
+	printk(KERN_INFO "slub_bench: %u times kmalloc(%zu)/kfree -> %llu"
+	       " cycles\n", iterations, size, div_u64(t1 - t0, iterations));
+}
+
+struct bench_thread {
+	struct task_struct *task;
+	int cpu;
+	void **objs;
+	struct bench_thread *peer;	/* Whose objects we free */
+	cycles_t alloc_cycles;
+	cycles_t free_cycles;
+};
+
+static size_t remote_size;
+static int remote_threads;
+static atomic_t remote_allocated;
+static atomic_t remote_done;
+static DECLARE_WAIT_QUEUE_HEAD(remote_wait);
+
+static int bench_remote_thread(void *arg)
+{
+	struct bench_thread *t = arg;
+	cycles_t t0;
+	unsigned int i;
+
+	t0 = get_cycles();
+	for (i = 0; i < iterations; i++)
+		t->objs[i] = kmalloc(remote_size, GFP_KERNEL);
+	t->alloc_cycles = get_cycles() - t0;
+
+	/* Do not start freeing before every batch has been allocated */
+	if (atomic_inc_return(&remote_allocated) == remote_threads)
+		wake_up_all(&remote_wait);
+	wait_event(remote_wait,
+		   atomic_read(&remote_allocated) == remote_threads);
+
+	t0 = get_cycles();
+	for (i = 0; i < iterations; i++)
+		kfree(t->peer->objs[i]);
+	t->free_cycles = get_cycles() - t0;
+
+	if (atomic_inc_return(&remote_done) == remote_threads)
+		wake_up_all(&remote_wait);
+	return 0;
+}
+
+static void bench_remote(struct bench_thread *threads, int nr, size_t size)
+{
+	cycles_t alloc_cycles = 0, free_cycles = 0;
+	int i;
+
+	remote_size = size;
+	remote_threads = nr;
+	atomic_set(&remote_allocated, 0);
+	atomic_set(&remote_done, 0);
+
+	/* Every thread frees its peer's objects: start all or none */
+	for (i = 0; i < nr; i++) {
+		threads[i].task = kthread_create(bench_remote_thread,
+				&threads[i], "slub_bench/%d", threads[i].cpu);
+		if (IS_ERR(threads[i].task)) {
+			printk(KERN_ERR "slub_bench: cannot create thread\n");
+			while (--i >= 0)
+				kthread_stop(threads[i].task);
+			return;
+		}
+		kthread_bind(threads[i].task, threads[i].cpu);
+	}
+	for (i = 0; i < nr; i++)
+		wake_up_process(threads[i].task);
+
+	wait_event(remote_wait, atomic_read(&remote_done) == nr);
+
+	for (i = 0; i < nr; i++) {
+		alloc_cycles += threads[i].alloc_cycles;
+		free_cycles += threads[i].free_cycles;
+	}
+	printk(KERN_INFO "slub_bench: %d cpus %u times kmalloc(%zu) -> %llu"
+	       " cycles remote kfree -> %llu cycles\n", nr, iterations, size,
+	       div_u64(alloc_cycles, nr * iterations),
+	       div_u64(free_cycles, nr * iterations));
+}
+
+static void bench_remote_all(void)
+{
+	struct bench_thread *threads;
+	size_t size;
+	int cpu, nr = 0, i;
+
+	get_online_cpus();
+	if (num_online_cpus() < 2) {
+		printk(KERN_INFO "slub_bench: remote free test needs at least"
+		       " two cpus\n");
+		goto out;
+	}
+
+	threads = kcalloc(num_online_cpus(), sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		goto out;
+
+	for_each_online_cpu(cpu) {
+		threads[nr].cpu = cpu;
+		threads[nr].objs = vmalloc(iterations * sizeof(void *));
+		if (!threads[nr].objs)
+			goto free;
+		nr++;
+	}
+	for (i = 0; i < nr; i++)
+		threads[i].peer = &threads[(i + 1) % nr];
+
+	for (size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 1)
+		bench_remote(threads, nr, size);
+free:
+	for (i = 0; i < nr; i++)
+		vfree(threads[i].objs);
+	kfree(threads);
+out:
+	put_online_cpus();
+}
+
+static int __init slub_bench_init(void)
+{
+	size_t size;
+
+	if (!iterations)
+		return -EINVAL;
+
+	bench_objs = vmalloc(iterations * sizeof(void *));
+	if (!bench_objs)
+		return -ENOMEM;
+
+	printk(KERN_INFO "slub_bench: single cpu kmalloc then kfree\n");
+	for (size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 1)
+		bench_single(size);
+
+	printk(KERN_INFO "slub_bench: single cpu kmalloc/kfree pairs\n");
+	for (size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 1)
+		bench_pairs(size);
+
+	vfree(bench_objs);
+
+	printk(KERN_INFO "slub_bench: kmalloc on each cpu, kfree on the next\n");
+	bench_remote_all();
+
+	/* Nothing left to do: fail the load so no rmmod is needed */
+	return -EAGAIN;
+}
+module_init(slub_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("SLUB allocator microbenchmark");
@@ -120,8 +120,15 @@ static void pagevec_move_tail(struct pagevec *pvec)
 		}
 		if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 			int lru = page_lru_base_type(page);
-			list_move_tail(&page->lru, &zone->lru[lru].list);
+			struct list_head *head;
+
 			pgmoved++;
+			if (lru_gen_del_page(zone, page, true)) {
+				lru_gen_add_page(zone, page, true);
+				continue;
+			}
+			head = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+			list_move_tail(&page->lru, head);
 		}
 	}
 	if (zone)
@@ -208,6 +215,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -182,6 +182,71 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Drop the shadow entries that evicted pages left behind in the range
+ * [start, end].  Their refault information is meaningless once the file
+ * range is gone, and the tree nodes they pin must be freed.
+ *
+ * nrshadows is only looked at under the tree_lock, which the shadow
+ * node shrinker holds while it works on the mapping.
+ */
+static void truncate_shadow_entries(struct address_space *mapping,
+				    pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t next = start;
+	bool done = false;
+
+	while (!done) {
+		unsigned int i, nr, nr_shadows = 0;
+
+		spin_lock_irq(&mapping->tree_lock);
+		if (!mapping->nrshadows) {
+			spin_unlock_irq(&mapping->tree_lock);
+			break;
+		}
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		if (!nr)
+			done = true;
+		/*
+		 * Collect the indices first: deleting entries can free
+		 * the nodes that the other slot pointers point into.
+		 */
+		for (i = 0; i < nr; i++) {
+			unsigned long index = indices[i];
+
+			if (index > end) {
+				done = true;
+				break;
+			}
+			if (radix_tree_exceptional_entry(
+					radix_tree_deref_slot(slots[i])))
+				indices[nr_shadows++] = index;
+			next = index + 1;
+			if (!next) {
+				done = true;
+				break;
+			}
+		}
+		for (i = 0; i < nr_shadows; i++) {
+			struct radix_tree_node *node;
+			void **slot;
+
+			__radix_tree_lookup(&mapping->page_tree, indices[i],
+					    &node, &slot);
+			/* The node goes away with its last entry */
+			if (node && node->count == 1)
+				workingset_forget_node(node);
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -215,7 +280,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -290,6 +355,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 	}
+
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -306,6 +374,20 @@ void truncate_inode_pages(struct address_space *mapping, loff_t lstart)
 }
 EXPORT_SYMBOL(truncate_inode_pages);
 
+/**
+ * truncate_inode_shadows - drop all shadow entries of a dying mapping
+ * @mapping: mapping to clear
+ *
+ * Called from clear_inode(), after the last page is gone.  This takes
+ * the tree_lock even if there is nothing to drop, so that the shadow
+ * node shrinker is done with @mapping before the inode is freed.
+ */
+void truncate_inode_shadows(struct address_space *mapping)
+{
+	truncate_shadow_entries(mapping, 0, ULONG_MAX);
+}
+EXPORT_SYMBOL(truncate_inode_shadows);
+
 /**
  * invalidate_mapping_pages - Invalidate all the unlocked pages of one inode
  * @mapping: the address_space which holds the pages to invalidate
@@ -387,7 +469,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 	page_cache_release(page);	/* pagecache ref */
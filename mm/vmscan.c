@@ -40,6 +40,10 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/hugetlb.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -81,7 +85,13 @@ struct scan_control {
 	 */
 	bool lumpy_reclaim_mode;
 
-	/* Which cgroup do we reclaim from */
+	/*
+	 * The cgroup that hit its limit and is the target of this reclaim,
+	 * NULL for global reclaim.
+	 */
+	struct mem_cgroup *target_mem_cgroup;
+
+	/* The cgroup whose lists are being scanned, see shrink_zone() */
 	struct mem_cgroup *mem_cgroup;
 
 	/*
@@ -130,9 +140,17 @@ long vm_total_pages;	/* The total number of pages which the VM controls */
 static LIST_HEAD(shrinker_list);
 static DECLARE_RWSEM(shrinker_rwsem);
 
+/*
+ * global_reclaim() is true for kswapd, direct and zone reclaim, which
+ * scan the lists of every cgroup.  scanning_global_lru() is true when
+ * there are no per-cgroup lists to scan, i.e. without the memory
+ * controller.
+ */
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
+#define global_reclaim(sc)	(!(sc)->target_mem_cgroup)
 #define scanning_global_lru(sc)	(!(sc)->mem_cgroup)
 #else
+#define global_reclaim(sc)	(1)
 #define scanning_global_lru(sc)	(1)
 #endif
 
@@ -154,6 +172,16 @@ static unsigned long zone_nr_lru_pages(struct zone *zone,
 	return zone_page_state(zone, NR_LRU_BASE + lru);
 }
 
+static struct list_head *get_lru_list(struct zone *zone,
+				      struct scan_control *sc,
+				      enum lru_list lru)
+{
+	if (!scanning_global_lru(sc))
+		return mem_cgroup_zone_lru_list(sc->mem_cgroup, zone, lru);
+
+	return &zone->lru[lru].list;
+}
+
 
 /*
  * Add a shrinker callback to be called from the vm
@@ -409,7 +437,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -454,7 +483,19 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swapcache_free(swap, page);
 	} else {
-		__remove_from_page_cache(page);
+		void *shadow = NULL;
+
+		/*
+		 * Leave a shadow entry behind for pages evicted by reclaim,
+		 * so a refault can tell how long the page was gone.  Only
+		 * inode mappings go through clear_inode(), which drops the
+		 * shadows again; private mappings like gfs2's glocks or
+		 * nilfs' btnode caches never do.
+		 */
+		if (reclaimed && page_is_file_cache(page) && mapping->host &&
+		    mapping == &mapping->host->i_data)
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 	}
@@ -474,7 +515,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -571,7 +612,8 @@ static enum page_references page_check_references(struct page *page,
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
-	referenced_ptes = page_referenced(page, 1, sc->mem_cgroup, &vm_flags);
+	referenced_ptes = page_referenced(page, 1, sc->target_mem_cgroup,
+					  &vm_flags);
 	referenced_page = TestClearPageReferenced(page);
 
 	/* Lumpy reclaim - ignore references */
@@ -708,7 +750,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+			switch (try_to_unmap(page, TTU_UNMAP|TTU_BATCH_FLUSH)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -728,7 +770,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
+			/*
+			 * Page is dirty.  A cpu may still hold a writable
+			 * translation from the batched unmap: flush it
+			 * before the IO starts, then write the page out.
+			 */
+			try_to_unmap_flush_dirty();
 			switch (pageout(page, mapping, sync_writeback)) {
 			case PAGE_KEEP:
 				goto keep_locked;
@@ -793,7 +840,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -807,6 +854,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 free_it:
 		nr_reclaimed++;
 		if (!pagevec_add(&freed_pvec, page)) {
+			try_to_unmap_flush();
 			__pagevec_free(&freed_pvec);
 			pagevec_reinit(&freed_pvec);
 		}
@@ -833,6 +881,7 @@ keep:
 		VM_BUG_ON(PageLRU(page) || PageUnevictable(page));
 	}
 	list_splice(&ret_pages, page_list);
+	try_to_unmap_flush();
 	if (pagevec_count(&freed_pvec))
 		__pagevec_free(&freed_pvec);
 	count_vm_events(PGACTIVATE, pgactivate);
@@ -933,14 +982,13 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		switch (__isolate_lru_page(page, mode, file)) {
 		case 0:
 			list_move(&page->lru, dst);
-			mem_cgroup_del_lru(page);
+			mem_cgroup_lru_del(page);
 			nr_taken++;
 			break;
 
 		case -EBUSY:
 			/* else it is being freed elsewhere */
 			list_move(&page->lru, src);
-			mem_cgroup_rotate_lru_list(page, page_lru(page));
 			continue;
 
 		default:
@@ -991,7 +1039,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 
 			if (__isolate_lru_page(cursor_page, mode, file) == 0) {
 				list_move(&cursor_page->lru, dst);
-				mem_cgroup_del_lru(cursor_page);
+				mem_cgroup_lru_del(cursor_page);
 				nr_taken++;
 				scan++;
 			}
@@ -1002,19 +1050,19 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
-static unsigned long isolate_pages_global(unsigned long nr,
-					struct list_head *dst,
-					unsigned long *scanned, int order,
-					int mode, struct zone *z,
-					int active, int file)
+static unsigned long isolate_pages(unsigned long nr, struct list_head *dst,
+				   unsigned long *scanned, int order,
+				   int mode, struct zone *z,
+				   struct scan_control *sc,
+				   int active, int file)
 {
 	int lru = LRU_BASE;
 	if (active)
 		lru += LRU_ACTIVE;
 	if (file)
 		lru += LRU_FILE;
-	return isolate_lru_pages(nr, &z->lru[lru].list, dst, scanned, order,
-								mode, file);
+	return isolate_lru_pages(nr, get_lru_list(z, sc, lru), dst, scanned,
+				 order, mode, file);
 }
 
 /*
@@ -1097,7 +1145,7 @@ static int too_many_isolated(struct zone *zone, int file,
 	if (current_is_kswapd())
 		return 0;
 
-	if (!scanning_global_lru(sc))
+	if (!global_reclaim(sc))
 		return 0;
 
 	if (file) {
@@ -1149,11 +1197,10 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 		unsigned long nr_anon;
 		unsigned long nr_file;
 
-		if (scanning_global_lru(sc)) {
-			nr_taken = isolate_pages_global(SWAP_CLUSTER_MAX,
-							&page_list, &nr_scan,
-							sc->order, mode,
-							zone, 0, file);
+		nr_taken = isolate_pages(SWAP_CLUSTER_MAX, &page_list,
+					 &nr_scan, sc->order, mode,
+					 zone, sc, 0, file);
+		if (global_reclaim(sc)) {
 			zone->pages_scanned += nr_scan;
 			if (current_is_kswapd())
 				__count_zone_vm_events(PGSCAN_KSWAPD, zone,
@@ -1161,16 +1208,6 @@ static unsigned long shrink_inactive_list(unsigned long max_scan,
 			else
 				__count_zone_vm_events(PGSCAN_DIRECT, zone,
 						       nr_scan);
-		} else {
-			nr_taken = mem_cgroup_isolate_pages(SWAP_CLUSTER_MAX,
-							&page_list, &nr_scan,
-							sc->order, mode,
-							zone, sc->mem_cgroup,
-							0, file);
-			/*
-			 * mem_cgroup_isolate_pages() keeps track of
-			 * scanned pages on its own.
-			 */
 		}
 
 		if (nr_taken == 0)
@@ -1316,8 +1353,7 @@ static void move_active_pages_to_lru(struct zone *zone,
 		VM_BUG_ON(PageLRU(page));
 		SetPageLRU(page);
 
-		list_move(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_add_lru_list(page, lru);
+		list_move(&page->lru, mem_cgroup_lru_add_list(zone, page, lru));
 		pgmoved++;
 
 		if (!pagevec_add(&pvec, page) || list_empty(list)) {
@@ -1348,22 +1384,10 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 
 	lru_add_drain();
 	spin_lock_irq(&zone->lru_lock);
-	if (scanning_global_lru(sc)) {
-		nr_taken = isolate_pages_global(nr_pages, &l_hold,
-						&pgscanned, sc->order,
-						ISOLATE_ACTIVE, zone,
-						1, file);
+	nr_taken = isolate_pages(nr_pages, &l_hold, &pgscanned, sc->order,
+				 ISOLATE_ACTIVE, zone, sc, 1, file);
+	if (global_reclaim(sc))
 		zone->pages_scanned += pgscanned;
-	} else {
-		nr_taken = mem_cgroup_isolate_pages(nr_pages, &l_hold,
-						&pgscanned, sc->order,
-						ISOLATE_ACTIVE, zone,
-						sc->mem_cgroup, 1, file);
-		/*
-		 * mem_cgroup_isolate_pages() keeps track of
-		 * scanned pages on its own.
-		 */
-	}
 
 	reclaim_stat->recent_scanned[file] += nr_taken;
 
@@ -1385,7 +1409,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 			continue;
 		}
 
-		if (page_referenced(page, 0, sc->mem_cgroup, &vm_flags)) {
+		if (page_referenced(page, 0, sc->target_mem_cgroup, &vm_flags)) {
 			nr_rotated++;
 			/*
 			 * Identify referenced, file-backed active pages and
@@ -1570,11 +1594,15 @@ static void get_scan_count(struct zone *zone, struct scan_control *sc,
 	file  = zone_nr_lru_pages(zone, sc, LRU_ACTIVE_FILE) +
 		zone_nr_lru_pages(zone, sc, LRU_INACTIVE_FILE);
 
-	if (scanning_global_lru(sc)) {
+	if (global_reclaim(sc)) {
+		unsigned long zone_file;
+
+		zone_file = zone_page_state(zone, NR_ACTIVE_FILE) +
+			    zone_page_state(zone, NR_INACTIVE_FILE);
 		free  = zone_page_state(zone, NR_FREE_PAGES);
 		/* If we have very few page cache pages,
 		   force-scan anon pages. */
-		if (unlikely(file + free <= high_wmark_pages(zone))) {
+		if (unlikely(zone_file + free <= high_wmark_pages(zone))) {
 			fraction[0] = 1;
 			fraction[1] = 0;
 			denominator = 1;
@@ -1658,11 +1686,740 @@ static void set_lumpy_reclaim_mode(int priority, struct scan_control *sc)
 		sc->lumpy_reclaim_mode = 0;
 }
 
+#ifdef CONFIG_LRU_GEN
 /*
- * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
+ * Multi-generational LRU.
+ *
+ * Instead of the active and inactive lists, the evictable pages of each
+ * cgroup in a zone are kept on MIN_NR_GENS to MAX_NR_GENS generations,
+ * per type.  Aging walks the page tables of every mm, moves the pages it
+ * finds accessed into the youngest generation and then starts a new one;
+ * eviction works on the oldest generation and retires it once it is
+ * empty.  Walking the page tables instead of the rmap of each page on the
+ * inactive list is what makes aging cheap: the accessed bits of pages
+ * that are mapped next to each other are found next to each other.
+ *
+ * Both are serialized by zone->lru_lock, so the generations a page can be
+ * on, and their sizes, are always exact.
  */
-static void shrink_zone(int priority, struct zone *zone,
-				struct scan_control *sc)
+
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+
+/* One page table walk at a time, for all zones */
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+
+void lru_gen_init(struct lru_gen_struct *lrugen)
+{
+	int gen, type;
+
+	lrugen->max_seq = MIN_NR_GENS;
+	for (type = 0; type < 2; type++)
+		lrugen->min_seq[type] = 0;
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		lrugen->timestamps[gen] = jiffies;
+		for (type = 0; type < 2; type++) {
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+			lrugen->nr_pages[gen][type] = 0;
+		}
+	}
+}
+
+/* mm's whose last user was the aging, waiting for lru_gen_mm_exit_fn() */
+static LIST_HEAD(lru_gen_mm_exit_list);
+
+static void lru_gen_mm_exit_fn(struct work_struct *work)
+{
+	struct mm_struct *mm;
+
+	spin_lock(&lru_gen_mm_lock);
+	while (!list_empty(&lru_gen_mm_exit_list)) {
+		mm = list_first_entry(&lru_gen_mm_exit_list, struct mm_struct,
+				      lru_gen_list);
+		spin_unlock(&lru_gen_mm_lock);
+		/* Takes it off the exit list */
+		mmput(mm);
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+static DECLARE_WORK(lru_gen_mm_exit_work, lru_gen_mm_exit_fn);
+
+/*
+ * Called once the mm is fully set up: the aging may pin it as soon as
+ * it is on the list, and only mmput() takes it off again.
+ */
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Called from mmput() when the last user is gone.  The aging holds a
+ * user reference while it walks an mm, so none can be walking this one.
+ */
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Drop the reference lru_gen_next_mm() took.  Reclaim must not run
+ * exit_mmap() and the file releases it implies, so if the mm's other
+ * users went away in the meantime, leave the final mmput() to keventd.
+ */
+static void lru_gen_put_mm(struct mm_struct *mm)
+{
+	if (atomic_add_unless(&mm->mm_users, -1, 1))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_move_tail(&mm->lru_gen_list, &lru_gen_mm_exit_list);
+	spin_unlock(&lru_gen_mm_lock);
+	schedule_work(&lru_gen_mm_exit_work);
+}
+
+/*
+ * Returns the mm after @prev on the list, or the first one if @prev is
+ * NULL, with a user reference held.  Exiting mm's are skipped.  The
+ * reference on @prev keeps it on the list until the next one is found,
+ * and is dropped then.
+ */
+static struct mm_struct *lru_gen_next_mm(struct mm_struct *prev)
+{
+	struct list_head *pos = prev ? &prev->lru_gen_list : &lru_gen_mm_list;
+	struct mm_struct *mm = NULL;
+
+	spin_lock(&lru_gen_mm_lock);
+	while ((pos = pos->next) != &lru_gen_mm_list) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		if (atomic_inc_not_zero(&mm->mm_users))
+			break;
+		mm = NULL;
+	}
+	spin_unlock(&lru_gen_mm_lock);
+
+	if (prev)
+		lru_gen_put_mm(prev);
+
+	return mm;
+}
+
+struct lru_gen_walk {
+	struct zone *zone;
+	struct lru_gen_struct *lrugen;
+	/* The youngest generation, at the time the walk started */
+	int gen;
+};
+
+/*
+ * Move an accessed page into the youngest generation, if it is on one of
+ * the generations being aged.  Called with zone->lru_lock held.
+ */
+static bool lru_gen_promote_page(struct page *page, struct lru_gen_walk *walk)
+{
+	int type = page_is_file_cache(page);
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+	if (mem_cgroup_page_lru_gen(walk->zone, page) != walk->lrugen)
+		return false;
+
+	if (gen != walk->gen) {
+		set_page_lru_gen(page, walk->gen, 0, 0);
+		lru_gen_update_size(walk->zone, walk->lrugen, page,
+				    gen, walk->gen);
+		list_move(&page->lru, &walk->lrugen->lists[walk->gen][type]);
+		__count_vm_event(PGACTIVATE);
+	}
+	return true;
+}
+
+static void lru_gen_walk_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
+				   unsigned long addr, unsigned long end,
+				   struct lru_gen_walk *walk)
+{
+	struct zone *zone = walk->zone;
+	bool locked = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || page_zone(page) != zone)
+			continue;
+
+		if (!locked) {
+			spin_lock_irq(&zone->lru_lock);
+			locked = true;
+		}
+		if (lru_gen_promote_page(page, walk))
+			ptep_test_and_clear_young(vma, addr, pte);
+	}
+	if (locked)
+		spin_unlock_irq(&zone->lru_lock);
+	pte_unmap_unlock(pte - 1, ptl);
+}
+
+static void lru_gen_walk_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr, struct lru_gen_walk *walk)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	struct mm_struct *mm = vma->vm_mm;
+	struct zone *zone = walk->zone;
+	struct page *page;
+	bool promoted = false;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (!pmd_trans_huge(*pmd) || !pmd_young(*pmd))
+		goto out;
+
+	page = pmd_page(*pmd);
+	if (page_zone(page) != zone)
+		goto out;
+
+	/* The subpages of a huge page are on the LRU individually */
+	spin_lock_irq(&zone->lru_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		promoted |= lru_gen_promote_page(page + i, walk);
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (promoted)
+		pmdp_test_and_clear_young(vma, addr & HPAGE_PMD_MASK, pmd);
+out:
+	spin_unlock(&mm->page_table_lock);
+#endif
+}
+
+static void lru_gen_walk_pmd_range(struct vm_area_struct *vma, pud_t *pud,
+				   unsigned long addr, unsigned long end,
+				   struct lru_gen_walk *walk)
+{
+	unsigned long next;
+	pmd_t *pmd;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		if (pmd_trans_huge(*pmd)) {
+			lru_gen_walk_huge_pmd(vma, pmd, addr, walk);
+			continue;
+		}
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+			continue;
+		lru_gen_walk_pte_range(vma, pmd, addr, next, walk);
+		cond_resched();
+	} while (pmd++, addr = next, addr != end);
+}
+
+static void lru_gen_walk_pud_range(struct vm_area_struct *vma, pgd_t *pgd,
+				   unsigned long addr, unsigned long end,
+				   struct lru_gen_walk *walk)
+{
+	unsigned long next;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		lru_gen_walk_pmd_range(vma, pud, addr, next, walk);
+	} while (pud++, addr = next, addr != end);
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *walk)
+{
+	struct vm_area_struct *vma;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		unsigned long addr = vma->vm_start, end = vma->vm_end, next;
+		pgd_t *pgd;
+
+		/* Nothing to age in there, or the pages are unevictable */
+		if (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP | VM_RESERVED))
+			continue;
+		if (is_vm_hugetlb_page(vma) || VM_SequentialReadHint(vma))
+			continue;
+
+		pgd = pgd_offset(mm, addr);
+		do {
+			next = pgd_addr_end(addr, end);
+			if (pgd_none_or_clear_bad(pgd))
+				continue;
+			lru_gen_walk_pud_range(vma, pgd, addr, next, walk);
+		} while (pgd++, addr = next, addr != end);
+	}
+}
+
+/*
+ * Fold the oldest generation of @type into the next one.  Returns false
+ * if zone->lru_lock needs to be dropped before going on.
+ */
+static bool lru_gen_fold_oldest(struct zone *zone,
+				struct lru_gen_struct *lrugen, int type)
+{
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	struct list_head *head = &lrugen->lists[old_gen][type];
+	int batch = 0;
+
+	while (!list_empty(head)) {
+		/* From the youngest end, to keep the order */
+		struct page *page = list_entry(head->next, struct page, lru);
+
+		if (batch++ == SWAP_CLUSTER_MAX)
+			return false;
+
+		set_page_lru_gen(page, new_gen, 0, 0);
+		lru_gen_update_size(zone, lrugen, page, old_gen, new_gen);
+		list_move_tail(&page->lru, &lrugen->lists[new_gen][type]);
+	}
+	lrugen->min_seq[type]++;
+	return true;
+}
+
+static void lru_gen_inc_max_seq(struct zone *zone,
+				struct lru_gen_struct *lrugen)
+{
+	int gen, type;
+
+	spin_lock_irq(&zone->lru_lock);
+	for (type = 0; type < 2; type++) {
+		while (lrugen->max_seq + 1 - lrugen->min_seq[type] >=
+		       MAX_NR_GENS) {
+			if (lru_gen_fold_oldest(zone, lrugen, type))
+				continue;
+			spin_unlock_irq(&zone->lru_lock);
+			cond_resched();
+			spin_lock_irq(&zone->lru_lock);
+		}
+	}
+
+	/* The second youngest generation turns inactive */
+	gen = lru_gen_from_seq(lrugen->max_seq - 1);
+	for (type = 0; type < 2; type++) {
+		enum lru_list l = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+		long nr = lrugen->nr_pages[gen][type];
+
+		__mod_zone_page_state(zone, NR_LRU_BASE + l + LRU_ACTIVE, -nr);
+		__mod_zone_page_state(zone, NR_LRU_BASE + l, nr);
+		mem_cgroup_lru_gen_update_size(zone, lrugen, l + LRU_ACTIVE, -nr);
+		mem_cgroup_lru_gen_update_size(zone, lrugen, l, nr);
+	}
+
+	gen = lru_gen_from_seq(lrugen->max_seq + 1);
+	lrugen->timestamps[gen] = jiffies;
+	lrugen->max_seq++;
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+/*
+ * Walk all page tables, promote the pages in @lrugen found accessed and
+ * start a new generation.  Does nothing if someone else got there first.
+ */
+static void lru_gen_age(struct zone *zone, struct lru_gen_struct *lrugen)
+{
+	struct lru_gen_walk walk = { .zone = zone, .lrugen = lrugen, };
+	unsigned long max_seq = ACCESS_ONCE(lrugen->max_seq);
+	struct mm_struct *mm = NULL;
+
+	mutex_lock(&lru_gen_aging_mutex);
+	if (lrugen->max_seq != max_seq)
+		goto out;
+
+	walk.gen = lru_gen_from_seq(max_seq);
+	while ((mm = lru_gen_next_mm(mm))) {
+		/* Busy mm's are skipped rather than waited for */
+		if (!down_read_trylock(&mm->mmap_sem))
+			continue;
+		lru_gen_walk_mm(mm, &walk);
+		up_read(&mm->mmap_sem);
+	}
+
+	lru_gen_inc_max_seq(zone, lrugen);
+out:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+/*
+ * Returns the type to evict next, or -1 if neither has a generation old
+ * enough and aging is due.  The type with the older oldest generation
+ * goes first; on a tie, swappiness weighs their sizes.
+ */
+static int lru_gen_pick_type(struct lru_gen_struct *lrugen,
+			     struct scan_control *sc, int can_swap)
+{
+	unsigned long max_seq = lrugen->max_seq;
+	unsigned long *min_seq = lrugen->min_seq;
+	int anon = can_swap && min_seq[0] + MIN_NR_GENS <= max_seq;
+	int file = min_seq[1] + MIN_NR_GENS <= max_seq;
+	int gen;
+
+	if (!anon)
+		return file ? 1 : -1;
+	if (!file)
+		return 0;
+	if (!sc->swappiness)
+		return 1;
+	if (min_seq[0] != min_seq[1])
+		return min_seq[0] < min_seq[1] ? 0 : 1;
+
+	gen = lru_gen_from_seq(min_seq[0]);
+	return lrugen->nr_pages[gen][0] * sc->swappiness >
+	       lrugen->nr_pages[gen][1] * (200 - sc->swappiness) ? 0 : 1;
+}
+
+/*
+ * Isolate a batch of pages from the oldest generation of @type, retiring
+ * it once empty, and reclaim them.  Returns the number reclaimed.
+ */
+static unsigned long lru_gen_evict(struct zone *zone,
+				   struct lru_gen_struct *lrugen, int type,
+				   struct scan_control *sc,
+				   unsigned long *nr_scanned)
+{
+	LIST_HEAD(page_list);
+	struct pagevec pvec;
+	struct list_head *head;
+	unsigned long nr_taken = 0;
+	unsigned long nr_reclaimed;
+	unsigned long scan = 0;
+	struct page *page;
+
+	pagevec_init(&pvec, 1);
+
+	spin_lock_irq(&zone->lru_lock);
+	/* Someone else may have retired it in the meantime */
+	if (lrugen->min_seq[type] + MIN_NR_GENS > lrugen->max_seq)
+		goto out;
+
+	head = &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[type])][type];
+	for (; scan < SWAP_CLUSTER_MAX && !list_empty(head); scan++) {
+		page = lru_to_page(head);
+		prefetchw_prev_lru_page(page, head, flags);
+
+		VM_BUG_ON(!PageLRU(page));
+
+		switch (__isolate_lru_page(page, ISOLATE_BOTH, type)) {
+		case 0:
+			lru_gen_del_page(zone, page, true);
+			list_add(&page->lru, &page_list);
+			nr_taken++;
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, head);
+			break;
+
+		default:
+			BUG();
+		}
+	}
+	if (list_empty(head))
+		lrugen->min_seq[type]++;
+
+	if (global_reclaim(sc)) {
+		zone->pages_scanned += scan;
+		if (current_is_kswapd())
+			__count_zone_vm_events(PGSCAN_KSWAPD, zone, scan);
+		else
+			__count_zone_vm_events(PGSCAN_DIRECT, zone, scan);
+	}
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, nr_taken);
+out:
+	spin_unlock_irq(&zone->lru_lock);
+
+	*nr_scanned = scan;
+	if (!nr_taken)
+		return 0;
+
+	nr_reclaimed = shrink_page_list(&page_list, sc, PAGEOUT_IO_ASYNC);
+
+	local_irq_disable();
+	if (current_is_kswapd())
+		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
+	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+
+	spin_lock(&zone->lru_lock);
+	/*
+	 * Put back any unfreeable pages, the referenced ones were marked
+	 * active by shrink_page_list() and go into the youngest generation.
+	 */
+	while (!list_empty(&page_list)) {
+		page = lru_to_page(&page_list);
+		VM_BUG_ON(PageLRU(page));
+		list_del(&page->lru);
+		if (unlikely(!page_evictable(page, NULL))) {
+			spin_unlock_irq(&zone->lru_lock);
+			putback_lru_page(page);
+			spin_lock_irq(&zone->lru_lock);
+			continue;
+		}
+		SetPageLRU(page);
+		add_page_to_lru_list(zone, page, page_lru(page));
+		if (!pagevec_add(&pvec, page)) {
+			spin_unlock_irq(&zone->lru_lock);
+			__pagevec_release(&pvec);
+			spin_lock_irq(&zone->lru_lock);
+		}
+	}
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, -nr_taken);
+	spin_unlock_irq(&zone->lru_lock);
+	pagevec_release(&pvec);
+
+	return nr_reclaimed;
+}
+
+/*
+ * The counterpart of shrink_mem_cgroup_zone(): evict from the oldest
+ * generations, aging at most once when there is none old enough left.
+ * There is no lumpy reclaim, higher orders are left to compaction.
+ */
+static void lru_gen_shrink_mem_cgroup_zone(int priority, struct zone *zone,
+					   struct scan_control *sc)
+{
+	struct lru_gen_struct *lrugen;
+	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	unsigned long nr_to_scan = 0;
+	int can_swap = sc->may_swap && nr_swap_pages > 0;
+	bool aged = false;
+	int gen, type;
+
+	lrugen = mem_cgroup_zone_lru_gen(sc->mem_cgroup, zone);
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = !can_swap; type < 2; type++)
+			nr_to_scan += lrugen->nr_pages[gen][type];
+	nr_to_scan >>= priority;
+	if (!nr_to_scan)
+		return;
+
+	lru_add_drain();
+	while (nr_to_scan) {
+		unsigned long nr_scanned;
+
+		type = lru_gen_pick_type(lrugen, sc, can_swap);
+		if (type < 0) {
+			if (aged)
+				break;
+			lru_gen_age(zone, lrugen);
+			aged = true;
+			continue;
+		}
+
+		if (unlikely(too_many_isolated(zone, type, sc))) {
+			congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+			/* We are about to die and free our memory. Return now. */
+			if (fatal_signal_pending(current)) {
+				nr_reclaimed += SWAP_CLUSTER_MAX;
+				break;
+			}
+			continue;
+		}
+
+		nr_reclaimed += lru_gen_evict(zone, lrugen, type, sc,
+					      &nr_scanned);
+		nr_to_scan -= min(nr_to_scan, max(nr_scanned, 1UL));
+
+		if (nr_reclaimed >= sc->nr_to_reclaim && priority < DEF_PRIORITY)
+			break;
+	}
+
+	sc->nr_reclaimed = nr_reclaimed;
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * /sys/kernel/debug/lru_gen lists the generations of each cgroup in each
+ * zone, oldest first, with their age in milliseconds and their number of
+ * anon and file pages.  Writing "+ node zone" to it ages the generations
+ * of every cgroup in a zone; "- node zone nr_pages" evicts up to nr_pages
+ * from them.  Aging periodically and watching how the pages spread over
+ * the generations tells the working set size of a cgroup.
+ */
+
+static unsigned short lru_gen_memcg_id(struct mem_cgroup *mem)
+{
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	if (mem)
+		return css_id(mem_cgroup_css(mem));
+#endif
+	return 0;
+}
+
+static void lru_gen_show(struct seq_file *m, struct zone *zone,
+			 struct mem_cgroup *mem)
+{
+	struct lru_gen_struct *lrugen = mem_cgroup_zone_lru_gen(mem, zone);
+	unsigned long seq;
+
+	seq_printf(m, "memcg %5hu node %d zone %s\n", lru_gen_memcg_id(mem),
+		   zone_to_nid(zone), zone->name);
+
+	spin_lock_irq(&zone->lru_lock);
+	for (seq = min(lrugen->min_seq[0], lrugen->min_seq[1]);
+	     seq <= lrugen->max_seq; seq++) {
+		int gen = lru_gen_from_seq(seq);
+		long nr[2];
+		int type;
+
+		for (type = 0; type < 2; type++)
+			nr[type] = seq < lrugen->min_seq[type] ? 0 :
+				   lrugen->nr_pages[gen][type];
+		seq_printf(m, " %10lu %10u %10ld %10ld\n", seq,
+			   jiffies_to_msecs(jiffies - lrugen->timestamps[gen]),
+			   nr[0], nr[1]);
+	}
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+static int lru_gen_seq_show(struct seq_file *m, void *v)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+		struct mem_cgroup *mem;
+
+		mem = mem_cgroup_reclaim_iter(NULL, &walk);
+		do {
+			lru_gen_show(m, zone, mem);
+		} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+	}
+	return 0;
+}
+
+static void lru_gen_age_zone(struct zone *zone)
+{
+	struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+	struct mem_cgroup *mem;
+
+	mem = mem_cgroup_reclaim_iter(NULL, &walk);
+	do {
+		lru_gen_age(zone, mem_cgroup_zone_lru_gen(mem, zone));
+	} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+}
+
+static void lru_gen_evict_zone(struct zone *zone, unsigned long nr_pages)
+{
+	struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+	struct mem_cgroup *mem;
+	struct reclaim_state reclaim_state;
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.swappiness = vm_swappiness,
+		.nr_to_reclaim = nr_pages,
+	};
+	struct task_struct *p = current;
+
+	p->flags |= PF_MEMALLOC;
+	lockdep_set_current_reclaim_state(sc.gfp_mask);
+	reclaim_state.reclaimed_slab = 0;
+	p->reclaim_state = &reclaim_state;
+
+	mem = mem_cgroup_reclaim_iter(NULL, &walk);
+	do {
+		sc.mem_cgroup = mem;
+		lru_gen_shrink_mem_cgroup_zone(0, zone, &sc);
+		if (sc.nr_reclaimed >= sc.nr_to_reclaim) {
+			mem_cgroup_reclaim_iter_break(mem);
+			break;
+		}
+	} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+
+	p->reclaim_state = NULL;
+	lockdep_clear_current_reclaim_state();
+	p->flags &= ~PF_MEMALLOC;
+}
+
+static ssize_t lru_gen_seq_write(struct file *file, const char __user *buf,
+				 size_t len, loff_t *ppos)
+{
+	char cmd[64];
+	char op;
+	int nid, zid, n;
+	unsigned long nr_pages;
+	struct zone *zone;
+
+	if (len >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, len))
+		return -EFAULT;
+	cmd[len] = '\0';
+
+	n = sscanf(cmd, "%c %d %d %lu", &op, &nid, &zid, &nr_pages);
+	if (n < 3 || nid < 0 || nid >= MAX_NUMNODES || !node_online(nid) ||
+	    zid < 0 || zid >= MAX_NR_ZONES)
+		return -EINVAL;
+
+	zone = &NODE_DATA(nid)->node_zones[zid];
+	if (!populated_zone(zone))
+		return -EINVAL;
+
+	if (op == '+' && n == 3)
+		lru_gen_age_zone(zone);
+	else if (op == '-' && n == 4)
+		lru_gen_evict_zone(zone, nr_pages);
+	else
+		return -EINVAL;
+
+	return len;
+}
+
+static int lru_gen_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_seq_show, NULL);
+}
+
+static const struct file_operations lru_gen_fops = {
+	.open		= lru_gen_seq_open,
+	.read		= seq_read,
+	.write		= lru_gen_seq_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lru_gen_debugfs_init(void)
+{
+	debugfs_create_file("lru_gen", 0644, NULL, NULL, &lru_gen_fops);
+	return 0;
+}
+late_initcall(lru_gen_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline void lru_gen_shrink_mem_cgroup_zone(int priority,
+						  struct zone *zone,
+						  struct scan_control *sc)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
+/*
+ * Scan the lists of one cgroup, sc->mem_cgroup, in a zone.
+ */
+static void shrink_mem_cgroup_zone(int priority, struct zone *zone,
+				   struct scan_control *sc)
 {
 	unsigned long nr[NR_LRU_LISTS];
 	unsigned long nr_to_scan;
@@ -1670,6 +2427,11 @@ static void shrink_zone(int priority, struct zone *zone,
 	unsigned long nr_reclaimed = sc->nr_reclaimed;
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
 
+	if (lru_gen_enabled()) {
+		lru_gen_shrink_mem_cgroup_zone(priority, zone, sc);
+		return;
+	}
+
 	get_scan_count(zone, sc, nr, priority);
 
 	set_lumpy_reclaim_mode(priority, sc);
@@ -1706,10 +2468,69 @@ static void shrink_zone(int priority, struct zone *zone,
 	 */
 	if (inactive_anon_is_low(zone, sc) && nr_swap_pages > 0)
 		shrink_active_list(SWAP_CLUSTER_MAX, zone, sc, priority, 0);
+}
+
+/*
+ * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
+ *
+ * Limit reclaim scans the lists of the cgroup over its limit.  Global
+ * reclaim scans the lists of every cgroup, each in proportion to its
+ * size in the zone, so a cgroup is neither spared nor scanned on behalf
+ * of the others.  Once enough has been reclaimed the walk stops, and
+ * the next one in this zone picks up with the following cgroup.
+ */
+static void shrink_zone(int priority, struct zone *zone,
+				struct scan_control *sc)
+{
+	struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+	struct mem_cgroup *mem;
 
+	if (!global_reclaim(sc)) {
+		sc->mem_cgroup = sc->target_mem_cgroup;
+		shrink_mem_cgroup_zone(priority, zone, sc);
+		goto out;
+	}
+
+	/* Without the memory controller, this is a single pass with NULL */
+	mem = mem_cgroup_reclaim_iter(NULL, &walk);
+	do {
+		sc->mem_cgroup = mem;
+		shrink_mem_cgroup_zone(priority, zone, sc);
+		if (sc->nr_reclaimed >= sc->nr_to_reclaim &&
+		    priority < DEF_PRIORITY) {
+			mem_cgroup_reclaim_iter_break(mem);
+			break;
+		}
+	} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+	sc->mem_cgroup = NULL;
+out:
 	throttle_vm_writeout(sc->gfp_mask);
 }
 
+/*
+ * Do some background aging of the anon lists, to give pages a chance to
+ * be referenced before reclaiming.  Each cgroup ages its own lists.
+ */
+static void age_active_anon(struct zone *zone, struct scan_control *sc,
+			    int priority)
+{
+	struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+	struct mem_cgroup *mem;
+
+	/* The generations are aged by their page table walks instead */
+	if (lru_gen_enabled())
+		return;
+
+	mem = mem_cgroup_reclaim_iter(NULL, &walk);
+	do {
+		sc->mem_cgroup = mem;
+		if (inactive_anon_is_low(zone, sc))
+			shrink_active_list(SWAP_CLUSTER_MAX, zone, sc,
+					   priority, 0);
+	} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+	sc->mem_cgroup = NULL;
+}
+
 /*
  * This is the direct reclaim path, for page-allocating processes.  We only
  * try to reclaim pages from zones which will satisfy the caller's allocation
@@ -1741,7 +2562,7 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 		 * Take care memory controller reclaiming has small influence
 		 * to global LRU.
 		 */
-		if (scanning_global_lru(sc)) {
+		if (global_reclaim(sc)) {
 			if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 				continue;
 			note_zone_scanning_priority(zone, priority);
@@ -1753,7 +2574,7 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 			 * Ignore cpuset limitation here. We just want to reduce
 			 * # of used pages by us regardless of memory shortage.
 			 */
-			mem_cgroup_note_reclaim_priority(sc->mem_cgroup,
+			mem_cgroup_note_reclaim_priority(sc->target_mem_cgroup,
 							priority);
 		}
 
@@ -1824,12 +2645,12 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 	get_mems_allowed();
 	delayacct_freepages_start();
 
-	if (scanning_global_lru(sc))
+	if (global_reclaim(sc))
 		count_vm_event(ALLOCSTALL);
 	/*
 	 * mem_cgroup will not do shrink_slab.
 	 */
-	if (scanning_global_lru(sc)) {
+	if (global_reclaim(sc)) {
 		for_each_zone_zonelist(zone, z, zonelist, high_zoneidx) {
 
 			if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
@@ -1848,7 +2669,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		 * Don't shrink slabs when reclaiming memory from
 		 * over limit cgroups
 		 */
-		if (scanning_global_lru(sc)) {
+		if (global_reclaim(sc)) {
 			shrink_slab(sc->nr_scanned, sc->gfp_mask, lru_pages);
 			if (reclaim_state) {
 				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
@@ -1889,7 +2710,7 @@ out:
 	if (priority < 0)
 		priority = 0;
 
-	if (scanning_global_lru(sc)) {
+	if (global_reclaim(sc)) {
 		for_each_zone_zonelist(zone, z, zonelist, high_zoneidx) {
 
 			if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
@@ -1898,7 +2719,7 @@ out:
 			zone->prev_priority = priority;
 		}
 	} else
-		mem_cgroup_record_reclaim_priority(sc->mem_cgroup, priority);
+		mem_cgroup_record_reclaim_priority(sc->target_mem_cgroup, priority);
 
 	delayacct_freepages_end();
 	put_mems_allowed();
@@ -1907,7 +2728,7 @@ out:
 		return sc->nr_reclaimed;
 
 	/* top priority shrink_zones still had more to do? don't OOM, then */
-	if (scanning_global_lru(sc) && !all_unreclaimable(zonelist, sc))
+	if (global_reclaim(sc) && !all_unreclaimable(zonelist, sc))
 		return 1;
 
 	return 0;
@@ -1924,7 +2745,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 		.may_swap = 1,
 		.swappiness = vm_swappiness,
 		.order = order,
-		.mem_cgroup = NULL,
+		.target_mem_cgroup = NULL,
 		.nodemask = nodemask,
 	};
 
@@ -1936,7 +2757,8 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 						gfp_t gfp_mask, bool noswap,
 						unsigned int swappiness,
-						struct zone *zone, int nid)
+						struct zone *zone, int nid,
+						unsigned long *nr_scanned)
 {
 	struct scan_control sc = {
 		.may_writepage = !laptop_mode,
@@ -1944,7 +2766,7 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 		.may_swap = !noswap,
 		.swappiness = swappiness,
 		.order = 0,
-		.mem_cgroup = mem,
+		.target_mem_cgroup = mem,
 	};
 	nodemask_t nm  = nodemask_of_node(nid);
 
@@ -1961,6 +2783,7 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
 	 * the priority and make it zero.
 	 */
 	shrink_zone(0, zone, &sc);
+	*nr_scanned = sc.nr_scanned;
 	return sc.nr_reclaimed;
 }
 
@@ -1977,7 +2800,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 		.nr_to_reclaim = SWAP_CLUSTER_MAX,
 		.swappiness = swappiness,
 		.order = 0,
-		.mem_cgroup = mem_cont,
+		.target_mem_cgroup = mem_cont,
 		.nodemask = NULL, /* we don't care the placement */
 	};
 
@@ -2054,7 +2877,7 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order)
 		.nr_to_reclaim = ULONG_MAX,
 		.swappiness = vm_swappiness,
 		.order = order,
-		.mem_cgroup = NULL,
+		.target_mem_cgroup = NULL,
 	};
 	/*
 	 * temp_priority is used to remember the scanning priority at which
@@ -2096,13 +2919,7 @@ loop_again:
 			if (zone->all_unreclaimable && priority != DEF_PRIORITY)
 				continue;
 
-			/*
-			 * Do some background aging of the anon list, to give
-			 * pages a chance to be referenced before reclaiming.
-			 */
-			if (inactive_anon_is_low(zone, &sc))
-				shrink_active_list(SWAP_CLUSTER_MAX, zone,
-							&sc, priority, 0);
+			age_active_anon(zone, &sc, priority);
 
 			if (!zone_watermark_ok_safe(zone, order,
 					high_wmark_pages(zone), 0, 0)) {
@@ -2132,6 +2949,7 @@ loop_again:
 			struct zone *zone = pgdat->node_zones + i;
 			int nr_slab;
 			int nid, zid;
+			unsigned long nr_soft_scanned;
 
 			if (!populated_zone(zone))
 				continue;
@@ -2146,11 +2964,16 @@ loop_again:
 			nid = pgdat->node_id;
 			zid = zone_idx(zone);
 			/*
-			 * Call soft limit reclaim before calling shrink_zone.
-			 * For now we ignore the return value
+			 * Call soft limit reclaim before calling shrink_zone,
+			 * and credit its work so that kswapd does not scan
+			 * and reclaim the zone harder than it has to.
 			 */
-			mem_cgroup_soft_limit_reclaim(zone, order, sc.gfp_mask,
-							nid, zid);
+			nr_soft_scanned = 0;
+			sc.nr_reclaimed += mem_cgroup_soft_limit_reclaim(zone,
+							order, sc.gfp_mask,
+							nid, zid,
+							&nr_soft_scanned);
+			total_scanned += nr_soft_scanned;
 			/*
 			 * We put equal pressure on every zone, unless one
 			 * zone has way too many pages free already.
@@ -2775,18 +3598,16 @@ retry:
 	if (page_evictable(page, NULL)) {
 		enum lru_list l = page_lru_base_type(page);
 
-		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
-		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
-		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
+		del_page_from_lru_list(zone, page, LRU_UNEVICTABLE);
+		add_page_to_lru_list(zone, page, l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
 	} else {
 		/*
 		 * rotate unevictable list
 		 */
 		SetPageUnevictable(page);
-		list_move(&page->lru, &zone->lru[LRU_UNEVICTABLE].list);
-		mem_cgroup_rotate_lru_list(page, LRU_UNEVICTABLE);
+		list_move(&page->lru, mem_cgroup_lru_move_lists(zone, page,
+					LRU_UNEVICTABLE, LRU_UNEVICTABLE));
 		if (page_evictable(page, NULL))
 			goto retry;
 	}
@@ -2847,22 +3668,12 @@ void scan_mapping_unevictable_pages(struct address_space *mapping)
 
 }
 
-/**
- * scan_zone_unevictable_pages - check unevictable list for evictable pages
- * @zone - zone of which to scan the unevictable list
- *
- * Scan @zone's unevictable LRU lists to check for pages that have become
- * evictable.  Move those that have to @zone's inactive list where they
- * become candidates for reclaim, unless shrink_inactive_zone() decides
- * to reactivate them.  Pages that are still unevictable are rotated
- * back onto @zone's unevictable list.
- */
 #define SCAN_UNEVICTABLE_BATCH_SIZE 16UL /* arbitrary lock hold batch size */
-static void scan_zone_unevictable_pages(struct zone *zone)
+static void scan_unevictable_list(struct zone *zone,
+				  struct list_head *l_unevictable,
+				  unsigned long nr_to_scan)
 {
-	struct list_head *l_unevictable = &zone->lru[LRU_UNEVICTABLE].list;
 	unsigned long scan;
-	unsigned long nr_to_scan = zone_page_state(zone, NR_UNEVICTABLE);
 
 	while (nr_to_scan > 0) {
 		unsigned long batch_size = min(nr_to_scan,
@@ -2870,7 +3681,12 @@ static void scan_zone_unevictable_pages(struct zone *zone)
 
 		spin_lock_irq(&zone->lru_lock);
 		for (scan = 0;  scan < batch_size; scan++) {
-			struct page *page = lru_to_page(l_unevictable);
+			struct page *page;
+
+			/* the counts are only a snapshot, the list can drain */
+			if (list_empty(l_unevictable))
+				break;
+			page = lru_to_page(l_unevictable);
 
 			if (!trylock_page(page))
 				continue;
@@ -2888,6 +3704,42 @@ static void scan_zone_unevictable_pages(struct zone *zone)
 	}
 }
 
+/**
+ * scan_zone_unevictable_pages - check unevictable list for evictable pages
+ * @zone - zone of which to scan the unevictable list
+ *
+ * Scan @zone's unevictable LRU lists to check for pages that have become
+ * evictable.  Move those that have to @zone's inactive list where they
+ * become candidates for reclaim, unless shrink_inactive_zone() decides
+ * to reactivate them.  Pages that are still unevictable are rotated
+ * back onto @zone's unevictable list.
+ *
+ * With the memory controller, every cgroup has its own unevictable list
+ * in @zone, and each of them is scanned in turn.
+ */
+static void scan_zone_unevictable_pages(struct zone *zone)
+{
+	struct mem_cgroup_reclaim_walk walk = { .zone = zone, };
+	struct mem_cgroup *mem;
+
+	mem = mem_cgroup_reclaim_iter(NULL, &walk);
+	do {
+		struct list_head *l_unevictable;
+		unsigned long nr_to_scan;
+
+		if (mem) {
+			l_unevictable = mem_cgroup_zone_lru_list(mem, zone,
+							LRU_UNEVICTABLE);
+			nr_to_scan = mem_cgroup_zone_nr_pages(mem, zone,
+							LRU_UNEVICTABLE);
+		} else {
+			l_unevictable = &zone->lru[LRU_UNEVICTABLE].list;
+			nr_to_scan = zone_page_state(zone, NR_UNEVICTABLE);
+		}
+		scan_unevictable_list(zone, l_unevictable, nr_to_scan);
+	} while (mem && (mem = mem_cgroup_reclaim_iter(mem, &walk)));
+}
+
 
 /**
  * scan_all_zones_unevictable_pages - scan all unevictable lists for evictable pages
@@ -0,0 +1,297 @@
+/*
+ * Workingset detection
+ *
+ * Released under the terms of the GNU GPL v2.0.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/mm_inline.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/vmstat.h>
+
+/*
+ *		Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the
+ * inactive and the active list.  Freshly faulted pages start out at
+ * the head of the inactive list and page reclaim scans pages from the
+ * tail.  Pages that are accessed multiple times on the inactive list
+ * are promoted to the active list, to protect them from reclaim,
+ * whereas active pages are demoted to the inactive list when the
+ * active list grows too big.
+ *
+ * This leaves a problem: a workingset that is bigger than the inactive
+ * list but smaller than the active list can make, is evicted from the
+ * inactive list before its second access ever happens.  It thrashes,
+ * while the active list is full of pages that are not used anymore.
+ *
+ *		Approximating inactive page access frequency
+ *
+ * Each zone counts, in inactive_age, the pages that leave its inactive
+ * list: through eviction and through activation.  When a page is
+ * evicted, a snapshot of that counter is stored in the page cache slot
+ * the page leaves behind, the "shadow entry".  When the page faults
+ * back in, the difference between the counter and the snapshot, the
+ * refault distance, is the number of inactive list slots the page was
+ * missing to stay in memory.
+ *
+ * If that distance is not bigger than the active list, the page would
+ * have been accessed twice in memory had the active list given up its
+ * space, so the refaulting page is activated right away to compete
+ * with the current active pages.  If the workingset really changed,
+ * the old active pages get deactivated and evicted in turn; if not,
+ * the refaulting page goes back out when the active list is aged.
+ *
+ *		Shadow entries
+ *
+ * Shadow entries are exceptional radix tree entries, so they cost no
+ * memory beyond the tree nodes that hold them.  Nodes holding nothing
+ * but shadow entries are kept on a global list and reclaimed by a
+ * shrinker once they take up more memory than is reasonable.
+ * Truncation and clear_inode() drop the shadow entries of a mapping.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	/*
+	 * The counter may have wrapped since the eviction, and the
+	 * snapshot lost its upper bits; the distance is only
+	 * meaningful modulo the bits the shadow entry could keep.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Radix tree nodes that hold nothing but shadow entries.  The lock
+ * nests inside the tree_lock of the nodes' mappings, and is therefore
+ * irq-safe as well.
+ */
+static LIST_HEAD(shadow_nodes);
+static DEFINE_SPINLOCK(shadow_nodes_lock);
+static unsigned long nr_shadow_nodes;
+
+/**
+ * workingset_update_node - track a radix tree node's shadow entries
+ * @mapping: address space the node belongs to
+ * @node: leaf node whose entries changed
+ * @index: index of one of @node's entries
+ *
+ * Puts @node on the shadow node list when it holds only shadow
+ * entries, and takes it off when it holds pages.  Must be called
+ * under @mapping->tree_lock.
+ */
+void workingset_update_node(struct address_space *mapping,
+			    struct radix_tree_node *node, pgoff_t index)
+{
+	bool shadow_only = node->count && node->count == node->exceptional;
+
+	if (shadow_only == !list_empty(&node->private_list))
+		return;
+
+	spin_lock(&shadow_nodes_lock);
+	if (shadow_only) {
+		node->private_data = mapping;
+		node->private_index = index;
+		list_add(&node->private_list, &shadow_nodes);
+		nr_shadow_nodes++;
+	} else {
+		list_del_init(&node->private_list);
+		nr_shadow_nodes--;
+	}
+	spin_unlock(&shadow_nodes_lock);
+}
+
+/**
+ * workingset_forget_node - stop tracking a radix tree node
+ * @node: node that is about to hold pages again, or to be freed
+ *
+ * Must be called under the tree_lock of the node's mapping.
+ */
+void workingset_forget_node(struct radix_tree_node *node)
+{
+	if (list_empty(&node->private_list))
+		return;
+
+	spin_lock(&shadow_nodes_lock);
+	list_del_init(&node->private_list);
+	nr_shadow_nodes--;
+	spin_unlock(&shadow_nodes_lock);
+}
+
+/*
+ * Free the least recently tracked shadow node.  Returns false when
+ * there is nothing left to scan.
+ */
+static bool shadow_node_reclaim(void)
+{
+	struct address_space *mapping;
+	struct radix_tree_node *node;
+	struct zone *zone;
+	unsigned long base;
+	unsigned int nr;
+	int i;
+
+	spin_lock_irq(&shadow_nodes_lock);
+	if (list_empty(&shadow_nodes)) {
+		spin_unlock_irq(&shadow_nodes_lock);
+		return false;
+	}
+	node = list_entry(shadow_nodes.prev, struct radix_tree_node,
+			  private_list);
+	mapping = node->private_data;
+
+	/* The tree_lock nests outside of ours, don't wait for it */
+	if (!spin_trylock(&mapping->tree_lock)) {
+		list_move(&node->private_list, &shadow_nodes);
+		spin_unlock_irq(&shadow_nodes_lock);
+		return true;
+	}
+	list_del_init(&node->private_list);
+	nr_shadow_nodes--;
+	spin_unlock(&shadow_nodes_lock);
+
+	/*
+	 * The node was on the list, so it holds shadow entries only, and
+	 * deleting the last of them frees it: don't touch it after that.
+	 */
+	zone = page_zone(virt_to_page(node));
+	base = node->private_index & ~(unsigned long)RADIX_TREE_MAP_MASK;
+	nr = node->count;
+	for (i = 0; nr && i < RADIX_TREE_MAP_SIZE; i++) {
+		if (!node->slots[i])
+			continue;
+		nr--;
+		radix_tree_delete(&mapping->page_tree, base + i);
+		mapping->nrshadows--;
+	}
+	__inc_zone_state(zone, WORKINGSET_NODERECLAIM);
+	spin_unlock_irq(&mapping->tree_lock);
+
+	return true;
+}
+
+/*
+ * A refault distance can never exceed the active list, so there is
+ * no point in remembering more evicted pages than there is memory.
+ * Allow one node for every sixteen pages: assuming half-full nodes,
+ * that is twice as many shadow entries as there are pages.
+ */
+static unsigned long max_shadow_nodes(void)
+{
+	return totalram_pages >> (1 + RADIX_TREE_MAP_SHIFT - 3);
+}
+
+static int shrink_shadow_nodes(struct shrinker *shrink, int nr_to_scan,
+			       gfp_t gfp_mask)
+{
+	unsigned long max_nodes = max_shadow_nodes();
+	unsigned long nodes;
+
+	while (nr_to_scan-- > 0 && ACCESS_ONCE(nr_shadow_nodes) > max_nodes) {
+		if (!shadow_node_reclaim())
+			break;
+		cond_resched();
+	}
+
+	nodes = ACCESS_ONCE(nr_shadow_nodes);
+	if (nodes <= max_nodes)
+		return 0;
+	return min_t(unsigned long, nodes - max_nodes, INT_MAX);
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadow_nodes,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
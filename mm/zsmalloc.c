@@ -0,0 +1,1290 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc is a slab-like allocator for the objects produced by page
+ * compression: many objects of arbitrary size between ZS_MIN_ALLOC_SIZE
+ * and a page.  Unlike kmalloc it never needs physically contiguous
+ * memory beyond order 0 and it wastes little memory on sizes that do not
+ * divide the page size.
+ *
+ * Objects are grouped in size classes ZS_SIZE_CLASS_DELTA bytes apart.
+ * Each class carves its objects out of "zspages": chains of up to
+ * ZS_MAX_PAGES_PER_ZSPAGE order-0 pages, the chain length chosen to
+ * minimise the tail waste for the class size.  Objects may straddle the
+ * boundary between two pages of a zspage.  Classes whose zspages end up
+ * with the same geometry are merged.
+ *
+ * zs_malloc() returns an opaque handle, not a pointer: the pages may be
+ * highmem, and the object may be moved by compaction.  The handle points
+ * to a word holding the object's current location; zs_map_object() pins
+ * that word and returns a pointer valid until zs_unmap_object().  An
+ * object spanning two pages is copied through a per-cpu buffer.
+ * Preemption is disabled while an object is mapped.
+ *
+ * Every object starts with a header word: for an allocated object it is
+ * the handle tagged with OBJ_ALLOCATED_TAG, for a free one the index of
+ * the next free object in the zspage.  That back-reference lets
+ * zs_compact() move allocated objects out of sparsely used zspages into
+ * fuller ones of the same class, and free the emptied zspages.
+ * Compaction also runs from a shrinker under memory pressure.
+ *
+ * Each size class has its own lock.  zs_malloc() and zs_free() use the
+ * KM_USER0 kmap slot internally, a mapped object holds KM_USER1.
+ *
+ * Usage of struct page fields:
+ *	page->private: points to the struct zspage the page belongs to,
+ *		PG_private is set on all component pages.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/hardirq.h>
+#include <linux/highmem.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/bit_spinlock.h>
+#include <linux/types.h>
+#include <linux/cpu.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/zsmalloc.h>
+
+/*
+ * A zspage is made of at most 2^ZS_MAX_ZSPAGE_ORDER pages.  Longer
+ * chains reduce tail waste for large classes at the cost of more
+ * straddling objects.
+ */
+#define ZS_MAX_ZSPAGE_ORDER 2
+#define ZS_MAX_PAGES_PER_ZSPAGE (_AC(1, UL) << ZS_MAX_ZSPAGE_ORDER)
+
+#define ZS_HANDLE_SIZE (sizeof(unsigned long))
+
+/*
+ * Object location (<PFN>, <obj_idx>) is encoded as a single unsigned
+ * long: PFN of the first page of the zspage and the object index within
+ * the zspage, shifted left by OBJ_TAG_BITS so that bit 0 stays free
+ * for the handle pin bit and the allocated tag.
+ */
+#ifndef MAX_PHYSMEM_BITS
+#ifdef CONFIG_HIGHMEM64G
+#define MAX_PHYSMEM_BITS 36
+#else /* !CONFIG_HIGHMEM64G */
+/*
+ * If this definition of MAX_PHYSMEM_BITS is used, OBJ_INDEX_BITS will be
+ * PAGE_SHIFT - OBJ_TAG_BITS
+ */
+#define MAX_PHYSMEM_BITS BITS_PER_LONG
+#endif
+#endif
+#define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
+
+/* Bit 0 of an object header: set while the object is allocated */
+#define OBJ_ALLOCATED_TAG 1
+#define OBJ_TAG_BITS 1
+#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
+#define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
+
+/* Bit 0 of the word a handle points to: set while the handle is pinned */
+#define HANDLE_PIN_BIT	0
+
+#define MAX(a, b) ((a) >= (b) ? (a) : (b))
+/* Objects smaller than this would not fit in OBJ_INDEX_BITS per zspage */
+#define ZS_MIN_ALLOC_SIZE \
+	MAX(32, (ZS_MAX_PAGES_PER_ZSPAGE << PAGE_SHIFT >> OBJ_INDEX_BITS))
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA bytes apart.  The delta is a
+ * multiple of the header size, so object headers never straddle pages.
+ */
+#define CLASS_BITS	8
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> CLASS_BITS)
+#define ZS_SIZE_CLASSES	(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE, \
+				      ZS_SIZE_CLASS_DELTA) + 1)
+
+/*
+ * We do not maintain any list for completely empty or full zspages:
+ * empty ones are freed at once, full ones cannot serve allocations and
+ * are not compaction sources.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+	ZS_FULL
+};
+
+/*
+ * A zspage is "almost full" once more than 3/4 of its objects are in
+ * use.  Allocations prefer almost full zspages, compaction empties the
+ * almost empty ones.
+ */
+static const int fullness_threshold_frac = 4;
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	/* Size of objects stored in this class, header included */
+	int size;
+	int objs_per_zspage;
+	/* Number of PAGE_SIZE sized pages to combine to form a 'zspage' */
+	int pages_per_zspage;
+	/* Highest size class index this class serves (see merging) */
+	unsigned int index;
+
+	/* Objects the zspages of this class can hold, and hold */
+	unsigned long objs_allocated;
+	unsigned long objs_inuse;
+};
+
+struct zspage {
+	struct list_head list;		/* fullness list of the class */
+	unsigned int inuse;		/* allocated objects */
+	unsigned int freeobj;		/* index of the first free object */
+	unsigned int class_idx;
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct zs_pool {
+	const char *name;
+
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+
+	/* Total pages allocated by the pool */
+	atomic_long_t pages_allocated;
+
+	struct shrinker shrinker;
+};
+
+/*
+ * Per-cpu area an object straddling two pages is copied into while it
+ * is mapped.
+ */
+struct mapping_area {
+	char *vm_buf; /* copy buffer for objects that span pages */
+	char *vm_addr; /* address of kmap_atomic()'ed pages */
+	enum zs_mapmode vm_mm; /* mapping mode */
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static struct kmem_cache *zs_handle_cachep;
+static struct kmem_cache *zspage_cachep;
+
+static unsigned long cache_alloc_handle(gfp_t gfp)
+{
+	return (unsigned long)kmem_cache_alloc(zs_handle_cachep,
+			gfp & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+}
+
+static void cache_free_handle(unsigned long handle)
+{
+	kmem_cache_free(zs_handle_cachep, (void *)handle);
+}
+
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	*(unsigned long *)handle = obj;
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle & ~(1UL << HANDLE_PIN_BIT);
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/*
+ * Encode <first page of zspage, obj_idx> as a single opaque value.
+ */
+static unsigned long location_to_obj(struct zspage *zspage,
+				unsigned int obj_idx)
+{
+	unsigned long obj;
+
+	obj = page_to_pfn(zspage->pages[0]) << OBJ_INDEX_BITS;
+	obj |= obj_idx & OBJ_INDEX_MASK;
+	obj <<= OBJ_TAG_BITS;
+
+	return obj;
+}
+
+static void obj_to_location(unsigned long obj, struct zspage **zspage,
+				unsigned int *obj_idx)
+{
+	struct page *page;
+
+	obj >>= OBJ_TAG_BITS;
+	page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+	*zspage = (struct zspage *)page_private(page);
+	*obj_idx = obj & OBJ_INDEX_MASK;
+}
+
+/* Page and in-page offset where object obj_idx starts */
+static struct page *obj_idx_to_page(struct size_class *class,
+			struct zspage *zspage, unsigned int obj_idx,
+			unsigned long *offset)
+{
+	unsigned long off = (unsigned long)obj_idx * class->size;
+
+	*offset = off & ~PAGE_MASK;
+	return zspage->pages[off >> PAGE_SHIFT];
+}
+
+/*
+ * Header word of an object: never straddles a page boundary as class
+ * sizes are multiples of ZS_SIZE_CLASS_DELTA.
+ */
+static unsigned long read_obj_header(struct size_class *class,
+			struct zspage *zspage, unsigned int obj_idx)
+{
+	unsigned long offset, val;
+	struct page *page;
+	void *vaddr;
+
+	page = obj_idx_to_page(class, zspage, obj_idx, &offset);
+	vaddr = kmap_atomic(page, KM_USER0);
+	val = *(unsigned long *)(vaddr + offset);
+	kunmap_atomic(vaddr, KM_USER0);
+
+	return val;
+}
+
+static void write_obj_header(struct size_class *class, struct zspage *zspage,
+			unsigned int obj_idx, unsigned long val)
+{
+	unsigned long offset;
+	struct page *page;
+	void *vaddr;
+
+	page = obj_idx_to_page(class, zspage, obj_idx, &offset);
+	vaddr = kmap_atomic(page, KM_USER0);
+	*(unsigned long *)(vaddr + offset) = val;
+	kunmap_atomic(vaddr, KM_USER0);
+}
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return min_t(int, idx, ZS_SIZE_CLASSES - 1);
+}
+
+/*
+ * For each size class, zspages are divided into different groups
+ * depending on how "full" they are, so that allocation can prefer
+ * nearly full zspages and compaction can find nearly empty ones.
+ * This function returns fullness status of the given zspage.
+ */
+static enum fullness_group get_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	int inuse, objs_per_zspage;
+
+	inuse = zspage->inuse;
+	objs_per_zspage = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == objs_per_zspage)
+		return ZS_FULL;
+	if (inuse <= 3 * objs_per_zspage / fullness_threshold_frac)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+/*
+ * Each size class maintains various freelists and zspages are assigned
+ * to one of these freelists based on the number of live objects they
+ * have. This functions inserts the given zspage into the freelist
+ * identified by <class, fullness_group>.
+ */
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+				enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+	list_add(&zspage->list, &class->fullness_list[fullness]);
+}
+
+/*
+ * This function removes the given zspage from the freelist identified
+ * by <class, fullness_group>.
+ */
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	if (zspage->fullness >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+	list_del_init(&zspage->list);
+}
+
+/*
+ * Each size class maintains zspages in different fullness groups depending
+ * on the number of live objects they contain. When allocating or freeing
+ * objects, the fullness status of the page can change, say, from ALMOST_FULL
+ * to ALMOST_EMPTY when freeing an object. This function checks if such
+ * a status change has occurred for the given page and accordingly moves the
+ * page from the freelist of the old fullness group to that of the new
+ * fullness group.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		goto out;
+
+	remove_zspage(class, zspage);
+	insert_zspage(class, zspage, newfg);
+out:
+	return newfg;
+}
+
+/*
+ * We have to decide on how many pages to link together
+ * to form a zspage for each size class. This is important
+ * to reduce wastage due to unusable space left at end of
+ * each zspage which is given as:
+ *     wastage = Zp % class_size
+ *     usage = Zp - wastage
+ * where Zp = zspage size = k * PAGE_SIZE where k = 1, 2, ...
+ *
+ * For example, for size class of 3/8 * PAGE_SIZE, we should
+ * link together 3 PAGE_SIZE sized pages to form a zspage
+ * since then we can perfectly fit in 8 such objects.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	int i;
+
+	BUG_ON(zspage->inuse);
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page = zspage->pages[i];
+
+		ClearPagePrivate(page);
+		set_page_private(page, 0);
+		__free_page(page);
+	}
+	kmem_cache_free(zspage_cachep, zspage);
+
+	class->objs_allocated -= class->objs_per_zspage;
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+/* Link all objects of a new zspage into its free list */
+static void init_zspage(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int i;
+
+	for (i = 0; i < class->objs_per_zspage; i++)
+		write_obj_header(class, zspage, i,
+				 (unsigned long)(i + 1) << OBJ_TAG_BITS);
+	zspage->freeobj = 0;
+	zspage->inuse = 0;
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->fullness = ZS_EMPTY;
+}
+
+/*
+ * Allocate a zspage for the given size class
+ */
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	struct zspage *zspage;
+	int i;
+
+	zspage = kmem_cache_alloc(zspage_cachep,
+			flags & ~(__GFP_HIGHMEM | __GFP_MOVABLE));
+	if (!zspage)
+		return NULL;
+	zspage->class_idx = class->index;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page;
+
+		page = alloc_page(flags);
+		if (!page) {
+			while (--i >= 0) {
+				ClearPagePrivate(zspage->pages[i]);
+				set_page_private(zspage->pages[i], 0);
+				__free_page(zspage->pages[i]);
+			}
+			kmem_cache_free(zspage_cachep, zspage);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)zspage);
+		SetPagePrivate(page);
+		zspage->pages[i] = page;
+	}
+
+	init_zspage(class, zspage);
+	return zspage;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = 0; i < _ZS_NR_FULLNESS_GROUPS; i++) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+/* Take a free object out of zspage and tag it with handle */
+static unsigned long obj_malloc(struct size_class *class,
+				struct zspage *zspage, unsigned long handle)
+{
+	unsigned int obj_idx = zspage->freeobj;
+	unsigned long next;
+
+	next = read_obj_header(class, zspage, obj_idx);
+	write_obj_header(class, zspage, obj_idx, handle | OBJ_ALLOCATED_TAG);
+	zspage->freeobj = next >> OBJ_TAG_BITS;
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	return location_to_obj(zspage, obj_idx);
+}
+
+static void obj_free(struct size_class *class, unsigned long obj)
+{
+	struct zspage *zspage;
+	unsigned int obj_idx;
+
+	obj_to_location(obj, &zspage, &obj_idx);
+	write_obj_header(class, zspage, obj_idx,
+			 (unsigned long)zspage->freeobj << OBJ_TAG_BITS);
+	zspage->freeobj = obj_idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @gfp: gfp flags when allocating object
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
+{
+	unsigned long handle, obj;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	handle = cache_alloc_handle(gfp);
+	if (!handle)
+		return 0;
+
+	/* extra space in chunk to keep the handle */
+	size += ZS_HANDLE_SIZE;
+	class = pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (likely(zspage)) {
+		obj = obj_malloc(class, zspage, handle);
+		/* Now move the zspage to another fullness group, if required */
+		fix_fullness_group(class, zspage);
+		record_obj(handle, obj);
+		spin_unlock(&class->lock);
+
+		return handle;
+	}
+	spin_unlock(&class->lock);
+
+	zspage = alloc_zspage(class, gfp);
+	if (!zspage) {
+		cache_free_handle(handle);
+		return 0;
+	}
+
+	spin_lock(&class->lock);
+	class->objs_allocated += class->objs_per_zspage;
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	obj = obj_malloc(class, zspage, handle);
+	insert_zspage(class, zspage, get_fullness_group(class, zspage));
+	record_obj(handle, obj);
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zspage *zspage;
+	unsigned int obj_idx;
+	unsigned long obj;
+	struct size_class *class;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &zspage, &obj_idx);
+	class = pool->size_class[zspage->class_idx];
+
+	spin_lock(&class->lock);
+	obj_free(class, obj);
+	fullness = fix_fullness_group(class, zspage);
+	if (fullness == ZS_EMPTY)
+		free_zspage(pool, class, zspage);
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	cache_free_handle(handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/* Copy an object spanning two pages into the per-cpu buffer */
+static void *__zs_map_object(struct mapping_area *area,
+			struct page *pages[2], int off, int size)
+{
+	int sizes[2];
+	void *addr;
+	char *buf = area->vm_buf;
+
+	/* no read fastpath: write-only mappings start from scratch */
+	if (area->vm_mm == ZS_MM_WO)
+		goto out;
+
+	sizes[0] = PAGE_SIZE - off;
+	sizes[1] = size - sizes[0];
+
+	/* copy object to per-cpu buffer */
+	addr = kmap_atomic(pages[0], KM_USER1);
+	memcpy(buf, addr + off, sizes[0]);
+	kunmap_atomic(addr, KM_USER1);
+	addr = kmap_atomic(pages[1], KM_USER1);
+	memcpy(buf + sizes[0], addr, sizes[1]);
+	kunmap_atomic(addr, KM_USER1);
+out:
+	return area->vm_buf;
+}
+
+/* Copy the per-cpu buffer back into an object spanning two pages */
+static void __zs_unmap_object(struct mapping_area *area,
+			struct page *pages[2], int off, int size)
+{
+	int sizes[2];
+	void *addr;
+	char *buf;
+
+	/* no write fastpath */
+	if (area->vm_mm == ZS_MM_RO)
+		return;
+
+	/* the handle header is not the user's to change */
+	buf = area->vm_buf + ZS_HANDLE_SIZE;
+	size -= ZS_HANDLE_SIZE;
+	off += ZS_HANDLE_SIZE;
+
+	sizes[0] = PAGE_SIZE - off;
+	sizes[1] = size - sizes[0];
+
+	/* copy per-cpu buffer to object */
+	addr = kmap_atomic(pages[0], KM_USER1);
+	memcpy(addr + off, buf, sizes[0]);
+	kunmap_atomic(addr, KM_USER1);
+	addr = kmap_atomic(pages[1], KM_USER1);
+	memcpy(addr, buf + sizes[0], sizes[1]);
+	kunmap_atomic(addr, KM_USER1);
+}
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: mapping mode to use
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped using
+ * this function. When done with the object, it must be unmapped using
+ * zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. There is no protection
+ * against nested mappings.
+ *
+ * This function returns with preemption and page faults disabled.  The
+ * mapping uses the KM_USER1 kmap slot.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zspage *zspage;
+	unsigned long obj, off;
+	unsigned int obj_idx;
+	struct size_class *class;
+	struct mapping_area *area;
+	struct page *pages[2];
+	void *ret;
+
+	BUG_ON(!handle);
+
+	/*
+	 * Because we use per-cpu mapping areas shared among the
+	 * pools/users, we can't allow mapping in interrupt context
+	 * because it can corrupt another users mappings.
+	 */
+	BUG_ON(in_interrupt());
+
+	/* From now on, compaction cannot move the object */
+	pin_tag(handle);
+
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &zspage, &obj_idx);
+	class = pool->size_class[zspage->class_idx];
+	pages[0] = obj_idx_to_page(class, zspage, obj_idx, &off);
+
+	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+	if (off + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(pages[0], KM_USER1);
+		ret = area->vm_addr + off;
+		goto out;
+	}
+
+	/* this object spans two pages */
+	pages[1] = zspage->pages[((unsigned long)obj_idx * class->size >>
+				  PAGE_SHIFT) + 1];
+	ret = __zs_map_object(area, pages, off, class->size);
+out:
+	return ret + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zspage *zspage;
+	unsigned long obj, off;
+	unsigned int obj_idx;
+	struct size_class *class;
+	struct mapping_area *area;
+	struct page *pages[2];
+
+	BUG_ON(!handle);
+
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &zspage, &obj_idx);
+	class = pool->size_class[zspage->class_idx];
+	pages[0] = obj_idx_to_page(class, zspage, obj_idx, &off);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (off + class->size <= PAGE_SIZE) {
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	} else {
+		pages[1] = zspage->pages[((unsigned long)obj_idx *
+					  class->size >> PAGE_SHIFT) + 1];
+		__zs_unmap_object(area, pages, off, class->size);
+	}
+	put_cpu_var(zs_map_area);
+
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/**
+ * zs_get_total_pages - pages used by the pool
+ * @pool: pool to query
+ *
+ * Includes the unused tail of every zspage, not the handles and zspage
+ * descriptors which live in slab caches.
+ */
+unsigned long zs_get_total_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_allocated);
+}
+EXPORT_SYMBOL_GPL(zs_get_total_pages);
+
+/*
+ * Copy an object between two zspages of the same class, page by page
+ * as either end may straddle a page boundary.
+ */
+static void zs_object_copy(struct size_class *class, unsigned long dst,
+				unsigned long src)
+{
+	struct zspage *s_zspage, *d_zspage;
+	unsigned int s_idx, d_idx;
+	unsigned long s_off, d_off;
+	struct page *s_page, *d_page;
+	void *s_addr, *d_addr;
+	int s_size, d_size, size;
+	int written = 0;
+
+	s_size = d_size = class->size;
+
+	obj_to_location(src, &s_zspage, &s_idx);
+	obj_to_location(dst, &d_zspage, &d_idx);
+	s_page = obj_idx_to_page(class, s_zspage, s_idx, &s_off);
+	d_page = obj_idx_to_page(class, d_zspage, d_idx, &d_off);
+
+	if (s_off + class->size > PAGE_SIZE)
+		s_size = PAGE_SIZE - s_off;
+	if (d_off + class->size > PAGE_SIZE)
+		d_size = PAGE_SIZE - d_off;
+
+	s_addr = kmap_atomic(s_page, KM_USER0);
+	d_addr = kmap_atomic(d_page, KM_USER1);
+
+	while (1) {
+		size = min(s_size, d_size);
+		memcpy(d_addr + d_off, s_addr + s_off, size);
+		written += size;
+
+		if (written == class->size)
+			break;
+
+		s_off += size;
+		s_size -= size;
+		d_off += size;
+		d_size -= size;
+
+		if (s_off >= PAGE_SIZE) {
+			kunmap_atomic(s_addr, KM_USER0);
+			s_page = s_zspage->pages[((unsigned long)s_idx *
+					class->size + written) >> PAGE_SHIFT];
+			s_addr = kmap_atomic(s_page, KM_USER0);
+			s_size = class->size - written;
+			s_off = 0;
+		}
+
+		if (d_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr, KM_USER1);
+			d_page = d_zspage->pages[((unsigned long)d_idx *
+					class->size + written) >> PAGE_SHIFT];
+			d_addr = kmap_atomic(d_page, KM_USER1);
+			d_size = class->size - written;
+			d_off = 0;
+		}
+	}
+
+	kunmap_atomic(d_addr, KM_USER1);
+	kunmap_atomic(s_addr, KM_USER0);
+}
+
+/*
+ * Find the first allocated object at or after *obj_idx in zspage and
+ * return its handle, or 0 if there is none.
+ */
+static unsigned long find_alloced_obj(struct size_class *class,
+			struct zspage *zspage, unsigned int *obj_idx)
+{
+	unsigned long head;
+
+	for (; *obj_idx < class->objs_per_zspage; (*obj_idx)++) {
+		head = read_obj_header(class, zspage, *obj_idx);
+		if (head & OBJ_ALLOCATED_TAG)
+			return head & ~OBJ_ALLOCATED_TAG;
+	}
+
+	return 0;
+}
+
+struct zs_compact_control {
+	/* Source zspage, and where to resume scanning it */
+	struct zspage *s_zspage;
+	unsigned int obj_idx;
+	/* Destination zspage */
+	struct zspage *d_zspage;
+};
+
+/*
+ * Move allocated objects from the source to the destination zspage.
+ * Returns -ENOMEM when the destination filled up before the source was
+ * drained, -EBUSY when an object is pinned (mapped or being freed) and
+ * 0 once the source is empty.
+ */
+static int migrate_zspage(struct size_class *class,
+			  struct zs_compact_control *cc)
+{
+	unsigned long used_obj, free_obj;
+	unsigned long handle;
+	int ret = 0;
+
+	while (1) {
+		handle = find_alloced_obj(class, cc->s_zspage, &cc->obj_idx);
+		if (!handle)
+			break;
+
+		/* Stop if there is no more space */
+		if (cc->d_zspage->inuse == class->objs_per_zspage) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		/* Mapped or being freed: the source can't be emptied */
+		if (!trypin_tag(handle)) {
+			ret = -EBUSY;
+			break;
+		}
+
+		used_obj = handle_to_obj(handle);
+		free_obj = obj_malloc(class, cc->d_zspage, handle);
+		zs_object_copy(class, free_obj, used_obj);
+		cc->obj_idx++;
+		/* Keep the handle pinned across the update */
+		record_obj(handle, free_obj | (1UL << HANDLE_PIN_BIT));
+		unpin_tag(handle);
+		obj_free(class, used_obj);
+	}
+
+	return ret;
+}
+
+/*
+ * Take a zspage off the fullness lists: sources are the emptiest
+ * zspages, destinations the fullest.
+ */
+static struct zspage *isolate_zspage(struct size_class *class, bool source)
+{
+	static const enum fullness_group source_fg[] = {
+		ZS_ALMOST_EMPTY, ZS_ALMOST_FULL
+	};
+	static const enum fullness_group dest_fg[] = {
+		ZS_ALMOST_FULL, ZS_ALMOST_EMPTY
+	};
+	const enum fullness_group *fg = source ? source_fg : dest_fg;
+	struct zspage *zspage;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct list_head *head = &class->fullness_list[fg[i]];
+
+		if (list_empty(head))
+			continue;
+		zspage = list_first_entry(head, struct zspage, list);
+		remove_zspage(class, zspage);
+		zspage->fullness = ZS_FULL;	/* off the lists */
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/* Put an isolated zspage back on the list its fullness calls for */
+static enum fullness_group putback_zspage(struct size_class *class,
+					  struct zspage *zspage)
+{
+	enum fullness_group fullness;
+
+	fullness = get_fullness_group(class, zspage);
+	insert_zspage(class, zspage, fullness);
+
+	return fullness;
+}
+
+/*
+ * Number of pages compaction of this class could free: the space of
+ * free objects, in whole zspages.
+ */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_wasted;
+
+	obj_wasted = class->objs_allocated - class->objs_inuse;
+	obj_wasted /= class->objs_per_zspage;
+
+	return obj_wasted * class->pages_per_zspage;
+}
+
+static unsigned long __zs_compact(struct zs_pool *pool,
+				  struct size_class *class)
+{
+	struct zs_compact_control cc;
+	struct zspage *src_zspage;
+	struct zspage *dst_zspage = NULL;
+	unsigned long pages_freed = 0;
+	int ret = 0;
+
+	spin_lock(&class->lock);
+	while ((src_zspage = isolate_zspage(class, true))) {
+
+		if (!zs_can_compact(class))
+			break;
+
+		cc.obj_idx = 0;
+		cc.s_zspage = src_zspage;
+
+		while ((dst_zspage = isolate_zspage(class, false))) {
+			cc.d_zspage = dst_zspage;
+			/* Move on to the next fullest zspage when this one fills */
+			ret = migrate_zspage(class, &cc);
+			if (ret != -ENOMEM)
+				break;
+
+			putback_zspage(class, dst_zspage);
+		}
+
+		/* Stop if we couldn't find slot */
+		if (dst_zspage == NULL)
+			break;
+
+		/*
+		 * The source keeps a pinned object: it would be picked again
+		 * as the emptiest zspage, so leave the class for now.
+		 */
+		if (ret == -EBUSY) {
+			putback_zspage(class, dst_zspage);
+			break;
+		}
+
+		putback_zspage(class, dst_zspage);
+		if (putback_zspage(class, src_zspage) == ZS_EMPTY) {
+			free_zspage(pool, class, src_zspage);
+			pages_freed += class->pages_per_zspage;
+		}
+		src_zspage = NULL;
+		spin_unlock(&class->lock);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+
+	if (src_zspage)
+		putback_zspage(class, src_zspage);
+
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - defragment the pool
+ * @pool: pool to compact
+ *
+ * Moves objects out of sparsely used zspages into fuller ones of the
+ * same size class and frees the zspages left empty.  Objects that are
+ * mapped at the time stay where they are.  May sleep.
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	struct size_class *class;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		class = pool->size_class[i];
+		if (!class)
+			continue;
+		if (class->index != i)
+			continue;
+		pages_freed += __zs_compact(pool, class);
+	}
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * Under memory pressure, compact the pool.  Reports the pages that
+ * compaction could free as the shrinkable "objects".
+ */
+static int zs_shrinker(struct shrinker *shrinker, int nr_to_scan,
+		       gfp_t gfp_mask)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+	unsigned long pages = 0;
+	int i;
+
+	if (nr_to_scan)
+		zs_compact(pool);
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		struct size_class *class = pool->size_class[i];
+
+		if (!class || class->index != i)
+			continue;
+		pages += zs_can_compact(class);
+	}
+
+	return min_t(unsigned long, pages, INT_MAX);
+}
+
+/*
+ * Classes whose zspages have the same geometry behave identically and
+ * can share their zspages.
+ */
+static bool can_merge(struct size_class *prev, int pages_per_zspage,
+			int objs_per_zspage)
+{
+	if (prev->pages_per_zspage == pages_per_zspage &&
+		prev->objs_per_zspage == objs_per_zspage)
+		return true;
+
+	return false;
+}
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: pool name to be created
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	int i;
+	struct zs_pool *pool;
+	struct size_class *prev_class = NULL;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->name = name;
+	atomic_long_set(&pool->pages_allocated, 0);
+
+	/*
+	 * Iterate reversely, because, size of size_class that we want to use
+	 * for merging should be larger or equal to current size.
+	 */
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+		int size;
+		int pages_per_zspage;
+		int objs_per_zspage;
+		struct size_class *class;
+		int fullness;
+
+		size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		if (size > ZS_MAX_ALLOC_SIZE)
+			size = ZS_MAX_ALLOC_SIZE;
+		pages_per_zspage = get_pages_per_zspage(size);
+		objs_per_zspage = pages_per_zspage * PAGE_SIZE / size;
+
+		/*
+		 * size_class is used for normal zsmalloc operation such
+		 * as alloc/free for that size. Although it is natural that we
+		 * have one size_class for each size, there is a chance that we
+		 * can get more memory utilization if we use one size_class for
+		 * many different sizes whose size_class have same
+		 * characteristics. So, we makes size_class point to
+		 * previous size_class if possible.
+		 */
+		if (prev_class &&
+		    can_merge(prev_class, pages_per_zspage, objs_per_zspage)) {
+			pool->size_class[i] = prev_class;
+			continue;
+		}
+
+		class = kzalloc(sizeof(struct size_class), GFP_KERNEL);
+		if (!class)
+			goto err;
+
+		class->size = size;
+		class->index = i;
+		class->pages_per_zspage = pages_per_zspage;
+		class->objs_per_zspage = objs_per_zspage;
+		spin_lock_init(&class->lock);
+		pool->size_class[i] = class;
+		for (fullness = 0; fullness < _ZS_NR_FULLNESS_GROUPS;
+							fullness++)
+			INIT_LIST_HEAD(&class->fullness_list[fullness]);
+
+		prev_class = class;
+	}
+
+	pool->shrinker.shrink = zs_shrinker;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+
+err:
+	zs_destroy_pool(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	if (pool->shrinker.shrink)
+		unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = pool->size_class[i];
+
+		if (!class)
+			continue;
+
+		if (class->index != i)
+			continue;
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (!list_empty(&class->fullness_list[fg])) {
+				pr_info("zsmalloc: freeing non-empty class with"
+					" size %db, fullness group %d\n",
+					class->size, fg);
+			}
+		}
+		kfree(class);
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
+				void *pcpu)
+{
+	int cpu = (long)pcpu;
+	struct mapping_area *area;
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+	case CPU_UP_PREPARE_FROZEN:
+		area = &per_cpu(zs_map_area, cpu);
+		/*
+		 * Make sure we don't leak memory if a cpu UP notification
+		 * and zs_init() race and both call zs_cpu_up() on the same cpu
+		 */
+		if (area->vm_buf)
+			return NOTIFY_OK;
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			return notifier_from_errno(-ENOMEM);
+		break;
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+	case CPU_UP_CANCELED:
+	case CPU_UP_CANCELED_FROZEN:
+		area = &per_cpu(zs_map_area, cpu);
+		kfree(area->vm_buf);
+		area->vm_buf = NULL;
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block zs_cpu_nb = {
+	.notifier_call = zs_cpu_notifier
+};
+
+static void zs_exit(void)
+{
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		zs_cpu_notifier(NULL, CPU_DEAD, (void *)(long)cpu);
+	unregister_cpu_notifier(&zs_cpu_nb);
+	put_online_cpus();
+
+	if (zspage_cachep)
+		kmem_cache_destroy(zspage_cachep);
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+}
+
+static int __init zs_init(void)
+{
+	int cpu, ret;
+
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					     0, 0, NULL);
+	zspage_cachep = kmem_cache_create("zspage", sizeof(struct zspage),
+					  0, 0, NULL);
+	if (!zs_handle_cachep || !zspage_cachep)
+		goto fail;
+
+	get_online_cpus();
+	register_cpu_notifier(&zs_cpu_nb);
+	for_each_online_cpu(cpu) {
+		ret = zs_cpu_notifier(NULL, CPU_UP_PREPARE, (void *)(long)cpu);
+		if (notifier_to_errno(ret)) {
+			put_online_cpus();
+			goto fail;
+		}
+	}
+	put_online_cpus();
+	return 0;
+fail:
+	zs_exit();
+	return -ENOMEM;
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Allocator for compressed pages");
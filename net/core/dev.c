@@ -130,6 +130,7 @@
 #include <linux/jhash.h>
 #include <linux/random.h>
 #include <trace/events/napi.h>
+#include <net/busy_poll.h>
 #include <linux/pci.h>
 
 #include "net-sysfs.h"
@@ -1497,7 +1498,8 @@ int dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 	skb_orphan(skb);
 	nf_reset(skb);
 
-	if (!(dev->flags & IFF_UP) ||
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)) ||
+	    !(dev->flags & IFF_UP) ||
 	    (skb->len > (dev->mtu + dev->hard_header_len + VLAN_HLEN))) {
 		kfree_skb(skb);
 		return NET_RX_DROP;
@@ -1555,6 +1557,10 @@ static void dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev)
 
 			skb2->transport_header = skb2->network_header;
 			skb2->pkt_type = PACKET_OUTGOING;
+			if (unlikely(skb_orphan_frags_rx(skb2, GFP_ATOMIC))) {
+				kfree_skb(skb2);
+				continue;
+			}
 			ptype->func(skb2, skb->dev, ptype, skb->dev);
 		}
 	}
@@ -1565,6 +1571,33 @@ static void dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev)
  * Routine to help set real_num_tx_queues. To avoid skbs mapped to queues
  * greater then real_num_tx_queues stale skbs on the qdisc must be flushed.
  */
+static void netif_setup_tc(struct net_device *dev, unsigned int txq)
+{
+	struct netdev_tc_txq *tc = &dev->tc_to_txq[0];
+	int i;
+
+	/* If TC0 is invalidated disable TC mapping */
+	if (tc->offset + tc->count > txq) {
+		pr_warning("%s: number of in use tx queues changed, "
+			   "invalidating tc mappings\n", dev->name);
+		dev->num_tc = 0;
+		return;
+	}
+
+	/* Invalidated prio to tc mappings are set to TC0 */
+	for (i = 1; i < TC_BITMASK + 1; i++) {
+		int q = netdev_get_prio_tc_map(dev, i);
+
+		tc = &dev->tc_to_txq[q];
+		if (tc->offset + tc->count > txq) {
+			pr_warning("%s: number of in use tx queues changed, "
+				   "priority %d to tc %d mapping reset to 0\n",
+				   dev->name, i, q);
+			netdev_set_prio_tc_map(dev, i, 0);
+		}
+	}
+}
+
 void netif_set_real_num_tx_queues(struct net_device *dev, unsigned int txq)
 {
 	unsigned int real_num = dev->real_num_tx_queues;
@@ -1575,6 +1608,8 @@ void netif_set_real_num_tx_queues(struct net_device *dev, unsigned int txq)
 		dev->real_num_tx_queues = txq;
 	else if (txq < real_num) {
 		dev->real_num_tx_queues = txq;
+		if (dev->num_tc)
+			netif_setup_tc(dev, txq);
 		qdisc_reset_all_tx_gt(dev, txq);
 	}
 }
@@ -1816,6 +1851,94 @@ struct sk_buff *skb_gso_segment(struct sk_buff *skb, int features)
 }
 EXPORT_SYMBOL(skb_gso_segment);
 
+/**
+ *	dev_find_offload - look up the offload handlers of a protocol
+ *	@type: protocol in network byte order
+ *
+ *	Returns the wildcard packet handler for @type that implements both
+ *	segmentation and receive offload, or %NULL.  Encapsulation protocols
+ *	use this to hand their inner packet on from their own GSO and GRO
+ *	callbacks.  The caller must hold rcu_read_lock().
+ */
+struct packet_type *dev_find_offload(__be16 type)
+{
+	struct packet_type *ptype;
+
+	list_for_each_entry_rcu(ptype,
+			&ptype_base[ntohs(type) & PTYPE_HASH_MASK], list) {
+		if (ptype->type == type && !ptype->dev &&
+		    ptype->gso_segment && ptype->gro_receive)
+			return ptype;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL(dev_find_offload);
+
+/**
+ *	skb_encap_gso_segment - segment the payload of a tunnel packet
+ *	@skb: buffer with data pointing at the inner network header
+ *	@features: features for the output path
+ *	@type: protocol of the inner packet in network byte order
+ *
+ *	Called from the gso_segment handler of an encapsulation protocol
+ *	once it has pulled its own header, under rcu_read_lock().  The outer
+ *	headers are treated as part of the link layer header and copied to
+ *	every segment.  On return the network header of each segment points
+ *	at the outer header again, so the outer protocol can fix up lengths
+ *	and checksums as it does for an ordinary segment.
+ */
+struct sk_buff *skb_encap_gso_segment(struct sk_buff *skb, int features,
+				      __be16 type)
+{
+	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
+	unsigned int mac_len = skb->mac_len;
+	__be16 protocol = skb->protocol;
+	struct packet_type *ptype;
+	struct sk_buff *seg;
+
+	ptype = dev_find_offload(type);
+	if (!ptype)
+		goto out;
+
+	skb->protocol = type;
+	skb_reset_network_header(skb);
+	skb->mac_len = skb->network_header - skb->mac_header;
+
+	segs = ptype->gso_segment(skb, features);
+
+	skb->protocol = protocol;
+	skb->mac_len = mac_len;
+	skb->network_header = skb->mac_header + mac_len;
+
+	if (!segs || IS_ERR(segs))
+		goto out;
+
+	for (seg = segs; seg; seg = seg->next) {
+		seg->protocol = protocol;
+		seg->mac_len = mac_len;
+		skb_set_network_header(seg, mac_len);
+
+		/* Only a generic checksum engine can reach the inner
+		 * transport header; everyone else gets it done here.
+		 */
+		if (seg->ip_summed == CHECKSUM_PARTIAL &&
+		    !(features & NETIF_F_GEN_CSUM) && skb_checksum_help(seg)) {
+			while (segs) {
+				seg = segs;
+				segs = segs->next;
+				kfree_skb(seg);
+			}
+			segs = ERR_PTR(-EINVAL);
+			break;
+		}
+	}
+
+out:
+	return segs;
+}
+EXPORT_SYMBOL(skb_encap_gso_segment);
+
 /* Take action when hardware reception checksum errors are detected. */
 #ifdef CONFIG_BUG
 void netdev_rx_csum_fault(struct net_device *dev)
@@ -2003,6 +2126,8 @@ static u32 hashrnd __read_mostly;
 u16 skb_tx_hash(const struct net_device *dev, const struct sk_buff *skb)
 {
 	u32 hash;
+	u16 qoffset = 0;
+	u16 qcount = dev->real_num_tx_queues;
 
 	if (skb_rx_queue_recorded(skb)) {
 		hash = skb_get_rx_queue(skb);
@@ -2011,13 +2136,21 @@ u16 skb_tx_hash(const struct net_device *dev, const struct sk_buff *skb)
 		return hash;
 	}
 
+	/* spread only over the queues of the packet's traffic class */
+	if (dev->num_tc) {
+		u8 tc = netdev_get_prio_tc_map(dev, skb->priority);
+
+		qoffset = dev->tc_to_txq[tc].offset;
+		qcount = dev->tc_to_txq[tc].count;
+	}
+
 	if (skb->sk && skb->sk->sk_hash)
 		hash = skb->sk->sk_hash;
 	else
 		hash = (__force u16) skb->protocol ^ skb->rxhash;
 	hash = jhash_1word(hash, hashrnd);
 
-	return (u16) (((u64) hash * dev->real_num_tx_queues) >> 32);
+	return (u16) (((u64) hash * qcount) >> 32) + qoffset;
 }
 EXPORT_SYMBOL(skb_tx_hash);
 
@@ -2037,17 +2170,21 @@ static inline u16 dev_cap_txqueue(struct net_device *dev, u16 queue_index)
 static struct netdev_queue *dev_pick_tx(struct net_device *dev,
 					struct sk_buff *skb)
 {
+	const struct net_device_ops *ops = dev->netdev_ops;
 	int queue_index;
-	struct sock *sk = skb->sk;
 
-	queue_index = sk_tx_queue_get(sk);
-	if (queue_index < 0) {
-		const struct net_device_ops *ops = dev->netdev_ops;
+	if (ops->ndo_select_queue) {
+		queue_index = ops->ndo_select_queue(dev, skb);
+		queue_index = dev_cap_txqueue(dev, queue_index);
+	} else {
+		struct sock *sk = skb->sk;
 
-		if (ops->ndo_select_queue) {
-			queue_index = ops->ndo_select_queue(dev, skb);
-			queue_index = dev_cap_txqueue(dev, queue_index);
-		} else {
+		/*
+		 * The cached queue may have been picked on another device
+		 * of a stack (e.g. a bond and its slaves), so range check it.
+		 */
+		queue_index = sk_tx_queue_get(sk);
+		if (queue_index < 0 || queue_index >= dev->real_num_tx_queues) {
 			queue_index = 0;
 			if (dev->real_num_tx_queues > 1)
 				queue_index = skb_tx_hash(dev, skb);
@@ -2270,50 +2407,28 @@ struct rps_sock_flow_table *rps_sock_flow_table __read_mostly;
 EXPORT_SYMBOL(rps_sock_flow_table);
 
 /*
- * get_rps_cpu is called from netif_receive_skb and returns the target
- * CPU from the RPS map of the receiving queue for a given skb.
- * rcu_read_lock must be held on entry.
+ * skb_get_rxhash returns the flow hash of an skb, computing it from the
+ * IPv4/IPv6 addresses and transport ports if the driver did not supply
+ * one.  Returns 0 if the packet is not hashable.
  */
-static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
-		       struct rps_dev_flow **rflowp)
+static u32 skb_get_rxhash(struct sk_buff *skb)
 {
 	struct ipv6hdr *ip6;
 	struct iphdr *ip;
-	struct netdev_rx_queue *rxqueue;
-	struct rps_map *map;
-	struct rps_dev_flow_table *flow_table;
-	struct rps_sock_flow_table *sock_flow_table;
-	int cpu = -1;
 	u8 ip_proto;
-	u16 tcpu;
 	u32 addr1, addr2, ihl;
 	union {
 		u32 v32;
 		u16 v16[2];
 	} ports;
 
-	if (skb_rx_queue_recorded(skb)) {
-		u16 index = skb_get_rx_queue(skb);
-		if (unlikely(index >= dev->num_rx_queues)) {
-			WARN_ONCE(dev->num_rx_queues > 1, "%s received packet "
-				"on queue %u, but number of RX queues is %u\n",
-				dev->name, index, dev->num_rx_queues);
-			goto done;
-		}
-		rxqueue = dev->_rx + index;
-	} else
-		rxqueue = dev->_rx;
-
-	if (!rxqueue->rps_map && !rxqueue->rps_flow_table)
-		goto done;
-
 	if (skb->rxhash)
-		goto got_hash; /* Skip hash computation on packet header */
+		return skb->rxhash; /* Skip hash computation on packet header */
 
 	switch (skb->protocol) {
 	case __constant_htons(ETH_P_IP):
 		if (!pskb_may_pull(skb, sizeof(*ip)))
-			goto done;
+			return 0;
 
 		ip = (struct iphdr *) skb->data;
 		ip_proto = ip->protocol;
@@ -2323,7 +2438,7 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		break;
 	case __constant_htons(ETH_P_IPV6):
 		if (!pskb_may_pull(skb, sizeof(*ip6)))
-			goto done;
+			return 0;
 
 		ip6 = (struct ipv6hdr *) skb->data;
 		ip_proto = ip6->nexthdr;
@@ -2332,7 +2447,7 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		ihl = (40 >> 2);
 		break;
 	default:
-		goto done;
+		return 0;
 	}
 	switch (ip_proto) {
 	case IPPROTO_TCP:
@@ -2360,7 +2475,42 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	if (!skb->rxhash)
 		skb->rxhash = 1;
 
-got_hash:
+	return skb->rxhash;
+}
+
+/*
+ * get_rps_cpu is called from netif_receive_skb and returns the target
+ * CPU from the RPS map of the receiving queue for a given skb.
+ * rcu_read_lock must be held on entry.
+ */
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
+		       struct rps_dev_flow **rflowp)
+{
+	struct netdev_rx_queue *rxqueue;
+	struct rps_map *map;
+	struct rps_dev_flow_table *flow_table;
+	struct rps_sock_flow_table *sock_flow_table;
+	int cpu = -1;
+	u16 tcpu;
+
+	if (skb_rx_queue_recorded(skb)) {
+		u16 index = skb_get_rx_queue(skb);
+		if (unlikely(index >= dev->num_rx_queues)) {
+			WARN_ONCE(dev->num_rx_queues > 1, "%s received packet "
+				"on queue %u, but number of RX queues is %u\n",
+				dev->name, index, dev->num_rx_queues);
+			goto done;
+		}
+		rxqueue = dev->_rx + index;
+	} else
+		rxqueue = dev->_rx;
+
+	if (!rxqueue->rps_map && !rxqueue->rps_flow_table)
+		goto done;
+
+	if (!skb_get_rxhash(skb))
+		goto done;
+
 	flow_table = rcu_dereference(rxqueue->rps_flow_table);
 	sock_flow_table = rcu_dereference(rps_sock_flow_table);
 	if (flow_table && sock_flow_table) {
@@ -2446,6 +2596,54 @@ static int rps_ipi_queued(struct softnet_data *sd)
 	return 0;
 }
 
+#ifdef CONFIG_NET_FLOW_LIMIT
+int netdev_flow_limit_table_len __read_mostly = (1 << 12);
+#endif
+
+/*
+ * skb_flow_limit decides whether to drop a packet early once the backlog
+ * is more than half full.  Each CPU with a flow limit table remembers the
+ * hashes of the last FLOW_LIMIT_HISTORY packets it enqueued; a flow that
+ * accounts for more than half of that history is dropped in preference to
+ * everybody else, so a single elephant flow cannot starve small flows that
+ * share its backlog.  Called with interrupts disabled.
+ */
+static bool skb_flow_limit(struct sk_buff *skb, unsigned int qlen)
+{
+#ifdef CONFIG_NET_FLOW_LIMIT
+	struct sd_flow_limit *fl;
+	struct softnet_data *sd;
+	unsigned int old_flow, new_flow;
+
+	if (qlen < (netdev_max_backlog >> 1))
+		return false;
+
+	sd = &__get_cpu_var(softnet_data);
+
+	rcu_read_lock();
+	fl = rcu_dereference(sd->flow_limit);
+	if (fl) {
+		new_flow = skb_get_rxhash(skb) & (fl->num_buckets - 1);
+		old_flow = fl->history[fl->history_head];
+		fl->history[fl->history_head] = new_flow;
+
+		fl->history_head++;
+		fl->history_head &= FLOW_LIMIT_HISTORY - 1;
+
+		if (likely(fl->buckets[old_flow]))
+			fl->buckets[old_flow]--;
+
+		if (++fl->buckets[new_flow] > (FLOW_LIMIT_HISTORY >> 1)) {
+			fl->count++;
+			rcu_read_unlock();
+			return true;
+		}
+	}
+	rcu_read_unlock();
+#endif
+	return false;
+}
+
 /*
  * enqueue_to_backlog is called to queue an skb to a per CPU backlog
  * queue (may be a remote CPU queue).
@@ -2455,14 +2653,16 @@ static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
 {
 	struct softnet_data *sd;
 	unsigned long flags;
+	unsigned int qlen;
 
 	sd = &per_cpu(softnet_data, cpu);
 
 	local_irq_save(flags);
 
 	rps_lock(sd);
-	if (skb_queue_len(&sd->input_pkt_queue) <= netdev_max_backlog) {
-		if (skb_queue_len(&sd->input_pkt_queue)) {
+	qlen = skb_queue_len(&sd->input_pkt_queue);
+	if (qlen <= netdev_max_backlog && !skb_flow_limit(skb, qlen)) {
+		if (qlen) {
 enqueue:
 			__skb_queue_tail(&sd->input_pkt_queue, skb);
 			input_queue_tail_incr_save(sd, qtail);
@@ -2619,6 +2819,8 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
+		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 }
@@ -2940,8 +3142,11 @@ ncls:
 	}
 
 	if (pt_prev) {
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
+			goto drop;
 		ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 	} else {
+drop:
 		kfree_skb(skb);
 		/* Jamal, now you will not able to escape explaining
 		 * me how you were going to use this. :-)
@@ -3039,6 +3244,11 @@ static int napi_gro_complete(struct sk_buff *skb)
 		goto out;
 	}
 
+	/* Encapsulation handlers leave the network header pointing at
+	 * the innermost header; completion starts again from the outer one.
+	 */
+	skb->network_header = skb->mac_header + skb->mac_len;
+
 	rcu_read_lock();
 	list_for_each_entry_rcu(ptype, head, list) {
 		if (ptype->type != type || ptype->dev || !ptype->gro_complete)
@@ -3100,6 +3310,7 @@ enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 		NAPI_GRO_CB(skb)->same_flow = 0;
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
+		NAPI_GRO_CB(skb)->encap_mark = 0;
 
 		pp = ptype->gro_receive(&napi->gro_list, skb);
 		break;
@@ -3221,6 +3432,7 @@ EXPORT_SYMBOL(skb_gro_reset_offset);
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(__napi_gro_receive(napi, skb), skb);
@@ -3244,8 +3456,10 @@ struct sk_buff *napi_get_frags(struct napi_struct *napi)
 
 	if (!skb) {
 		skb = netdev_alloc_skb_ip_align(napi->dev, GRO_MAX_HEAD);
-		if (skb)
+		if (skb) {
 			napi->skb = skb;
+			skb_mark_napi_id(skb, napi);
+		}
 	}
 	return skb;
 }
@@ -3432,7 +3646,8 @@ void __napi_complete(struct napi_struct *n)
 	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
 	BUG_ON(n->gro_list);
 
-	list_del(&n->poll_list);
+	/* A busy poller may own the NAPI without it being on a poll_list */
+	list_del_init(&n->poll_list);
 	smp_mb__before_clear_bit();
 	clear_bit(NAPI_STATE_SCHED, &n->state);
 }
@@ -3456,6 +3671,125 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+#define NAPI_HASH_BITS	8
+#define NAPI_HASH_SIZE	(1 << NAPI_HASH_BITS)
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[NAPI_HASH_SIZE];
+
+/* must be called under rcu_read_lock() or napi_hash_lock */
+static struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct hlist_head *head = &napi_hash[napi_id & (NAPI_HASH_SIZE - 1)];
+	struct hlist_node *node;
+	struct napi_struct *napi;
+
+	hlist_for_each_entry_rcu(napi, node, head, napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+
+void napi_hash_add(struct napi_struct *napi)
+{
+	if (test_and_set_bit(NAPI_STATE_HASHED, &napi->state))
+		return;
+
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken;
+	 * we expect both events to be extremely rare
+	 */
+	napi->napi_id = 0;
+	while (!napi->napi_id) {
+		napi->napi_id = ++napi_gen_id;
+		if (napi_by_id(napi->napi_id))
+			napi->napi_id = 0;
+	}
+
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   &napi_hash[napi->napi_id & (NAPI_HASH_SIZE - 1)]);
+
+	spin_unlock(&napi_hash_lock);
+}
+EXPORT_SYMBOL_GPL(napi_hash_add);
+
+bool napi_hash_del(struct napi_struct *napi)
+{
+	bool rcu_sync_needed = false;
+
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state)) {
+		rcu_sync_needed = true;
+		hlist_del_rcu(&napi->napi_hash_node);
+	}
+	spin_unlock(&napi_hash_lock);
+	return rcu_sync_needed;
+}
+EXPORT_SYMBOL_GPL(napi_hash_del);
+
+#define BUSY_POLL_BUDGET 8
+
+/**
+ *	sk_busy_loop - poll the NAPI context a socket last received on
+ *	@sk: socket
+ *	@nonblock: only do a single pass
+ *
+ * Call the driver poll routine of the NAPI that last delivered to @sk
+ * directly from process context, until data shows up on the socket
+ * receive queue, sk->sk_ll_usec expires or we need to reschedule.
+ * Returns true if the receive queue is not empty on return.
+ */
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+	struct napi_struct *napi;
+	bool rc = false;
+
+	rcu_read_lock();
+
+	napi = napi_by_id(sk->sk_napi_id);
+	if (!napi)
+		goto out;
+
+	do {
+		int work = 0;
+
+		local_bh_disable();
+		if (napi_schedule_prep(napi)) {
+			void *have = netpoll_poll_lock(napi);
+
+			work = napi->poll(napi, BUSY_POLL_BUDGET);
+			trace_napi_poll(napi);
+			if (work == BUSY_POLL_BUDGET) {
+				/* Driver still owns the NAPI and has more
+				 * work to do: let the softirq finish it.
+				 */
+				__napi_schedule(napi);
+			}
+			netpoll_poll_unlock(have);
+		}
+		if (work > 0)
+			NET_ADD_STATS_BH(sock_net(sk),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, work);
+		local_bh_enable();
+
+		cpu_relax();
+	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+
+	rc = !skb_queue_empty(&sk->sk_receive_queue);
+out:
+	rcu_read_unlock();
+	return rc;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -3479,6 +3813,8 @@ void netif_napi_del(struct napi_struct *napi)
 {
 	struct sk_buff *skb, *next;
 
+	if (napi_hash_del(napi))
+		synchronize_net();
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
@@ -3806,11 +4142,23 @@ static void softnet_seq_stop(struct seq_file *seq, void *v)
 static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct softnet_data *sd = v;
+	unsigned int flow_limit_count = 0;
+
+#ifdef CONFIG_NET_FLOW_LIMIT
+	struct sd_flow_limit *fl;
+
+	rcu_read_lock();
+	fl = rcu_dereference(sd->flow_limit);
+	if (fl)
+		flow_limit_count = fl->count;
+	rcu_read_unlock();
+#endif
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq,
+		   "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   sd->processed, sd->dropped, sd->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   sd->cpu_collision, sd->received_rps);
+		   sd->cpu_collision, sd->received_rps, flow_limit_count);
 	return 0;
 }
 
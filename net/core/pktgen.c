@@ -169,7 +169,7 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION 	"2.73"
+#define VERSION 	"2.74"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
@@ -198,6 +198,14 @@
 #define T_REMDEVALL   (1<<2)	/* Remove all devs */
 #define T_REMDEV      (1<<3)	/* Remove one dev */
 
+/* Xmit modes */
+#define M_START_XMIT		0	/* Default normal TX */
+#define M_NETIF_RECEIVE		1	/* Inject packets into the RX path */
+
+/* IMIX size profiles */
+#define MAX_IMIX_ENTRIES	20
+#define IMIX_PRECISION		100	/* Resolution of the size distribution */
+
 /* If lock -- can be removed after some work */
 #define   if_lock(t)           spin_lock(&(t->if_lock));
 #define   if_unlock(t)           spin_unlock(&(t->if_lock));
@@ -225,6 +233,12 @@ struct flow_state {
 /* flow flag bits */
 #define F_INIT   (1<<0)		/* flow has been initialized */
 
+struct imix_pkt {
+	__u32 size;
+	__u32 weight;
+	__u64 count_so_far;	/* packets of this size sent */
+};
+
 struct pktgen_dev {
 	/*
 	 * Try to keep frequent/infrequent used vars. separated.
@@ -342,6 +356,13 @@ struct pktgen_dev {
 	__u32 cur_pkt_size;
 	__u32 last_pkt_size;
 
+	/* IMIX: weighted packet size profile, overrides min/max_pkt_size */
+	unsigned int n_imix_entries;
+	unsigned int cur_imix_entry;
+	struct imix_pkt imix_entries[MAX_IMIX_ENTRIES];
+	/* Maps a random 0..IMIX_PRECISION-1 index to an imix entry */
+	__u8 imix_distribution[IMIX_PRECISION];
+
 	__u8 hh[14];
 	/* = {
 	   0x00, 0x80, 0xC8, 0x79, 0xB3, 0xCB,
@@ -374,6 +395,7 @@ struct pktgen_dev {
 	u16 queue_map_min;
 	u16 queue_map_max;
 	int node;               /* Memory node */
+	int xmit_mode;		/* M_START_XMIT or M_NETIF_RECEIVE */
 
 #ifdef CONFIG_XFRM
 	__u8	ipsmode;		/* IPSEC mode (config) */
@@ -454,6 +476,234 @@ static struct notifier_block pktgen_notifier_block = {
 	.notifier_call = pktgen_device_event,
 };
 
+/*
+ * Receive side: latency measurement
+ *
+ * When enabled from pgctrl, a packet handler picks pktgen packets (UDP
+ * carrying PKTGEN_MAGIC) off the IPv4/IPv6 receive path and accounts
+ * one-way latency from the timestamp stamped in fill_packet().  The
+ * handler runs in softirq context on whatever CPU receives the packet,
+ * so stats are kept per CPU and only summed when /proc/net/pktgen/pgrx
+ * is read.  Across hosts the figures are only as good as the clock
+ * synchronisation between sender and receiver.
+ */
+#define PGRX		"pgrx"
+#define PG_LAT_BUCKETS	24	/* log2(usec) buckets, the last is open ended */
+
+struct pktgen_rx_stats {
+	__u64 pkts;
+	__u64 bytes;
+	__u64 lat_sum;		/* usec */
+	__u64 lat_min;
+	__u64 lat_max;
+	__u64 hist[PG_LAT_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct pktgen_rx_stats, pktgen_rx_stats);
+static int pg_rx_ifindex;	/* 0: accept from any device */
+static bool pg_rx_enabled;
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt, struct net_device *orig_dev);
+
+static struct packet_type pktgen_rx_pt __read_mostly = {
+	.type = cpu_to_be16(ETH_P_IP),
+	.func = pktgen_rcv,
+};
+
+static struct packet_type pktgen_rx6_pt __read_mostly = {
+	.type = cpu_to_be16(ETH_P_IPV6),
+	.func = pktgen_rcv,
+};
+
+/* Offset of the pktgen header in an IPv4/IPv6 UDP packet, or 0 */
+static unsigned int pktgen_rx_offset(const struct sk_buff *skb)
+{
+	if (skb->protocol == htons(ETH_P_IP)) {
+		struct iphdr _iph;
+		const struct iphdr *iph;
+
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (!iph || iph->ihl < 5 || iph->protocol != IPPROTO_UDP ||
+		    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+			return 0;
+		return iph->ihl * 4 + sizeof(struct udphdr);
+	} else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6h;
+
+		/* pktgen never emits extension headers */
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (!ip6h || ip6h->nexthdr != IPPROTO_UDP)
+			return 0;
+		return sizeof(struct ipv6hdr) + sizeof(struct udphdr);
+	}
+}
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_rx_stats *st;
+	struct pktgen_hdr _pgh;
+	const struct pktgen_hdr *pgh;
+	unsigned int off;
+	ktime_t sent;
+	s64 lat;
+	int ifindex = pg_rx_ifindex;
+
+	if (ifindex && dev->ifindex != ifindex)
+		goto out;
+
+	off = pktgen_rx_offset(skb);
+	if (!off)
+		goto out;
+
+	pgh = skb_header_pointer(skb, off, sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		goto out;
+
+	sent = ktime_set(ntohl(pgh->tv_sec),
+			 ntohl(pgh->tv_usec) * NSEC_PER_USEC);
+	lat = ktime_to_us(ktime_sub(ktime_get_real(), sent));
+	if (lat < 0)
+		lat = 0;	/* clock skew between sender and receiver */
+
+	st = &__get_cpu_var(pktgen_rx_stats);
+	st->pkts++;
+	st->bytes += skb->len;
+	st->lat_sum += lat;
+	if (st->pkts == 1 || lat < st->lat_min)
+		st->lat_min = lat;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+	st->hist[min_t(int, fls64(lat), PG_LAT_BUCKETS - 1)]++;
+out:
+	kfree_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+static void pktgen_rx_reset(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(&per_cpu(pktgen_rx_stats, cpu), 0,
+		       sizeof(struct pktgen_rx_stats));
+}
+
+/* Called with pktgen_thread_lock held */
+static void pktgen_rx_stop(void)
+{
+	if (!pg_rx_enabled)
+		return;
+	__dev_remove_pack(&pktgen_rx_pt);
+	__dev_remove_pack(&pktgen_rx6_pt);
+	synchronize_net();
+	pg_rx_enabled = false;
+}
+
+/* Called with pktgen_thread_lock held, ifname "" means any device */
+static int pktgen_rx_start(const char *ifname)
+{
+	struct net_device *dev;
+	int ifindex = 0;
+
+	if (*ifname) {
+		dev = dev_get_by_name(&init_net, ifname);
+		if (!dev)
+			return -ENODEV;
+		ifindex = dev->ifindex;
+		dev_put(dev);
+	}
+
+	pktgen_rx_stop();
+	pktgen_rx_reset();
+	pg_rx_ifindex = ifindex;
+	dev_add_pack(&pktgen_rx_pt);
+	dev_add_pack(&pktgen_rx6_pt);
+	pg_rx_enabled = true;
+	return 0;
+}
+
+static int pgrx_show(struct seq_file *seq, void *v)
+{
+	struct pktgen_rx_stats sum;
+	__u64 avg;
+	int cpu, i;
+
+	memset(&sum, 0, sizeof(sum));
+
+	if (pg_rx_enabled) {
+		struct net_device *dev = NULL;
+
+		if (pg_rx_ifindex)
+			dev = dev_get_by_index(&init_net, pg_rx_ifindex);
+		seq_printf(seq, "RX: listening on %s\n",
+			   dev ? dev->name : pg_rx_ifindex ? "?" : "any");
+		if (dev)
+			dev_put(dev);
+	} else
+		seq_puts(seq, "RX: stopped\n");
+
+	for_each_possible_cpu(cpu) {
+		const struct pktgen_rx_stats *st = &per_cpu(pktgen_rx_stats, cpu);
+
+		if (!st->pkts)
+			continue;
+		avg = div64_u64(st->lat_sum, st->pkts);
+		seq_printf(seq, "CPU%d: pkts: %llu  bytes: %llu  "
+			   "lat min/avg/max: %llu/%llu/%llu usec\n", cpu,
+			   (unsigned long long)st->pkts,
+			   (unsigned long long)st->bytes,
+			   (unsigned long long)st->lat_min,
+			   (unsigned long long)avg,
+			   (unsigned long long)st->lat_max);
+
+		if (!sum.pkts || st->lat_min < sum.lat_min)
+			sum.lat_min = st->lat_min;
+		if (st->lat_max > sum.lat_max)
+			sum.lat_max = st->lat_max;
+		sum.pkts += st->pkts;
+		sum.bytes += st->bytes;
+		sum.lat_sum += st->lat_sum;
+		for (i = 0; i < PG_LAT_BUCKETS; i++)
+			sum.hist[i] += st->hist[i];
+	}
+
+	avg = sum.pkts ? div64_u64(sum.lat_sum, sum.pkts) : 0;
+	seq_printf(seq, "Total: pkts: %llu  bytes: %llu  "
+		   "lat min/avg/max: %llu/%llu/%llu usec\n",
+		   (unsigned long long)sum.pkts,
+		   (unsigned long long)sum.bytes,
+		   (unsigned long long)sum.lat_min,
+		   (unsigned long long)avg,
+		   (unsigned long long)sum.lat_max);
+
+	seq_puts(seq, "Latency histogram (usec):\n");
+	seq_printf(seq, "     %10u - %-10u: %llu\n", 0, 0,
+		   (unsigned long long)sum.hist[0]);
+	for (i = 1; i < PG_LAT_BUCKETS - 1; i++)
+		seq_printf(seq, "     %10u - %-10u: %llu\n",
+			   1U << (i - 1), (1U << i) - 1,
+			   (unsigned long long)sum.hist[i]);
+	seq_printf(seq, "     %10u - %-10s: %llu\n", 1U << (i - 1), "",
+		   (unsigned long long)sum.hist[i]);
+	return 0;
+}
+
+static int pgrx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pgrx_show, NULL);
+}
+
+static const struct file_operations pktgen_rx_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pgrx_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 /*
  * /proc handling functions
  *
@@ -494,6 +744,23 @@ static ssize_t pgctrl_write(struct file *file, const char __user *buf,
 	else if (!strcmp(data, "reset"))
 		pktgen_reset_all_threads();
 
+	else if (!strcmp(data, "rx") || !strncmp(data, "rx ", 3)) {
+		mutex_lock(&pktgen_thread_lock);
+		err = pktgen_rx_start(data[2] ? data + 3 : "");
+		mutex_unlock(&pktgen_thread_lock);
+		if (err)
+			goto out;
+	}
+
+	else if (!strcmp(data, "rx_stop")) {
+		mutex_lock(&pktgen_thread_lock);
+		pktgen_rx_stop();
+		mutex_unlock(&pktgen_thread_lock);
+	}
+
+	else if (!strcmp(data, "rx_reset"))
+		pktgen_rx_reset();
+
 	else
 		printk(KERN_WARNING "pktgen: Unknown command: %s\n", data);
 
@@ -533,6 +800,17 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		   pkt_dev->nfrags, (unsigned long long) pkt_dev->delay,
 		   pkt_dev->clone_skb, pkt_dev->odevname);
 
+	if (pkt_dev->n_imix_entries > 0) {
+		unsigned int i;
+
+		seq_puts(seq, "     imix_weights: ");
+		for (i = 0; i < pkt_dev->n_imix_entries; i++)
+			seq_printf(seq, "%u,%u ",
+				   pkt_dev->imix_entries[i].size,
+				   pkt_dev->imix_entries[i].weight);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq, "     flows: %u flowlen: %u\n", pkt_dev->cflows,
 		   pkt_dev->lflow);
 
@@ -612,6 +890,9 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 	if (pkt_dev->node >= 0)
 		seq_printf(seq, "     node: %d\n", pkt_dev->node);
 
+	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE)
+		seq_puts(seq, "     xmit_mode: netif_receive\n");
+
 	seq_printf(seq, "     Flags: ");
 
 	if (pkt_dev->flags & F_IPV6)
@@ -707,6 +988,18 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 
 	seq_printf(seq, "     flows: %u\n", pkt_dev->nflows);
 
+	if (pkt_dev->n_imix_entries > 0) {
+		unsigned int i;
+
+		seq_puts(seq, "     imix_size_counts: ");
+		for (i = 0; i < pkt_dev->n_imix_entries; i++)
+			seq_printf(seq, "%u,%llu ",
+				   pkt_dev->imix_entries[i].size,
+				   (unsigned long long)
+				   pkt_dev->imix_entries[i].count_so_far);
+		seq_puts(seq, "\n");
+	}
+
 	if (pkt_dev->result[0])
 		seq_printf(seq, "Result: %s\n", pkt_dev->result);
 	else
@@ -836,6 +1129,93 @@ static ssize_t get_labels(const char __user *buffer, struct pktgen_dev *pkt_dev)
 	return i;
 }
 
+/*
+ * Parse an IMIX profile: space separated "size,weight" pairs, e.g.
+ * "64,7 576,4 1500,1".  A lone "0" clears the profile.
+ */
+static ssize_t get_imix_entries(const char __user *buffer, size_t maxlen,
+				struct pktgen_dev *pkt_dev)
+{
+	unsigned int n = 0;
+	unsigned long size, weight;
+	ssize_t i = 0;
+	int len;
+	char c;
+
+	pkt_dev->n_imix_entries = 0;
+	do {
+		len = num_arg(&buffer[i], 10, &size);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		i += len;
+		if (i >= maxlen)
+			c = 0;
+		else if (get_user(c, &buffer[i]))
+			return -EFAULT;
+
+		if (c != ',') {
+			/* "imix_weights 0" turns IMIX off */
+			if (n == 0 && size == 0)
+				return i;
+			return -EINVAL;
+		}
+		i++;
+
+		len = num_arg(&buffer[i], 10, &weight);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		if (weight == 0)
+			return -EINVAL;
+		i += len;
+
+		if (n >= MAX_IMIX_ENTRIES)
+			return -E2BIG;
+		if (size < 14 + 20 + 8)
+			size = 14 + 20 + 8;
+		pkt_dev->imix_entries[n].size = size;
+		pkt_dev->imix_entries[n].weight = weight;
+		pkt_dev->imix_entries[n].count_so_far = 0;
+		n++;
+
+		if (i >= maxlen)
+			c = 0;
+		else if (get_user(c, &buffer[i]))
+			return -EFAULT;
+		i++;
+	} while (c == ' ');
+
+	pkt_dev->n_imix_entries = n;
+	return i;
+}
+
+/*
+ * Turn the IMIX weights into a lookup table: each entry owns a share of
+ * the IMIX_PRECISION slots proportional to its weight, so picking a
+ * random slot in mod_cur_headers() yields the requested size mix.
+ */
+static void fill_imix_distribution(struct pktgen_dev *pkt_dev)
+{
+	unsigned int cumulative[MAX_IMIX_ENTRIES];
+	__u64 total_weight = 0, acc = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < pkt_dev->n_imix_entries; i++)
+		total_weight += pkt_dev->imix_entries[i].weight;
+
+	for (i = 0; i < pkt_dev->n_imix_entries; i++) {
+		acc += pkt_dev->imix_entries[i].weight;
+		cumulative[i] = div64_u64(acc * IMIX_PRECISION, total_weight);
+	}
+	/* rounding must not leave the tail of the table unassigned */
+	cumulative[pkt_dev->n_imix_entries - 1] = IMIX_PRECISION;
+
+	for (i = 0, j = 0; i < IMIX_PRECISION; i++) {
+		while (i >= cumulative[j])
+			j++;
+		pkt_dev->imix_distribution[i] = j;
+	}
+}
+
 static ssize_t pktgen_if_write(struct file *file,
 			       const char __user * user_buffer, size_t count,
 			       loff_t * offset)
@@ -1038,11 +1418,61 @@ static ssize_t pktgen_if_write(struct file *file,
 			return len;
 
 		i += len;
+		if (value > 0 && pkt_dev->xmit_mode == M_NETIF_RECEIVE) {
+			sprintf(pg_result,
+				"ERROR: clone_skb not supported with xmit_mode netif_receive");
+			return count;
+		}
 		pkt_dev->clone_skb = value;
 
 		sprintf(pg_result, "OK: clone_skb=%d", pkt_dev->clone_skb);
 		return count;
 	}
+	if (!strcmp(name, "imix_weights")) {
+		len = get_imix_entries(&user_buffer[i], count - i, pkt_dev);
+		if (len < 0)
+			return len;
+
+		i += len;
+		if (pkt_dev->n_imix_entries)
+			fill_imix_distribution(pkt_dev);
+		sprintf(pg_result, "OK: imix_weights=%u entries",
+			pkt_dev->n_imix_entries);
+		return count;
+	}
+	if (!strcmp(name, "xmit_mode")) {
+		char f[32];
+		memset(f, 0, 32);
+		len = strn_len(&user_buffer[i], sizeof(f) - 1);
+		if (len < 0)
+			return len;
+
+		if (copy_from_user(f, &user_buffer[i], len))
+			return -EFAULT;
+		i += len;
+
+		if (strcmp(f, "start_xmit") == 0)
+			pkt_dev->xmit_mode = M_START_XMIT;
+
+		else if (strcmp(f, "netif_receive") == 0) {
+			/*
+			 * The stack mangles the skb it is handed, so every
+			 * injected packet must be freshly built.
+			 */
+			pkt_dev->xmit_mode = M_NETIF_RECEIVE;
+			pkt_dev->clone_skb = 0;
+			pkt_dev->last_ok = 1;
+		}
+
+		else {
+			sprintf(pg_result,
+				"xmit_mode -:%s:- unknown\nAvailable modes: %s",
+				f, "start_xmit, netif_receive\n");
+			return count;
+		}
+		sprintf(pg_result, "OK: xmit_mode=%s", f);
+		return count;
+	}
 	if (!strcmp(name, "count")) {
 		len = num_arg(&user_buffer[i], 10, &value);
 		if (len < 0)
@@ -2449,7 +2879,13 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		}
 	}
 
-	if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
+	if (pkt_dev->n_imix_entries > 0) {
+		unsigned int e;
+
+		e = pkt_dev->imix_distribution[random32() % IMIX_PRECISION];
+		pkt_dev->cur_imix_entry = e;
+		pkt_dev->cur_pkt_size = pkt_dev->imix_entries[e].size;
+	} else if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
 		__u32 t;
 		if (pkt_dev->flags & F_TXSIZE_RND) {
 			t = random32() %
@@ -3129,11 +3565,15 @@ static struct sk_buff *fill_packet(struct net_device *odev,
 
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev)
 {
+	unsigned int i;
+
 	pkt_dev->seq_num = 1;
 	pkt_dev->idle_acc = 0;
 	pkt_dev->sofar = 0;
 	pkt_dev->tx_bytes = 0;
 	pkt_dev->errors = 0;
+	for (i = 0; i < pkt_dev->n_imix_entries; i++)
+		pkt_dev->imix_entries[i].count_so_far = 0;
 }
 
 /* Set up structure for sending pkts, clear counters */
@@ -3446,6 +3886,15 @@ static void pktgen_wait_for_skb(struct pktgen_dev *pkt_dev)
 	pkt_dev->idle_acc += ktime_to_ns(ktime_sub(ktime_now(), idle_start));
 }
 
+static inline void pktgen_xmit_done(struct pktgen_dev *pkt_dev)
+{
+	pkt_dev->sofar++;
+	pkt_dev->seq_num++;
+	pkt_dev->tx_bytes += pkt_dev->last_pkt_size;
+	if (pkt_dev->n_imix_entries > 0)
+		pkt_dev->imix_entries[pkt_dev->cur_imix_entry].count_so_far++;
+}
+
 static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 {
 	struct net_device *odev = pkt_dev->odev;
@@ -3491,6 +3940,22 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	if (pkt_dev->delay && pkt_dev->last_ok)
 		spin(pkt_dev, pkt_dev->next_tx);
 
+	if (pkt_dev->xmit_mode == M_NETIF_RECEIVE) {
+		struct sk_buff *skb = pkt_dev->skb;
+
+		skb->protocol = eth_type_trans(skb, skb->dev);
+		atomic_inc(&skb->users);
+		local_bh_disable();
+		ret = netif_receive_skb(skb);
+		local_bh_enable();
+		pkt_dev->last_ok = 1;
+		if (ret == NET_RX_DROP)
+			pkt_dev->errors++;
+		else
+			pktgen_xmit_done(pkt_dev);
+		goto out;
+	}
+
 	queue_map = skb_get_queue_mapping(pkt_dev->skb);
 	txq = netdev_get_tx_queue(odev, queue_map);
 
@@ -3508,9 +3973,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	case NETDEV_TX_OK:
 		txq_trans_update(txq);
 		pkt_dev->last_ok = 1;
-		pkt_dev->sofar++;
-		pkt_dev->seq_num++;
-		pkt_dev->tx_bytes += pkt_dev->last_pkt_size;
+		pktgen_xmit_done(pkt_dev);
 		break;
 	case NET_XMIT_DROP:
 	case NET_XMIT_CN:
@@ -3532,7 +3995,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	}
 unlock:
 	__netif_tx_unlock_bh(txq);
-
+out:
 	/* If pkt_dev->count is zero, then run forever */
 	if ((pkt_dev->count != 0) && (pkt_dev->sofar >= pkt_dev->count)) {
 		pktgen_wait_for_skb(pkt_dev);
@@ -3871,6 +4334,15 @@ static int __init pg_init(void)
 		return -EINVAL;
 	}
 
+	pe = proc_create(PGRX, 0400, pg_proc_dir, &pktgen_rx_fops);
+	if (pe == NULL) {
+		printk(KERN_ERR "pktgen: ERROR: cannot create %s "
+		       "procfs entry.\n", PGRX);
+		remove_proc_entry(PGCTRL, pg_proc_dir);
+		proc_net_remove(&init_net, PG_PROC_DIR);
+		return -EINVAL;
+	}
+
 	/* Register us to receive netdevice events */
 	register_netdevice_notifier(&pktgen_notifier_block);
 
@@ -3887,6 +4359,7 @@ static int __init pg_init(void)
 		printk(KERN_ERR "pktgen: ERROR: Initialization failed for "
 		       "all threads\n");
 		unregister_netdevice_notifier(&pktgen_notifier_block);
+		remove_proc_entry(PGRX, pg_proc_dir);
 		remove_proc_entry(PGCTRL, pg_proc_dir);
 		proc_net_remove(&init_net, PG_PROC_DIR);
 		return -ENODEV;
@@ -3913,7 +4386,13 @@ static void __exit pg_cleanup(void)
 	/* Un-register us from receiving netdevice events */
 	unregister_netdevice_notifier(&pktgen_notifier_block);
 
+	/* Stop latency accounting */
+	mutex_lock(&pktgen_thread_lock);
+	pktgen_rx_stop();
+	mutex_unlock(&pktgen_thread_lock);
+
 	/* Clean up proc file system */
+	remove_proc_entry(PGRX, pg_proc_dir);
 	remove_proc_entry(PGCTRL, pg_proc_dir);
 	proc_net_remove(&init_net, PG_PROC_DIR);
 }
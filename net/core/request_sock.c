@@ -109,6 +109,9 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 	size_t lopt_size = sizeof(struct listen_sock) +
 		lopt->nr_table_entries * sizeof(struct request_sock *);
 
+	/* SYNs handled without the listener lock may still look at lopt */
+	synchronize_net();
+
 	if (lopt->qlen != 0) {
 		unsigned int i;
 
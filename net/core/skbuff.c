@@ -340,6 +340,9 @@ static void skb_release_data(struct sk_buff *skb)
 				put_page(skb_shinfo(skb)->frags[i].page);
 		}
 
+		/* user pages are released, tell the sender */
+		skb_zcopy_clear(skb, true);
+
 		if (skb_has_frags(skb))
 			skb_drop_fraglist(skb);
 
@@ -551,6 +554,9 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 #endif
 #endif
 	new->vlan_tci		= old->vlan_tci;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id		= old->napi_id;
+#endif
 
 	skb_copy_secmark(new, old);
 }
@@ -757,6 +763,7 @@ struct sk_buff *pskb_copy(struct sk_buff *skb, gfp_t gfp_mask)
 			get_page(skb_shinfo(n)->frags[i].page);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		skb_zerocopy_clone(n, skb);
 	}
 
 	if (skb_has_frags(skb)) {
@@ -822,6 +829,10 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 		get_page(skb_shinfo(skb)->frags[i].page);
 
+	/* the copied shared info points to the same ubuf_info */
+	if (skb_zcopy(skb))
+		sock_zerocopy_get(skb_zcopy(skb));
+
 	if (skb_has_frags(skb))
 		skb_clone_fraglist(skb);
 
@@ -2080,6 +2091,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 {
 	int pos = skb_headlen(skb);
 
+	skb_zerocopy_clone(skb1, skb);
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2122,6 +2134,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* an skb can only point to one ubuf_info */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2600,6 +2616,9 @@ struct sk_buff *skb_segment(struct sk_buff *skb, int features)
 		skb_copy_from_linear_data_offset(skb, offset,
 						 skb_put(nskb, hsize), hsize);
 
+		if (unlikely(skb_zerocopy_clone(nskb, skb)))
+			goto err;
+
 		while (pos < offset + len && i < nfrags) {
 			*frag = skb_shinfo(skb)->frags[i];
 			get_page(frag->page);
@@ -3039,6 +3058,325 @@ void skb_tstamp_tx(struct sk_buff *orig_skb,
 }
 EXPORT_SYMBOL_GPL(skb_tstamp_tx);
 
+/*
+ * MSG_ZEROCOPY: skb frags point to pinned user pages. Each sendmsg call
+ * gets a notification id from sk->sk_zckey; its range is reported on
+ * the socket error queue once no skb references those pages anymore.
+ * The ubuf_info tracking a range lives in the cb[] of the very skb that
+ * carries the notification, so completion never needs to allocate.
+ */
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	skb = sock_omalloc(sk, 0, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+	uarg = (void *)skb->cb;
+
+	uarg->id = ((u32)atomic_inc_return(&sk->sk_zckey)) - 1;
+	uarg->len = 1;
+	uarg->bytelen = size;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+/* Extend @uarg, the ubuf_info of the skb at the tail of a stream socket
+ * write queue, to cover one more sendmsg call, so that consecutive small
+ * sends share one notification and one skb. Falls back to a new ubuf_info.
+ */
+struct ubuf_info *sock_zerocopy_realloc(struct sock *sk, size_t size,
+					struct ubuf_info *uarg)
+{
+	if (uarg) {
+		const u32 byte_limit = 1 << 19;		/* limit to a few TSO */
+		u32 bytelen, next;
+
+		/* realloc only when socket is locked (TCP), so uarg->len
+		 * and sk_zckey access is serialized
+		 */
+		if (!sock_owned_by_user(sk)) {
+			WARN_ON_ONCE(1);
+			return NULL;
+		}
+
+		bytelen = uarg->bytelen + size;
+		if (uarg->len == USHRT_MAX - 1 || bytelen > byte_limit)
+			goto new_alloc;
+
+		next = (u32)atomic_read(&sk->sk_zckey);
+		if ((u32)(uarg->id + uarg->len) == next) {
+			uarg->len++;
+			uarg->bytelen = bytelen;
+			atomic_set(&sk->sk_zckey, ++next);
+			sock_zerocopy_get(uarg);
+			return uarg;
+		}
+	}
+
+new_alloc:
+	return sock_zerocopy_alloc(sk, size);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_realloc);
+
+static bool skb_zerocopy_notify_extend(struct sk_buff *skb, u32 lo, u16 len)
+{
+	struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+	u32 old_lo, old_hi;
+	u64 sum_len;
+
+	old_lo = serr->ee.ee_info;
+	old_hi = serr->ee.ee_data;
+	sum_len = old_hi - old_lo + 1ULL + len;
+
+	if (sum_len >= (1ULL << 32))
+		return false;
+
+	if (lo != old_hi + 1)
+		return false;
+
+	serr->ee.ee_data += len;
+	return true;
+}
+
+static void sock_zerocopy_notify(struct ubuf_info *uarg)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock_exterr_skb *serr;
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	bool copied;
+	u32 lo, hi;
+	u16 len;
+
+	/* if !len, there was only 1 call, and it was aborted
+	 * so do not queue a completion notification
+	 */
+	if (!uarg->len || sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	len = uarg->len;
+	lo = uarg->id;
+	hi = uarg->id + len - 1;
+	copied = !uarg->zerocopy;
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_data = hi;
+	serr->ee.ee_info = lo;
+	if (copied)
+		serr->ee.ee_code |= SO_EE_CODE_ZEROCOPY_COPIED;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (!tail || SKB_EXT_ERR(tail)->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    SKB_EXT_ERR(tail)->ee.ee_code != serr->ee.ee_code ||
+	    !skb_zerocopy_notify_extend(tail, lo, len)) {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	consume_skb(skb);
+	sock_put(sk);
+}
+
+void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		sock_zerocopy_notify(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/* Drop the sender's reference after a sendmsg call that failed before
+ * queueing any data: give back its notification id.
+ */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	if (uarg) {
+		struct sock *sk = skb_from_uarg(uarg)->sk;
+
+		atomic_dec(&sk->sk_zckey);
+		uarg->len--;
+
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/**
+ *	skb_zerocopy_from_user - append pinned user pages to an skb
+ *	@sk: socket the skb is charged to
+ *	@skb: buffer to fill
+ *	@from: user buffer
+ *	@len: number of bytes
+ *
+ *	Pins the pages backing @from and attaches them as frags of @skb,
+ *	adjusting len, data_len and truesize; socket memory accounting is
+ *	left to the caller. Returns the number of bytes attached, which may
+ *	be short when @skb runs out of frags, -EMSGSIZE if nothing could be
+ *	attached for that reason or -EFAULT.
+ */
+int skb_zerocopy_from_user(struct sock *sk, struct sk_buff *skb,
+			   const void __user *from, int len)
+{
+	struct page *pages[MAX_SKB_FRAGS];
+	int frag = skb_shinfo(skb)->nr_frags;
+	int copied = 0;
+
+	while (len && frag < MAX_SKB_FRAGS) {
+		unsigned long start = (unsigned long)from;
+		int off = start & ~PAGE_MASK;
+		int n, i;
+
+		n = min_t(int, MAX_SKB_FRAGS - frag,
+			  DIV_ROUND_UP(off + len, PAGE_SIZE));
+		n = get_user_pages_fast(start & PAGE_MASK, n, 0, pages);
+		if (n <= 0) {
+			if (!copied)
+				return -EFAULT;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			int size = min_t(int, len, PAGE_SIZE - off);
+
+			if (skb_can_coalesce(skb, frag, pages[i], off)) {
+				skb_shinfo(skb)->frags[frag - 1].size += size;
+				put_page(pages[i]);
+			} else {
+				skb_fill_page_desc(skb, frag++, pages[i],
+						   off, size);
+			}
+			from += size;
+			len -= size;
+			copied += size;
+			off = 0;
+		}
+	}
+
+	if (!copied)
+		return -EMSGSIZE;
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_from_user);
+
+/**
+ *	skb_zerocopy_from_iovec - append pinned user pages to an skb
+ *	@sk: socket the skb is charged to
+ *	@skb: buffer to fill
+ *	@iov: user iovec, not modified
+ *	@offset: offset into @iov to start at
+ *	@len: number of bytes
+ *
+ *	Like skb_zerocopy_from_user(), for datagram senders that walk
+ *	the iovec by offset (see ip_generic_getfrag()).
+ */
+int skb_zerocopy_from_iovec(struct sock *sk, struct sk_buff *skb,
+			    struct iovec *iov, int offset, int len)
+{
+	int copied = 0;
+
+	while (offset >= iov->iov_len) {
+		offset -= iov->iov_len;
+		iov++;
+	}
+
+	while (len > 0) {
+		int seglen = min_t(int, iov->iov_len - offset, len);
+		int ret;
+
+		ret = skb_zerocopy_from_user(sk, skb,
+					     iov->iov_base + offset, seglen);
+		if (ret < 0)
+			return copied ? : ret;
+		copied += ret;
+		len -= ret;
+		if (ret < seglen)
+			break;
+		offset = 0;
+		iov++;
+	}
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_from_iovec);
+
+/**
+ *	skb_copy_ubufs - copy userspace skb frags buffers to kernel
+ *	@skb: the skb to modify
+ *	@gfp_mask: allocation priority
+ *
+ *	This must be called on a zerocopy skb before its frags reach a
+ *	receiving socket or another place that may hold them indefinitely.
+ *	It replaces the user pages by private copies and notifies the
+ *	sender that its data was copied after all.
+ *
+ *	Returns 0 on success or a negative error code on failure
+ *	to allocate kernel memory to copy to.
+ */
+int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	int num_frags = skb_shinfo(skb)->nr_frags;
+	struct page *pages[MAX_SKB_FRAGS];
+	int i;
+
+	if (skb_shared(skb))
+		return -EINVAL;
+	if (skb_cloned(skb) && pskb_expand_head(skb, 0, 0, gfp_mask))
+		return -ENOMEM;
+
+	for (i = 0; i < num_frags; i++) {
+		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
+		u8 *vaddr;
+
+		pages[i] = alloc_pages(gfp_mask, get_order(f->size));
+		if (!pages[i]) {
+			while (--i >= 0)
+				__free_pages(pages[i],
+					get_order(skb_shinfo(skb)->frags[i].size));
+			return -ENOMEM;
+		}
+		vaddr = kmap_skb_frag(f);
+		memcpy(page_address(pages[i]), vaddr + f->page_offset,
+		       f->size);
+		kunmap_skb_frag(vaddr);
+	}
+
+	/* skb frags release userspace buffers and point to kernel ones */
+	for (i = 0; i < num_frags; i++) {
+		put_page(skb_shinfo(skb)->frags[i].page);
+		skb_shinfo(skb)->frags[i].page = pages[i];
+		skb_shinfo(skb)->frags[i].page_offset = 0;
+	}
+
+	skb_zcopy_clear(skb, false);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_copy_ubufs);
+
 
 /**
  * skb_partial_csum_set - set up and verify partial csum values for packet
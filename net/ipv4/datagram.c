@@ -73,6 +73,7 @@ int ip4_datagram_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len)
 	inet->inet_id = jiffies;
 
 	sk_dst_set(sk, &rt->u.dst);
+	inet_sk_rx_dst_reset(sk);
 	return(0);
 }
 
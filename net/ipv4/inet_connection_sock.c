@@ -440,12 +440,23 @@ void inet_csk_reqsk_queue_hash_add(struct sock *sk, struct request_sock *req,
 				   unsigned long timeout)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
-				     lopt->hash_rnd, lopt->nr_table_entries);
-
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
+	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
+	struct listen_sock *lopt;
+	u32 h;
+
+	write_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (unlikely(lopt == NULL)) {
+		/* listener closed under a SYN handled without its lock */
+		write_unlock(&queue->syn_wait_lock);
+		reqsk_free(req);
+		return;
+	}
+	h = inet_synq_hash(inet_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
+			   lopt->hash_rnd, lopt->nr_table_entries);
+	reqsk_queue_hash_req(queue, h, req, timeout);
 	inet_csk_reqsk_queue_added(sk, timeout);
+	write_unlock(&queue->syn_wait_lock);
 }
 
 /* Only thing we need from tcp.h */
@@ -543,8 +554,11 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 				     inet_rsk(req)->acked)) {
 					unsigned long timeo;
 
-					if (req->retrans++ == 0)
+					if (req->retrans++ == 0) {
+						write_lock(&queue->syn_wait_lock);
 						lopt->qlen_young--;
+						write_unlock(&queue->syn_wait_lock);
+					}
 					timeo = min((timeout << req->retrans), max_rto);
 					req->expires = now + timeo;
 					reqp = &req->dl_next;
@@ -553,7 +567,9 @@ void inet_csk_reqsk_queue_prune(struct sock *parent,
 
 				/* Drop this request */
 				inet_csk_reqsk_queue_unlink(parent, req, reqp);
+				write_lock(&queue->syn_wait_lock);
 				reqsk_queue_removed(queue, req);
+				write_unlock(&queue->syn_wait_lock);
 				reqsk_free(req);
 				continue;
 			}
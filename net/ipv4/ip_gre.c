@@ -122,6 +122,10 @@ static int ipgre_tunnel_init(struct net_device *dev);
 static void ipgre_tunnel_setup(struct net_device *dev);
 static int ipgre_tunnel_bind_dev(struct net_device *dev);
 
+/* Offloads of a tunnel whose header is identical for every segment */
+#define IPGRE_FEATURES (NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_HIGHDMA | \
+			NETIF_F_GSO_SOFTWARE)
+
 /* Fallback tunnel: no source, no destination, no key, no options */
 
 #define HASH_SIZE  16
@@ -601,6 +605,9 @@ static int ipgre_rcv(struct sk_buff *skb)
 		__pskb_pull(skb, offset);
 		skb_postpull_rcsum(skb, skb_transport_header(skb), offset);
 		skb->pkt_type = PACKET_HOST;
+
+		if (skb_is_gso(skb))
+			skb_shinfo(skb)->gso_type &= ~SKB_GSO_GRE;
 #ifdef CONFIG_NET_IPGRE_BROADCAST
 		if (ipv4_is_multicast(iph->daddr)) {
 			/* Looped back packet, drop it! */
@@ -678,6 +685,10 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 	if (dev->type == ARPHRD_ETHER)
 		IPCB(skb)->flags = 0;
 
+	if (skb->ip_summed == CHECKSUM_PARTIAL && !skb_is_gso(skb) &&
+	    skb_checksum_help(skb))
+		goto tx_error;
+
 	if (dev->header_ops && dev->type == ARPHRD_IPGRE) {
 		gre_hlen = 0;
 		tiph = (struct iphdr *)skb->data;
@@ -766,7 +777,7 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		df |= (old_iph->frag_off&htons(IP_DF));
 
 		if ((old_iph->frag_off&htons(IP_DF)) &&
-		    mtu < ntohs(old_iph->tot_len)) {
+		    mtu < ntohs(old_iph->tot_len) && !skb_is_gso(skb)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(mtu));
 			ip_rt_put(rt);
 			goto tx_error;
@@ -785,7 +796,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			}
 		}
 
-		if (mtu >= IPV6_MIN_MTU && mtu < skb->len - tunnel->hlen + gre_hlen) {
+		if (mtu >= IPV6_MIN_MTU && !skb_is_gso(skb) &&
+		    mtu < skb->len - tunnel->hlen + gre_hlen) {
 			icmpv6_send(skb, ICMPV6_PKT_TOOBIG, 0, mtu);
 			ip_rt_put(rt);
 			goto tx_error;
@@ -806,7 +818,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 	max_headroom = LL_RESERVED_SPACE(tdev) + gre_hlen + rt->u.dst.header_len;
 
 	if (skb_headroom(skb) < max_headroom || skb_shared(skb)||
-	    (skb_cloned(skb) && !skb_clone_writable(skb, 0))) {
+	    (skb_cloned(skb) && !skb_clone_writable(skb, 0)) ||
+	    (skb_cloned(skb) && skb_is_gso(skb))) {
 		struct sk_buff *new_skb = skb_realloc_headroom(skb, max_headroom);
 		if (max_headroom > dev->needed_headroom)
 			dev->needed_headroom = max_headroom;
@@ -878,6 +891,9 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		}
 	}
 
+	if (skb_is_gso(skb))
+		skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+
 	nf_reset(skb);
 
 	IPTUNNEL_XMIT();
@@ -944,6 +960,16 @@ static int ipgre_tunnel_bind_dev(struct net_device *dev)
 	dev->needed_headroom = addend + hlen;
 	mtu -= dev->hard_header_len + addend;
 
+	/* A sequence number or checksum differs per segment, so such
+	 * tunnels take their packets one at a time.
+	 */
+	if (dev->type == ARPHRD_IPGRE &&
+	    !(tunnel->parms.o_flags & (GRE_CSUM|GRE_SEQ))) {
+		dev->features |= IPGRE_FEATURES;
+		netif_set_gso_max_size(dev, GSO_MAX_SIZE - addend);
+	} else
+		dev->features &= ~IPGRE_FEATURES;
+
 	if (mtu < 68)
 		mtu = 68;
 
@@ -1276,9 +1302,140 @@ static void ipgre_fb_tunnel_init(struct net_device *dev)
 }
 
 
+/*
+ * GRE offload.  Only the key option is understood: a checksum or sequence
+ * number differs between segments and must be handled by ipgre_rcv and
+ * ipgre_tunnel_xmit one packet at a time.  The inner packet is handed on
+ * to the offload handlers of its own protocol, with the outer IPv4 and GRE
+ * headers treated as part of the link layer header.
+ */
+static int ipgre_offload_hlen(__be16 flags)
+{
+	if (flags & (GRE_CSUM|GRE_ROUTING|GRE_SEQ|GRE_VERSION))
+		return -1;
+
+	return (flags & GRE_KEY) ? 8 : 4;
+}
+
+static struct sk_buff *ipgre_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	__be16 *greh;
+	int grehlen;
+
+	if (unlikely(!pskb_may_pull(skb, 4)))
+		goto out;
+
+	greh = (__be16 *)skb->data;
+	grehlen = ipgre_offload_hlen(greh[0]);
+	if (grehlen < 0 || unlikely(!pskb_may_pull(skb, grehlen)))
+		goto out;
+
+	greh = (__be16 *)skb->data;
+	__skb_pull(skb, grehlen);
+
+	segs = skb_encap_gso_segment(skb, features, greh[1]);
+
+out:
+	return segs;
+}
+
+static struct sk_buff **ipgre_gro_receive(struct sk_buff **head,
+					  struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	unsigned int hlen;
+	unsigned int off;
+	__be16 *greh;
+	int grehlen;
+	int flush = 1;
+	__wsum csum;
+
+	if (NAPI_GRO_CB(skb)->encap_mark)
+		goto out;
+
+	off = skb_gro_offset(skb);
+	hlen = off + 4;
+	greh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	grehlen = ipgre_offload_hlen(greh[0]);
+	if (grehlen < 0)
+		goto out;
+
+	hlen = off + grehlen;
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	ptype = dev_find_offload(greh[1]);
+	if (!ptype)
+		goto out;
+
+	flush = 0;
+
+	/* Flags, protocol and key must all match. */
+	for (p = *head; p; p = p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		if (memcmp(greh, p->data + off, grehlen))
+			NAPI_GRO_CB(p)->same_flow = 0;
+	}
+
+	skb_gro_pull(skb, grehlen);
+	NAPI_GRO_CB(skb)->encap_mark = 1;
+
+	/* The inner protocol verifies its checksum without our header. */
+	csum = skb->csum;
+	skb_postpull_rcsum(skb, greh, grehlen);
+
+	pp = ptype->gro_receive(head, skb);
+
+	skb->csum = csum;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+static int ipgre_gro_complete(struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	__be16 *greh;
+	int grehlen;
+	int err;
+
+	greh = (__be16 *)(skb_network_header(skb) + ip_hdrlen(skb));
+	grehlen = ipgre_offload_hlen(greh[0]);
+
+	ptype = dev_find_offload(greh[1]);
+	if (WARN_ON(!ptype || grehlen < 0))
+		return -ENOENT;
+
+	skb_set_network_header(skb, skb_network_offset(skb) +
+				    ip_hdrlen(skb) + grehlen);
+	err = ptype->gro_complete(skb);
+	skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+
+	return err;
+}
+
 static const struct net_protocol ipgre_protocol = {
 	.handler	=	ipgre_rcv,
 	.err_handler	=	ipgre_err,
+	.gso_segment	=	ipgre_gso_segment,
+	.gro_receive	=	ipgre_gro_receive,
+	.gro_complete	=	ipgre_gro_complete,
 	.netns_ok	=	1,
 };
 
@@ -145,6 +145,8 @@
 #include <linux/mroute.h>
 #include <linux/netlink.h>
 
+int sysctl_ip_early_demux __read_mostly = 1;
+
 /*
  *	Process Router Attention IP option
  */
@@ -190,63 +192,66 @@ int ip_call_ra_chain(struct sk_buff *skb)
 	return 0;
 }
 
-static int ip_local_deliver_finish(struct sk_buff *skb)
+/*
+ * Hand @skb to the handler of @protocol, following resubmissions.
+ * Called under rcu_read_lock() with the transport header set.
+ */
+void ip_protocol_deliver_rcu(struct net *net, struct sk_buff *skb, int protocol)
 {
-	struct net *net = dev_net(skb->dev);
-
-	__skb_pull(skb, ip_hdrlen(skb));
+	int hash, raw;
+	const struct net_protocol *ipprot;
 
-	/* Point into the IP datagram, just past the header. */
-	skb_reset_transport_header(skb);
-
-	rcu_read_lock();
-	{
-		int protocol = ip_hdr(skb)->protocol;
-		int hash, raw;
-		const struct net_protocol *ipprot;
+resubmit:
+	raw = raw_local_deliver(skb, protocol);
 
-	resubmit:
-		raw = raw_local_deliver(skb, protocol);
+	hash = protocol & (MAX_INET_PROTOS - 1);
+	ipprot = rcu_dereference(inet_protos[hash]);
+	if (ipprot != NULL) {
+		int ret;
 
-		hash = protocol & (MAX_INET_PROTOS - 1);
-		ipprot = rcu_dereference(inet_protos[hash]);
-		if (ipprot != NULL) {
-			int ret;
+		if (!net_eq(net, &init_net) && !ipprot->netns_ok) {
+			if (net_ratelimit())
+				printk("%s: proto %d isn't netns-ready\n",
+					__func__, protocol);
+			kfree_skb(skb);
+			return;
+		}
 
-			if (!net_eq(net, &init_net) && !ipprot->netns_ok) {
-				if (net_ratelimit())
-					printk("%s: proto %d isn't netns-ready\n",
-						__func__, protocol);
+		if (!ipprot->no_policy) {
+			if (!xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
 				kfree_skb(skb);
-				goto out;
-			}
-
-			if (!ipprot->no_policy) {
-				if (!xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
-					kfree_skb(skb);
-					goto out;
-				}
-				nf_reset(skb);
+				return;
 			}
-			ret = ipprot->handler(skb);
-			if (ret < 0) {
-				protocol = -ret;
-				goto resubmit;
+			nf_reset(skb);
+		}
+		ret = ipprot->handler(skb);
+		if (ret < 0) {
+			protocol = -ret;
+			goto resubmit;
+		}
+		IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
+	} else {
+		if (!raw) {
+			if (xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
+				IP_INC_STATS_BH(net, IPSTATS_MIB_INUNKNOWNPROTOS);
+				icmp_send(skb, ICMP_DEST_UNREACH,
+					  ICMP_PROT_UNREACH, 0);
 			}
+		} else
 			IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
-		} else {
-			if (!raw) {
-				if (xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
-					IP_INC_STATS_BH(net, IPSTATS_MIB_INUNKNOWNPROTOS);
-					icmp_send(skb, ICMP_DEST_UNREACH,
-						  ICMP_PROT_UNREACH, 0);
-				}
-			} else
-				IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
-			kfree_skb(skb);
-		}
+		kfree_skb(skb);
 	}
- out:
+}
+
+static int ip_local_deliver_finish(struct sk_buff *skb)
+{
+	__skb_pull(skb, ip_hdrlen(skb));
+
+	/* Point into the IP datagram, just past the header. */
+	skb_reset_transport_header(skb);
+
+	rcu_read_lock();
+	ip_protocol_deliver_rcu(dev_net(skb->dev), skb, ip_hdr(skb)->protocol);
 	rcu_read_unlock();
 
 	return 0;
@@ -326,6 +331,23 @@ static int ip_rcv_finish(struct sk_buff *skb)
 	const struct iphdr *iph = ip_hdr(skb);
 	struct rtable *rt;
 
+	/*
+	 *	Let the transport find an established socket first: its cached
+	 *	input route saves the route lookup below.
+	 */
+	if (sysctl_ip_early_demux && !skb_dst(skb) && skb->sk == NULL &&
+	    !(iph->frag_off & htons(IP_MF | IP_OFFSET))) {
+		const struct net_protocol *ipprot;
+		int protocol = iph->protocol;
+
+		ipprot = rcu_dereference(inet_protos[protocol & (MAX_INET_PROTOS - 1)]);
+		if (ipprot && ipprot->early_demux) {
+			ipprot->early_demux(skb);
+			/* must reload iph, skb->head might have changed */
+			iph = ip_hdr(skb);
+		}
+	}
+
 	/*
 	 *	Initialise the virtual path cache for the packet. It describes
 	 *	how the packet travels inside Linux networking.
@@ -438,6 +460,8 @@ int ip_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt,
 		goto drop;
 	}
 
+	skb->transport_header = skb->network_header + iph->ihl*4;
+
 	/* Remove any debris in the socket control block */
 	memset(IPCB(skb), 0, sizeof(struct inet_skb_parm));
 
@@ -801,6 +801,7 @@ int ip_append_data(struct sock *sk,
 		   unsigned int flags)
 {
 	struct inet_sock *inet = inet_sk(sk);
+	struct ubuf_info *uarg = NULL;
 	struct sk_buff *skb;
 
 	struct ip_options *opt = NULL;
@@ -809,6 +810,7 @@ int ip_append_data(struct sock *sk,
 	int mtu;
 	int copy;
 	int err;
+	int zc = 0;
 	int offset = 0;
 	unsigned int maxfraglen, fragheaderlen;
 	int csummode = CHECKSUM_NONE;
@@ -839,9 +841,10 @@ int ip_append_data(struct sock *sk,
 		 * We steal reference to this route, caller should not release it
 		 */
 		*rtp = NULL;
-		inet->cork.fragsize = mtu = inet->pmtudisc == IP_PMTUDISC_PROBE ?
-					    rt->u.dst.dev->mtu :
-					    dst_mtu(rt->u.dst.path);
+		inet->cork.fragsize = inet->pmtudisc == IP_PMTUDISC_PROBE ?
+				      rt->u.dst.dev->mtu :
+				      dst_mtu(rt->u.dst.path);
+		inet->cork.gso_size = ipc->gso_size;
 		inet->cork.dst = &rt->u.dst;
 		inet->cork.length = 0;
 		sk->sk_sndmsg_page = NULL;
@@ -857,8 +860,9 @@ int ip_append_data(struct sock *sk,
 
 		transhdrlen = 0;
 		exthdrlen = 0;
-		mtu = inet->cork.fragsize;
 	}
+	/* A UDP_SEGMENT datagram is cut to size by GSO, not here. */
+	mtu = inet->cork.gso_size ? 0xFFFF : inet->cork.fragsize;
 	hh_len = LL_RESERVED_SPACE(rt->u.dst.dev);
 
 	fragheaderlen = sizeof(struct iphdr) + (opt ? opt->optlen : 0);
@@ -884,7 +888,7 @@ int ip_append_data(struct sock *sk,
 
 	inet->cork.length += length;
 	if (((length > mtu) || (skb && skb_is_gso(skb))) &&
-	    (sk->sk_protocol == IPPROTO_UDP) &&
+	    (sk->sk_protocol == IPPROTO_UDP) && !inet->cork.gso_size &&
 	    (rt->u.dst.dev->features & NETIF_F_UFO)) {
 		err = ip_ufo_append_data(sk, getfrag, from, length, hh_len,
 					 fragheaderlen, transhdrlen, mtu,
@@ -894,6 +898,20 @@ int ip_append_data(struct sock *sk,
 		return 0;
 	}
 
+	/* MSG_ZEROCOPY: only a single, checksum offloaded datagram that
+	 * starts a new packet is built with its payload left in user pages.
+	 */
+	if ((flags & MSG_ZEROCOPY) && sock_flag(sk, SOCK_ZEROCOPY) &&
+	    csummode == CHECKSUM_PARTIAL && getfrag == ip_generic_getfrag &&
+	    length > transhdrlen && rt->u.dst.dev->features & NETIF_F_SG) {
+		uarg = sock_zerocopy_alloc(sk, length - transhdrlen);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto error;
+		}
+		zc = 1;
+	}
+
 	/* So, what's going on in the loop below?
 	 *
 	 * We use calculated fragment length to generate chained skb,
@@ -946,6 +964,10 @@ alloc_new_skb:
 			if (datalen == length + fraggap)
 				alloclen += rt->u.dst.trailer_len;
 
+			/* zerocopy payload goes to frags, keep only headers */
+			if (zc)
+				alloclen = fragheaderlen + transhdrlen;
+
 			if (transhdrlen) {
 				skb = sock_alloc_send_skb(sk,
 						alloclen + hh_len + 15,
@@ -978,7 +1000,7 @@ alloc_new_skb:
 			/*
 			 *	Find where to start putting bytes.
 			 */
-			data = skb_put(skb, fraglen);
+			data = skb_put(skb, zc ? alloclen : fraglen);
 			skb_set_network_header(skb, exthdrlen);
 			skb->transport_header = (skb->network_header +
 						 fragheaderlen);
@@ -995,7 +1017,16 @@ alloc_new_skb:
 			}
 
 			copy = datalen - transhdrlen - fraggap;
-			if (copy > 0 && getfrag(from, data + transhdrlen, offset, copy, fraggap, skb) < 0) {
+			if (zc) {
+				if (skb_zerocopy_from_iovec(sk, skb, from,
+							    offset, copy) != copy) {
+					err = -EFAULT;
+					kfree_skb(skb);
+					goto error;
+				}
+				atomic_add(copy, &sk->sk_wmem_alloc);
+				skb_zcopy_set(skb, uarg);
+			} else if (copy > 0 && getfrag(from, data + transhdrlen, offset, copy, fraggap, skb) < 0) {
 				err = -EFAULT;
 				kfree_skb(skb);
 				goto error;
@@ -1078,9 +1109,11 @@ alloc_new_skb:
 		length -= copy;
 	}
 
+	sock_zerocopy_put(uarg);
 	return 0;
 
 error:
+	sock_zerocopy_put_abort(uarg);
 	inet->cork.length -= length;
 	IP_INC_STATS(sock_net(sk), IPSTATS_MIB_OUTDISCARDS);
 	return err;
@@ -1116,7 +1149,7 @@ ssize_t	ip_append_page(struct sock *sk, struct page *page,
 		return -EOPNOTSUPP;
 
 	hh_len = LL_RESERVED_SPACE(rt->u.dst.dev);
-	mtu = inet->cork.fragsize;
+	mtu = inet->cork.gso_size ? 0xFFFF : inet->cork.fragsize;
 
 	fragheaderlen = sizeof(struct iphdr) + (opt ? opt->optlen : 0);
 	maxfraglen = ((mtu - fragheaderlen) & ~7) + fragheaderlen;
@@ -1131,7 +1164,7 @@ ssize_t	ip_append_page(struct sock *sk, struct page *page,
 
 	inet->cork.length += size;
 	if ((size + skb->len > mtu) &&
-	    (sk->sk_protocol == IPPROTO_UDP) &&
+	    (sk->sk_protocol == IPPROTO_UDP) && !inet->cork.gso_size &&
 	    (rt->u.dst.dev->features & NETIF_F_UFO)) {
 		skb_shinfo(skb)->gso_size = mtu - fragheaderlen;
 		skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
@@ -1394,6 +1427,7 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, struct ip_reply_arg *ar
 	daddr = ipc.addr = rt->rt_src;
 	ipc.opt = NULL;
 	ipc.shtx.flags = 0;
+	ipc.gso_size = 0;
 
 	if (replyopts.opt.optlen) {
 		ipc.opt = &replyopts.opt;
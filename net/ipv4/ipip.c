@@ -374,6 +374,10 @@ static int ipip_rcv(struct sk_buff *skb)
 		skb->protocol = htons(ETH_P_IP);
 		skb->pkt_type = PACKET_HOST;
 
+		/* An aggregate from GRO is a plain IPv4 one from here on. */
+		if (skb_is_gso(skb))
+			skb_shinfo(skb)->gso_type &= ~SKB_GSO_IPIP;
+
 		skb_tunnel_rx(skb, tunnel->dev);
 
 		ipip_ecn_decapsulate(iph, skb);
@@ -410,6 +414,10 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 	if (skb->protocol != htons(ETH_P_IP))
 		goto tx_error;
 
+	if (skb->ip_summed == CHECKSUM_PARTIAL && !skb_is_gso(skb) &&
+	    skb_checksum_help(skb))
+		goto tx_error;
+
 	if (tos&1)
 		tos = old_iph->tos;
 
@@ -458,7 +466,7 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 			skb_dst(skb)->ops->update_pmtu(skb_dst(skb), mtu);
 
 		if ((old_iph->frag_off & htons(IP_DF)) &&
-		    mtu < ntohs(old_iph->tot_len)) {
+		    mtu < ntohs(old_iph->tot_len) && !skb_is_gso(skb)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED,
 				  htonl(mtu));
 			ip_rt_put(rt);
@@ -480,8 +488,12 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 	 */
 	max_headroom = (LL_RESERVED_SPACE(tdev)+sizeof(struct iphdr));
 
+	/* The gso_type of a GSO packet is rewritten below, so it needs a
+	 * private skb_shared_info as well.
+	 */
 	if (skb_headroom(skb) < max_headroom || skb_shared(skb) ||
-	    (skb_cloned(skb) && !skb_clone_writable(skb, 0))) {
+	    (skb_cloned(skb) && !skb_clone_writable(skb, 0)) ||
+	    (skb_cloned(skb) && skb_is_gso(skb))) {
 		struct sk_buff *new_skb = skb_realloc_headroom(skb, max_headroom);
 		if (!new_skb) {
 			ip_rt_put(rt);
@@ -521,6 +533,9 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 	if ((iph->ttl = tiph->ttl) == 0)
 		iph->ttl	=	old_iph->ttl;
 
+	if (skb_is_gso(skb))
+		skb_shinfo(skb)->gso_type |= SKB_GSO_IPIP;
+
 	nf_reset(skb);
 
 	IPTUNNEL_XMIT();
@@ -712,6 +727,14 @@ static void ipip_tunnel_setup(struct net_device *dev)
 	dev->addr_len		= 4;
 	dev->features		|= NETIF_F_NETNS_LOCAL;
 	dev->priv_flags		&= ~IFF_XMIT_DST_RELEASE;
+
+	/* Segmentation is deferred to the underlying device, see
+	 * tunnel4_gso_segment().
+	 */
+	dev->features		|= NETIF_F_SG | NETIF_F_HW_CSUM |
+				   NETIF_F_HIGHDMA | NETIF_F_TSO |
+				   NETIF_F_TSO_ECN;
+	netif_set_gso_max_size(dev, GSO_MAX_SIZE - sizeof(struct iphdr));
 }
 
 static void ipip_tunnel_init(struct net_device *dev)
@@ -72,6 +72,7 @@
 #include <net/timewait_sock.h>
 #include <net/xfrm.h>
 #include <net/netdma.h>
+#include <net/busy_poll.h>
 
 #include <linux/inet.h>
 #include <linux/ipv6.h>
@@ -1020,6 +1021,7 @@ static int tcp_v4_parse_md5_keys(struct sock *sk, char __user *optval,
 
 		tp->md5sig_info = p;
 		sk_nocaps_add(sk, NETIF_F_GSO_MASK);
+		tcp_syn_lockless_sync(sk);
 	}
 
 	newkey = kmemdup(cmd.tcpm_key, cmd.tcpm_keylen, sk->sk_allocation);
@@ -1553,7 +1555,14 @@ int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 #endif
 
 	if (sk->sk_state == TCP_ESTABLISHED) { /* Fast path */
+		struct dst_entry *dst = sk->sk_rx_dst;
+
 		sock_rps_save_rxhash(sk, skb->rxhash);
+		if (dst && (inet_sk(sk)->rx_dst_ifindex != skb->skb_iif ||
+			    dst->ops->check(dst, 0) == NULL))
+			inet_sk_rx_dst_reset(sk);
+		if (unlikely(!sk->sk_rx_dst) && skb_dst(skb))
+			inet_sk_rx_dst_set(sk, skb);
 		TCP_CHECK_TIMER(sk);
 		if (tcp_rcv_established(sk, skb, tcp_hdr(skb), skb->len)) {
 			rsk = sk;
@@ -1606,6 +1615,93 @@ csum_err:
 	goto discard;
 }
 
+/*
+ * Answer a SYN that does not belong to a pending request without taking
+ * the listener lock, so that a SYN flood does not serialize all CPUs on
+ * one listener. The request hash has its own lock, see
+ * inet_csk_reqsk_queue_hash_add(). Returns false if the skb has to take
+ * the locked path instead.
+ */
+static bool tcp_v4_syn_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct tcphdr *th = tcp_hdr(skb);
+	const struct iphdr *iph = ip_hdr(skb);
+	struct request_sock **prev;
+	bool pending = true;
+
+	if (!tcp_syn_lockless(sk, th))
+		return false;
+
+	/* retransmitted SYNs and closing listeners take the locked path */
+	read_lock(&queue->syn_wait_lock);
+	if (queue->listen_opt)
+		pending = inet_csk_search_req(sk, &prev, th->source,
+					      iph->saddr, iph->daddr) != NULL;
+	read_unlock(&queue->syn_wait_lock);
+	if (pending)
+		return false;
+
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_v4_inbound_md5_hash(sk, skb))
+		goto discard;
+#endif
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb)) {
+		TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_INERRS);
+		goto discard;
+	}
+
+	if (inet_csk(sk)->icsk_af_ops->conn_request(sk, skb) < 0)
+		tcp_v4_send_reset(sk, skb);
+discard:
+	kfree_skb(skb);
+	return true;
+}
+
+/*
+ * Called from ip_rcv_finish() before the route lookup.  An established
+ * (or TIME_WAIT) socket found here rides along in skb->sk, saving the
+ * lookup in tcp_v4_rcv(), and its cached input route replaces the route
+ * lookup.
+ */
+void tcp_v4_early_demux(struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	const struct tcphdr *th;
+	struct dst_entry *dst;
+	struct sock *sk;
+
+	if (skb->pkt_type != PACKET_HOST)
+		return;
+
+	if (!pskb_may_pull(skb, skb_transport_offset(skb) +
+				sizeof(struct tcphdr)))
+		return;
+
+	iph = ip_hdr(skb);
+	th = tcp_hdr(skb);
+
+	if (th->doff < sizeof(struct tcphdr) / 4)
+		return;
+
+	sk = __inet_lookup_established(dev_net(skb->dev), &tcp_hashinfo,
+				       iph->saddr, th->source,
+				       iph->daddr, ntohs(th->dest),
+				       skb->skb_iif);
+	if (!sk)
+		return;
+
+	skb->sk = sk;
+	skb->destructor = sock_edemux;
+	if (sk->sk_state == TCP_TIME_WAIT)
+		return;
+
+	dst = rcu_dereference(sk->sk_rx_dst);
+	if (dst && inet_sk(sk)->rx_dst_ifindex == skb->skb_iif &&
+	    dst->ops->check(dst, 0))
+		skb_dst_set_noref(skb, dst);
+}
+
 /*
  *	From tcp_input.c
  */
@@ -1673,6 +1769,12 @@ process:
 
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v4_syn_rcv(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
+	sk_mark_napi_id(sk, skb);
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1868,6 +1970,8 @@ static int tcp_v4_init_sock(struct sock *sk)
 	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
 	tp->snd_cwnd_clamp = ~0;
 	tp->mss_cache = TCP_MSS_DEFAULT;
+	/* Nothing sent yet: rate samples start out app-limited */
+	tp->app_limited = ~0U;
 
 	tp->reordering = sysctl_tcp_reordering;
 	icsk->icsk_ca_ops = &tcp_init_congestion_ops;
@@ -776,6 +776,40 @@ static unsigned tcp_established_options(struct sock *sk, struct sk_buff *skb,
 	return size;
 }
 
+/* Snapshot the current delivery information in the skb, to generate
+ * a rate sample later when the skb is (s)acked in tcp_rate_skb_delivered().
+ */
+static void tcp_rate_skb_sent(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 now = tcp_clock_us();
+
+	/* In general we need to start delivery rate samples from the
+	 * time we received the most recent ACK, to ensure we include
+	 * the full time the network needs to deliver all in-flight
+	 * packets. If there are no packets in flight yet, then we
+	 * know that any ACKs after now indicate that the network was
+	 * able to deliver those packets completely in the sampling
+	 * interval between now and the next ACK.
+	 *
+	 * Note that we use packets_out instead of tcp_packets_in_flight(tp)
+	 * because the latter is a guess based on RTO and loss-marking
+	 * heuristics. We don't want spurious RTOs or loss markings to cause
+	 * a spuriously small time interval, causing a spuriously high
+	 * bandwidth estimate.
+	 */
+	if (!tp->packets_out) {
+		tp->first_tx_mstamp  = now;
+		tp->delivered_mstamp = now;
+	}
+
+	TCP_SKB_CB(skb)->tx.sent_mstamp		= now;
+	TCP_SKB_CB(skb)->tx.first_tx_mstamp	= tp->first_tx_mstamp;
+	TCP_SKB_CB(skb)->tx.delivered_mstamp	= tp->delivered_mstamp;
+	TCP_SKB_CB(skb)->tx.delivered		= tp->delivered;
+	TCP_SKB_CB(skb)->tx.is_app_limited	= tp->app_limited ? 1 : 0;
+}
+
 /* This routine actually transmits TCP packets queued in by
  * tcp_do_sendmsg().  This is used by both the initial
  * transmission and possible later retransmissions.
@@ -809,6 +843,8 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 		__net_timestamp(skb);
 
 	if (likely(clone_it)) {
+		tcp_rate_skb_sent(sk, skb);
+
 		if (unlikely(skb_cloned(skb)))
 			skb = pskb_copy(skb, gfp_mask);
 		else
@@ -892,6 +928,10 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 		TCP_ADD_STATS(sock_net(sk), TCP_MIB_OUTSEGS,
 			      tcp_skb_pcount(skb));
 
+	/* The IP layers expect a clean control block, not our tx state */
+	if (likely(clone_it))
+		memset(&tcb->header, 0, sizeof(tcb->header));
+
 	err = icsk->icsk_af_ops->queue_xmit(skb);
 	if (likely(err <= 0))
 		return err;
@@ -1049,6 +1089,7 @@ int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 	 * skbs, which it never sent before. --ANK
 	 */
 	TCP_SKB_CB(buff)->when = TCP_SKB_CB(skb)->when;
+	TCP_SKB_CB(buff)->tx = TCP_SKB_CB(skb)->tx;
 	buff->tstamp = skb->tstamp;
 
 	old_factor = tcp_skb_pcount(skb);
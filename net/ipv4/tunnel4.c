@@ -133,9 +133,61 @@ static void tunnel64_err(struct sk_buff *skb, u32 info)
 }
 #endif
 
+/*
+ * Offload of IPv4-in-IPv4 traffic.  These are called from inet_gso_segment
+ * and inet_gro_* with rcu_read_lock() held, after the outer header has
+ * been pulled and matched.  The inner packet is handed to the IPv4 packet
+ * handler again, so GRO and GSO simply recurse one level deeper.
+ */
+static struct sk_buff *tunnel4_gso_segment(struct sk_buff *skb, int features)
+{
+	return skb_encap_gso_segment(skb, features, htons(ETH_P_IP));
+}
+
+static struct sk_buff **tunnel4_gro_receive(struct sk_buff **head,
+					    struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+
+	/* Only one level of encapsulation is aggregated. */
+	if (NAPI_GRO_CB(skb)->encap_mark)
+		goto flush;
+
+	ptype = dev_find_offload(htons(ETH_P_IP));
+	if (!ptype)
+		goto flush;
+
+	NAPI_GRO_CB(skb)->encap_mark = 1;
+
+	return ptype->gro_receive(head, skb);
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
+static int tunnel4_gro_complete(struct sk_buff *skb)
+{
+	struct packet_type *ptype;
+	int err;
+
+	ptype = dev_find_offload(htons(ETH_P_IP));
+	if (WARN_ON(!ptype))
+		return -ENOENT;
+
+	skb_set_network_header(skb, skb_network_offset(skb) + ip_hdrlen(skb));
+	err = ptype->gro_complete(skb);
+	skb_shinfo(skb)->gso_type |= SKB_GSO_IPIP;
+
+	return err;
+}
+
 static const struct net_protocol tunnel4_protocol = {
 	.handler	=	tunnel4_rcv,
 	.err_handler	=	tunnel4_err,
+	.gso_segment	=	tunnel4_gso_segment,
+	.gro_receive	=	tunnel4_gro_receive,
+	.gro_complete	=	tunnel4_gro_complete,
 	.no_policy	=	1,
 	.netns_ok	=	1,
 };
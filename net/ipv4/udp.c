@@ -105,6 +105,7 @@
 #include <net/route.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 struct udp_table udp_table __read_mostly;
@@ -122,6 +123,9 @@ EXPORT_SYMBOL(sysctl_udp_wmem_min);
 atomic_t udp_memory_allocated;
 EXPORT_SYMBOL(udp_memory_allocated);
 
+/* Sockets with UDP_GRO set: until there is one, GRO skips the lookup */
+static atomic_t udp_gro_sockets;
+
 #define MAX_UDP_PORTS 65536
 #define PORTS_PER_CHAIN (MAX_UDP_PORTS / UDP_HTABLE_SIZE_MIN)
 
@@ -730,7 +734,37 @@ static int udp_push_pending_frames(struct sock *sk)
 	uh->len = htons(up->len);
 	uh->check = 0;
 
-	if (is_udplite)  				 /*     UDP-Lite      */
+	if (inet->cork.gso_size) {			 /*    UDP_SEGMENT    */
+		int hlen = skb_network_header_len(skb) + sizeof(struct udphdr);
+		int datalen = up->len - sizeof(struct udphdr);
+		unsigned int mss = inet->cork.gso_size;
+
+		if (hlen + mss > inet->cork.fragsize ||
+		    datalen > mss * UDP_MAX_SEGMENTS || is_udplite ||
+		    sk->sk_no_check == UDP_CSUM_NOXMIT ||
+		    inet->cork.dst->xfrm) {
+			ip_flush_pending_frames(sk);
+			err = -EINVAL;
+			goto out;
+		}
+
+		if (datalen > mss) {
+			skb_shinfo(skb)->gso_size = mss;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+			skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen, mss);
+		}
+
+		/* Each segment is checksummed on its own once it has been
+		 * cut, by the device or by udp4_gso_segment().
+		 */
+		skb->ip_summed = CHECKSUM_PARTIAL;
+		skb->csum_start = skb_transport_header(skb) - skb->head;
+		skb->csum_offset = offsetof(struct udphdr, check);
+		uh->check = ~csum_tcpudp_magic(fl->fl4_src, fl->fl4_dst,
+					       up->len, IPPROTO_UDP, 0);
+		goto send;
+
+	} else if (is_udplite)  			 /*     UDP-Lite      */
 		csum  = udplite_csum_outgoing(sk, skb);
 
 	else if (sk->sk_no_check == UDP_CSUM_NOXMIT) {   /* UDP csum disabled */
@@ -769,6 +803,33 @@ out:
 	return err;
 }
 
+/*
+ * Parse the SOL_UDP control messages of a send: UDP_SEGMENT overrides
+ * the socket's segment size for this datagram.
+ */
+static int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (!CMSG_OK(msg, cmsg))
+			return -EINVAL;
+		if (cmsg->cmsg_level != SOL_UDP)
+			continue;
+		switch (cmsg->cmsg_type) {
+		case UDP_SEGMENT:
+			if (cmsg->cmsg_len != CMSG_LEN(sizeof(__u16)))
+				return -EINVAL;
+			*gso_size = *(__u16 *)CMSG_DATA(cmsg);
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t len)
 {
@@ -798,6 +859,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.shtx.flags = 0;
+	ipc.gso_size = up->gso_size;
 
 	if (up->pending) {
 		/*
@@ -849,7 +911,9 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	if (err)
 		return err;
 	if (msg->msg_controllen) {
-		err = ip_cmsg_send(sock_net(sk), msg, &ipc);
+		err = udp_cmsg_send(sk, msg, &ipc.gso_size);
+		if (!err)
+			err = ip_cmsg_send(sock_net(sk), msg, &ipc);
 		if (err)
 			return err;
 		if (ipc.opt)
@@ -1189,6 +1253,12 @@ try_again:
 	if (inet->cmsg_flags)
 		ip_cmsg_recv(msg, skb);
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		int gso_size = skb_shinfo(skb)->gso_size;
+
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
+
 	err = len;
 	if (flags & MSG_TRUNC)
 		err = ulen;
@@ -1233,6 +1303,7 @@ int udp_disconnect(struct sock *sk, int flags)
 		inet->inet_sport = 0;
 	}
 	sk_dst_reset(sk);
+	inet_sk_rx_dst_reset(sk);
 	return 0;
 }
 EXPORT_SYMBOL(udp_disconnect);
@@ -1330,6 +1401,40 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 }
 
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, int features);
+
+/*
+ * A packet coalesced by udp4_gro_receive() for a UDP_GRO socket may still
+ * reach one that did not ask for it, such as a socket that replaced the
+ * one seen at GRO time.  Split it back into its datagrams,
+ * each returned with data pointing at its UDP header.
+ */
+static struct sk_buff *udp_rcv_segment(struct sk_buff *skb)
+{
+	struct sk_buff *segs, *seg;
+
+	/* skb_segment() copies everything from the mac header on. */
+	skb->mac_header = skb->network_header;
+	skb->mac_len = 0;
+
+	segs = udp4_gso_segment(skb, NETIF_F_SG | NETIF_F_HW_CSUM);
+	kfree_skb(skb);
+	if (IS_ERR(segs))
+		return NULL;
+
+	for (seg = segs; seg; seg = seg->next) {
+		struct iphdr *iph = ip_hdr(seg);
+
+		iph->tot_len = htons(seg->len);
+		ip_send_check(iph);
+		__skb_pull(seg, skb_transport_offset(seg));
+	}
+
+	return segs;
+}
+
+static int udp_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb);
+
 /* returns:
  *  -1: error
  *   0: success
@@ -1339,6 +1444,27 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
  * have either been requeued or freed.
  */
 int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *next;
+	int ret;
+
+	if (likely(!(skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) ||
+		   udp_sk(sk)->gro_enabled))
+		return udp_queue_rcv_one_skb(sk, skb);
+
+	for (skb = udp_rcv_segment(skb); skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+
+		ret = udp_queue_rcv_one_skb(sk, skb);
+		if (ret > 0)
+			ip_protocol_deliver_rcu(dev_net(skb->dev), skb, ret);
+	}
+
+	return 0;
+}
+
+static int udp_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
 	int rc;
@@ -1608,7 +1734,13 @@ int __udp4_lib_rcv(struct sk_buff *skb, struct udp_table *udptable,
 	sk = __udp4_lib_lookup_skb(skb, uh->source, uh->dest, udptable);
 
 	if (sk != NULL) {
-		int ret = udp_queue_rcv_skb(sk, skb);
+		int ret;
+
+		sk_mark_napi_id(sk, skb);
+		if (sk->sk_state == TCP_ESTABLISHED &&
+		    unlikely(sk->sk_rx_dst != skb_dst(skb)))
+			inet_sk_rx_dst_set(sk, skb);
+		ret = udp_queue_rcv_skb(sk, skb);
 		sock_put(sk);
 
 		/* a return value > 0 means to resubmit the input, but
@@ -1666,6 +1798,48 @@ drop:
 	return 0;
 }
 
+/*
+ * Early demux for connected sockets, called from ip_rcv_finish() before
+ * the route lookup.  Unconnected sockets are left alone: their wildcard
+ * binding would also match packets that are about to be forwarded.
+ */
+void udp_v4_early_demux(struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	const struct udphdr *uh;
+	struct dst_entry *dst;
+	struct sock *sk;
+
+	if (skb->pkt_type != PACKET_HOST)
+		return;
+
+	if (!pskb_may_pull(skb, skb_transport_offset(skb) +
+				sizeof(struct udphdr)))
+		return;
+
+	iph = ip_hdr(skb);
+	uh = udp_hdr(skb);
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->skb_iif, &udp_table);
+	if (!sk)
+		return;
+
+	if (sk->sk_state != TCP_ESTABLISHED ||
+	    inet_sk(sk)->inet_rcv_saddr != iph->daddr) {
+		sock_put(sk);
+		return;
+	}
+
+	skb->sk = sk;
+	skb->destructor = sock_edemux;
+
+	dst = rcu_dereference(sk->sk_rx_dst);
+	if (dst && inet_sk(sk)->rx_dst_ifindex == skb->skb_iif &&
+	    dst->ops->check(dst, 0))
+		skb_dst_set_noref(skb, dst);
+}
+
 int udp_rcv(struct sk_buff *skb)
 {
 	return __udp4_lib_rcv(skb, &udp_table, IPPROTO_UDP);
@@ -1675,6 +1849,8 @@ void udp_destroy_sock(struct sock *sk)
 {
 	bool slow = lock_sock_fast(sk);
 	udp_flush_pending_frames(sk);
+	if (udp_sk(sk)->gro_enabled)
+		atomic_dec(&udp_gro_sockets);
 	unlock_sock_fast(sk, slow);
 }
 
@@ -1724,6 +1900,31 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		}
 		break;
 
+	/*
+	 *	Segmentation offload, IPv4 UDP sockets only.
+	 */
+	case UDP_SEGMENT:
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHRT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
+	case UDP_GRO:
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		lock_sock(sk);
+		if (!up->gro_enabled != !val) {
+			up->gro_enabled = val ? 1 : 0;
+			if (val)
+				atomic_inc(&udp_gro_sockets);
+			else
+				atomic_dec(&udp_gro_sockets);
+		}
+		release_sock(sk);
+		break;
+
 	/*
 	 * 	UDP-Lite's partial checksum coverage (RFC 3828).
 	 */
@@ -1806,6 +2007,14 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->encap_type;
 		break;
 
+	case UDP_SEGMENT:
+		val = up->gso_size;
+		break;
+
+	case UDP_GRO:
+		val = up->gro_enabled;
+		break;
+
 	/* The following two cannot be changed on UDP sockets, the return is
 	 * always 0 (which corresponds to the full checksum coverage of UDP). */
 	case UDPLITE_SEND_CSCOV:
@@ -2205,6 +2414,56 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/*
+ * UDP_SEGMENT: cut a large datagram into gso_size sized datagrams, each
+ * with its own UDP header.  The IP headers are fixed up by the caller.
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct sk_buff *seg;
+	unsigned int mss = skb_shinfo(skb)->gso_size;
+	__be32 saddr, daddr;
+	struct udphdr *uh;
+	unsigned int ulen;
+
+	if (unlikely(!pskb_may_pull(skb, sizeof(*uh))))
+		goto out;
+
+	if (unlikely(skb->len <= sizeof(*uh) + mss))
+		goto out;
+
+	saddr = ip_hdr(skb)->saddr;
+	daddr = ip_hdr(skb)->daddr;
+
+	__skb_pull(skb, sizeof(*uh));
+	segs = skb_segment(skb, features);
+	__skb_push(skb, sizeof(*uh));
+	if (IS_ERR(segs))
+		goto out;
+
+	for (seg = segs; seg; seg = seg->next) {
+		uh = udp_hdr(seg);
+		ulen = seg->len - skb_transport_offset(seg);
+		uh->len = htons(ulen);
+		uh->check = 0;
+
+		if (seg->ip_summed == CHECKSUM_PARTIAL) {
+			uh->check = ~csum_tcpudp_magic(saddr, daddr, ulen,
+						       IPPROTO_UDP, 0);
+			continue;
+		}
+
+		uh->check = csum_tcpudp_magic(saddr, daddr, ulen, IPPROTO_UDP,
+					      csum_partial(uh, sizeof(*uh),
+							   seg->csum));
+		if (uh->check == 0)
+			uh->check = CSUM_MANGLED_0;
+	}
+out:
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2212,6 +2471,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, int features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -2247,3 +2509,130 @@ out:
 	return segs;
 }
 
+/*
+ * UDP receive aggregation.  Back-to-back datagrams of one flow are merged
+ * only when the receiving socket asked for it with UDP_GRO; all but the
+ * last must have the size of the first, which becomes gso_size and is
+ * reported to the reader in a UDP_GRO control message.
+ */
+struct sk_buff **udp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	struct udphdr *uh, *uh2;
+	struct iphdr *iph;
+	struct sock *sk;
+	unsigned int hlen, off, len;
+	unsigned int mss = 1;
+	int flush = 1;
+
+	/* Spare everyone else the socket lookup below */
+	if (!atomic_read(&udp_gro_sockets))
+		goto out;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto out;
+	}
+	iph = skb_gro_network_header(skb);
+
+	if (ntohs(uh->len) != skb_gro_len(skb) ||
+	    skb_gro_len(skb) <= sizeof(*uh))
+		goto out;
+	if (iph->frag_off & htons(IP_MF | IP_OFFSET))
+		goto out;
+	if (ipv4_is_multicast(iph->daddr) || ipv4_is_lbcast(iph->daddr))
+		goto out;
+
+	if (uh->check) {
+		switch (skb->ip_summed) {
+		case CHECKSUM_COMPLETE:
+			if (!csum_tcpudp_magic(iph->saddr, iph->daddr,
+					       skb_gro_len(skb), IPPROTO_UDP,
+					       skb->csum)) {
+				skb->ip_summed = CHECKSUM_UNNECESSARY;
+				break;
+			}
+
+			/* fall through */
+		case CHECKSUM_NONE:
+			goto out;
+		}
+	}
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table);
+	if (!sk)
+		goto out;
+	flush = !udp_sk(sk)->gro_enabled || udp_sk(sk)->encap_type;
+	sock_put(sk);
+	if (flush)
+		goto out;
+
+	skb_gro_pull(skb, sizeof(*uh));
+	len = skb_gro_len(skb);
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = udp_hdr(p);
+
+		if (*(u32 *)&uh->source ^ *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		goto found;
+	}
+
+	goto out_check_final;
+
+found:
+	mss = skb_shinfo(p)->gso_size;
+
+	flush = NAPI_GRO_CB(p)->flush;
+	flush |= len > mss;
+	flush |= !uh->check ^ !uh2->check;
+
+	if (flush || skb_gro_receive(head, skb))
+		mss = 1;
+
+out_check_final:
+	/* A short datagram ends the train. */
+	flush = len < mss;
+
+	if (p && (!NAPI_GRO_CB(skb)->same_flow || flush))
+		pp = head;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+int udp4_gro_complete(struct sk_buff *skb)
+{
+	struct iphdr *iph = ip_hdr(skb);
+	struct udphdr *uh = udp_hdr(skb);
+	unsigned int ulen = skb->len - skb_transport_offset(skb);
+
+	uh->len = htons(ulen);
+	uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr, ulen,
+				       IPPROTO_UDP, 0);
+
+	skb->csum_start = skb_transport_header(skb) - skb->head;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+	return 0;
+}
+
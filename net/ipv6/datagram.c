@@ -361,7 +361,11 @@ int ipv6_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	serr = SKB_EXT_ERR(skb);
 
 	sin = (struct sockaddr_in6 *)msg->msg_name;
-	if (sin) {
+	if (sin && serr->ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+		/* completion notification, no packet behind it */
+		memset(sin, 0, sizeof(*sin));
+		sin->sin6_family = AF_UNSPEC;
+	} else if (sin) {
 		const unsigned char *nh = skb_network_header(skb);
 		sin->sin6_family = AF_INET6;
 		sin->sin6_flowinfo = 0;
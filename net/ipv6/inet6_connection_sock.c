@@ -115,13 +115,23 @@ void inet6_csk_reqsk_queue_hash_add(struct sock *sk,
 				    const unsigned long timeout)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
-	struct listen_sock *lopt = icsk->icsk_accept_queue.listen_opt;
-	const u32 h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr,
-				      inet_rsk(req)->rmt_port,
-				      lopt->hash_rnd, lopt->nr_table_entries);
-
-	reqsk_queue_hash_req(&icsk->icsk_accept_queue, h, req, timeout);
+	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
+	struct listen_sock *lopt;
+	u32 h;
+
+	write_lock(&queue->syn_wait_lock);
+	lopt = queue->listen_opt;
+	if (unlikely(lopt == NULL)) {
+		/* listener closed under a SYN handled without its lock */
+		write_unlock(&queue->syn_wait_lock);
+		reqsk_free(req);
+		return;
+	}
+	h = inet6_synq_hash(&inet6_rsk(req)->rmt_addr, inet_rsk(req)->rmt_port,
+			    lopt->hash_rnd, lopt->nr_table_entries);
+	reqsk_queue_hash_req(queue, h, req, timeout);
 	inet_csk_reqsk_queue_added(sk, timeout);
+	write_unlock(&queue->syn_wait_lock);
 }
 
 EXPORT_SYMBOL_GPL(inet6_csk_reqsk_queue_hash_add);
@@ -113,6 +113,8 @@ struct ipv6_txoptions *ipv6_update_options(struct sock *sk,
 			icsk->icsk_sync_mss(sk, icsk->icsk_pmtu_cookie);
 		}
 		opt = xchg(&inet6_sk(sk)->opt, opt);
+		if (!opt && inet6_sk(sk)->opt && sk->sk_type == SOCK_STREAM)
+			tcp_syn_lockless_sync(sk);
 	} else {
 		spin_lock(&sk->sk_dst_lock);
 		opt = xchg(&inet6_sk(sk)->opt, opt);
@@ -61,6 +61,7 @@
 #include <net/timewait_sock.h>
 #include <net/netdma.h>
 #include <net/inet_common.h>
+#include <net/busy_poll.h>
 
 #include <asm/uaccess.h>
 
@@ -742,6 +743,7 @@ static int tcp_v6_parse_md5_keys (struct sock *sk, char __user *optval,
 
 		tp->md5sig_info = p;
 		sk_nocaps_add(sk, NETIF_F_GSO_MASK);
+		tcp_syn_lockless_sync(sk);
 	}
 
 	newkey = kmemdup(cmd.tcpm_key, cmd.tcpm_keylen, GFP_KERNEL);
@@ -1680,6 +1682,46 @@ ipv6_pktoptions:
 	return 0;
 }
 
+/* IPv6 version of tcp_v4_syn_rcv(). Listeners with IPv6 tx options
+ * take the locked path: setsockopt() may replace and free np->opt.
+ */
+static bool tcp_v6_syn_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct tcphdr *th = tcp_hdr(skb);
+	struct request_sock **prev;
+	bool pending = true;
+
+	if (!tcp_syn_lockless(sk, th) || inet6_sk(sk)->opt)
+		return false;
+
+	/* retransmitted SYNs and closing listeners take the locked path */
+	read_lock(&queue->syn_wait_lock);
+	if (queue->listen_opt)
+		pending = inet6_csk_search_req(sk, &prev, th->source,
+					       &ipv6_hdr(skb)->saddr,
+					       &ipv6_hdr(skb)->daddr,
+					       inet6_iif(skb)) != NULL;
+	read_unlock(&queue->syn_wait_lock);
+	if (pending)
+		return false;
+
+#ifdef CONFIG_TCP_MD5SIG
+	if (tcp_v6_inbound_md5_hash(sk, skb))
+		goto discard;
+#endif
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb)) {
+		TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_INERRS);
+		goto discard;
+	}
+
+	if (inet_csk(sk)->icsk_af_ops->conn_request(sk, skb) < 0)
+		tcp_v6_send_reset(sk, skb);
+discard:
+	kfree_skb(skb);
+	return true;
+}
+
 static int tcp_v6_rcv(struct sk_buff *skb)
 {
 	struct tcphdr *th;
@@ -1740,6 +1782,12 @@ process:
 
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v6_syn_rcv(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
+	sk_mark_napi_id(sk, skb);
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1922,6 +1970,8 @@ static int tcp_v6_init_sock(struct sock *sk)
 	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
 	tp->snd_cwnd_clamp = ~0;
 	tp->mss_cache = TCP_MSS_DEFAULT;
+	/* Nothing sent yet: rate samples start out app-limited */
+	tp->app_limited = ~0U;
 
 	tp->reordering = sysctl_tcp_reordering;
 
@@ -2142,6 +2192,17 @@ void tcp6_proc_exit(struct net *net)
 }
 #endif
 
+/* MSG_ZEROCOPY completions are reported in the IPv6 error queue format */
+static int tcp_v6_recvmsg(struct kiocb *iocb, struct sock *sk,
+			  struct msghdr *msg, size_t len, int nonblock,
+			  int flags, int *addr_len)
+{
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return ipv6_recv_error(sk, msg, len);
+
+	return tcp_recvmsg(iocb, sk, msg, len, nonblock, flags, addr_len);
+}
+
 struct proto tcpv6_prot = {
 	.name			= "TCPv6",
 	.owner			= THIS_MODULE,
@@ -2155,7 +2216,7 @@ struct proto tcpv6_prot = {
 	.shutdown		= tcp_shutdown,
 	.setsockopt		= tcp_setsockopt,
 	.getsockopt		= tcp_getsockopt,
-	.recvmsg		= tcp_recvmsg,
+	.recvmsg		= tcp_v6_recvmsg,
 	.backlog_rcv		= tcp_v6_do_rcv,
 	.hash			= tcp_v6_hash,
 	.unhash			= inet_unhash,
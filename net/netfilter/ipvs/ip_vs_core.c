@@ -103,25 +103,43 @@ void ip_vs_init_hash_table(struct list_head *table, int rows)
 		INIT_LIST_HEAD(&table[rows]);
 }
 
+static inline void
+ip_vs_cpu_stats_in(struct ip_vs_stats *stats, unsigned int len)
+{
+	struct ip_vs_cpu_stats *s = this_cpu_ptr(stats->cpustats);
+
+	write_seqcount_begin(&s->syncp);
+	s->inpkts++;
+	s->inbytes += len;
+	write_seqcount_end(&s->syncp);
+}
+
+static inline void
+ip_vs_cpu_stats_out(struct ip_vs_stats *stats, unsigned int len)
+{
+	struct ip_vs_cpu_stats *s = this_cpu_ptr(stats->cpustats);
+
+	write_seqcount_begin(&s->syncp);
+	s->outpkts++;
+	s->outbytes += len;
+	write_seqcount_end(&s->syncp);
+}
+
+/*
+ *	The counters are per CPU, so the packet path takes no lock.  BH is
+ *	disabled only to keep the hooks that run in process context from
+ *	being interrupted by the NET_RX softirq in the middle of an update.
+ */
 static inline void
 ip_vs_in_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 {
 	struct ip_vs_dest *dest = cp->dest;
 	if (dest && (dest->flags & IP_VS_DEST_F_AVAILABLE)) {
-		spin_lock(&dest->stats.lock);
-		dest->stats.ustats.inpkts++;
-		dest->stats.ustats.inbytes += skb->len;
-		spin_unlock(&dest->stats.lock);
-
-		spin_lock(&dest->svc->stats.lock);
-		dest->svc->stats.ustats.inpkts++;
-		dest->svc->stats.ustats.inbytes += skb->len;
-		spin_unlock(&dest->svc->stats.lock);
-
-		spin_lock(&ip_vs_stats.lock);
-		ip_vs_stats.ustats.inpkts++;
-		ip_vs_stats.ustats.inbytes += skb->len;
-		spin_unlock(&ip_vs_stats.lock);
+		local_bh_disable();
+		ip_vs_cpu_stats_in(&dest->stats, skb->len);
+		ip_vs_cpu_stats_in(&dest->svc->stats, skb->len);
+		ip_vs_cpu_stats_in(&ip_vs_stats, skb->len);
+		local_bh_enable();
 	}
 }
 
@@ -131,20 +149,11 @@ ip_vs_out_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 {
 	struct ip_vs_dest *dest = cp->dest;
 	if (dest && (dest->flags & IP_VS_DEST_F_AVAILABLE)) {
-		spin_lock(&dest->stats.lock);
-		dest->stats.ustats.outpkts++;
-		dest->stats.ustats.outbytes += skb->len;
-		spin_unlock(&dest->stats.lock);
-
-		spin_lock(&dest->svc->stats.lock);
-		dest->svc->stats.ustats.outpkts++;
-		dest->svc->stats.ustats.outbytes += skb->len;
-		spin_unlock(&dest->svc->stats.lock);
-
-		spin_lock(&ip_vs_stats.lock);
-		ip_vs_stats.ustats.outpkts++;
-		ip_vs_stats.ustats.outbytes += skb->len;
-		spin_unlock(&ip_vs_stats.lock);
+		local_bh_disable();
+		ip_vs_cpu_stats_out(&dest->stats, skb->len);
+		ip_vs_cpu_stats_out(&dest->svc->stats, skb->len);
+		ip_vs_cpu_stats_out(&ip_vs_stats, skb->len);
+		local_bh_enable();
 	}
 }
 
@@ -152,17 +161,11 @@ ip_vs_out_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 static inline void
 ip_vs_conn_stats(struct ip_vs_conn *cp, struct ip_vs_service *svc)
 {
-	spin_lock(&cp->dest->stats.lock);
-	cp->dest->stats.ustats.conns++;
-	spin_unlock(&cp->dest->stats.lock);
-
-	spin_lock(&svc->stats.lock);
-	svc->stats.ustats.conns++;
-	spin_unlock(&svc->stats.lock);
-
-	spin_lock(&ip_vs_stats.lock);
-	ip_vs_stats.ustats.conns++;
-	spin_unlock(&ip_vs_stats.lock);
+	local_bh_disable();
+	this_cpu_ptr(cp->dest->stats.cpustats)->conns++;
+	this_cpu_ptr(svc->stats.cpustats)->conns++;
+	this_cpu_ptr(ip_vs_stats.cpustats)->conns++;
+	local_bh_enable();
 }
 
 
@@ -57,6 +57,14 @@ static DEFINE_MUTEX(__ip_vs_mutex);
 /* lock for service table */
 static DEFINE_RWLOCK(__ip_vs_svc_lock);
 
+/*
+ * The packet path looks services up under RCU without touching
+ * __ip_vs_svc_lock.  Writers bump this sequence while they hold the
+ * lock for writing, so a lookup that raced with a writer waiting for
+ * svc->usecnt to drain drops its reference and retries.
+ */
+static seqcount_t ip_vs_svc_seq = SEQCNT_ZERO;
+
 /* lock for table with the real services */
 static DEFINE_RWLOCK(__ip_vs_rs_lock);
 
@@ -355,13 +363,13 @@ static int ip_vs_svc_hash(struct ip_vs_service *svc)
 		 */
 		hash = ip_vs_svc_hashkey(svc->af, svc->protocol, &svc->addr,
 					 svc->port);
-		list_add(&svc->s_list, &ip_vs_svc_table[hash]);
+		list_add_rcu(&svc->s_list, &ip_vs_svc_table[hash]);
 	} else {
 		/*
 		 *  Hash it by fwmark in ip_vs_svc_fwm_table
 		 */
 		hash = ip_vs_svc_fwm_hashkey(svc->fwmark);
-		list_add(&svc->f_list, &ip_vs_svc_fwm_table[hash]);
+		list_add_rcu(&svc->f_list, &ip_vs_svc_fwm_table[hash]);
 	}
 
 	svc->flags |= IP_VS_SVC_F_HASHED;
@@ -385,10 +393,10 @@ static int ip_vs_svc_unhash(struct ip_vs_service *svc)
 
 	if (svc->fwmark == 0) {
 		/* Remove it from the ip_vs_svc_table table */
-		list_del(&svc->s_list);
+		list_del_rcu(&svc->s_list);
 	} else {
 		/* Remove it from the ip_vs_svc_fwm_table table */
-		list_del(&svc->f_list);
+		list_del_rcu(&svc->f_list);
 	}
 
 	svc->flags &= ~IP_VS_SVC_F_HASHED;
@@ -410,7 +418,7 @@ __ip_vs_service_get(int af, __u16 protocol, const union nf_inet_addr *vaddr,
 	/* Check for "full" addressed entries */
 	hash = ip_vs_svc_hashkey(af, protocol, vaddr, vport);
 
-	list_for_each_entry(svc, &ip_vs_svc_table[hash], s_list){
+	list_for_each_entry_rcu(svc, &ip_vs_svc_table[hash], s_list){
 		if ((svc->af == af)
 		    && ip_vs_addr_equal(af, &svc->addr, vaddr)
 		    && (svc->port == vport)
@@ -437,7 +445,7 @@ __ip_vs_svc_fwm_get(int af, __u32 fwmark)
 	/* Check for fwmark addressed entries */
 	hash = ip_vs_svc_fwm_hashkey(fwmark);
 
-	list_for_each_entry(svc, &ip_vs_svc_fwm_table[hash], f_list) {
+	list_for_each_entry_rcu(svc, &ip_vs_svc_fwm_table[hash], f_list) {
 		if (svc->fwmark == fwmark && svc->af == af) {
 			/* HIT */
 			atomic_inc(&svc->usecnt);
@@ -448,19 +456,17 @@ __ip_vs_svc_fwm_get(int af, __u32 fwmark)
 	return NULL;
 }
 
-struct ip_vs_service *
-ip_vs_service_get(int af, __u32 fwmark, __u16 protocol,
-		  const union nf_inet_addr *vaddr, __be16 vport)
+static inline struct ip_vs_service *
+__ip_vs_service_lookup(int af, __u32 fwmark, __u16 protocol,
+		       const union nf_inet_addr *vaddr, __be16 vport)
 {
 	struct ip_vs_service *svc;
 
-	read_lock(&__ip_vs_svc_lock);
-
 	/*
 	 *	Check the table hashed by fwmark first
 	 */
 	if (fwmark && (svc = __ip_vs_svc_fwm_get(af, fwmark)))
-		goto out;
+		return svc;
 
 	/*
 	 *	Check the table hashed by <protocol,addr,port>
@@ -487,8 +493,29 @@ ip_vs_service_get(int af, __u32 fwmark, __u16 protocol,
 		svc = __ip_vs_service_get(af, protocol, vaddr, 0);
 	}
 
-  out:
-	read_unlock(&__ip_vs_svc_lock);
+	return svc;
+}
+
+struct ip_vs_service *
+ip_vs_service_get(int af, __u32 fwmark, __u16 protocol,
+		  const union nf_inet_addr *vaddr, __be16 vport)
+{
+	struct ip_vs_service *svc;
+	unsigned seq;
+
+	rcu_read_lock();
+	for (;;) {
+		seq = read_seqcount_begin(&ip_vs_svc_seq);
+		svc = __ip_vs_service_lookup(af, fwmark, protocol,
+					     vaddr, vport);
+		/* order our usecnt increment before the recheck */
+		smp_mb();
+		if (!read_seqcount_retry(&ip_vs_svc_seq, seq))
+			break;
+		if (svc)
+			atomic_dec(&svc->usecnt);
+	}
+	rcu_read_unlock();
 
 	IP_VS_DBG_BUF(9, "lookup service: fwm %u %s %s:%u %s\n",
 		      fwmark, ip_vs_proto_name(protocol),
@@ -499,6 +526,48 @@ ip_vs_service_get(int af, __u32 fwmark, __u16 protocol,
 }
 
 
+/*
+ *	Lock the service table against other writers and the lockless
+ *	readers in ip_vs_service_get().
+ */
+static inline void ip_vs_svc_write_lock_bh(void)
+{
+	write_lock_bh(&__ip_vs_svc_lock);
+	write_seqcount_begin(&ip_vs_svc_seq);
+	/* order the sequence bump before our reads of svc->usecnt */
+	smp_mb();
+}
+
+static inline void ip_vs_svc_write_unlock_bh(void)
+{
+	write_seqcount_end(&ip_vs_svc_seq);
+	write_unlock_bh(&__ip_vs_svc_lock);
+}
+
+static void ip_vs_service_rcu_free(struct rcu_head *head)
+{
+	struct ip_vs_service *svc = container_of(head, struct ip_vs_service,
+						 rcu_head);
+
+	free_percpu(svc->stats.cpustats);
+	kfree(svc);
+}
+
+/*
+ *	Free a service once lockless readers that may have found it
+ *	before it was unhashed are gone.
+ */
+static inline void ip_vs_service_free(struct ip_vs_service *svc)
+{
+	call_rcu(&svc->rcu_head, ip_vs_service_rcu_free);
+}
+
+static inline void ip_vs_dest_free(struct ip_vs_dest *dest)
+{
+	free_percpu(dest->stats.cpustats);
+	kfree(dest);
+}
+
 static inline void
 __ip_vs_bind_svc(struct ip_vs_dest *dest, struct ip_vs_service *svc)
 {
@@ -513,7 +582,7 @@ __ip_vs_unbind_svc(struct ip_vs_dest *dest)
 
 	dest->svc = NULL;
 	if (atomic_dec_and_test(&svc->refcnt))
-		kfree(svc);
+		ip_vs_service_free(svc);
 }
 
 
@@ -713,7 +782,7 @@ ip_vs_trash_get_dest(struct ip_vs_service *svc, const union nf_inet_addr *daddr,
 			list_del(&dest->n_list);
 			ip_vs_dst_reset(dest);
 			__ip_vs_unbind_svc(dest);
-			kfree(dest);
+			ip_vs_dest_free(dest);
 		}
 	}
 
@@ -738,7 +807,7 @@ static void ip_vs_trash_cleanup(void)
 		list_del(&dest->n_list);
 		ip_vs_dst_reset(dest);
 		__ip_vs_unbind_svc(dest);
-		kfree(dest);
+		ip_vs_dest_free(dest);
 	}
 }
 
@@ -748,6 +817,14 @@ ip_vs_zero_stats(struct ip_vs_stats *stats)
 {
 	spin_lock_bh(&stats->lock);
 
+	/* the per CPU counters keep running, remember where they are */
+	ip_vs_read_stats(stats);
+	stats->zbase.conns += stats->ustats.conns;
+	stats->zbase.inpkts += stats->ustats.inpkts;
+	stats->zbase.outpkts += stats->ustats.outpkts;
+	stats->zbase.inbytes += stats->ustats.inbytes;
+	stats->zbase.outbytes += stats->ustats.outbytes;
+
 	memset(&stats->ustats, 0, sizeof(stats->ustats));
 	ip_vs_zero_estimator(stats);
 
@@ -848,6 +925,12 @@ ip_vs_new_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest,
 		pr_err("%s(): no memory.\n", __func__);
 		return -ENOMEM;
 	}
+	dest->stats.cpustats = alloc_percpu(struct ip_vs_cpu_stats);
+	if (dest->stats.cpustats == NULL) {
+		pr_err("%s(): no memory.\n", __func__);
+		kfree(dest);
+		return -ENOMEM;
+	}
 
 	dest->af = svc->af;
 	dest->protocol = svc->protocol;
@@ -935,7 +1018,7 @@ ip_vs_add_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 
 		ip_vs_new_estimator(&dest->stats);
 
-		write_lock_bh(&__ip_vs_svc_lock);
+		ip_vs_svc_write_lock_bh();
 
 		/*
 		 * Wait until all other svc users go away.
@@ -949,7 +1032,7 @@ ip_vs_add_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 		if (svc->scheduler->update_service)
 			svc->scheduler->update_service(svc);
 
-		write_unlock_bh(&__ip_vs_svc_lock);
+		ip_vs_svc_write_unlock_bh();
 		return 0;
 	}
 
@@ -966,7 +1049,7 @@ ip_vs_add_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 	 */
 	atomic_inc(&dest->refcnt);
 
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 
 	/*
 	 * Wait until all other svc users go away.
@@ -980,7 +1063,7 @@ ip_vs_add_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 	if (svc->scheduler->update_service)
 		svc->scheduler->update_service(svc);
 
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 
 	LeaveFunction(2);
 
@@ -1025,7 +1108,7 @@ ip_vs_edit_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 
 	__ip_vs_update_dest(svc, dest, udest);
 
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 
 	/* Wait until all other svc users go away */
 	IP_VS_WAIT_WHILE(atomic_read(&svc->usecnt) > 1);
@@ -1034,7 +1117,7 @@ ip_vs_edit_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 	if (svc->scheduler->update_service)
 		svc->scheduler->update_service(svc);
 
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 
 	LeaveFunction(2);
 
@@ -1069,7 +1152,7 @@ static void __ip_vs_del_dest(struct ip_vs_dest *dest)
 		   and only one user context can update virtual service at a
 		   time, so the operation here is OK */
 		atomic_dec(&dest->svc->refcnt);
-		kfree(dest);
+		ip_vs_dest_free(dest);
 	} else {
 		IP_VS_DBG_BUF(3, "Moving dest %s:%u into trash, "
 			      "dest->refcnt=%d\n",
@@ -1123,7 +1206,7 @@ ip_vs_del_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 		return -ENOENT;
 	}
 
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 
 	/*
 	 *	Wait until all other svc users go away.
@@ -1135,7 +1218,7 @@ ip_vs_del_dest(struct ip_vs_service *svc, struct ip_vs_dest_user_kern *udest)
 	 */
 	__ip_vs_unlink_dest(svc, dest, 1);
 
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 
 	/*
 	 *	Delete the destination
@@ -1183,6 +1266,12 @@ ip_vs_add_service(struct ip_vs_service_user_kern *u,
 		ret = -ENOMEM;
 		goto out_err;
 	}
+	svc->stats.cpustats = alloc_percpu(struct ip_vs_cpu_stats);
+	if (svc->stats.cpustats == NULL) {
+		IP_VS_DBG(1, "%s(): no memory\n", __func__);
+		ret = -ENOMEM;
+		goto out_err;
+	}
 
 	/* I'm the first user of the service */
 	atomic_set(&svc->usecnt, 1);
@@ -1220,9 +1309,9 @@ ip_vs_add_service(struct ip_vs_service_user_kern *u,
 		ip_vs_num_services++;
 
 	/* Hash the service into the service table */
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 	ip_vs_svc_hash(svc);
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 
 	*svc_p = svc;
 	return 0;
@@ -1236,6 +1325,7 @@ ip_vs_add_service(struct ip_vs_service_user_kern *u,
 			ip_vs_app_inc_put(svc->inc);
 			local_bh_enable();
 		}
+		free_percpu(svc->stats.cpustats);
 		kfree(svc);
 	}
 	ip_vs_scheduler_put(sched);
@@ -1274,7 +1364,7 @@ ip_vs_edit_service(struct ip_vs_service *svc, struct ip_vs_service_user_kern *u)
 	}
 #endif
 
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 
 	/*
 	 * Wait until all other svc users go away.
@@ -1319,7 +1409,7 @@ ip_vs_edit_service(struct ip_vs_service *svc, struct ip_vs_service_user_kern *u)
 	}
 
   out_unlock:
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 #ifdef CONFIG_IP_VS_IPV6
   out:
 #endif
@@ -1379,7 +1469,7 @@ static void __ip_vs_del_service(struct ip_vs_service *svc)
 	 *    Free the service if nobody refers to it
 	 */
 	if (atomic_read(&svc->refcnt) == 0)
-		kfree(svc);
+		ip_vs_service_free(svc);
 
 	/* decrease the module use count */
 	ip_vs_use_count_dec();
@@ -1396,7 +1486,7 @@ static int ip_vs_del_service(struct ip_vs_service *svc)
 	/*
 	 * Unhash it from the service table
 	 */
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 
 	ip_vs_svc_unhash(svc);
 
@@ -1407,7 +1497,7 @@ static int ip_vs_del_service(struct ip_vs_service *svc)
 
 	__ip_vs_del_service(svc);
 
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 
 	return 0;
 }
@@ -1426,14 +1516,14 @@ static int ip_vs_flush(void)
 	 */
 	for(idx = 0; idx < IP_VS_SVC_TAB_SIZE; idx++) {
 		list_for_each_entry_safe(svc, nxt, &ip_vs_svc_table[idx], s_list) {
-			write_lock_bh(&__ip_vs_svc_lock);
+			ip_vs_svc_write_lock_bh();
 			ip_vs_svc_unhash(svc);
 			/*
 			 * Wait until all the svc users go away.
 			 */
 			IP_VS_WAIT_WHILE(atomic_read(&svc->usecnt) > 0);
 			__ip_vs_del_service(svc);
-			write_unlock_bh(&__ip_vs_svc_lock);
+			ip_vs_svc_write_unlock_bh();
 		}
 	}
 
@@ -1443,14 +1533,14 @@ static int ip_vs_flush(void)
 	for(idx = 0; idx < IP_VS_SVC_TAB_SIZE; idx++) {
 		list_for_each_entry_safe(svc, nxt,
 					 &ip_vs_svc_fwm_table[idx], f_list) {
-			write_lock_bh(&__ip_vs_svc_lock);
+			ip_vs_svc_write_lock_bh();
 			ip_vs_svc_unhash(svc);
 			/*
 			 * Wait until all the svc users go away.
 			 */
 			IP_VS_WAIT_WHILE(atomic_read(&svc->usecnt) > 0);
 			__ip_vs_del_service(svc);
-			write_unlock_bh(&__ip_vs_svc_lock);
+			ip_vs_svc_write_unlock_bh();
 		}
 	}
 
@@ -1465,12 +1555,12 @@ static int ip_vs_zero_service(struct ip_vs_service *svc)
 {
 	struct ip_vs_dest *dest;
 
-	write_lock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_lock_bh();
 	list_for_each_entry(dest, &svc->destinations, n_list) {
 		ip_vs_zero_stats(&dest->stats);
 	}
 	ip_vs_zero_stats(&svc->stats);
-	write_unlock_bh(&__ip_vs_svc_lock);
+	ip_vs_svc_write_unlock_bh();
 	return 0;
 }
 
@@ -1948,6 +2038,7 @@ static int ip_vs_stats_show(struct seq_file *seq, void *v)
 		   "   Conns  Packets  Packets            Bytes            Bytes\n");
 
 	spin_lock_bh(&ip_vs_stats.lock);
+	ip_vs_read_stats(&ip_vs_stats);
 	seq_printf(seq, "%8X %8X %8X %16LX %16LX\n\n", ip_vs_stats.ustats.conns,
 		   ip_vs_stats.ustats.inpkts, ip_vs_stats.ustats.outpkts,
 		   (unsigned long long) ip_vs_stats.ustats.inbytes,
@@ -2204,6 +2295,7 @@ static void
 ip_vs_copy_stats(struct ip_vs_stats_user *dst, struct ip_vs_stats *src)
 {
 	spin_lock_bh(&src->lock);
+	ip_vs_read_stats(src);
 	memcpy(dst, &src->ustats, sizeof(*dst));
 	spin_unlock_bh(&src->lock);
 }
@@ -2588,6 +2680,7 @@ static int ip_vs_genl_fill_stats(struct sk_buff *skb, int container_type,
 
 	spin_lock_bh(&stats->lock);
 
+	ip_vs_read_stats(stats);
 	NLA_PUT_U32(skb, IPVS_STATS_ATTR_CONNS, stats->ustats.conns);
 	NLA_PUT_U32(skb, IPVS_STATS_ATTR_INPKTS, stats->ustats.inpkts);
 	NLA_PUT_U32(skb, IPVS_STATS_ATTR_OUTPKTS, stats->ustats.outpkts);
@@ -3383,9 +3476,16 @@ int __init ip_vs_control_init(void)
 
 	EnterFunction(2);
 
+	ip_vs_stats.cpustats = alloc_percpu(struct ip_vs_cpu_stats);
+	if (!ip_vs_stats.cpustats) {
+		pr_err("cannot allocate stats.\n");
+		return -ENOMEM;
+	}
+
 	ret = nf_register_sockopt(&ip_vs_sockopts);
 	if (ret) {
 		pr_err("cannot register sockopt.\n");
+		free_percpu(ip_vs_stats.cpustats);
 		return ret;
 	}
 
@@ -3393,6 +3493,7 @@ int __init ip_vs_control_init(void)
 	if (ret) {
 		pr_err("cannot register Generic Netlink interface.\n");
 		nf_unregister_sockopt(&ip_vs_sockopts);
+		free_percpu(ip_vs_stats.cpustats);
 		return ret;
 	}
 
@@ -3432,5 +3533,8 @@ void ip_vs_control_cleanup(void)
 	proc_net_remove(&init_net, "ip_vs");
 	ip_vs_genl_unregister();
 	nf_unregister_sockopt(&ip_vs_sockopts);
+	/* services and dests still queued for freeing */
+	rcu_barrier();
+	free_percpu(ip_vs_stats.cpustats);
 	LeaveFunction(2);
 }
@@ -21,6 +21,7 @@
 #include <linux/interrupt.h>
 #include <linux/sysctl.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 
 #include <net/ip_vs.h>
 
@@ -54,6 +55,43 @@ static LIST_HEAD(est_list);
 static DEFINE_SPINLOCK(est_lock);
 static DEFINE_TIMER(est_timer, estimation_timer, 0, 0);
 
+/*
+ * Sum the per CPU counters of stats into stats->ustats, relative to
+ * the values they had when the stats were last zeroed.
+ * Caller must hold stats->lock.
+ */
+void ip_vs_read_stats(struct ip_vs_stats *stats)
+{
+	struct ip_vs_stats_user *u = &stats->ustats;
+	u32 conns = 0, inpkts = 0, outpkts = 0;
+	u64 inbytes = 0, outbytes = 0;
+	int i;
+
+	for_each_possible_cpu(i) {
+		struct ip_vs_cpu_stats *s = per_cpu_ptr(stats->cpustats, i);
+		unsigned seq;
+		u64 in, out;
+
+		do {
+			seq = read_seqcount_begin(&s->syncp);
+			in = s->inbytes;
+			out = s->outbytes;
+		} while (read_seqcount_retry(&s->syncp, seq));
+
+		conns += s->conns;
+		inpkts += s->inpkts;
+		outpkts += s->outpkts;
+		inbytes += in;
+		outbytes += out;
+	}
+
+	u->conns = conns - stats->zbase.conns;
+	u->inpkts = inpkts - stats->zbase.inpkts;
+	u->outpkts = outpkts - stats->zbase.outpkts;
+	u->inbytes = inbytes - stats->zbase.inbytes;
+	u->outbytes = outbytes - stats->zbase.outbytes;
+}
+
 static void estimation_timer(unsigned long arg)
 {
 	struct ip_vs_estimator *e;
@@ -68,6 +106,7 @@ static void estimation_timer(unsigned long arg)
 		s = container_of(e, struct ip_vs_stats, est);
 
 		spin_lock(&s->lock);
+		ip_vs_read_stats(s);
 		n_conns = s->ustats.conns;
 		n_inpkts = s->ustats.inpkts;
 		n_outpkts = s->ustats.outpkts;
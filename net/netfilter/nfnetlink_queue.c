@@ -193,6 +193,30 @@ find_dequeue_entry(struct nfqnl_instance *queue, unsigned int id)
 	return entry;
 }
 
+/*
+ * Move every entry with an id up to and including @maxid onto @list.
+ * Ids are compared with wraparound in mind.
+ */
+static int
+dequeue_entries_upto(struct nfqnl_instance *queue, unsigned int maxid,
+		     struct list_head *list)
+{
+	struct nf_queue_entry *entry, *next;
+	int count = 0;
+
+	spin_lock_bh(&queue->lock);
+	list_for_each_entry_safe(entry, next, &queue->queue_list, list) {
+		if ((int)(entry->id - maxid) > 0)
+			continue;
+		list_move_tail(&entry->list, list);
+		queue->queue_total--;
+		count++;
+	}
+	spin_unlock_bh(&queue->lock);
+
+	return count;
+}
+
 static void
 nfqnl_flush(struct nfqnl_instance *queue, nfqnl_cmpfn cmpfn, unsigned long data)
 {
@@ -667,6 +691,69 @@ err_out_unlock:
 	return err;
 }
 
+/*
+ * Apply one verdict (and optionally a mark) to all packets queued with an
+ * id up to vhdr->id, so that userspace can acknowledge a whole batch of
+ * packets with a single message.
+ */
+static int
+nfqnl_recv_verdict_batch(struct sock *ctnl, struct sk_buff *skb,
+			 const struct nlmsghdr *nlh,
+			 const struct nlattr * const nfqa[])
+{
+	struct nfgenmsg *nfmsg = NLMSG_DATA(nlh);
+	u_int16_t queue_num = ntohs(nfmsg->res_id);
+
+	struct nfqnl_msg_verdict_hdr *vhdr;
+	struct nfqnl_instance *queue;
+	struct nf_queue_entry *entry, *next;
+	unsigned int verdict;
+	LIST_HEAD(batch_list);
+	int err;
+
+	rcu_read_lock();
+	queue = instance_lookup(queue_num);
+	if (!queue) {
+		err = -ENODEV;
+		goto err_out_unlock;
+	}
+
+	if (queue->peer_pid != NETLINK_CB(skb).pid) {
+		err = -EPERM;
+		goto err_out_unlock;
+	}
+
+	if (!nfqa[NFQA_VERDICT_HDR]) {
+		err = -EINVAL;
+		goto err_out_unlock;
+	}
+
+	vhdr = nla_data(nfqa[NFQA_VERDICT_HDR]);
+	verdict = ntohl(vhdr->verdict);
+
+	if ((verdict & NF_VERDICT_MASK) > NF_MAX_VERDICT) {
+		err = -EINVAL;
+		goto err_out_unlock;
+	}
+
+	if (!dequeue_entries_upto(queue, ntohl(vhdr->id), &batch_list)) {
+		err = -ENOENT;
+		goto err_out_unlock;
+	}
+	rcu_read_unlock();
+
+	list_for_each_entry_safe(entry, next, &batch_list, list) {
+		if (nfqa[NFQA_MARK])
+			entry->skb->mark = ntohl(nla_get_be32(nfqa[NFQA_MARK]));
+		nf_reinject(entry, verdict);
+	}
+	return 0;
+
+err_out_unlock:
+	rcu_read_unlock();
+	return err;
+}
+
 static int
 nfqnl_recv_unsupp(struct sock *ctnl, struct sk_buff *skb,
 		  const struct nlmsghdr *nlh,
@@ -785,6 +872,9 @@ static const struct nfnl_callback nfqnl_cb[NFQNL_MSG_MAX] = {
 	[NFQNL_MSG_CONFIG]	= { .call = nfqnl_recv_config,
 				    .attr_count = NFQA_CFG_MAX,
 				    .policy = nfqa_cfg_policy },
+	[NFQNL_MSG_VERDICT_BATCH] = { .call = nfqnl_recv_verdict_batch,
+				    .attr_count = NFQA_MAX,
+				    .policy = nfqa_verdict_policy },
 };
 
 static const struct nfnetlink_subsystem nfqnl_subsys = {
@@ -40,6 +40,7 @@
 #include <linux/fs.h>
 #include <linux/slab.h>
 #include <asm/uaccess.h>
+#include <asm/cacheflush.h>
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
 #include <linux/rtnetlink.h>
@@ -55,6 +56,7 @@
 #include <linux/types.h>
 #include <linux/audit.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
 
 #include <net/net_namespace.h>
 #include <net/sock.h>
@@ -64,6 +66,18 @@
 #define NLGRPSZ(x)	(ALIGN(x, sizeof(unsigned long) * 8) / 8)
 #define NLGRPLONGS(x)	(NLGRPSZ(x)/sizeof(unsigned long))
 
+struct netlink_ring {
+	char			**pg_vec;
+	unsigned int		head;
+	unsigned int		frames_per_block;
+	unsigned int		frame_size;
+	unsigned int		frame_max;
+
+	unsigned int		pg_vec_order;
+	unsigned int		pg_vec_pages;
+	unsigned int		pg_vec_len;
+};
+
 struct netlink_sock {
 	/* struct sock has to be the first member of netlink_sock */
 	struct sock		sk;
@@ -81,6 +95,12 @@ struct netlink_sock {
 	struct mutex		cb_def_mutex;
 	void			(*netlink_rcv)(struct sk_buff *skb);
 	struct module		*module;
+#ifdef CONFIG_NETLINK_MMAP
+	struct mutex		pg_vec_lock;
+	struct netlink_ring	rx_ring;
+	struct netlink_ring	tx_ring;
+	atomic_t		mapped;
+#endif /* CONFIG_NETLINK_MMAP */
 };
 
 struct listeners_rcu_head {
@@ -149,6 +169,378 @@ static struct hlist_head *nl_pid_hashfn(struct nl_pid_hash *hash, u32 pid)
 	return &hash->table[jhash_1word(pid, hash->rnd) & hash->mask];
 }
 
+static void netlink_overrun(struct sock *sk);
+
+#ifdef CONFIG_NETLINK_MMAP
+static bool netlink_rx_is_mmaped(struct sock *sk)
+{
+	return nlk_sk(sk)->rx_ring.pg_vec != NULL;
+}
+
+static bool netlink_tx_is_mmaped(struct sock *sk)
+{
+	return nlk_sk(sk)->tx_ring.pg_vec != NULL;
+}
+
+static void free_pg_vec(char **pg_vec, unsigned int order, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		if (likely(pg_vec[i]))
+			free_pages((unsigned long) pg_vec[i], order);
+	}
+	kfree(pg_vec);
+}
+
+static char **alloc_pg_vec(struct nl_mmap_req *req, unsigned int order)
+{
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_COMP | __GFP_ZERO | __GFP_NOWARN;
+	unsigned int block_nr = req->nm_block_nr;
+	char **pg_vec;
+	unsigned int i;
+
+	pg_vec = kcalloc(block_nr, sizeof(char *), GFP_KERNEL);
+	if (pg_vec == NULL)
+		return NULL;
+
+	for (i = 0; i < block_nr; i++) {
+		pg_vec[i] = (char *)__get_free_pages(gfp_flags, order);
+		if (pg_vec[i] == NULL) {
+			free_pg_vec(pg_vec, order, block_nr);
+			return NULL;
+		}
+	}
+	return pg_vec;
+}
+
+static int netlink_set_ring(struct sock *sk, struct nl_mmap_req *req,
+			    bool tx_ring)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	struct netlink_ring *ring;
+	struct sk_buff_head *queue;
+	char **pg_vec = NULL;
+	unsigned int order = 0;
+	unsigned int frames_per_block = 0;
+	int err;
+
+	ring  = tx_ring ? &nlk->tx_ring : &nlk->rx_ring;
+	queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
+
+	if (atomic_read(&nlk->mapped))
+		return -EBUSY;
+
+	if (req->nm_block_nr) {
+		if (ring->pg_vec != NULL)
+			return -EBUSY;
+
+		if ((int)req->nm_block_size <= 0)
+			return -EINVAL;
+		if (!IS_ALIGNED(req->nm_block_size, PAGE_SIZE))
+			return -EINVAL;
+		if (req->nm_frame_size < NL_MMAP_HDRLEN)
+			return -EINVAL;
+		if (!IS_ALIGNED(req->nm_frame_size, NL_MMAP_MSG_ALIGNMENT))
+			return -EINVAL;
+
+		frames_per_block = req->nm_block_size / req->nm_frame_size;
+		if (frames_per_block == 0)
+			return -EINVAL;
+		if (frames_per_block * req->nm_block_nr != req->nm_frame_nr)
+			return -EINVAL;
+
+		order = get_order(req->nm_block_size);
+		pg_vec = alloc_pg_vec(req, order);
+		if (pg_vec == NULL)
+			return -ENOMEM;
+	} else {
+		if (req->nm_frame_nr)
+			return -EINVAL;
+	}
+
+	/*
+	 * The geometry only goes into the ring together with the pg_vec
+	 * it describes, and a racing setsockopt() may have set up a ring
+	 * since the check above.
+	 */
+	err = -EBUSY;
+	mutex_lock(&nlk->pg_vec_lock);
+	if (atomic_read(&nlk->mapped) == 0 &&
+	    !(pg_vec && ring->pg_vec)) {
+		spin_lock_bh(&queue->lock);
+
+		ring->frame_max		= req->nm_frame_nr - 1;
+		ring->head		= 0;
+		ring->frame_size	= req->nm_frame_size;
+		ring->frames_per_block	= frames_per_block;
+		ring->pg_vec_pages	= req->nm_block_size / PAGE_SIZE;
+
+		swap(ring->pg_vec_len, req->nm_block_nr);
+		swap(ring->pg_vec_order, order);
+		swap(ring->pg_vec, pg_vec);
+
+		__skb_queue_purge(queue);
+		spin_unlock_bh(&queue->lock);
+		err = 0;
+	}
+	mutex_unlock(&nlk->pg_vec_lock);
+
+	if (pg_vec)
+		free_pg_vec(pg_vec, order, req->nm_block_nr);
+	return err;
+}
+
+static void netlink_mm_open(struct vm_area_struct *vma)
+{
+	struct file *file = vma->vm_file;
+	struct socket *sock = file->private_data;
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_inc(&nlk_sk(sk)->mapped);
+}
+
+static void netlink_mm_close(struct vm_area_struct *vma)
+{
+	struct file *file = vma->vm_file;
+	struct socket *sock = file->private_data;
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_dec(&nlk_sk(sk)->mapped);
+}
+
+static const struct vm_operations_struct netlink_mmap_ops = {
+	.open	= netlink_mm_open,
+	.close	= netlink_mm_close,
+};
+
+static int netlink_mmap(struct file *file, struct socket *sock,
+			struct vm_area_struct *vma)
+{
+	struct sock *sk = sock->sk;
+	struct netlink_sock *nlk = nlk_sk(sk);
+	struct netlink_ring *ring;
+	unsigned long start, size, expected;
+	unsigned int i;
+	int err = -EINVAL;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	mutex_lock(&nlk->pg_vec_lock);
+
+	expected = 0;
+	for (ring = &nlk->rx_ring; ring <= &nlk->tx_ring; ring++) {
+		if (ring->pg_vec == NULL)
+			continue;
+		expected += ring->pg_vec_len * ring->pg_vec_pages * PAGE_SIZE;
+	}
+
+	if (expected == 0)
+		goto out;
+
+	size = vma->vm_end - vma->vm_start;
+	if (size != expected)
+		goto out;
+
+	start = vma->vm_start;
+	for (ring = &nlk->rx_ring; ring <= &nlk->tx_ring; ring++) {
+		if (ring->pg_vec == NULL)
+			continue;
+
+		for (i = 0; i < ring->pg_vec_len; i++) {
+			struct page *page = virt_to_page(ring->pg_vec[i]);
+			unsigned int pg_num;
+
+			for (pg_num = 0; pg_num < ring->pg_vec_pages;
+			     pg_num++, page++) {
+				err = vm_insert_page(vma, start, page);
+				if (err < 0)
+					goto out;
+				start += PAGE_SIZE;
+			}
+		}
+	}
+
+	atomic_inc(&nlk->mapped);
+	vma->vm_ops = &netlink_mmap_ops;
+	err = 0;
+out:
+	mutex_unlock(&nlk->pg_vec_lock);
+	return err;
+}
+
+static void netlink_frame_flush_dcache(const struct nl_mmap_hdr *hdr,
+				       unsigned int len)
+{
+	struct page *p_start, *p_end;
+
+	p_start = virt_to_page(hdr);
+	p_end = virt_to_page((void *)hdr + NL_MMAP_HDRLEN + len - 1);
+	while (p_start <= p_end) {
+		flush_dcache_page(p_start);
+		p_start++;
+	}
+}
+
+static enum nl_mmap_status netlink_get_status(const struct nl_mmap_hdr *hdr)
+{
+	smp_rmb();
+	flush_dcache_page(virt_to_page(hdr));
+	return hdr->nm_status;
+}
+
+static void netlink_set_status(struct nl_mmap_hdr *hdr,
+			       enum nl_mmap_status status)
+{
+	smp_mb();
+	hdr->nm_status = status;
+	flush_dcache_page(virt_to_page(hdr));
+	smp_wmb();
+}
+
+static struct nl_mmap_hdr *
+__netlink_lookup_frame(const struct netlink_ring *ring, unsigned int pos)
+{
+	unsigned int pg_vec_pos, frame_off;
+
+	pg_vec_pos = pos / ring->frames_per_block;
+	frame_off  = pos % ring->frames_per_block;
+
+	return (struct nl_mmap_hdr *)(ring->pg_vec[pg_vec_pos] +
+				      frame_off * ring->frame_size);
+}
+
+static struct nl_mmap_hdr *
+netlink_lookup_frame(const struct netlink_ring *ring, unsigned int pos,
+		     enum nl_mmap_status status)
+{
+	struct nl_mmap_hdr *hdr;
+
+	hdr = __netlink_lookup_frame(ring, pos);
+	if (netlink_get_status(hdr) != status)
+		return NULL;
+
+	return hdr;
+}
+
+static struct nl_mmap_hdr *
+netlink_current_frame(const struct netlink_ring *ring,
+		      enum nl_mmap_status status)
+{
+	return netlink_lookup_frame(ring, ring->head, status);
+}
+
+static struct nl_mmap_hdr *
+netlink_previous_frame(const struct netlink_ring *ring,
+		       enum nl_mmap_status status)
+{
+	unsigned int prev;
+
+	prev = ring->head ? ring->head - 1 : ring->frame_max;
+	return netlink_lookup_frame(ring, prev, status);
+}
+
+static void netlink_increment_head(struct netlink_ring *ring)
+{
+	ring->head = ring->head != ring->frame_max ? ring->head + 1 : 0;
+}
+
+/*
+ * Deliver an skb that has already been charged to @sk through its receive
+ * ring.  Messages that fit are copied into the next free frame and the skb
+ * is released; larger ones are queued as usual and the frame is marked
+ * NL_MMAP_STATUS_COPY so that userspace knows to pick them up with
+ * recvmsg().  When no frame is free the message is dropped.
+ */
+static int netlink_ring_deliver(struct sock *sk, struct sk_buff *skb)
+{
+	struct netlink_ring *ring = &nlk_sk(sk)->rx_ring;
+	struct nl_mmap_hdr *hdr;
+	unsigned int len = skb->len;
+
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	if (ring->pg_vec == NULL) {
+		/* ring was torn down under us */
+		__skb_queue_tail(&sk->sk_receive_queue, skb);
+		goto out;
+	}
+
+	hdr = netlink_current_frame(ring, NL_MMAP_STATUS_UNUSED);
+	if (hdr == NULL) {
+		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		netlink_overrun(sk);
+		kfree_skb(skb);
+		return -ENOBUFS;
+	}
+	netlink_increment_head(ring);
+
+	hdr->nm_len	= len;
+	hdr->nm_group	= NETLINK_CB(skb).dst_group;
+	hdr->nm_pid	= NETLINK_CREDS(skb)->pid;
+	hdr->nm_uid	= NETLINK_CREDS(skb)->uid;
+	hdr->nm_gid	= NETLINK_CREDS(skb)->gid;
+
+	if (len <= ring->frame_size - NL_MMAP_HDRLEN) {
+		skb_copy_bits(skb, 0, (void *)hdr + NL_MMAP_HDRLEN, len);
+		netlink_frame_flush_dcache(hdr, len);
+		netlink_set_status(hdr, NL_MMAP_STATUS_VALID);
+		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		consume_skb(skb);
+		sk->sk_data_ready(sk, len);
+		return len;
+	}
+
+	__skb_queue_tail(&sk->sk_receive_queue, skb);
+	netlink_set_status(hdr, NL_MMAP_STATUS_COPY);
+out:
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	sk->sk_data_ready(sk, len);
+	return len;
+}
+
+static unsigned int netlink_poll(struct file *file, struct socket *sock,
+				 poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct netlink_sock *nlk = nlk_sk(sk);
+	unsigned int mask;
+
+	mask = datagram_poll(file, sock, wait);
+
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	if (nlk->rx_ring.pg_vec &&
+	    !netlink_previous_frame(&nlk->rx_ring, NL_MMAP_STATUS_UNUSED))
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+
+	spin_lock_bh(&sk->sk_write_queue.lock);
+	if (nlk->tx_ring.pg_vec &&
+	    netlink_current_frame(&nlk->tx_ring, NL_MMAP_STATUS_UNUSED))
+		mask |= POLLOUT | POLLWRNORM;
+	spin_unlock_bh(&sk->sk_write_queue.lock);
+
+	return mask;
+}
+
+static void netlink_free_rings(struct netlink_sock *nlk)
+{
+	struct netlink_ring *ring;
+
+	for (ring = &nlk->rx_ring; ring <= &nlk->tx_ring; ring++) {
+		if (ring->pg_vec == NULL)
+			continue;
+		free_pg_vec(ring->pg_vec, ring->pg_vec_order, ring->pg_vec_len);
+		ring->pg_vec = NULL;
+	}
+}
+#else /* CONFIG_NETLINK_MMAP */
+#define netlink_mmap			sock_no_mmap
+#define netlink_poll			datagram_poll
+#endif /* CONFIG_NETLINK_MMAP */
+
 static void netlink_sock_destruct(struct sock *sk)
 {
 	struct netlink_sock *nlk = nlk_sk(sk);
@@ -160,6 +552,9 @@ static void netlink_sock_destruct(struct sock *sk)
 	}
 
 	skb_queue_purge(&sk->sk_receive_queue);
+#ifdef CONFIG_NETLINK_MMAP
+	netlink_free_rings(nlk);
+#endif
 
 	if (!sock_flag(sk, SOCK_DEAD)) {
 		printk(KERN_ERR "Freeing alive netlink socket %p\n", sk);
@@ -422,6 +817,9 @@ static int __netlink_create(struct net *net, struct socket *sock,
 		mutex_init(nlk->cb_mutex);
 	}
 	init_waitqueue_head(&nlk->wait);
+#ifdef CONFIG_NETLINK_MMAP
+	mutex_init(&nlk->pg_vec_lock);
+#endif
 
 	sk->sk_destruct = netlink_sock_destruct;
 	sk->sk_protocol = protocol;
@@ -830,12 +1228,23 @@ int netlink_attachskb(struct sock *sk, struct sk_buff *skb,
 	return 0;
 }
 
-int netlink_sendskb(struct sock *sk, struct sk_buff *skb)
+static int __netlink_sendskb(struct sock *sk, struct sk_buff *skb)
 {
 	int len = skb->len;
 
+#ifdef CONFIG_NETLINK_MMAP
+	if (netlink_rx_is_mmaped(sk))
+		return netlink_ring_deliver(sk, skb);
+#endif
 	skb_queue_tail(&sk->sk_receive_queue, skb);
 	sk->sk_data_ready(sk, len);
+	return len;
+}
+
+int netlink_sendskb(struct sock *sk, struct sk_buff *skb)
+{
+	int len = __netlink_sendskb(sk, skb);
+
 	sock_put(sk);
 	return len;
 }
@@ -960,8 +1369,7 @@ static inline int netlink_broadcast_deliver(struct sock *sk,
 	if (atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf &&
 	    !test_bit(0, &nlk->state)) {
 		skb_set_owner_r(skb, sk);
-		skb_queue_tail(&sk->sk_receive_queue, skb);
-		sk->sk_data_ready(sk, skb->len);
+		__netlink_sendskb(sk, skb);
 		return atomic_read(&sk->sk_rmem_alloc) > sk->sk_rcvbuf;
 	}
 	return -1;
@@ -1241,6 +1649,24 @@ static int netlink_setsockopt(struct socket *sock, int level, int optname,
 			nlk->flags &= ~NETLINK_RECV_NO_ENOBUFS;
 		err = 0;
 		break;
+#ifdef CONFIG_NETLINK_MMAP
+	case NETLINK_RX_RING:
+	case NETLINK_TX_RING: {
+		struct nl_mmap_req req;
+
+		/* Rings are not accounted against sk_rcvbuf/sk_sndbuf, so
+		 * limit them to privileged users.
+		 */
+		if (!capable(CAP_NET_ADMIN))
+			return -EPERM;
+		if (optlen < sizeof(req))
+			return -EINVAL;
+		if (copy_from_user(&req, optval, sizeof(req)))
+			return -EFAULT;
+		err = netlink_set_ring(sk, &req, optname == NETLINK_TX_RING);
+		break;
+	}
+#endif /* CONFIG_NETLINK_MMAP */
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1307,6 +1733,114 @@ static void netlink_cmsg_recv_pktinfo(struct msghdr *msg, struct sk_buff *skb)
 	put_cmsg(msg, SOL_NETLINK, NETLINK_PKTINFO, sizeof(info), &info);
 }
 
+static void netlink_set_skb_creds(struct sk_buff *skb, struct netlink_sock *nlk,
+				  u32 dst_group, struct scm_cookie *scm)
+{
+	NETLINK_CB(skb).pid	= nlk->pid;
+	NETLINK_CB(skb).dst_group = dst_group;
+	NETLINK_CB(skb).loginuid = audit_get_loginuid(current);
+	NETLINK_CB(skb).sessionid = audit_get_sessionid(current);
+	security_task_getsecid(current, &(NETLINK_CB(skb).sid));
+	memcpy(NETLINK_CREDS(skb), &scm->creds, sizeof(struct ucred));
+}
+
+#ifdef CONFIG_NETLINK_MMAP
+/*
+ * Take the next valid frame off the transmit ring and copy it into a new
+ * skb.  Returns NULL with *err left at 0 once the ring is drained.
+ */
+static struct sk_buff *netlink_mmap_get_frame(struct netlink_sock *nlk,
+					      int *err)
+{
+	struct netlink_ring *ring = &nlk->tx_ring;
+	struct nl_mmap_hdr *hdr;
+	struct sk_buff *skb;
+	unsigned int maxlen, nm_len;
+
+	if (ring->pg_vec == NULL) {
+		*err = -EINVAL;
+		return NULL;
+	}
+	maxlen = ring->frame_size - NL_MMAP_HDRLEN;
+
+	for (;;) {
+		hdr = netlink_current_frame(ring, NL_MMAP_STATUS_SKIP);
+		if (hdr == NULL)
+			break;
+		netlink_set_status(hdr, NL_MMAP_STATUS_UNUSED);
+		netlink_increment_head(ring);
+	}
+
+	hdr = netlink_current_frame(ring, NL_MMAP_STATUS_VALID);
+	if (hdr == NULL)
+		return NULL;
+
+	nm_len = ACCESS_ONCE(hdr->nm_len);
+	if (nm_len > maxlen) {
+		*err = -EINVAL;
+		return NULL;
+	}
+	netlink_frame_flush_dcache(hdr, nm_len);
+
+	skb = alloc_skb(nm_len, GFP_KERNEL);
+	if (skb == NULL) {
+		*err = -ENOBUFS;
+		return NULL;
+	}
+	memcpy(skb_put(skb, nm_len), (void *)hdr + NL_MMAP_HDRLEN, nm_len);
+	netlink_set_status(hdr, NL_MMAP_STATUS_UNUSED);
+	netlink_increment_head(ring);
+
+	return skb;
+}
+
+/*
+ * Transmit every frame userspace has marked valid in the transmit ring,
+ * each as a message of its own, so that a whole batch (e.g. a run of
+ * nfqueue verdicts) is submitted with a single sendmsg() call.
+ *
+ * pg_vec_lock only covers taking a frame off the ring: delivery may
+ * block on the receiver, and must not hold up the ring's owner.
+ */
+static int netlink_mmap_sendmsg(struct sock *sk, struct msghdr *msg,
+				u32 dst_pid, u32 dst_group,
+				struct scm_cookie *scm)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	struct sk_buff *skb;
+	int err = 0, len = 0;
+
+	for (;;) {
+		mutex_lock(&nlk->pg_vec_lock);
+		skb = netlink_mmap_get_frame(nlk, &err);
+		mutex_unlock(&nlk->pg_vec_lock);
+		if (skb == NULL)
+			break;
+
+		netlink_set_skb_creds(skb, nlk, dst_group, scm);
+
+		err = security_netlink_send(sk, skb);
+		if (err) {
+			kfree_skb(skb);
+			break;
+		}
+
+		if (dst_group) {
+			atomic_inc(&skb->users);
+			netlink_broadcast(sk, skb, dst_pid, dst_group,
+					  GFP_KERNEL);
+		}
+		err = netlink_unicast(sk, skb, dst_pid,
+				      msg->msg_flags & MSG_DONTWAIT);
+		if (err < 0)
+			break;
+		len += err;
+	}
+
+	return len ? len : err;
+}
+#endif /* CONFIG_NETLINK_MMAP */
+
 static int netlink_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			   struct msghdr *msg, size_t len)
 {
@@ -1350,6 +1884,15 @@ static int netlink_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			goto out;
 	}
 
+#ifdef CONFIG_NETLINK_MMAP
+	if (netlink_tx_is_mmaped(sk) &&
+	    (msg->msg_iovlen == 0 || msg->msg_iov->iov_base == NULL)) {
+		err = netlink_mmap_sendmsg(sk, msg, dst_pid, dst_group,
+					   siocb->scm);
+		goto out;
+	}
+#endif
+
 	err = -EMSGSIZE;
 	if (len > sk->sk_sndbuf - 32)
 		goto out;
@@ -1358,12 +1901,7 @@ static int netlink_sendmsg(struct kiocb *kiocb, struct socket *sock,
 	if (skb == NULL)
 		goto out;
 
-	NETLINK_CB(skb).pid	= nlk->pid;
-	NETLINK_CB(skb).dst_group = dst_group;
-	NETLINK_CB(skb).loginuid = audit_get_loginuid(current);
-	NETLINK_CB(skb).sessionid = audit_get_sessionid(current);
-	security_task_getsecid(current, &(NETLINK_CB(skb).sid));
-	memcpy(NETLINK_CREDS(skb), &siocb->scm->creds, sizeof(struct ucred));
+	netlink_set_skb_creds(skb, nlk, dst_group, siocb->scm);
 
 	/* What can I do? Netlink is asynchronous, so that
 	   we will have to save current capabilities to
@@ -1705,10 +2243,8 @@ static int netlink_dump(struct sock *sk)
 
 		if (sk_filter(sk, skb))
 			kfree_skb(skb);
-		else {
-			skb_queue_tail(&sk->sk_receive_queue, skb);
-			sk->sk_data_ready(sk, skb->len);
-		}
+		else
+			__netlink_sendskb(sk, skb);
 		return 0;
 	}
 
@@ -1720,10 +2256,8 @@ static int netlink_dump(struct sock *sk)
 
 	if (sk_filter(sk, skb))
 		kfree_skb(skb);
-	else {
-		skb_queue_tail(&sk->sk_receive_queue, skb);
-		sk->sk_data_ready(sk, skb->len);
-	}
+	else
+		__netlink_sendskb(sk, skb);
 
 	if (cb->done)
 		cb->done(cb);
@@ -2065,7 +2599,7 @@ static const struct proto_ops netlink_ops = {
 	.socketpair =	sock_no_socketpair,
 	.accept =	sock_no_accept,
 	.getname =	netlink_getname,
-	.poll =		datagram_poll,
+	.poll =		netlink_poll,
 	.ioctl =	sock_no_ioctl,
 	.listen =	sock_no_listen,
 	.shutdown =	sock_no_shutdown,
@@ -2073,7 +2607,7 @@ static const struct proto_ops netlink_ops = {
 	.getsockopt =	netlink_getsockopt,
 	.sendmsg =	netlink_sendmsg,
 	.recvmsg =	netlink_recvmsg,
-	.mmap =		sock_no_mmap,
+	.mmap =		netlink_mmap,
 	.sendpage =	sock_no_sendpage,
 };
 
@@ -0,0 +1,610 @@
+/*
+ * net/sched/sch_mqprio.c	Multiqueue traffic class scheduler
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * Maps skb->priority to a traffic class and each traffic class to a
+ * contiguous range of hardware TX queues.  Like mq, every TX queue gets
+ * its own child qdisc under its own lock, so nothing serializes on a
+ * root lock.
+ *
+ * A traffic class may carry a maximum rate.  If the device can limit
+ * its TX queues (ndo_set_tx_maxrate) the rate is split evenly over the
+ * queues of the class and programmed into the hardware.  Otherwise each
+ * of those queues gets a token bucket child qdisc shaping its share in
+ * software, still under that queue's own lock.
+ */
+
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+
+struct mqprio_sched {
+	struct Qdisc		**qdiscs;
+	int			hw_owned;	/* driver set up the tc queues */
+	int			hw_rate;	/* rates programmed in the device */
+	u64			max_rate[TC_QOPT_MAX_QUEUE];	/* bytes/sec */
+};
+
+/*
+ * Per queue software token bucket.  Tokens are kept as nanoseconds of
+ * transmission time at the configured rate.
+ */
+struct mqprio_shaper {
+	u64			rate;		/* bytes per second */
+	s64			burst;		/* bucket depth, ns */
+	s64			tokens;		/* ns */
+	u64			t_c;		/* time of last refill, ns */
+	struct qdisc_watchdog	watchdog;
+};
+
+static s64 mqprio_shaper_cost(const struct mqprio_shaper *q, unsigned int len)
+{
+	return div64_u64((u64)len * NSEC_PER_SEC, q->rate);
+}
+
+static void mqprio_shaper_set_rate(struct Qdisc *sch, u64 rate)
+{
+	struct mqprio_shaper *q = qdisc_priv(sch);
+	unsigned int mtu = psched_mtu(qdisc_dev(sch));
+
+	q->rate = max_t(u64, rate, 1);
+	/* allow a couple of full sized frames, or 1ms, back to back */
+	q->burst = max_t(s64, mqprio_shaper_cost(q, 2 * mtu), NSEC_PER_MSEC);
+	q->tokens = q->burst;
+	q->t_c = ktime_to_ns(ktime_get());
+}
+
+static int mqprio_shaper_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	if (likely(skb_queue_len(&sch->q) < qdisc_dev(sch)->tx_queue_len))
+		return qdisc_enqueue_tail(skb, sch);
+
+	return qdisc_drop(skb, sch);
+}
+
+static struct sk_buff *mqprio_shaper_dequeue(struct Qdisc *sch)
+{
+	struct mqprio_shaper *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+	u64 now;
+	s64 toks, cost;
+
+	skb = qdisc_peek_head(sch);
+	if (!skb)
+		return NULL;
+
+	now = ktime_to_ns(ktime_get());
+	toks = min_t(s64, q->tokens + (s64)(now - q->t_c), q->burst);
+	cost = mqprio_shaper_cost(q, qdisc_pkt_len(skb));
+
+	if (toks >= cost) {
+		q->tokens = toks - cost;
+		q->t_c = now;
+		sch->flags &= ~TCQ_F_THROTTLED;
+		return qdisc_dequeue_head(sch);
+	}
+
+	qdisc_watchdog_schedule(&q->watchdog,
+				PSCHED_NS2TICKS(now + cost - toks));
+	sch->qstats.overlimits++;
+	return NULL;
+}
+
+static int mqprio_shaper_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct mqprio_shaper *q = qdisc_priv(sch);
+
+	qdisc_watchdog_init(&q->watchdog, sch);
+	mqprio_shaper_set_rate(sch, ~0ULL);
+	return 0;
+}
+
+static void mqprio_shaper_reset(struct Qdisc *sch)
+{
+	struct mqprio_shaper *q = qdisc_priv(sch);
+
+	qdisc_reset_queue(sch);
+	q->tokens = q->burst;
+	q->t_c = ktime_to_ns(ktime_get());
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+static void mqprio_shaper_destroy(struct Qdisc *sch)
+{
+	struct mqprio_shaper *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+/*
+ * Only ever instantiated through qdisc_create_dflt(), which does not take
+ * a module reference, so no .owner here; the mqprio root pins the module.
+ */
+static struct Qdisc_ops mqprio_shaper_qdisc_ops __read_mostly = {
+	.id		= "mqprio_tbf",
+	.priv_size	= sizeof(struct mqprio_shaper),
+	.enqueue	= mqprio_shaper_enqueue,
+	.dequeue	= mqprio_shaper_dequeue,
+	.peek		= qdisc_peek_head,
+	.init		= mqprio_shaper_init,
+	.reset		= mqprio_shaper_reset,
+	.destroy	= mqprio_shaper_destroy,
+};
+
+static const struct nla_policy mqprio_policy[TCA_MQPRIO_MAX + 1] = {
+	[TCA_MQPRIO_MAX_RATE64]	= { .type = NLA_NESTED },
+};
+
+static void mqprio_set_hw_rates(struct net_device *dev,
+				struct mqprio_sched *priv, int reset)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	int tc, q;
+
+	for (tc = 0; tc < netdev_get_num_tc(dev); tc++) {
+		struct netdev_tc_txq *txq = &dev->tc_to_txq[tc];
+		u32 mbps = 0;
+
+		if (!priv->max_rate[tc] || !txq->count)
+			continue;
+		if (!reset)
+			mbps = max_t(u64, div64_u64(priv->max_rate[tc] * 8,
+					txq->count * 1000000ULL), 1);
+		for (q = txq->offset; q < txq->offset + txq->count; q++)
+			ops->ndo_set_tx_maxrate(dev, q, mbps);
+	}
+}
+
+static void mqprio_destroy(struct Qdisc *sch)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqprio_sched *priv = qdisc_priv(sch);
+	unsigned int ntx;
+
+	if (priv->qdiscs) {
+		for (ntx = 0;
+		     ntx < dev->num_tx_queues && priv->qdiscs[ntx];
+		     ntx++)
+			qdisc_destroy(priv->qdiscs[ntx]);
+		kfree(priv->qdiscs);
+	}
+
+	if (priv->hw_rate)
+		mqprio_set_hw_rates(dev, priv, 1);
+
+	if (priv->hw_owned && dev->netdev_ops->ndo_setup_tc)
+		dev->netdev_ops->ndo_setup_tc(dev, 0);
+	else
+		netdev_set_num_tc(dev, 0);
+}
+
+static int mqprio_parse_opt(struct net_device *dev, struct tc_mqprio_qopt *qopt)
+{
+	int i, j;
+
+	/* Verify num_tc is not out of max range */
+	if (qopt->num_tc > TC_MAX_QUEUE)
+		return -EINVAL;
+
+	/* Verify priority mapping uses valid tcs */
+	for (i = 0; i < TC_BITMASK + 1; i++) {
+		if (qopt->prio_tc_map[i] >= qopt->num_tc)
+			return -EINVAL;
+	}
+
+	/* net_device does not support requested operation */
+	if (qopt->hw && !dev->netdev_ops->ndo_setup_tc)
+		return -EINVAL;
+
+	/* if hw owned, the queue counts and offsets come from the driver */
+	if (qopt->hw)
+		return 0;
+
+	for (i = 0; i < qopt->num_tc; i++) {
+		unsigned int last = qopt->offset[i] + qopt->count[i];
+
+		/* Verify the queue range is within the active TX queues */
+		if (qopt->offset[i] >= dev->real_num_tx_queues ||
+		    !qopt->count[i] ||
+		    last > dev->real_num_tx_queues)
+			return -EINVAL;
+
+		/* Verify that the ranges do not overlap */
+		for (j = i + 1; j < qopt->num_tc; j++) {
+			if (last > qopt->offset[j] &&
+			    qopt->offset[j] + qopt->count[j] > qopt->offset[i])
+				return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int mqprio_parse_rates(struct mqprio_sched *priv,
+			      struct tc_mqprio_qopt *qopt, struct nlattr *opt)
+{
+	struct nlattr *tb[TCA_MQPRIO_MAX + 1];
+	struct nlattr *attr;
+	int len = nla_len(opt) - NLA_ALIGN(sizeof(*qopt));
+	int err, rem, i = 0;
+
+	if (len <= 0)
+		return 0;
+
+	err = nla_parse(tb, TCA_MQPRIO_MAX,
+			nla_data(opt) + NLA_ALIGN(sizeof(*qopt)), len,
+			mqprio_policy);
+	if (err < 0)
+		return err;
+
+	if (!tb[TCA_MQPRIO_MAX_RATE64])
+		return 0;
+
+	nla_for_each_nested(attr, tb[TCA_MQPRIO_MAX_RATE64], rem) {
+		if (nla_type(attr) != TCA_MQPRIO_MAX_RATE64 ||
+		    nla_len(attr) < sizeof(u64) || i >= qopt->num_tc)
+			return -EINVAL;
+		priv->max_rate[i++] = nla_get_u64(attr);
+	}
+
+	return 0;
+}
+
+/* find the traffic class owning TX queue ntx, or -1 */
+static int mqprio_queue_tc(struct net_device *dev, unsigned int ntx)
+{
+	int tc;
+
+	for (tc = 0; tc < netdev_get_num_tc(dev); tc++) {
+		struct netdev_tc_txq *txq = &dev->tc_to_txq[tc];
+
+		if (ntx >= txq->offset && ntx < txq->offset + txq->count)
+			return tc;
+	}
+	return -1;
+}
+
+static int mqprio_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqprio_sched *priv = qdisc_priv(sch);
+	struct netdev_queue *dev_queue;
+	struct Qdisc *qdisc;
+	struct tc_mqprio_qopt *qopt;
+	int i, tc, err;
+
+	if (sch->parent != TC_H_ROOT)
+		return -EOPNOTSUPP;
+
+	if (!netif_is_multiqueue(dev))
+		return -EOPNOTSUPP;
+
+	if (opt == NULL || nla_len(opt) < sizeof(*qopt))
+		return -EINVAL;
+
+	qopt = nla_data(opt);
+	err = mqprio_parse_opt(dev, qopt);
+	if (err)
+		return err;
+
+	err = mqprio_parse_rates(priv, qopt, opt);
+	if (err)
+		return err;
+
+	/*
+	 * If the options ask for the hardware to own the queue mapping, let
+	 * the driver set it up, otherwise use the mapping we just verified.
+	 */
+	if (qopt->hw) {
+		priv->hw_owned = 1;
+		err = dev->netdev_ops->ndo_setup_tc(dev, qopt->num_tc);
+		if (err)
+			goto err;
+	} else {
+		netdev_set_num_tc(dev, qopt->num_tc);
+		for (i = 0; i < qopt->num_tc; i++)
+			netdev_set_tc_queue(dev, i,
+					    qopt->count[i], qopt->offset[i]);
+	}
+
+	/* Always use supplied priority mappings */
+	for (i = 0; i < TC_BITMASK + 1; i++)
+		netdev_set_prio_tc_map(dev, i, qopt->prio_tc_map[i]);
+
+	if (dev->netdev_ops->ndo_set_tx_maxrate) {
+		priv->hw_rate = 1;
+		mqprio_set_hw_rates(dev, priv, 0);
+	}
+
+	/* pre-allocate qdiscs, attachment can't fail */
+	priv->qdiscs = kcalloc(dev->num_tx_queues, sizeof(priv->qdiscs[0]),
+			       GFP_KERNEL);
+	if (priv->qdiscs == NULL) {
+		err = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		u32 parentid = TC_H_MAKE(TC_H_MAJ(sch->handle),
+					 TC_H_MIN(i + 1));
+
+		dev_queue = netdev_get_tx_queue(dev, i);
+		tc = mqprio_queue_tc(dev, i);
+
+		if (tc >= 0 && priv->max_rate[tc] && !priv->hw_rate) {
+			qdisc = qdisc_create_dflt(dev, dev_queue,
+						  &mqprio_shaper_qdisc_ops,
+						  parentid);
+			if (qdisc == NULL) {
+				err = -ENOMEM;
+				goto err;
+			}
+			mqprio_shaper_set_rate(qdisc, div_u64(priv->max_rate[tc],
+					       dev->tc_to_txq[tc].count));
+		} else {
+			qdisc = qdisc_create_dflt(dev, dev_queue,
+						  &pfifo_fast_ops, parentid);
+			if (qdisc == NULL) {
+				err = -ENOMEM;
+				goto err;
+			}
+			qdisc->flags |= TCQ_F_CAN_BYPASS;
+		}
+		priv->qdiscs[i] = qdisc;
+	}
+
+	sch->flags |= TCQ_F_MQROOT;
+	return 0;
+
+err:
+	mqprio_destroy(sch);
+	return err;
+}
+
+static void mqprio_attach(struct Qdisc *sch)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqprio_sched *priv = qdisc_priv(sch);
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+
+	/* Attach underlying qdisc */
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = priv->qdiscs[ntx];
+		qdisc = dev_graft_qdisc(qdisc->dev_queue, qdisc);
+		if (qdisc)
+			qdisc_destroy(qdisc);
+	}
+	kfree(priv->qdiscs);
+	priv->qdiscs = NULL;
+}
+
+static int mqprio_dump_rates(struct net_device *dev,
+			     struct mqprio_sched *priv, struct sk_buff *skb)
+{
+	struct nlattr *nest;
+	int tc;
+
+	for (tc = 0; tc < netdev_get_num_tc(dev); tc++)
+		if (priv->max_rate[tc])
+			break;
+	if (tc == netdev_get_num_tc(dev))
+		return 0;
+
+	nest = nla_nest_start(skb, TCA_MQPRIO_MAX_RATE64);
+	if (nest == NULL)
+		goto nla_put_failure;
+	for (tc = 0; tc < netdev_get_num_tc(dev); tc++)
+		NLA_PUT_U64(skb, TCA_MQPRIO_MAX_RATE64, priv->max_rate[tc]);
+	nla_nest_end(skb, nest);
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static int mqprio_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqprio_sched *priv = qdisc_priv(sch);
+	unsigned char *b = skb_tail_pointer(skb);
+	struct nlattr *nla = (struct nlattr *)b;
+	struct tc_mqprio_qopt opt;
+	struct Qdisc *qdisc;
+	unsigned int i;
+
+	sch->q.qlen = 0;
+	memset(&sch->bstats, 0, sizeof(sch->bstats));
+	memset(&sch->qstats, 0, sizeof(sch->qstats));
+
+	for (i = 0; i < dev->num_tx_queues; i++) {
+		qdisc = netdev_get_tx_queue(dev, i)->qdisc_sleeping;
+		spin_lock_bh(qdisc_lock(qdisc));
+		sch->q.qlen		+= qdisc->q.qlen;
+		sch->bstats.bytes	+= qdisc->bstats.bytes;
+		sch->bstats.packets	+= qdisc->bstats.packets;
+		sch->qstats.qlen	+= qdisc->qstats.qlen;
+		sch->qstats.backlog	+= qdisc->qstats.backlog;
+		sch->qstats.drops	+= qdisc->qstats.drops;
+		sch->qstats.requeues	+= qdisc->qstats.requeues;
+		sch->qstats.overlimits	+= qdisc->qstats.overlimits;
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+
+	memset(&opt, 0, sizeof(opt));
+	opt.num_tc = netdev_get_num_tc(dev);
+	memcpy(opt.prio_tc_map, dev->prio_tc_map, sizeof(opt.prio_tc_map));
+	opt.hw = priv->hw_owned;
+
+	for (i = 0; i < netdev_get_num_tc(dev); i++) {
+		opt.count[i] = dev->tc_to_txq[i].count;
+		opt.offset[i] = dev->tc_to_txq[i].offset;
+	}
+
+	/* the rates follow the option struct inside TCA_OPTIONS */
+	NLA_PUT(skb, TCA_OPTIONS, sizeof(opt), &opt);
+	if (mqprio_dump_rates(dev, priv, skb) < 0)
+		goto nla_put_failure;
+	nla->nla_len = skb_tail_pointer(skb) - b;
+
+	return skb->len;
+
+nla_put_failure:
+	nlmsg_trim(skb, b);
+	return -1;
+}
+
+static struct netdev_queue *mqprio_queue_get(struct Qdisc *sch,
+					     unsigned long cl)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned long ntx = cl - 1;
+
+	if (ntx >= dev->num_tx_queues)
+		return NULL;
+	return netdev_get_tx_queue(dev, ntx);
+}
+
+static struct netdev_queue *mqprio_select_queue(struct Qdisc *sch,
+						struct tcmsg *tcm)
+{
+	unsigned int ntx = TC_H_MIN(tcm->tcm_parent);
+	struct netdev_queue *dev_queue = mqprio_queue_get(sch, ntx);
+
+	if (!dev_queue) {
+		struct net_device *dev = qdisc_dev(sch);
+
+		return netdev_get_tx_queue(dev, 0);
+	}
+	return dev_queue;
+}
+
+static int mqprio_graft(struct Qdisc *sch, unsigned long cl, struct Qdisc *new,
+			struct Qdisc **old)
+{
+	struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
+	struct net_device *dev = qdisc_dev(sch);
+
+	if (dev_queue == NULL)
+		return -EINVAL;
+
+	if (dev->flags & IFF_UP)
+		dev_deactivate(dev);
+
+	*old = dev_graft_qdisc(dev_queue, new);
+
+	if (dev->flags & IFF_UP)
+		dev_activate(dev);
+	return 0;
+}
+
+static struct Qdisc *mqprio_leaf(struct Qdisc *sch, unsigned long cl)
+{
+	struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
+
+	if (dev_queue == NULL)
+		return NULL;
+	return dev_queue->qdisc_sleeping;
+}
+
+static unsigned long mqprio_get(struct Qdisc *sch, u32 classid)
+{
+	unsigned int ntx = TC_H_MIN(classid);
+
+	if (!mqprio_queue_get(sch, ntx))
+		return 0;
+	return ntx;
+}
+
+static void mqprio_put(struct Qdisc *sch, unsigned long cl)
+{
+}
+
+static int mqprio_dump_class(struct Qdisc *sch, unsigned long cl,
+			     struct sk_buff *skb, struct tcmsg *tcm)
+{
+	struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
+
+	tcm->tcm_parent = TC_H_ROOT;
+	tcm->tcm_handle |= TC_H_MIN(cl);
+	tcm->tcm_info = dev_queue->qdisc_sleeping->handle;
+	return 0;
+}
+
+static int mqprio_dump_class_stats(struct Qdisc *sch, unsigned long cl,
+				   struct gnet_dump *d)
+{
+	struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
+
+	sch = dev_queue->qdisc_sleeping;
+	sch->qstats.qlen = sch->q.qlen;
+	if (gnet_stats_copy_basic(d, &sch->bstats) < 0 ||
+	    gnet_stats_copy_queue(d, &sch->qstats) < 0)
+		return -1;
+	return 0;
+}
+
+static void mqprio_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	unsigned int ntx;
+
+	if (arg->stop)
+		return;
+
+	arg->count = arg->skip;
+	for (ntx = arg->skip; ntx < dev->num_tx_queues; ntx++) {
+		if (arg->fn(sch, ntx + 1, arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+		arg->count++;
+	}
+}
+
+static const struct Qdisc_class_ops mqprio_class_ops = {
+	.select_queue	= mqprio_select_queue,
+	.graft		= mqprio_graft,
+	.leaf		= mqprio_leaf,
+	.get		= mqprio_get,
+	.put		= mqprio_put,
+	.walk		= mqprio_walk,
+	.dump		= mqprio_dump_class,
+	.dump_stats	= mqprio_dump_class_stats,
+};
+
+static struct Qdisc_ops mqprio_qdisc_ops __read_mostly = {
+	.cl_ops		= &mqprio_class_ops,
+	.id		= "mqprio",
+	.priv_size	= sizeof(struct mqprio_sched),
+	.init		= mqprio_init,
+	.destroy	= mqprio_destroy,
+	.attach		= mqprio_attach,
+	.dump		= mqprio_dump,
+	.owner		= THIS_MODULE,
+};
+
+static int __init mqprio_module_init(void)
+{
+	return register_qdisc(&mqprio_qdisc_ops);
+}
+
+static void __exit mqprio_module_exit(void)
+{
+	unregister_qdisc(&mqprio_qdisc_ops);
+}
+
+module_init(mqprio_module_init);
+module_exit(mqprio_module_exit);
+
+MODULE_LICENSE("GPL");
@@ -114,12 +114,20 @@
 #include <linux/mount.h>
 #include <net/checksum.h>
 #include <linux/security.h>
+#include <linux/hash.h>
 
-static struct hlist_head unix_socket_table[UNIX_HASH_SIZE + 1];
-static DEFINE_SPINLOCK(unix_table_lock);
-static atomic_t unix_nr_socks = ATOMIC_INIT(0);
+/*
+ * Bound sockets hash into the first UNIX_HASH_SIZE chains: abstract names
+ * by name hash ^ type, filesystem names by inode number.  Unbound sockets
+ * are spread over the second half by address, so that socket creation
+ * and release do not all contend on one chain.  Every chain has its own
+ * lock and sk->sk_hash records the chain a socket is on.
+ */
+#define UNIX_HASH_TABLE_SIZE	(2 * UNIX_HASH_SIZE)
 
-#define unix_sockets_unbound	(&unix_socket_table[UNIX_HASH_SIZE])
+static struct hlist_head unix_socket_table[UNIX_HASH_TABLE_SIZE];
+static spinlock_t unix_table_locks[UNIX_HASH_TABLE_SIZE];
+static atomic_t unix_nr_socks = ATOMIC_INIT(0);
 
 #define UNIX_ABSTRACT(sk)	(unix_sk(sk)->addr->hash != UNIX_HASH_SIZE)
 
@@ -143,7 +151,8 @@ static inline void unix_set_secdata(struct scm_cookie *scm, struct sk_buff *skb)
 
 /*
  *  SMP locking strategy:
- *    hash table is protected with spinlock unix_table_lock
+ *    each hash chain is protected by its own spinlock in unix_table_locks;
+ *    a bind takes the old (unbound) and the new chain lock, lower first.
  *    each socket state is protected by separate spin lock.
  */
 
@@ -220,29 +229,63 @@ static int unix_mkname(struct sockaddr_un *sunaddr, int len, unsigned *hashp)
 	return len;
 }
 
+static inline unsigned int unix_unbound_hash(struct sock *sk)
+{
+	return UNIX_HASH_SIZE + hash_ptr(sk, UNIX_HASH_BITS);
+}
+
+static void unix_table_double_lock(unsigned int hash1, unsigned int hash2)
+{
+	if (hash1 > hash2)
+		swap(hash1, hash2);
+
+	spin_lock(&unix_table_locks[hash1]);
+	spin_lock_nested(&unix_table_locks[hash2], SINGLE_DEPTH_NESTING);
+}
+
+static void unix_table_double_unlock(unsigned int hash1, unsigned int hash2)
+{
+	spin_unlock(&unix_table_locks[hash1]);
+	spin_unlock(&unix_table_locks[hash2]);
+}
+
 static void __unix_remove_socket(struct sock *sk)
 {
 	sk_del_node_init(sk);
 }
 
-static void __unix_insert_socket(struct hlist_head *list, struct sock *sk)
+static void __unix_insert_socket(unsigned int hash, struct sock *sk)
 {
 	WARN_ON(!sk_unhashed(sk));
-	sk_add_node(sk, list);
+	sk->sk_hash = hash;
+	sk_add_node(sk, &unix_socket_table[hash]);
 }
 
 static inline void unix_remove_socket(struct sock *sk)
 {
-	spin_lock(&unix_table_lock);
+	spinlock_t *lock = &unix_table_locks[sk->sk_hash];
+
+	spin_lock(lock);
 	__unix_remove_socket(sk);
-	spin_unlock(&unix_table_lock);
+	spin_unlock(lock);
 }
 
-static inline void unix_insert_socket(struct hlist_head *list, struct sock *sk)
+static inline void unix_insert_unbound_socket(struct sock *sk)
 {
-	spin_lock(&unix_table_lock);
-	__unix_insert_socket(list, sk);
-	spin_unlock(&unix_table_lock);
+	unsigned int hash = unix_unbound_hash(sk);
+
+	spin_lock(&unix_table_locks[hash]);
+	__unix_insert_socket(hash, sk);
+	spin_unlock(&unix_table_locks[hash]);
+}
+
+/* Move a socket from its unbound chain to @hash; both chains are locked. */
+static void __unix_set_addr(struct sock *sk, struct unix_address *addr,
+			    unsigned int hash)
+{
+	__unix_remove_socket(sk);
+	unix_sk(sk)->addr = addr;
+	__unix_insert_socket(hash, sk);
 }
 
 static struct sock *__unix_find_socket_byname(struct net *net,
@@ -274,22 +317,22 @@ static inline struct sock *unix_find_socket_byname(struct net *net,
 {
 	struct sock *s;
 
-	spin_lock(&unix_table_lock);
+	spin_lock(&unix_table_locks[hash ^ type]);
 	s = __unix_find_socket_byname(net, sunname, len, type, hash);
 	if (s)
 		sock_hold(s);
-	spin_unlock(&unix_table_lock);
+	spin_unlock(&unix_table_locks[hash ^ type]);
 	return s;
 }
 
 static struct sock *unix_find_socket_byinode(struct net *net, struct inode *i)
 {
+	unsigned int hash = i->i_ino & (UNIX_HASH_SIZE - 1);
 	struct sock *s;
 	struct hlist_node *node;
 
-	spin_lock(&unix_table_lock);
-	sk_for_each(s, node,
-		    &unix_socket_table[i->i_ino & (UNIX_HASH_SIZE - 1)]) {
+	spin_lock(&unix_table_locks[hash]);
+	sk_for_each(s, node, &unix_socket_table[hash]) {
 		struct dentry *dentry = unix_sk(s)->dentry;
 
 		if (!net_eq(sock_net(s), net))
@@ -302,7 +345,7 @@ static struct sock *unix_find_socket_byinode(struct net *net, struct inode *i)
 	}
 	s = NULL;
 found:
-	spin_unlock(&unix_table_lock);
+	spin_unlock(&unix_table_locks[hash]);
 	return s;
 }
 
@@ -610,7 +653,7 @@ static struct sock *unix_create1(struct net *net, struct socket *sock)
 	INIT_LIST_HEAD(&u->link);
 	mutex_init(&u->readlock); /* single task reading lock */
 	init_waitqueue_head(&u->peer_wait);
-	unix_insert_socket(unix_sockets_unbound, sk);
+	unix_insert_unbound_socket(sk);
 out:
 	if (sk == NULL)
 		atomic_dec(&unix_nr_socks);
@@ -672,6 +715,8 @@ static int unix_autobind(struct socket *sock)
 	struct unix_sock *u = unix_sk(sk);
 	static u32 ordernum = 1;
 	struct unix_address *addr;
+	unsigned int old_hash = sk->sk_hash;
+	unsigned int new_hash;
 	int err;
 	unsigned int retries = 0;
 
@@ -692,13 +737,14 @@ static int unix_autobind(struct socket *sock)
 retry:
 	addr->len = sprintf(addr->name->sun_path+1, "%05x", ordernum) + 1 + sizeof(short);
 	addr->hash = unix_hash_fold(csum_partial(addr->name, addr->len, 0));
+	new_hash = addr->hash ^ sk->sk_type;
 
-	spin_lock(&unix_table_lock);
+	unix_table_double_lock(old_hash, new_hash);
 	ordernum = (ordernum+1)&0xFFFFF;
 
 	if (__unix_find_socket_byname(net, addr->name, addr->len, sock->type,
 				      addr->hash)) {
-		spin_unlock(&unix_table_lock);
+		unix_table_double_unlock(old_hash, new_hash);
 		/*
 		 * __unix_find_socket_byname() may take long time if many names
 		 * are already in use.
@@ -712,12 +758,10 @@ retry:
 		}
 		goto retry;
 	}
-	addr->hash ^= sk->sk_type;
+	addr->hash = new_hash;
 
-	__unix_remove_socket(sk);
-	u->addr = addr;
-	__unix_insert_socket(&unix_socket_table[addr->hash], sk);
-	spin_unlock(&unix_table_lock);
+	__unix_set_addr(sk, addr, new_hash);
+	unix_table_double_unlock(old_hash, new_hash);
 	err = 0;
 
 out:	mutex_unlock(&u->readlock);
@@ -790,8 +834,9 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	struct nameidata nd;
 	int err;
 	unsigned hash;
+	unsigned int old_hash = sk->sk_hash;
+	unsigned int new_hash;
 	struct unix_address *addr;
-	struct hlist_head *list;
 
 	err = -EINVAL;
 	if (sunaddr->sun_family != AF_UNIX)
@@ -862,7 +907,12 @@ out_mknod_drop_write:
 		addr->hash = UNIX_HASH_SIZE;
 	}
 
-	spin_lock(&unix_table_lock);
+	if (!sunaddr->sun_path[0])
+		new_hash = addr->hash;
+	else
+		new_hash = dentry->d_inode->i_ino & (UNIX_HASH_SIZE-1);
+
+	unix_table_double_lock(old_hash, new_hash);
 
 	if (!sunaddr->sun_path[0]) {
 		err = -EADDRINUSE;
@@ -871,21 +921,16 @@ out_mknod_drop_write:
 			unix_release_addr(addr);
 			goto out_unlock;
 		}
-
-		list = &unix_socket_table[addr->hash];
 	} else {
-		list = &unix_socket_table[dentry->d_inode->i_ino & (UNIX_HASH_SIZE-1)];
 		u->dentry = nd.path.dentry;
 		u->mnt    = nd.path.mnt;
 	}
 
 	err = 0;
-	__unix_remove_socket(sk);
-	u->addr = addr;
-	__unix_insert_socket(list, sk);
+	__unix_set_addr(sk, addr, new_hash);
 
 out_unlock:
-	spin_unlock(&unix_table_lock);
+	unix_table_double_unlock(old_hash, new_hash);
 out_up:
 	mutex_unlock(&u->readlock);
 out:
@@ -1399,11 +1444,12 @@ static int unix_dgram_sendmsg(struct kiocb *kiocb, struct socket *sock,
 
 	if (NULL == siocb->scm)
 		siocb->scm = &tmp_scm;
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, siocb->scm);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(siocb->scm->fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out;
@@ -1552,11 +1598,12 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 
 	if (NULL == siocb->scm)
 		siocb->scm = &tmp_scm;
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, siocb->scm);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(siocb->scm->fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out_err;
@@ -2122,76 +2169,65 @@ static unsigned int unix_dgram_poll(struct file *file, struct socket *sock,
 }
 
 #ifdef CONFIG_PROC_FS
-static struct sock *first_unix_socket(int *i)
-{
-	for (*i = 0; *i <= UNIX_HASH_SIZE; (*i)++) {
-		if (!hlist_empty(&unix_socket_table[*i]))
-			return __sk_head(&unix_socket_table[*i]);
-	}
-	return NULL;
-}
-
-static struct sock *next_unix_socket(int *i, struct sock *s)
-{
-	struct sock *next = sk_next(s);
-	/* More in this chain? */
-	if (next)
-		return next;
-	/* Look for next non-empty chain. */
-	for ((*i)++; *i <= UNIX_HASH_SIZE; (*i)++) {
-		if (!hlist_empty(&unix_socket_table[*i]))
-			return __sk_head(&unix_socket_table[*i]);
-	}
-	return NULL;
-}
-
 struct unix_iter_state {
 	struct seq_net_private p;
-	int i;
+	int i;		/* chain being walked, its lock is held */
 };
 
-static struct sock *unix_seq_idx(struct seq_file *seq, loff_t pos)
+/*
+ * Return @s or the first socket of our namespace after it, moving on to
+ * the following chains (and their locks) once this one is exhausted.
+ */
+static struct sock *unix_seq_advance(struct seq_file *seq, struct sock *s)
 {
 	struct unix_iter_state *iter = seq->private;
-	loff_t off = 0;
-	struct sock *s;
 
-	for (s = first_unix_socket(&iter->i); s; s = next_unix_socket(&iter->i, s)) {
-		if (sock_net(s) != seq_file_net(seq))
-			continue;
-		if (off == pos)
-			return s;
-		++off;
+	for (;;) {
+		for (; s; s = sk_next(s))
+			if (net_eq(sock_net(s), seq_file_net(seq)))
+				return s;
+
+		spin_unlock(&unix_table_locks[iter->i]);
+		if (++iter->i == UNIX_HASH_TABLE_SIZE)
+			return NULL;
+		spin_lock(&unix_table_locks[iter->i]);
+		s = sk_head(&unix_socket_table[iter->i]);
 	}
-	return NULL;
 }
 
 static void *unix_seq_start(struct seq_file *seq, loff_t *pos)
-	__acquires(unix_table_lock)
 {
-	spin_lock(&unix_table_lock);
-	return *pos ? unix_seq_idx(seq, *pos - 1) : SEQ_START_TOKEN;
+	struct unix_iter_state *iter = seq->private;
+	loff_t off;
+	struct sock *s;
+
+	iter->i = 0;
+	spin_lock(&unix_table_locks[0]);
+	if (!*pos)
+		return SEQ_START_TOKEN;
+
+	s = unix_seq_advance(seq, sk_head(&unix_socket_table[0]));
+	for (off = 1; s && off < *pos; off++)
+		s = unix_seq_advance(seq, sk_next(s));
+	return s;
 }
 
 static void *unix_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
 	struct unix_iter_state *iter = seq->private;
-	struct sock *sk = v;
 	++*pos;
 
 	if (v == SEQ_START_TOKEN)
-		sk = first_unix_socket(&iter->i);
-	else
-		sk = next_unix_socket(&iter->i, sk);
-	while (sk && (sock_net(sk) != seq_file_net(seq)))
-		sk = next_unix_socket(&iter->i, sk);
-	return sk;
+		return unix_seq_advance(seq, sk_head(&unix_socket_table[iter->i]));
+	return unix_seq_advance(seq, sk_next((struct sock *)v));
 }
 
 static void unix_seq_stop(struct seq_file *seq, void *v)
-	__releases(unix_table_lock)
 {
-	spin_unlock(&unix_table_lock);
+	struct unix_iter_state *iter = seq->private;
+
+	if (iter->i < UNIX_HASH_TABLE_SIZE)
+		spin_unlock(&unix_table_locks[iter->i]);
 }
 
 static int unix_seq_show(struct seq_file *seq, void *v)
@@ -2301,10 +2337,14 @@ static struct pernet_operations unix_net_ops = {
 static int __init af_unix_init(void)
 {
 	int rc = -1;
+	int i;
 	struct sk_buff *dummy_skb;
 
 	BUILD_BUG_ON(sizeof(struct unix_skb_parms) > sizeof(dummy_skb->cb));
 
+	for (i = 0; i < UNIX_HASH_TABLE_SIZE; i++)
+		spin_lock_init(&unix_table_locks[i]);
+
 	rc = proto_register(&unix_proto, 1);
 	if (rc != 0) {
 		printk(KERN_CRIT "%s: Cannot create unix_sock SLAB cache!\n",
@@ -2320,6 +2360,8 @@ out:
 
 static void __exit af_unix_exit(void)
 {
+	/* A collection may still be queued from the last sockets' release */
+	flush_work(&unix_gc_work);
 	sock_unregister(PF_UNIX);
 	proto_unregister(&unix_proto);
 	unregister_pernet_subsys(&unix_net_ops);
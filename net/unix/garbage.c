@@ -66,6 +66,11 @@
  *		Reimplement with a cycle collecting algorithm. This should
  *		solve several problems with the previous code, like being racy
  *		wrt receive and holding up unrelated socket operations.
+ *
+ *		Collection now runs from a work item instead of inside
+ *		close(), only senders of descriptors are throttled on it,
+ *		and candidates with empty receive queues, which cannot be
+ *		part of a cycle, are left out of the scan.
  */
 
 #include <linux/kernel.h>
@@ -79,7 +84,7 @@
 #include <linux/file.h>
 #include <linux/proc_fs.h>
 #include <linux/mutex.h>
-#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <net/sock.h>
 #include <net/af_unix.h>
@@ -91,7 +96,6 @@
 static LIST_HEAD(gc_inflight_list);
 static LIST_HEAD(gc_candidates);
 static DEFINE_SPINLOCK(unix_gc_lock);
-static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
 
 unsigned int unix_tot_inflight;
 
@@ -261,19 +265,31 @@ static void inc_inflight_move_tail(struct unix_sock *u)
 static bool gc_in_progress = false;
 #define UNIX_INFLIGHT_TRIGGER_GC 16000
 
-void wait_for_unix_gc(void)
+static void unix_gc_work_fn(struct work_struct *work);
+DECLARE_WORK(unix_gc_work, unix_gc_work_fn);
+
+/*
+ * Called by senders once their control message is parsed.  Only those
+ * passing descriptors can grow the in-flight set, so only they wait for
+ * the collector, and only when the in-flight count is insane.
+ */
+void wait_for_unix_gc(struct scm_fp_list *fpl)
 {
-	/*
-	 * If number of inflight sockets is insane,
-	 * force a garbage collect right now.
-	 */
-	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC && !gc_in_progress)
-		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+	if (unix_tot_inflight <= UNIX_INFLIGHT_TRIGGER_GC)
+		return;
+
+	unix_gc();
+	if (fpl)
+		flush_work(&unix_gc_work);
 }
 
-/* The external entry point: unix_gc() */
+/* The external entry point: unix_gc() queues a collection. */
 void unix_gc(void)
+{
+	schedule_work(&unix_gc_work);
+}
+
+static void unix_gc_work_fn(struct work_struct *work)
 {
 	struct unix_sock *u;
 	struct unix_sock *next;
@@ -313,6 +329,15 @@ void unix_gc(void)
 
 		BUG_ON(inflight_refs < 1);
 		BUG_ON(total_refs < inflight_refs);
+
+		/*
+		 * Nothing queued means no in-flight children, so the
+		 * socket cannot close a cycle.  If it is garbage it goes
+		 * away once the cycle holding it is broken.
+		 */
+		if (skb_queue_empty(&u->sk.sk_receive_queue))
+			continue;
+
 		if (total_refs == inflight_refs) {
 			list_move_tail(&u->link, &gc_candidates);
 			u->gc_candidate = 1;
@@ -379,7 +404,6 @@ void unix_gc(void)
 	/* All candidates should have been detached by now. */
 	BUG_ON(!list_empty(&gc_candidates));
 	gc_in_progress = false;
-	wake_up(&unix_gc_wait);
 
  out:
 	spin_unlock(&unix_gc_lock);